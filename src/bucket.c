@@ -0,0 +1,97 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include "bucket.h"
+
+static void bucket_refill( bucket_t* bucket, uint64_t now );
+
+/**
+ * Change the rate and the burst of the given bucket
+ *
+ * The bucket starts out full after the change. A rate of 0 disables it.
+ */
+void bucket_set_rate( bucket_t* bucket, unsigned long rate, unsigned long burst ) 
+{
+    pthread_mutex_lock( &bucket->lock );
+    bucket->rate   = rate;
+    bucket->burst  = burst;
+    bucket->tokens = burst;
+    bucket->last   = 0;
+    pthread_mutex_unlock( &bucket->lock );
+}
+
+/**
+ * Current rate of the given bucket in bytes per second
+ */
+unsigned long bucket_rate( bucket_t* bucket ) 
+{
+    unsigned long rate = 0;
+
+    pthread_mutex_lock( &bucket->lock );
+    rate = (unsigned long)bucket->rate;
+    pthread_mutex_unlock( &bucket->lock );
+
+    return rate;
+}
+
+/**
+ * Add the tokens accumulated since the last refill
+ */
+static void bucket_refill( bucket_t* bucket, uint64_t now ) 
+{
+    if ( bucket->last != 0 && now > bucket->last ) 
+    {
+        bucket->tokens += ( now - bucket->last ) * bucket->rate / 1000000;
+        bucket->tokens  = ( bucket->tokens > bucket->burst ) ? bucket->burst : bucket->tokens;
+    }
+    bucket->last = ( now > bucket->last ) ? now : bucket->last;
+}
+
+/**
+ * Try to pass a chunk of the given number of bytes
+ *
+ * 0 is returned if the chunk may pass, in which case its tokens have been
+ * taken. Otherwise nothing is taken and the number of microseconds until
+ * the debt of the bucket has been paid back is returned.
+ */
+uint64_t bucket_take( bucket_t* bucket, size_t bytes, uint64_t now ) 
+{
+    uint64_t wait = 0;
+
+    pthread_mutex_lock( &bucket->lock );
+    if ( bucket->rate > 0 ) 
+    {
+        bucket_refill( bucket, now );
+
+        if ( bucket->tokens > 0 ) 
+        {
+            bucket->tokens -= bytes;
+        }
+        else 
+        {
+            wait = (uint64_t)( -bucket->tokens * 1000000 / bucket->rate ) + 1;
+        }
+    }
+    pthread_mutex_unlock( &bucket->lock );
+
+    return wait;
+}
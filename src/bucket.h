@@ -0,0 +1,57 @@
+#ifndef BUCKET_H
+#define BUCKET_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+ * Token bucket limiting the rate of a byte stream
+ *
+ * Tokens are added at rate bytes per second up to burst bytes. A chunk of
+ * data may be passed as long as there are any tokens left. Its whole size is
+ * taken, so the bucket may run into debt, which needs to be paid back before
+ * the next chunk passes. This allows chunks larger than the burst without
+ * ever exceeding the rate in the long run.
+ *
+ * A rate of 0 disables the limit. Buckets are thread safe and may be defined
+ * statically using BUCKET_INITIALIZER, which creates a disabled one. All
+ * times are given in microseconds of the monotonic clock.
+ */
+typedef struct 
+{
+    double rate;
+    double burst;
+    double tokens;
+    uint64_t last;
+    pthread_mutex_t lock;
+} bucket_t;
+
+#define BUCKET_INITIALIZER { 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER }
+
+void bucket_set_rate( bucket_t* bucket, unsigned long rate, unsigned long burst );
+unsigned long bucket_rate( bucket_t* bucket );
+uint64_t bucket_take( bucket_t* bucket, size_t bytes, uint64_t now );
+
+#endif
@@ -23,27 +23,56 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 #include <glib.h>
 
 #include "salloc.h"
 #include "cache.h"
+#include "metrics.h"
 
 static void cache_key_free( gpointer key ); 
 static void cache_object_data_free( gpointer key, gpointer obj, gpointer user_data );
-static void cache_value_free( gpointer value );
+static long cache_initial_ttl( cache_t* cache, const char* identifier, int* fixed );
+static int cache_admit( cache_t* cache, const char* key );
+static gboolean cache_object_expired( gpointer key, gpointer value, gpointer user_data );
 
 /**
  * Structure to store one cached object including all the needed meta
  * information.
+ *
+ * Refcount counts the number of callers currently holding the object data
+ * retrieved by cache_get_object. Detached is set if the object has been
+ * removed from the cache while still being referenced. It is freed as soon
+ * as the last reference is released.
+ *
+ * Link is the position of the object in the recency queue of the cache.
  */
 typedef struct
 {
     char* prefix;
     char* identifier;
     time_t timestamp;
+    long ttl;
+    int refcount;
+    int detached;
     void* ptr;
+    GList link;
 } cache_object_t;
 
+/**
+ * State passed to the callbacks of a sweep
+ */
+typedef struct 
+{
+    cache_t* cache;
+    time_t now;
+    int stale;
+} cache_sweep_t;
+
+static void cache_object_discard( cache_t* cache, cache_object_t* obj );
+static void cache_sweep( cache_t* cache, time_t now );
+static void* cache_lookup( cache_t* cache, const char* prefix, const char* identifier, int counted );
+
 /**
  * Create a new cache structure and return it
  *
@@ -54,19 +83,185 @@ typedef struct
  * A function may be supplied which is called every time a cached objects needs
  * to be freed. If NULL is supplied here no free function will be called for
  * cached objects on destruction.
+ *
+ * All cache functions may be called concurrently from different threads.
  */
 cache_t* cache_new( long ttl, cache_object_free_func object_free_func ) 
 {
     cache_t* cache = snew( cache_t );
 
-    cache->ttl              = ttl;
-    cache->object_free_func = object_free_func;
+    cache->ttl               = ttl;
+    cache->min_ttl           = ttl;
+    cache->max_ttl           = ttl;
+    cache->object_free_func  = object_free_func;
+    cache->object_equal_func = NULL;
+    cache->clock             = time;
+    cache->next_sweep        = 0;
     cache->hashtable = g_hash_table_new_full( 
         g_str_hash,
         g_str_equal,
         cache_key_free,
-        cache_value_free
+        NULL
+    );    
+    cache->stale = g_hash_table_new_full( 
+        g_str_hash,
+        g_str_equal,
+        cache_key_free,
+        NULL
     );    
+    cache->ttl_overrides = g_hash_table_new_full( 
+        g_str_hash,
+        g_str_equal,
+        cache_key_free,
+        cache_key_free
+    );    
+    cache->references = g_hash_table_new( g_direct_hash, g_direct_equal );
+    g_queue_init( &cache->recency );
+    pthread_mutex_init( &cache->lock, NULL );
+
+    return cache;
+}
+
+/**
+ * Enable adaptive time to live handling for the given cache
+ *
+ * Every cached object starts out with the ttl supplied during cache creation.
+ * Each time an object is replaced by a new version the supplied equal function
+ * is used to decide whether the data has changed in the meantime. An unchanged
+ * object gets its ttl doubled, a changed one gets it halved. The result is
+ * always clamped to the given min_ttl and max_ttl boundaries.
+ *
+ * An expired object is moved aside once it is looked up, as its replacement
+ * usually follows right away. Expired objects not replaced within
+ * CACHE_SWEEP_INTERVAL seconds are freed.
+ */
+void cache_set_adaptive_ttl( cache_t* cache, long min_ttl, long max_ttl, cache_object_equal_func object_equal_func ) 
+{
+    cache->min_ttl           = min_ttl;
+    cache->max_ttl           = ( max_ttl < min_ttl ) ? min_ttl : max_ttl;
+    cache->object_equal_func = object_equal_func;
+
+    // The initial ttl needs to lie within the given boundaries as well
+    cache->ttl = ( cache->ttl < cache->min_ttl ) ? cache->min_ttl : cache->ttl;
+    cache->ttl = ( cache->ttl > cache->max_ttl ) ? cache->max_ttl : cache->ttl;
+}
+
+/**
+ * Set a fixed time to live for all objects inside a given container
+ *
+ * Identifiers are expected to be request paths. Every identifier whose first
+ * path segment equals the given container name will use the provided ttl in
+ * seconds. Adaptive ttl handling is disabled for these objects.
+ */
+void cache_set_ttl_override( cache_t* cache, const char* container, long ttl ) 
+{
+    long* value = snew( long );
+    *value = ttl;
+
+    pthread_mutex_lock( &cache->lock );
+    g_hash_table_replace( cache->ttl_overrides, strdup( container ), value );
+    pthread_mutex_unlock( &cache->lock );
+}
+
+/**
+ * Replace the clock the lifespan of cached objects is measured with
+ *
+ * The clock has the signature of time(), which is used by default. Offline
+ * tools like the cache simulator supply the time of the replayed operations
+ * instead.
+ */
+void cache_set_clock( cache_t* cache, cache_clock_func clock ) 
+{
+    cache->clock = clock;
+}
+
+/**
+ * Limit the number of objects kept in the cache
+ *
+ * Once the limit is reached a new object is only admitted, if it has been
+ * looked up more often recently than the least recently used object, which
+ * it replaces then. Otherwise it is freed right away. Objects requested only
+ * once, like those of a scan over all files, therefore do not displace the
+ * working set. The access frequencies are estimated using a sketch.
+ *
+ * A limit of 0 disables the limit, which is the default.
+ */
+void cache_set_limit( cache_t* cache, unsigned long max_objects ) 
+{
+    pthread_mutex_lock( &cache->lock );
+
+    ( cache->sketch != NULL ) ? sketch_free( cache->sketch ) : NULL;
+    cache->max_objects = max_objects;
+    cache->sketch      = ( max_objects > 0 ) ? sketch_new( max_objects ) : NULL;
+
+    pthread_mutex_unlock( &cache->lock );
+}
+
+/**
+ * Decide whether a new object with the given key may replace the least
+ * recently used one
+ *
+ * If it may, the least recently used object is removed.
+ *
+ * The cache lock needs to be held while calling this function.
+ */
+static int cache_admit( cache_t* cache, const char* key ) 
+{
+    cache_object_t* victim = (cache_object_t*)cache->recency.tail->data;
+    char* victim_key = NULL;
+
+    asprintf( &victim_key, "%s/%s", victim->prefix, victim->identifier );
+
+    if ( sketch_estimate( cache->sketch, g_str_hash( key ) ) <= sketch_estimate( cache->sketch, g_str_hash( victim_key ) ) ) 
+    {
+        free( victim_key );
+        return 0;
+    }
+
+    g_hash_table_remove( cache->hashtable, victim_key );
+    g_queue_unlink( &cache->recency, &victim->link );
+    cache_object_discard( cache, victim );
+    free( victim_key );
+    return 1;
+}
+
+/**
+ * Determine the ttl a newly cached object with the given identifier starts
+ * with.
+ *
+ * Fixed is set to TRUE if a container specific override is in effect, which
+ * means the ttl may not be adapted later on.
+ *
+ * The cache lock needs to be held while calling this function.
+ */
+static long cache_initial_ttl( cache_t* cache, const char* identifier, int* fixed ) 
+{
+    const char* start = ( *identifier == '/' ) ? ( identifier + 1 ) : identifier;
+    const char* end   = start;
+    long* override    = NULL;
+    char* container   = NULL;
+
+    *fixed = 0;
+
+    if ( g_hash_table_size( cache->ttl_overrides ) == 0 ) 
+    {
+        return cache->ttl;
+    }
+
+    // Isolate the first path segment, which is the container name
+    while( *end != '/' && *end != 0 ) { ++end; }
+    container = (char*)smalloc( end - start + 1 );
+    memcpy( container, start, end - start );
+
+    if ( ( override = g_hash_table_lookup( cache->ttl_overrides, container ) ) != NULL ) 
+    {
+        *fixed = 1;
+        free( container );
+        return *override;
+    }
+
+    free( container );
+    return cache->ttl;
 }
 
 /**
@@ -77,14 +272,19 @@ cache_t* cache_new( long ttl, cache_object_free_func object_free_func )
  *
  * If a object_free_func has been supplied during creation it will be called
  * for each of the cached objects.
+ *
+ * No references to cached objects may be held any longer at this point.
  */
 void cache_free( cache_t* cache ) 
 {
-    if ( cache->object_free_func != NULL ) 
-    {
-        g_hash_table_foreach( cache->hashtable, cache_object_data_free, (gpointer)cache->object_free_func );
-    }
+    g_hash_table_foreach( cache->hashtable, cache_object_data_free, (gpointer)cache->object_free_func );
+    g_hash_table_foreach( cache->stale, cache_object_data_free, (gpointer)cache->object_free_func );
     g_hash_table_destroy( cache->hashtable );
+    g_hash_table_destroy( cache->stale );
+    g_hash_table_destroy( cache->ttl_overrides );
+    g_hash_table_destroy( cache->references );
+    ( cache->sketch != NULL ) ? sketch_free( cache->sketch ) : NULL;
+    pthread_mutex_destroy( &cache->lock );
     free( cache );
 }
 
@@ -97,28 +297,99 @@ static void cache_key_free( gpointer key )
 }
 
 /**
- * Function used to free an arbitrary cache object data using a user defined
- * free function.
+ * Free the cache_object_t structure as well as its data using an optional user
+ * defined free function.
  *
  * The free function needs to be supplied as a cache_object_free_func pointer
- * and been put into the user_data pointer.
+ * and been put into the user_data pointer. It may be NULL.
  */
 static void cache_object_data_free( gpointer key, gpointer value, gpointer user_data ) 
 {
     cache_object_free_func free_func = ( cache_object_free_func )user_data;
     cache_object_t* obj = ( cache_object_t* )value;
-    free_func( obj->prefix, obj->identifier, obj->ptr );
+    ( free_func != NULL ) ? free_func( obj->prefix, obj->identifier, obj->ptr ) : NULL;
+    ( obj->prefix != NULL ) ? ( free( obj->prefix ) ) : NULL;
+    ( obj->identifier != NULL ) ? ( free( obj->identifier ) ) : NULL;
+    free( obj );
 }
 
 /**
- * Free the cache_object_t structure associated with a key
+ * Discard a cache object which has just been taken out of the hashtable.
+ *
+ * If the object is not referenced by anyone it is freed immediately.
+ * Otherwise it is marked as detached and will be freed by the last call to
+ * cache_release_object.
+ *
+ * The cache lock needs to be held while calling this function.
  */
-static void cache_value_free( gpointer value ) 
+static void cache_object_discard( cache_t* cache, cache_object_t* obj ) 
 {
-    cache_object_t* obj = ( cache_object_t* )value;
-    ( obj->prefix != NULL ) ? ( free( obj->prefix ) ) : NULL;
-    ( obj->identifier != NULL ) ? ( free( obj->identifier ) ) : NULL;
-    free( obj );
+    if ( obj->refcount > 0 ) 
+    {
+        obj->detached = 1;
+        return;
+    }
+
+    cache_object_data_free( NULL, obj, (gpointer)cache->object_free_func );
+}
+
+/**
+ * Callback of g_hash_table_foreach_remove discarding expired objects
+ *
+ * Objects of the table of stale objects expire CACHE_SWEEP_INTERVAL seconds
+ * after they have been moved there.
+ *
+ * The cache lock needs to be held while calling this function.
+ */
+static gboolean cache_object_expired( gpointer key, gpointer value, gpointer user_data ) 
+{
+    cache_sweep_t* sweep = (cache_sweep_t*)user_data;
+    cache_object_t* obj  = (cache_object_t*)value;
+
+    (void)key;
+
+    if ( sweep->stale && obj->timestamp + CACHE_SWEEP_INTERVAL >= sweep->now ) 
+    {
+        return FALSE;
+    }
+    if ( !sweep->stale ) 
+    {
+        if ( obj->timestamp + obj->ttl >= sweep->now ) 
+        {
+            return FALSE;
+        }
+        g_queue_unlink( &sweep->cache->recency, &obj->link );
+    }
+
+    cache_object_discard( sweep->cache, obj );
+    return TRUE;
+}
+
+/**
+ * Free all expired objects, if the last sweep is at least
+ * CACHE_SWEEP_INTERVAL seconds ago
+ *
+ * Without this, objects looked up only once, like those of a single walk over
+ * the whole tree, would stay in memory forever.
+ *
+ * The cache lock needs to be held while calling this function.
+ */
+static void cache_sweep( cache_t* cache, time_t now ) 
+{
+    cache_sweep_t sweep;
+
+    if ( now < cache->next_sweep ) 
+    {
+        return;
+    }
+    cache->next_sweep = now + CACHE_SWEEP_INTERVAL;
+
+    sweep.cache = cache;
+    sweep.now   = now;
+    sweep.stale = FALSE;
+    g_hash_table_foreach_remove( cache->hashtable, cache_object_expired, &sweep );
+    sweep.stale = TRUE;
+    g_hash_table_foreach_remove( cache->stale, cache_object_expired, &sweep );
 }
 
 /**
@@ -137,11 +408,12 @@ static void cache_value_free( gpointer value )
 void cache_add_object( cache_t* cache, const char* prefix, const char* identifier, void* ptr ) 
 {
     cache_object_t* old_obj = NULL;
-    void* old_ptr = NULL;
     char* key = NULL;
+    int fixed = 0;
+    int stale = 0;
 
     cache_object_t* obj = snew( cache_object_t );
-    obj->timestamp = time( NULL );
+    obj->timestamp = cache->clock( NULL );
     obj->prefix = strdup( prefix );
     obj->identifier = strdup( identifier );
     obj->ptr = ptr;
@@ -149,16 +421,57 @@ void cache_add_object( cache_t* cache, const char* prefix, const char* identifie
     // Add the newly created object to the storage hashmap
     asprintf( &key, "%s/%s", prefix, identifier );
     
-    // Retrieve the possibly already defined cache entry
-    old_obj = g_hash_table_lookup( cache->hashtable, key );
-    if ( old_obj != NULL && cache->object_free_func != NULL ) 
+    pthread_mutex_lock( &cache->lock );
+
+    cache_sweep( cache, obj->timestamp );
+
+    obj->ttl = cache_initial_ttl( cache, identifier, &fixed );
+
+    // Retrieve the possibly already defined cache entry. An expired one has
+    // been moved aside by the lookup preceding this call.
+    if ( ( old_obj = g_hash_table_lookup( cache->hashtable, key ) ) == NULL 
+      && ( old_obj = g_hash_table_lookup( cache->stale, key ) ) != NULL ) 
+    {
+        g_hash_table_remove( cache->stale, key );
+        stale = 1;
+    }
+
+    // Adapt the ttl based on the change rate of the object. Unchanged data
+    // lives twice as long, changed data half as long as before.
+    if ( old_obj != NULL && !fixed && cache->object_equal_func != NULL ) 
+    {
+        if ( cache->object_equal_func( obj->prefix, obj->identifier, old_obj->ptr, ptr ) ) 
+        {
+            obj->ttl = ( old_obj->ttl * 2 > cache->max_ttl ) ? cache->max_ttl : old_obj->ttl * 2;
+        }
+        else 
+        {
+            obj->ttl = ( old_obj->ttl / 2 < cache->min_ttl ) ? cache->min_ttl : old_obj->ttl / 2;
+        }
+    }
+
+    if ( old_obj != NULL && !stale ) 
+    {
+        g_queue_unlink( &cache->recency, &old_obj->link );
+    }
+    else if ( cache->max_objects > 0 && g_hash_table_size( cache->hashtable ) >= cache->max_objects && !cache_admit( cache, key ) ) 
     {
-        // Call the user defined free func on it
-        cache->object_free_func( old_obj->prefix, old_obj->identifier, old_obj->ptr );
+        // The cache is full of objects used more often
+        ( old_obj != NULL ) ? cache_object_discard( cache, old_obj ) : NULL;
+        cache_object_discard( cache, obj );
+        pthread_mutex_unlock( &cache->lock );
+        free( key );
+        metrics_count( METRICS_CACHE_REJECTED, 1 );
+        return;
     }
 
     // Store the new cache object possibly removing the old one
+    obj->link.data = obj;
+    g_queue_push_head_link( &cache->recency, &obj->link );
     g_hash_table_replace( cache->hashtable, key, obj );
+    ( old_obj != NULL ) ? cache_object_discard( cache, old_obj ) : NULL;
+
+    pthread_mutex_unlock( &cache->lock );
 }
 
 /**
@@ -167,40 +480,132 @@ void cache_add_object( cache_t* cache, const char* prefix, const char* identifie
  * If the object is not available in the cache NULL will be returned. If the
  * time to live of the requested cache object lies within the past NULL will be
  * returned and the old cache is beeing freed.
+ *
+ * If adaptive ttl handling is enabled an expired object is kept aside for
+ * CACHE_SWEEP_INTERVAL seconds instead, so the replacement added by
+ * cache_add_object can be compared to it.
+ *
+ * A returned object is referenced by the caller and stays valid even if it is
+ * replaced or removed by another thread in the meantime. Every returned
+ * object needs to be handed back using cache_release_object, as soon as it is
+ * not needed any longer.
  */
 void* cache_get_object( cache_t* cache, const char* prefix, const char* identifier ) 
+{
+    return cache_lookup( cache, prefix, identifier, TRUE );
+}
+
+/**
+ * Retrieve an object like cache_get_object without counting the access
+ *
+ * Neither the frequency sketch, nor the recency order, nor the hit and miss
+ * counters are updated. Background work probing the cache, like the
+ * prefetcher, uses this, so its lookups do not make entries look used.
+ */
+void* cache_peek_object( cache_t* cache, const char* prefix, const char* identifier ) 
+{
+    return cache_lookup( cache, prefix, identifier, FALSE );
+}
+
+/**
+ * Look up an object, counting the access if requested
+ */
+static void* cache_lookup( cache_t* cache, const char* prefix, const char* identifier, int counted ) 
 {
     char* key = NULL;
-    time_t now = time( NULL );
+    time_t now = cache->clock( NULL );
     cache_object_t* obj = NULL;
+    cache_object_t* old = NULL;
 
     asprintf( &key, "%s/%s", prefix, identifier );
 
+    pthread_mutex_lock( &cache->lock );
+
+    cache_sweep( cache, now );
+
+    ( counted && cache->sketch != NULL ) ? sketch_increment( cache->sketch, g_str_hash( key ) ) : NULL;
+
     if ( ( obj = g_hash_table_lookup( cache->hashtable, key ) ) == NULL ) 
     {
+        pthread_mutex_unlock( &cache->lock );
         free( key );
-        return obj;
+        ( counted ) ? metrics_count( METRICS_CACHE_MISSES, 1 ) : (void)0;
+        return NULL;
     }
     
     // Check if we are still in an acceptable ttl lifespan
-    if ( obj->timestamp + cache->ttl < now ) 
+    if ( obj->timestamp + obj->ttl < now ) 
     {
-        // The object does not live any longer kill it
-        if ( cache->object_free_func != NULL ) 
+        // The object does not live any longer, take it out of the cache
+        g_hash_table_remove( cache->hashtable, key );
+        g_queue_unlink( &cache->recency, &obj->link );
+
+        if ( cache->object_equal_func != NULL ) 
         {
-            // Call the user defined free func on it
-            cache->object_free_func( obj->prefix, obj->identifier, obj->ptr );
+            // The object is kept aside for the comparison with its
+            // replacement. Its timestamp now tells when it has been moved.
+            obj->timestamp = now;
+            ( ( old = g_hash_table_lookup( cache->stale, key ) ) != NULL ) ? cache_object_discard( cache, old ) : NULL;
+            g_hash_table_replace( cache->stale, key, obj );
+            key = NULL;
+        }
+        else 
+        {
+            cache_object_discard( cache, obj );
         }
-        g_hash_table_remove( cache->hashtable, key );
         
-        free( key );
+        pthread_mutex_unlock( &cache->lock );
+        ( key != NULL ) ? free( key ) : NULL;
+        ( counted ) ? metrics_count( METRICS_CACHE_MISSES, 1 ) : (void)0;
         return NULL;
     }
+
+    if ( counted ) 
+    {
+        g_queue_unlink( &cache->recency, &obj->link );
+        g_queue_push_head_link( &cache->recency, &obj->link );
+    }
+
+    // Hand out a new reference to the object data
+    if ( obj->refcount++ == 0 ) 
+    {
+        g_hash_table_insert( cache->references, obj->ptr, obj );
+    }
     
+    pthread_mutex_unlock( &cache->lock );
     free( key );
+    ( counted ) ? metrics_count( METRICS_CACHE_HITS, 1 ) : (void)0;
     return obj->ptr;
 }
 
+/**
+ * Release an object reference retrieved by cache_get_object
+ *
+ * If the object has been removed from the cache in the meantime and this was
+ * the last reference to it, it is freed.
+ */
+void cache_release_object( cache_t* cache, void* ptr ) 
+{
+    cache_object_t* obj = NULL;
+
+    pthread_mutex_lock( &cache->lock );
+
+    if ( ( obj = g_hash_table_lookup( cache->references, ptr ) ) == NULL ) 
+    {
+        // Not a referenced cache object. Nothing to be done
+        pthread_mutex_unlock( &cache->lock );
+        return;
+    }
+
+    if ( --obj->refcount == 0 ) 
+    {
+        g_hash_table_remove( cache->references, ptr );
+        ( obj->detached ) ? cache_object_discard( cache, obj ) : NULL;
+    }
+
+    pthread_mutex_unlock( &cache->lock );
+}
+
 /** 
  * Remove an object from cache if it is stored there.
  */
@@ -211,16 +616,20 @@ void cache_remove_object( cache_t* cache, const char* prefix, const char* identi
 
     asprintf( &key, "%s/%s", prefix, identifier );
 
-    if ( ( obj = g_hash_table_lookup( cache->hashtable, key ) ) == NULL ) 
+    pthread_mutex_lock( &cache->lock );
+
+    if ( ( obj = g_hash_table_lookup( cache->hashtable, key ) ) != NULL ) 
     {
-        free( key );
-        return;
+        g_hash_table_remove( cache->hashtable, key );
+        g_queue_unlink( &cache->recency, &obj->link );
+        cache_object_discard( cache, obj );
     }
-
-    if ( cache->object_free_func != NULL ) 
+    if ( ( obj = g_hash_table_lookup( cache->stale, key ) ) != NULL ) 
     {
-        // Call the user defined free func on it
-        cache->object_free_func( obj->prefix, obj->identifier, obj->ptr );
+        g_hash_table_remove( cache->stale, key );
+        cache_object_discard( cache, obj );
     }
-    g_hash_table_remove( cache->hashtable, key );
+
+    pthread_mutex_unlock( &cache->lock );
+    free( key );
 }
@@ -22,21 +22,50 @@
  * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
  */
 
+#include <time.h>
+#include <pthread.h>
 #include <glib.h>
 
+#include "sketch.h"
+
+/**
+ * Seconds between two sweeps removing all expired objects
+ */
+#define CACHE_SWEEP_INTERVAL 60
+
 typedef void (*cache_object_free_func)( char* prefix, char* identifier, void* ptr );
+typedef int (*cache_object_equal_func)( char* prefix, char* identifier, void* a, void* b );
+typedef time_t (*cache_clock_func)( time_t* now );
 
 typedef struct 
 {
     GHashTable* hashtable;
+    GHashTable* stale;
+    GHashTable* ttl_overrides;
+    GHashTable* references;
+    GQueue recency;
+    sketch_t* sketch;
+    unsigned long max_objects;
+    pthread_mutex_t lock;
     long ttl;
+    long min_ttl;
+    long max_ttl;
     cache_object_free_func object_free_func;
+    cache_object_equal_func object_equal_func;
+    cache_clock_func clock;
+    time_t next_sweep;
 } cache_t;
 
 cache_t* cache_new( long ttl, cache_object_free_func object_free_func );
 void cache_free( cache_t* cache );
+void cache_set_adaptive_ttl( cache_t* cache, long min_ttl, long max_ttl, cache_object_equal_func object_equal_func );
+void cache_set_ttl_override( cache_t* cache, const char* container, long ttl );
+void cache_set_clock( cache_t* cache, cache_clock_func clock );
+void cache_set_limit( cache_t* cache, unsigned long max_objects );
 void cache_add_object( cache_t* cache, const char* prefix, const char* identifier, void* ptr );
 void* cache_get_object( cache_t* cache, const char* prefix, const char* identifier );
+void* cache_peek_object( cache_t* cache, const char* prefix, const char* identifier );
+void cache_release_object( cache_t* cache, void* ptr );
 void cache_remove_object( cache_t* cache, const char* prefix, const char* identifier );
 
 #endif
@@ -0,0 +1,506 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include "salloc.h"
+#include "datacache.h"
+
+static guint datacache_block_hash( gconstpointer key );
+static gboolean datacache_block_equal( gconstpointer a, gconstpointer b );
+static inline uint64_t datacache_key( uint64_t file, uint64_t index );
+static void datacache_list_insert( datacache_t* cache, int list, datacache_block_t* block, datacache_block_t* before );
+static void datacache_list_remove( datacache_t* cache, datacache_block_t* block );
+static void datacache_discard( datacache_t* cache, datacache_block_t* block );
+static void datacache_ghost( datacache_t* cache, datacache_block_t* block, int list );
+static void datacache_clock_evict( datacache_t* cache );
+static void datacache_tinylfu_admit( datacache_t* cache );
+static void datacache_arc_replace( datacache_t* cache, int frequent_ghost );
+static void datacache_arc_add( datacache_t* cache, datacache_block_t* block, datacache_block_t* ghost );
+
+/**
+ * Names of the policies as used by options
+ */
+static const char* datacache_policy_names[DATACACHE_POLICIES] = { "lru", "clock", "tinylfu", "arc" };
+
+/**
+ * Create a new data cache using the given eviction policy
+ *
+ * Capacity is the maximal amount of data to be cached in bytes. It is
+ * rounded down to full blocks, but the cache holds at least one block.
+ */
+datacache_t* datacache_new( int policy, uint64_t capacity, size_t block_size ) 
+{
+    datacache_t* cache = snew( datacache_t );
+
+    cache->policy     = policy;
+    cache->block_size = block_size;
+    cache->capacity   = ( capacity / block_size > 0 ) ? capacity / block_size : 1;
+    cache->window     = ( cache->capacity * DATACACHE_WINDOW / 100 > 0 ) ? cache->capacity * DATACACHE_WINDOW / 100 : 1;
+    cache->blocks     = g_hash_table_new( datacache_block_hash, datacache_block_equal );
+    cache->sketch     = sketch_new( cache->capacity );
+    pthread_mutex_init( &cache->lock, NULL );
+
+    return cache;
+}
+
+/**
+ * Free the given data cache including all cached blocks
+ */
+void datacache_free( datacache_t* cache ) 
+{
+    int list = 0;
+
+    for( list = 0; list < DATACACHE_LISTS; ++list ) 
+    {
+        while( cache->lists[list].head != NULL ) 
+        {
+            datacache_discard( cache, cache->lists[list].head );
+        }
+    }
+
+    g_hash_table_destroy( cache->blocks );
+    sketch_free( cache->sketch );
+    pthread_mutex_destroy( &cache->lock );
+    free( cache );
+}
+
+/**
+ * Determine the policy with the given name
+ *
+ * -1 is returned for unknown names.
+ */
+int datacache_policy( const char* name ) 
+{
+    int policy = 0;
+
+    for( policy = 0; policy < DATACACHE_POLICIES; ++policy ) 
+    {
+        if ( strcasecmp( name, datacache_policy_names[policy] ) == 0 ) 
+        {
+            return policy;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Name of the given policy
+ */
+const char* datacache_policy_name( int policy ) 
+{
+    return datacache_policy_names[policy];
+}
+
+/**
+ * Hash and compare blocks stored in the hashtable, which uses the blocks as
+ * keys and values at the same time
+ */
+static guint datacache_block_hash( gconstpointer key ) 
+{
+    const datacache_block_t* block = (const datacache_block_t*)key;
+    uint64_t hash = datacache_key( block->file, block->index );
+    return (guint)( hash ^ ( hash >> 32 ) );
+}
+
+static gboolean datacache_block_equal( gconstpointer a, gconstpointer b ) 
+{
+    const datacache_block_t* first  = (const datacache_block_t*)a;
+    const datacache_block_t* second = (const datacache_block_t*)b;
+    return first->file == second->file && first->index == second->index;
+}
+
+/**
+ * Combine file and block number into one key
+ */
+static inline uint64_t datacache_key( uint64_t file, uint64_t index ) 
+{
+    return file ^ ( ( index + 1 ) * 0x9e3779b97f4a7c15ULL );
+}
+
+/**
+ * Insert a block into the given list in front of another block of it
+ *
+ * If before is NULL the block becomes the first of the list.
+ */
+static void datacache_list_insert( datacache_t* cache, int list, datacache_block_t* block, datacache_block_t* before ) 
+{
+    datacache_list_t* target = &cache->lists[list];
+
+    before = ( before != NULL ) ? before : target->head;
+
+    block->list = list;
+    block->next = before;
+    block->prev = ( before != NULL ) ? before->prev : NULL;
+    ( block->prev != NULL ) ? ( block->prev->next = block ) : ( target->head = block );
+    ( before != NULL ) ? ( before->prev = block ) : ( target->tail = block );
+    ++target->length;
+}
+
+/**
+ * Remove a block from the list it is currently kept in
+ */
+static void datacache_list_remove( datacache_t* cache, datacache_block_t* block ) 
+{
+    datacache_list_t* source = &cache->lists[block->list];
+
+    // The clock hand moves on to the next block, wrapping around at the end
+    if ( cache->hand == block ) 
+    {
+        cache->hand = ( block->next != NULL ) ? block->next : source->head;
+        cache->hand = ( cache->hand == block ) ? NULL : cache->hand;
+    }
+
+    ( block->prev != NULL ) ? ( block->prev->next = block->next ) : ( source->head = block->next );
+    ( block->next != NULL ) ? ( block->next->prev = block->prev ) : ( source->tail = block->prev );
+    block->prev = NULL;
+    block->next = NULL;
+    --source->length;
+}
+
+/**
+ * Remove a block from the cache and free it
+ */
+static void datacache_discard( datacache_t* cache, datacache_block_t* block ) 
+{
+    datacache_list_remove( cache, block );
+    g_hash_table_remove( cache->blocks, block );
+    ( block->data != NULL ) ? free( block->data ) : NULL;
+    free( block );
+}
+
+/**
+ * Evict a block, but remember it in the given ghost list
+ */
+static void datacache_ghost( datacache_t* cache, datacache_block_t* block, int list ) 
+{
+    datacache_list_remove( cache, block );
+    ( block->data != NULL ) ? free( block->data ) : NULL;
+    block->data = NULL;
+    datacache_list_insert( cache, list, block, NULL );
+}
+
+/**
+ * Record an access of the given block in the frequency sketch
+ *
+ * Reads are not counted by datacache_read, as a single access of a block may
+ * be split into several reads. Callers touch each block once per access
+ * instead, for example once per sequential pass of a file handle.
+ */
+void datacache_touch( datacache_t* cache, uint64_t file, uint64_t index ) 
+{
+    pthread_mutex_lock( &cache->lock );
+    sketch_increment( cache->sketch, datacache_key( file, index ) );
+    pthread_mutex_unlock( &cache->lock );
+}
+
+/**
+ * Read data of the given block into the buffer
+ *
+ * At most size bytes starting at offset within the block are copied. The
+ * number of bytes available is returned, which is smaller than size at the
+ * end of a file. If the buffer is NULL nothing is copied. -1 is returned if
+ * the block is not cached.
+ */
+ssize_t datacache_read( datacache_t* cache, uint64_t file, uint64_t index, char* buffer, size_t offset, size_t size ) 
+{
+    datacache_block_t key;
+    datacache_block_t* block = NULL;
+    size_t available = 0;
+
+    key.file  = file;
+    key.index = index;
+
+    pthread_mutex_lock( &cache->lock );
+
+    block = g_hash_table_lookup( cache->blocks, &key );
+    if ( block == NULL || block->list == DATACACHE_LIST_RECENT_GHOST || block->list == DATACACHE_LIST_FREQUENT_GHOST ) 
+    {
+        ++cache->misses;
+        pthread_mutex_unlock( &cache->lock );
+        return -1;
+    }
+
+    ++cache->hits;
+    switch( cache->policy ) 
+    {
+        case DATACACHE_POLICY_CLOCK:
+            block->referenced = 1;
+        break;
+        case DATACACHE_POLICY_ARC:
+            datacache_list_remove( cache, block );
+            datacache_list_insert( cache, DATACACHE_LIST_FREQUENT, block, NULL );
+        break;
+        default:
+            if ( block != cache->lists[block->list].head ) 
+            {
+                int list = block->list;
+                datacache_list_remove( cache, block );
+                datacache_list_insert( cache, list, block, NULL );
+            }
+    }
+
+    available = ( offset < block->size ) ? block->size - offset : 0;
+    available = ( available < size ) ? available : size;
+    ( buffer != NULL && block->data != NULL ) ? memcpy( buffer, block->data + offset, available ) : NULL;
+
+    pthread_mutex_unlock( &cache->lock );
+    return available;
+}
+
+/**
+ * Store the data of a block retrieved after a miss
+ *
+ * The data is copied. If it is NULL only the presence of the block is
+ * tracked. Blocks already cached are replaced. Depending on the policy the
+ * block may evict another one or not be admitted at all.
+ */
+void datacache_add( datacache_t* cache, uint64_t file, uint64_t index, const char* data, size_t size ) 
+{
+    datacache_block_t key;
+    datacache_block_t* block = NULL;
+    datacache_block_t* ghost = NULL;
+
+    key.file  = file;
+    key.index = index;
+
+    pthread_mutex_lock( &cache->lock );
+
+    if ( ( block = g_hash_table_lookup( cache->blocks, &key ) ) != NULL ) 
+    {
+        if ( block->list != DATACACHE_LIST_RECENT_GHOST && block->list != DATACACHE_LIST_FREQUENT_GHOST ) 
+        {
+            // Another reader fetched the same block in the meantime
+            ( block->data != NULL ) ? free( block->data ) : NULL;
+            block->data = ( data != NULL ) ? (char*)memcpy( smalloc( size ), data, size ) : NULL;
+            block->size = size;
+            pthread_mutex_unlock( &cache->lock );
+            return;
+        }
+        ghost = block;
+    }
+
+    block        = snew( datacache_block_t );
+    block->file  = file;
+    block->index = index;
+    block->size  = size;
+    block->data  = ( data != NULL ) ? (char*)memcpy( smalloc( size ), data, size ) : NULL;
+
+    switch( cache->policy ) 
+    {
+        case DATACACHE_POLICY_LRU:
+            if ( cache->lists[DATACACHE_LIST_MAIN].length >= cache->capacity ) 
+            {
+                ++cache->evicted;
+                datacache_discard( cache, cache->lists[DATACACHE_LIST_MAIN].tail );
+            }
+            datacache_list_insert( cache, DATACACHE_LIST_MAIN, block, NULL );
+            g_hash_table_insert( cache->blocks, block, block );
+        break;
+        case DATACACHE_POLICY_CLOCK:
+            if ( cache->lists[DATACACHE_LIST_MAIN].length >= cache->capacity ) 
+            {
+                datacache_clock_evict( cache );
+            }
+            // New blocks are placed right behind the hand, so they are the
+            // last ones it reaches
+            datacache_list_insert( cache, DATACACHE_LIST_MAIN, block, cache->hand );
+            cache->hand = ( cache->hand != NULL ) ? cache->hand : block;
+            g_hash_table_insert( cache->blocks, block, block );
+        break;
+        case DATACACHE_POLICY_TINYLFU:
+            datacache_list_insert( cache, DATACACHE_LIST_WINDOW, block, NULL );
+            g_hash_table_insert( cache->blocks, block, block );
+            if ( cache->lists[DATACACHE_LIST_WINDOW].length > cache->window ) 
+            {
+                datacache_tinylfu_admit( cache );
+            }
+        break;
+        case DATACACHE_POLICY_ARC:
+            datacache_arc_add( cache, block, ghost );
+        break;
+    }
+
+    pthread_mutex_unlock( &cache->lock );
+}
+
+/**
+ * Check whether the given block has been read repeatedly in the recent past
+ *
+ * Callers reading data only once, like a sequential scan, may use this to
+ * add only blocks which are used by others as well.
+ */
+int datacache_frequent( datacache_t* cache, uint64_t file, uint64_t index ) 
+{
+    int estimate = 0;
+
+    pthread_mutex_lock( &cache->lock );
+    estimate = sketch_estimate( cache->sketch, datacache_key( file, index ) );
+    pthread_mutex_unlock( &cache->lock );
+
+    return estimate >= DATACACHE_FREQUENT;
+}
+
+/**
+ * Evict the first block the clock hand reaches which has not been
+ * referenced since the hand passed it the last time
+ */
+static void datacache_clock_evict( datacache_t* cache ) 
+{
+    datacache_list_t* list = &cache->lists[DATACACHE_LIST_MAIN];
+
+    cache->hand = ( cache->hand != NULL ) ? cache->hand : list->head;
+    while( cache->hand->referenced ) 
+    {
+        cache->hand->referenced = 0;
+        cache->hand = ( cache->hand->next != NULL ) ? cache->hand->next : list->head;
+    }
+
+    ++cache->evicted;
+    datacache_discard( cache, cache->hand );
+}
+
+/**
+ * Move the least recently used block of the window to the main list
+ *
+ * If the main list is full the block competes with its least recently used
+ * block. Only the one used more often recently stays in the cache, which
+ * keeps blocks read only once from displacing the working set.
+ */
+static void datacache_tinylfu_admit( datacache_t* cache ) 
+{
+    datacache_block_t* candidate = cache->lists[DATACACHE_LIST_WINDOW].tail;
+    datacache_block_t* victim    = cache->lists[DATACACHE_LIST_MAIN].tail;
+
+    if ( cache->lists[DATACACHE_LIST_MAIN].length + cache->window >= cache->capacity && victim != NULL ) 
+    {
+        if ( sketch_estimate( cache->sketch, datacache_key( candidate->file, candidate->index ) ) 
+          <= sketch_estimate( cache->sketch, datacache_key( victim->file, victim->index ) ) ) 
+        {
+            ++cache->rejected;
+            datacache_discard( cache, candidate );
+            return;
+        }
+
+        ++cache->evicted;
+        datacache_discard( cache, victim );
+    }
+
+    datacache_list_remove( cache, candidate );
+    datacache_list_insert( cache, DATACACHE_LIST_MAIN, candidate, NULL );
+}
+
+/**
+ * Evict one block from the recent or the frequent list of ARC into the
+ * according ghost list
+ *
+ * The recent list gives up a block as long as it exceeds its target size.
+ * Frequent ghost tells whether the block to be added has been found in the
+ * frequent ghost list.
+ */
+static void datacache_arc_replace( datacache_t* cache, int frequent_ghost ) 
+{
+    uint64_t recent = cache->lists[DATACACHE_LIST_RECENT].length;
+
+    if ( recent + cache->lists[DATACACHE_LIST_FREQUENT].length < cache->capacity ) 
+    {
+        return;
+    }
+
+    ++cache->evicted;
+    if ( recent > 0 && ( recent > cache->target || ( frequent_ghost && recent == cache->target ) || cache->lists[DATACACHE_LIST_FREQUENT].length == 0 ) ) 
+    {
+        datacache_ghost( cache, cache->lists[DATACACHE_LIST_RECENT].tail, DATACACHE_LIST_RECENT_GHOST );
+    }
+    else 
+    {
+        datacache_ghost( cache, cache->lists[DATACACHE_LIST_FREQUENT].tail, DATACACHE_LIST_FREQUENT_GHOST );
+    }
+}
+
+/**
+ * Add a block using ARC
+ *
+ * A hit in one of the ghost lists shows the according list would have
+ * needed more space, so its target size is adapted before the block is
+ * added to the frequent list. Other blocks enter the recent list. Both
+ * ghost lists together never remember more blocks than the cache holds.
+ */
+static void datacache_arc_add( datacache_t* cache, datacache_block_t* block, datacache_block_t* ghost ) 
+{
+    datacache_list_t* recent          = &cache->lists[DATACACHE_LIST_RECENT];
+    datacache_list_t* frequent        = &cache->lists[DATACACHE_LIST_FREQUENT];
+    datacache_list_t* recent_ghost    = &cache->lists[DATACACHE_LIST_RECENT_GHOST];
+    datacache_list_t* frequent_ghost  = &cache->lists[DATACACHE_LIST_FREQUENT_GHOST];
+
+    if ( ghost != NULL && ghost->list == DATACACHE_LIST_RECENT_GHOST ) 
+    {
+        uint64_t delta = ( frequent_ghost->length > recent_ghost->length ) ? frequent_ghost->length / recent_ghost->length : 1;
+        cache->target = ( cache->target + delta < cache->capacity ) ? cache->target + delta : cache->capacity;
+    }
+    else if ( ghost != NULL ) 
+    {
+        uint64_t delta = ( recent_ghost->length > frequent_ghost->length ) ? recent_ghost->length / frequent_ghost->length : 1;
+        cache->target = ( cache->target > delta ) ? cache->target - delta : 0;
+    }
+
+    if ( ghost != NULL ) 
+    {
+        int frequent_hit = ( ghost->list == DATACACHE_LIST_FREQUENT_GHOST );
+        datacache_discard( cache, ghost );
+        datacache_arc_replace( cache, frequent_hit );
+        datacache_list_insert( cache, DATACACHE_LIST_FREQUENT, block, NULL );
+        g_hash_table_insert( cache->blocks, block, block );
+        return;
+    }
+
+    if ( recent->length + recent_ghost->length >= cache->capacity ) 
+    {
+        if ( recent->length < cache->capacity ) 
+        {
+            datacache_discard( cache, recent_ghost->tail );
+            datacache_arc_replace( cache, FALSE );
+        }
+        else 
+        {
+            ++cache->evicted;
+            datacache_discard( cache, recent->tail );
+        }
+    }
+    else if ( recent->length + frequent->length + recent_ghost->length + frequent_ghost->length >= cache->capacity ) 
+    {
+        if ( recent->length + frequent->length + recent_ghost->length + frequent_ghost->length >= 2 * cache->capacity ) 
+        {
+            datacache_discard( cache, frequent_ghost->tail );
+        }
+        datacache_arc_replace( cache, FALSE );
+    }
+
+    datacache_list_insert( cache, DATACACHE_LIST_RECENT, block, NULL );
+    g_hash_table_insert( cache->blocks, block, block );
+}
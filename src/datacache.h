@@ -0,0 +1,144 @@
+#ifndef DATACACHE_H
+#define DATACACHE_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include "sketch.h"
+
+/**
+ * Policies deciding which blocks are evicted once the cache is full
+ *
+ * LRU evicts the least recently used block. CLOCK approximates it using a
+ * referenced bit per block, which is cheaper upon hits. TINYLFU keeps new
+ * blocks in a small LRU window and only admits them into the main LRU, if
+ * they have been used more often recently than the block they would
+ * replace. ARC balances between recently and frequently used blocks based
+ * on the hits on recently evicted ones.
+ */
+#define DATACACHE_POLICY_LRU     0
+#define DATACACHE_POLICY_CLOCK   1
+#define DATACACHE_POLICY_TINYLFU 2
+#define DATACACHE_POLICY_ARC     3
+#define DATACACHE_POLICIES       4
+
+/**
+ * Lists the blocks are kept in
+ *
+ * LRU and CLOCK only use the main list, TINYLFU the window and the main
+ * list. ARC keeps blocks used once in the recent and blocks used more often
+ * in the frequent list. Its ghost lists remember the keys of blocks evicted
+ * from them, without their data.
+ */
+#define DATACACHE_LIST_MAIN           0
+#define DATACACHE_LIST_WINDOW         1
+#define DATACACHE_LIST_RECENT         2
+#define DATACACHE_LIST_FREQUENT       3
+#define DATACACHE_LIST_RECENT_GHOST   4
+#define DATACACHE_LIST_FREQUENT_GHOST 5
+#define DATACACHE_LISTS               6
+
+/**
+ * Share of the capacity used for the admission window of TINYLFU in
+ * percent
+ */
+#define DATACACHE_WINDOW 1
+
+/**
+ * Number of recent accesses after which a block counts as frequently used
+ */
+#define DATACACHE_FREQUENT 2
+
+/**
+ * One cached block of a file
+ *
+ * Index is the number of the block within the file. Size is the number of
+ * valid bytes, which is smaller than the block size at the end of a file.
+ * Data is NULL for ghost entries and if the cache only keeps track of the
+ * blocks, like the cache simulator does.
+ */
+typedef struct datacache_block
+{
+    uint64_t file;
+    uint64_t index;
+    int list;
+    int referenced;
+    size_t size;
+    char* data;
+    struct datacache_block* prev;
+    struct datacache_block* next;
+} datacache_block_t;
+
+/**
+ * Doubly linked list of blocks with the most recently used one first
+ */
+typedef struct 
+{
+    datacache_block_t* head;
+    datacache_block_t* tail;
+    uint64_t length;
+} datacache_list_t;
+
+/**
+ * Cache of fixed size blocks of file data
+ *
+ * Files are identified by a 64 bit key, usually a hash of their path.
+ * Capacity is the number of blocks the cache holds. Hand is the position of
+ * the CLOCK policy, target the size of the recent list ARC aims for. The
+ * sketch counts the reads of every block. It is used for the admission of
+ * TINYLFU and tells callers which blocks are read repeatedly.
+ *
+ * All functions may be called concurrently from different threads.
+ */
+typedef struct 
+{
+    int policy;
+    size_t block_size;
+    uint64_t capacity;
+    uint64_t window;
+    uint64_t target;
+    GHashTable* blocks;
+    datacache_list_t lists[DATACACHE_LISTS];
+    datacache_block_t* hand;
+    sketch_t* sketch;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t rejected;
+    uint64_t evicted;
+    pthread_mutex_t lock;
+} datacache_t;
+
+datacache_t* datacache_new( int policy, uint64_t capacity, size_t block_size );
+void datacache_free( datacache_t* cache );
+int datacache_policy( const char* name );
+const char* datacache_policy_name( int policy );
+void datacache_touch( datacache_t* cache, uint64_t file, uint64_t index );
+ssize_t datacache_read( datacache_t* cache, uint64_t file, uint64_t index, char* buffer, size_t offset, size_t size );
+void datacache_add( datacache_t* cache, uint64_t file, uint64_t index, const char* data, size_t size );
+int datacache_frequent( datacache_t* cache, uint64_t file, uint64_t index );
+
+#endif
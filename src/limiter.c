@@ -0,0 +1,498 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "salloc.h"
+#include "limiter.h"
+
+/**
+ * Weights of a new latency sample in the short and the long term averages
+ */
+#define LIMITER_SHORT_WEIGHT 0.1
+#define LIMITER_LONG_WEIGHT  0.005
+
+/**
+ * Reserved share of the window of every priority class
+ */
+static const double limiter_shares[LIMITER_CLASSES] = { 0.25, 0.25, 0.1, 0.1 };
+
+static int limiter_reserved( limiter_t* limiter, int class );
+static int limiter_admissible( limiter_t* limiter, int class );
+static void limiter_grant( limiter_t* limiter, limiter_slot_t* slot );
+static limiter_slot_t* limiter_next( limiter_t* limiter, int class );
+static void limiter_dispatch( limiter_t* limiter );
+static void limiter_preempt( limiter_t* limiter );
+static void limiter_enqueue( limiter_t* limiter, limiter_slot_t* slot );
+static void limiter_dequeue( limiter_t* limiter, limiter_slot_t* slot );
+
+/**
+ * Create a new limiter for the given endpoint
+ *
+ * The window starts at initial and is kept between min_limit and max_limit.
+ * A tolerance of 0 disables the reaction to increasing latencies.
+ */
+limiter_t* limiter_new( const char* endpoint, int initial, int min_limit, int max_limit, double tolerance ) 
+{
+    limiter_t* limiter = snew( limiter_t );
+
+    limiter->endpoint  = strdup( endpoint );
+    limiter->min_limit = ( min_limit < 1 ) ? 1 : min_limit;
+    limiter->max_limit = ( max_limit < limiter->min_limit ) ? limiter->min_limit : max_limit;
+    limiter->limit     = initial;
+    limiter->limit     = ( limiter->limit < limiter->min_limit ) ? limiter->min_limit : limiter->limit;
+    limiter->limit     = ( limiter->limit > limiter->max_limit ) ? limiter->max_limit : limiter->limit;
+    limiter->tolerance = tolerance;
+    limiter->running   = NULL;
+    limiter->next      = NULL;
+    pthread_mutex_init( &limiter->lock, NULL );
+
+    return limiter;
+}
+
+/**
+ * Free the given limiter
+ *
+ * No requests may be in flight or waiting anymore.
+ */
+void limiter_free( limiter_t* limiter ) 
+{
+    pthread_mutex_destroy( &limiter->lock );
+    free( limiter->endpoint );
+    free( limiter );
+}
+
+/**
+ * Number of places in the current window reserved for the given class
+ */
+static int limiter_reserved( limiter_t* limiter, int class ) 
+{
+    int reserved = (int)( limiter->limit * limiter_shares[class] );
+    return ( reserved < 1 ) ? 1 : reserved;
+}
+
+/**
+ * Check if a request of the given class may take a free place
+ *
+ * Background requests are restricted to their common share of the window,
+ * so foreground requests always find a free place quickly.
+ */
+static int limiter_admissible( limiter_t* limiter, int class ) 
+{
+    int background = 0;
+    int i = 0;
+
+    if ( limiter->in_flight >= (int)limiter->limit ) 
+    {
+        return 0;
+    }
+
+    if ( class < LIMITER_CLASS_PREFETCH || limiter->class_in_flight[class] < limiter_reserved( limiter, class ) ) 
+    {
+        return 1;
+    }
+
+    for( i = LIMITER_CLASS_PREFETCH; i < LIMITER_CLASSES; ++i ) 
+    {
+        background += limiter->class_in_flight[i];
+    }
+
+    return background < (int)( limiter->limit * LIMITER_BACKGROUND_SHARE );
+}
+
+/**
+ * Hand a place of the window to the given slot and add it to the running
+ * requests
+ */
+static void limiter_grant( limiter_t* limiter, limiter_slot_t* slot ) 
+{
+    slot->state     = LIMITER_SLOT_GRANTED;
+    slot->cancelled = 0;
+    slot->preempted = 0;
+    slot->prev      = NULL;
+    slot->next      = limiter->running;
+    ( limiter->running != NULL ) ? ( limiter->running->prev = slot ) : NULL;
+    limiter->running = slot;
+
+    ++limiter->in_flight;
+    ++limiter->class_in_flight[slot->class];
+}
+
+/**
+ * Select the next waiting request of the given class using deficit round
+ * robin
+ *
+ * The current flow is served as long as its deficit covers the cost of its
+ * next request. Otherwise it is credited another quantum and moved to the
+ * end of the round. The class needs to have waiting requests.
+ */
+static limiter_slot_t* limiter_next( limiter_t* limiter, int class ) 
+{
+    for(;;) 
+    {
+        limiter_flow_t* flow = limiter->flows[class];
+        limiter_flow_t* last = flow;
+
+        if ( (int64_t)flow->head->cost <= flow->deficit ) 
+        {
+            flow->deficit -= flow->head->cost;
+            return flow->head;
+        }
+
+        flow->deficit += LIMITER_QUANTUM;
+        if ( flow->next != NULL ) 
+        {
+            while( last->next != NULL ) 
+            {
+                last = last->next;
+            }
+            limiter->flows[class] = flow->next;
+            last->next = flow;
+            flow->next = NULL;
+        }
+    }
+}
+
+/**
+ * Hand free places of the window to waiting requests
+ *
+ * Classes below their reserved share are served first, the highest one
+ * first. Afterwards the remaining places go to the highest waiting class.
+ */
+static void limiter_dispatch( limiter_t* limiter ) 
+{
+    while( limiter->num_waiting > 0 ) 
+    {
+        limiter_slot_t* slot = NULL;
+        int class = 0;
+
+        for( class = 0; class < LIMITER_CLASSES; ++class ) 
+        {
+            if ( limiter->flows[class] != NULL 
+              && limiter->class_in_flight[class] < limiter_reserved( limiter, class ) 
+              && limiter_admissible( limiter, class ) ) 
+            {
+                break;
+            }
+        }
+
+        if ( class == LIMITER_CLASSES ) 
+        {
+            for( class = 0; class < LIMITER_CLASSES; ++class ) 
+            {
+                if ( limiter->flows[class] != NULL && limiter_admissible( limiter, class ) ) 
+                {
+                    break;
+                }
+            }
+        }
+
+        if ( class == LIMITER_CLASSES ) 
+        {
+            return;
+        }
+
+        slot = limiter_next( limiter, class );
+        limiter_dequeue( limiter, slot );
+        limiter_grant( limiter, slot );
+        pthread_cond_signal( &slot->cond );
+    }
+}
+
+/**
+ * Ask running background requests to stop in favour of waiting foreground
+ * requests
+ *
+ * Only classes using more than their reserved share are preempted, the
+ * lowest class and the most recently started request first. Every waiting
+ * foreground request causes at most one preemption.
+ */
+static void limiter_preempt( limiter_t* limiter ) 
+{
+    int waiting = limiter->class_waiting[LIMITER_CLASS_METADATA] + limiter->class_waiting[LIMITER_CLASS_DATA];
+    int class   = 0;
+    limiter_slot_t* cur = NULL;
+
+    for( class = LIMITER_CLASSES - 1; class >= LIMITER_CLASS_PREFETCH && limiter->preempting < waiting; --class ) 
+    {
+        int excess = limiter->class_in_flight[class] - limiter_reserved( limiter, class );
+
+        for( cur = limiter->running; cur != NULL && excess > 0 && limiter->preempting < waiting; cur = cur->next ) 
+        {
+            if ( cur->class == class && !cur->cancelled ) 
+            {
+                cur->cancelled = 1;
+                cur->preempted = 1;
+                ++limiter->preempting;
+                ++limiter->preemptions;
+                --excess;
+            }
+        }
+    }
+}
+
+/**
+ * Append a slot to the queue of its flow
+ *
+ * Flows without waiting requests do not exist. A new one is added to the end
+ * of the round of its class with an empty deficit.
+ */
+static void limiter_enqueue( limiter_t* limiter, limiter_slot_t* slot ) 
+{
+    limiter_flow_t** flow = &limiter->flows[slot->class];
+
+    while( *flow != NULL && (*flow)->key != slot->flow ) 
+    {
+        flow = &(*flow)->next;
+    }
+
+    if ( *flow == NULL ) 
+    {
+        *flow = snew( limiter_flow_t );
+        (*flow)->key = slot->flow;
+    }
+
+    slot->state = LIMITER_SLOT_WAITING;
+    slot->queue = *flow;
+    slot->prev  = (*flow)->tail;
+    slot->next  = NULL;
+    ( (*flow)->tail != NULL ) ? ( (*flow)->tail->next = slot ) : ( (*flow)->head = slot );
+    (*flow)->tail = slot;
+    ++limiter->num_waiting;
+    ++limiter->class_waiting[slot->class];
+}
+
+/**
+ * Remove a slot from the queue of its flow
+ *
+ * The flow is removed as well, once it has no waiting requests anymore. Its
+ * remaining deficit is forfeited.
+ */
+static void limiter_dequeue( limiter_t* limiter, limiter_slot_t* slot ) 
+{
+    limiter_flow_t* queue = slot->queue;
+    limiter_flow_t** flow = &limiter->flows[slot->class];
+
+    ( slot->prev != NULL ) ? ( slot->prev->next = slot->next ) : ( queue->head = slot->next );
+    ( slot->next != NULL ) ? ( slot->next->prev = slot->prev ) : ( queue->tail = slot->prev );
+    --limiter->num_waiting;
+    --limiter->class_waiting[slot->class];
+
+    if ( queue->head == NULL ) 
+    {
+        while( *flow != queue ) 
+        {
+            flow = &(*flow)->next;
+        }
+        *flow = queue->next;
+        free( queue );
+    }
+}
+
+/**
+ * Wait until the window allows another request of the given class
+ *
+ * The request is queued for the given flow with the given cost, if there is
+ * no free place right away.
+ * The state the slot ended up in is returned. It is LIMITER_SLOT_GRANTED if
+ * the request may be issued, LIMITER_SLOT_TIMEOUT if the deadline passed
+ * before and LIMITER_SLOT_CANCELLED if the wait has been cancelled. A
+ * deadline of 0 waits forever. A granted slot needs to be released using
+ * limiter_release.
+ */
+int limiter_acquire( limiter_t* limiter, limiter_slot_t* slot, int class, unsigned long flow, uint64_t cost, uint64_t deadline ) 
+{
+    struct timespec until;
+    pthread_condattr_t attr;
+
+    slot->class = class;
+    slot->flow  = flow;
+    slot->cost  = cost;
+
+    pthread_mutex_lock( &limiter->lock );
+    if ( limiter->num_waiting == 0 && limiter_admissible( limiter, class ) ) 
+    {
+        limiter_grant( limiter, slot );
+        pthread_mutex_unlock( &limiter->lock );
+        return LIMITER_SLOT_GRANTED;
+    }
+
+    // Deadlines are given on the monotonic clock
+    pthread_condattr_init( &attr );
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+    pthread_cond_init( &slot->cond, &attr );
+    pthread_condattr_destroy( &attr );
+    until.tv_sec  = deadline / 1000000;
+    until.tv_nsec = ( deadline % 1000000 ) * 1000;
+
+    limiter_enqueue( limiter, slot );
+    limiter_dispatch( limiter );
+    if ( slot->state == LIMITER_SLOT_WAITING && class < LIMITER_CLASS_PREFETCH ) 
+    {
+        limiter_preempt( limiter );
+    }
+
+    while( slot->state == LIMITER_SLOT_WAITING ) 
+    {
+        if ( deadline == 0 ) 
+        {
+            pthread_cond_wait( &slot->cond, &limiter->lock );
+        }
+        else if ( pthread_cond_timedwait( &slot->cond, &limiter->lock, &until ) == ETIMEDOUT 
+               && slot->state == LIMITER_SLOT_WAITING ) 
+        {
+            limiter_dequeue( limiter, slot );
+            slot->state = LIMITER_SLOT_TIMEOUT;
+        }
+    }
+    pthread_mutex_unlock( &limiter->lock );
+    pthread_cond_destroy( &slot->cond );
+
+    return slot->state;
+}
+
+/**
+ * Take a place in the window if one is free right now
+ *
+ * Requests which are only worth it if there is spare capacity, like hedged
+ * duplicates, use this instead of limiter_acquire. TRUE is returned if a
+ * place has been taken.
+ */
+int limiter_try_acquire( limiter_t* limiter, limiter_slot_t* slot, int class ) 
+{
+    int acquired = 0;
+
+    slot->class = class;
+
+    pthread_mutex_lock( &limiter->lock );
+    if ( limiter->num_waiting == 0 && limiter_admissible( limiter, class ) ) 
+    {
+        limiter_grant( limiter, slot );
+        acquired = 1;
+    }
+    pthread_mutex_unlock( &limiter->lock );
+
+    return acquired;
+}
+
+/**
+ * Report the outcome of a request started at start and finished at end and
+ * free its place in the window
+ *
+ * Latency is the time the request waited for the first byte of the
+ * response. The place is handed to the next waiting request right away.
+ */
+void limiter_release( limiter_t* limiter, limiter_slot_t* slot, uint64_t start, uint64_t end, uint64_t latency, int outcome ) 
+{
+    double factor = 1.0;
+
+    pthread_mutex_lock( &limiter->lock );
+    ( slot->prev != NULL ) ? ( slot->prev->next = slot->next ) : ( limiter->running = slot->next );
+    ( slot->next != NULL ) ? ( slot->next->prev = slot->prev ) : NULL;
+    --limiter->in_flight;
+    --limiter->class_in_flight[slot->class];
+    ( slot->preempted ) ? --limiter->preempting : 0;
+
+    if ( outcome == LIMITER_DROPPED ) 
+    {
+        factor = LIMITER_BACKOFF;
+    }
+    else if ( outcome == LIMITER_SUCCESS ) 
+    {
+        if ( limiter->long_latency == 0 ) 
+        {
+            limiter->short_latency = limiter->long_latency = latency;
+        }
+        limiter->short_latency += ( latency - limiter->short_latency ) * LIMITER_SHORT_WEIGHT;
+        limiter->long_latency  += ( latency - limiter->long_latency ) * LIMITER_LONG_WEIGHT;
+
+        if ( limiter->tolerance > 0 && limiter->short_latency > limiter->long_latency * limiter->tolerance ) 
+        {
+            factor = LIMITER_LATENCY_BACKOFF;
+        }
+        else if ( limiter->in_flight + 1 >= limiter->limit / 2 ) 
+        {
+            // Only grow a window which is actually used. Otherwise an idle
+            // period would allow an arbitrarily large burst afterwards.
+            limiter->limit += 1.0 / limiter->limit;
+            limiter->limit  = ( limiter->limit > limiter->max_limit ) ? limiter->max_limit : limiter->limit;
+        }
+    }
+
+    if ( factor < 1.0 && start >= limiter->last_decrease ) 
+    {
+        limiter->limit *= factor;
+        limiter->limit  = ( limiter->limit < limiter->min_limit ) ? limiter->min_limit : limiter->limit;
+        limiter->last_decrease = end;
+        ++limiter->decreases;
+    }
+
+    limiter_dispatch( limiter );
+    pthread_mutex_unlock( &limiter->lock );
+}
+
+/**
+ * Cancel all waiting and running requests of the given class
+ *
+ * Waiting requests return LIMITER_SLOT_CANCELLED from limiter_acquire.
+ * Running ones are flagged as cancelled and are expected to stop soon.
+ */
+void limiter_cancel( limiter_t* limiter, int class ) 
+{
+    limiter_slot_t* cur = NULL;
+
+    pthread_mutex_lock( &limiter->lock );
+    while( limiter->flows[class] != NULL ) 
+    {
+        cur = limiter->flows[class]->head;
+        limiter_dequeue( limiter, cur );
+        cur->state = LIMITER_SLOT_CANCELLED;
+        pthread_cond_signal( &cur->cond );
+    }
+
+    for( cur = limiter->running; cur != NULL; cur = cur->next ) 
+    {
+        if ( cur->class == class ) 
+        {
+            cur->cancelled = 1;
+        }
+    }
+    pthread_mutex_unlock( &limiter->lock );
+}
+
+/**
+ * Current size of the window
+ */
+int limiter_limit( limiter_t* limiter ) 
+{
+    int limit = 0;
+
+    pthread_mutex_lock( &limiter->lock );
+    limit = (int)limiter->limit;
+    pthread_mutex_unlock( &limiter->lock );
+
+    return limit;
+}
@@ -0,0 +1,174 @@
+#ifndef LIMITER_H
+#define LIMITER_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * Outcome of a request reported to the limiter
+ *
+ * Success grows the window. Dropped requests, which have been throttled by
+ * the server or timed out, shrink it. Ignored outcomes, like cancelled
+ * requests or errors not related to the load, do not change it.
+ */
+#define LIMITER_SUCCESS 0
+#define LIMITER_DROPPED 1
+#define LIMITER_IGNORED 2
+
+/**
+ * Factors the window is multiplied with upon a dropped request and upon a
+ * latency increase beyond the tolerance.
+ */
+#define LIMITER_BACKOFF         0.7
+#define LIMITER_LATENCY_BACKOFF 0.9
+
+/**
+ * Priority classes of requests, from the most to the least important one
+ *
+ * Every class has a reserved share of the window, which it gets before any
+ * lower class is served. Beyond that free places are given to the waiting
+ * requests of the highest class. Requests of the background classes starting
+ * with LIMITER_CLASS_PREFETCH together never use more than
+ * LIMITER_BACKGROUND_SHARE of the window. They may be preempted, if a
+ * foreground request is waiting and their class uses more than its reserved
+ * share.
+ */
+#define LIMITER_CLASS_METADATA 0
+#define LIMITER_CLASS_DATA     1
+#define LIMITER_CLASS_PREFETCH 2
+#define LIMITER_CLASS_UPLOAD   3
+#define LIMITER_CLASSES        4
+
+#define LIMITER_BACKGROUND_SHARE 0.75
+
+/**
+ * Amount of cost credited to a flow in every round of the fair queue
+ *
+ * The cost of a request is the number of bytes it is expected to transfer.
+ */
+#define LIMITER_QUANTUM 65536
+
+/**
+ * States of a place in the window requested using limiter_acquire
+ */
+#define LIMITER_SLOT_WAITING   0
+#define LIMITER_SLOT_GRANTED   1
+#define LIMITER_SLOT_TIMEOUT   2
+#define LIMITER_SLOT_CANCELLED 3
+
+/**
+ * Place in the window of a limiter held or waited for by one request
+ *
+ * The structure is owned by the request. Cancelled is set while the request
+ * is running if it has been preempted or cancelled. The request should stop
+ * as soon as possible and release its place afterwards. Preempted tells both
+ * reasons apart.
+ *
+ * Flow identifies the caller the request is issued for. Waiting requests of
+ * the same class are served fairly between the flows according to their
+ * cost.
+ */
+typedef struct limiter_slot
+{
+    int class;
+    int state;
+    unsigned long flow;
+    uint64_t cost;
+    volatile int cancelled;
+    int preempted;
+    pthread_cond_t cond;
+    struct limiter_flow* queue;
+    struct limiter_slot* prev;
+    struct limiter_slot* next;
+} limiter_slot_t;
+
+/**
+ * Waiting requests of one flow in one priority class
+ *
+ * The deficit is the cost the flow may still issue in the current round of
+ * the fair queue.
+ */
+typedef struct limiter_flow
+{
+    unsigned long key;
+    int64_t deficit;
+    limiter_slot_t* head;
+    limiter_slot_t* tail;
+    struct limiter_flow* next;
+} limiter_flow_t;
+
+/**
+ * Adaptive limit of the concurrently issued requests to one endpoint
+ *
+ * The window is adjusted using additive increase and multiplicative
+ * decrease. Every fully used window of successful requests grows it by one.
+ * A throttled or timed out request shrinks it by LIMITER_BACKOFF. A short
+ * term average latency exceeding the long term one by the given tolerance
+ * indicates queueing on the server and shrinks it by LIMITER_LATENCY_BACKOFF.
+ * The latency is the time until the first byte of a response arrived, so it
+ * does not depend on the size of the response.
+ * Only requests started after the last decrease may shrink the window again,
+ * so one overload event is answered by a single decrease.
+ *
+ * Waiting requests are queued per priority class and flow. The flows of a
+ * class are served using deficit round robin, so every caller gets an equal
+ * share of the bytes transferred, regardless of the number and size of its
+ * requests. The first flow of a class is the one currently served. Running
+ * requests are kept in a list with the most recently started one first.
+ *
+ * All times are given in microseconds of the monotonic clock.
+ */
+typedef struct limiter
+{
+    char* endpoint;
+    double limit;
+    int min_limit;
+    int max_limit;
+    int in_flight;
+    int class_in_flight[LIMITER_CLASSES];
+    int num_waiting;
+    int class_waiting[LIMITER_CLASSES];
+    int preempting;
+    double tolerance;
+    double short_latency;
+    double long_latency;
+    uint64_t last_decrease;
+    unsigned long decreases;
+    unsigned long preemptions;
+    limiter_flow_t* flows[LIMITER_CLASSES];
+    limiter_slot_t* running;
+    pthread_mutex_t lock;
+    struct limiter* next;
+} limiter_t;
+
+limiter_t* limiter_new( const char* endpoint, int initial, int min_limit, int max_limit, double tolerance );
+void limiter_free( limiter_t* limiter );
+int limiter_acquire( limiter_t* limiter, limiter_slot_t* slot, int class, unsigned long flow, uint64_t cost, uint64_t deadline );
+int limiter_try_acquire( limiter_t* limiter, limiter_slot_t* slot, int class );
+void limiter_release( limiter_t* limiter, limiter_slot_t* slot, uint64_t start, uint64_t end, uint64_t latency, int outcome );
+void limiter_cancel( limiter_t* limiter, int class );
+int limiter_limit( limiter_t* limiter );
+
+#endif
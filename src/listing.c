@@ -0,0 +1,187 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "salloc.h"
+#include "mosso.h"
+#include "listing.h"
+
+static int listing_fetch_page( mosso_connection_t* mosso, listing_t* listing, int index );
+
+/**
+ * Create a new empty listing for the given directory path
+ *
+ * No request is issued before the first page is loaded using
+ * listing_load_page.
+ */
+listing_t* listing_new( const char* path ) 
+{
+    listing_t* listing = snew( listing_t );
+
+    pthread_mutex_init( &listing->lock, NULL );
+    listing->path            = strdup( path );
+    listing->markers         = snewlen( char*, 1 );
+    listing->markers[0]      = NULL;
+    listing->num_markers     = 1;
+    listing->complete        = FALSE;
+    listing->num_pages       = 0;
+    listing->page_index      = -1;
+    listing->page_count      = 0;
+    listing->page            = NULL;
+    listing->page0_count     = -1;
+    listing->prefetched_page = -1;
+
+    return listing;
+}
+
+/**
+ * Free a listing including the currently loaded page and all markers
+ */
+void listing_free( listing_t* listing ) 
+{
+    int i = 0;
+
+    for( i = 0; i < listing->num_markers; ++i ) 
+    {
+        ( listing->markers[i] != NULL ) ? free( listing->markers[i] ) : NULL;
+    }
+    free( listing->markers );
+    ( listing->page != NULL ) ? mosso_object_free_all( listing->page ) : NULL;
+    pthread_mutex_destroy( &listing->lock );
+    free( listing->path );
+    free( listing );
+}
+
+/**
+ * Retrieve the page with the given index from mosso, replacing the currently
+ * loaded one.
+ *
+ * The marker of the requested page needs to be known already.
+ */
+static int listing_fetch_page( mosso_connection_t* mosso, listing_t* listing, int index ) 
+{
+    int count = 0;
+    mosso_object_t* page = mosso_list_objects_page( mosso, listing->path, listing->markers[index], &count );
+
+    if ( page == NULL && mosso_error() != MOSSO_ERROR_NOCONTENT ) 
+    {
+        return FALSE;
+    }
+
+    ( listing->page != NULL ) ? mosso_object_free_all( listing->page ) : NULL;
+    listing->page       = page;
+    listing->page_index = index;
+    listing->page_count = count;
+
+    // Remember the marker of the following page or the end of the listing
+    if ( count < MOSSO_LIST_PAGE_SIZE ) 
+    {
+        listing->complete  = TRUE;
+        listing->num_pages = index + 1;
+    }
+    else if ( index + 1 == listing->num_markers ) 
+    {
+        listing->markers = (char**)srealloc( listing->markers, sizeof( char* ) * ( listing->num_markers + 1 ) );
+        listing->markers[listing->num_markers++] = strdup( mosso_object_marker( page ) );
+    }
+
+    // Fingerprint the first page to detect changes of the directory
+    if ( index == 0 ) 
+    {
+        mosso_object_t* cur = NULL;
+        unsigned long hash = 5381;
+        for( cur = ( page != NULL ) ? page->root : NULL; cur != NULL; cur = cur->next ) 
+        {
+            char* c = NULL;
+            for( c = cur->name; *c != 0; ++c ) 
+            {
+                hash = hash * 33 + (unsigned char)*c;
+            }
+            hash = hash * 33 + '/';
+        }
+        listing->page0_hash  = hash;
+        listing->page0_count = count;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Make the page with the given index the currently loaded one
+ *
+ * If the marker for the requested page is not known yet, all pages in between
+ * are retrieved one after another. Requesting the page currently loaded does
+ * not issue any request.
+ *
+ * FALSE is returned if a request failed. The error information of the mosso
+ * layer is set accordingly in this case. If the requested page lies behind
+ * the end of the listing TRUE is returned and the loaded page is empty.
+ */
+int listing_load_page( mosso_connection_t* mosso, listing_t* listing, int index ) 
+{
+    if ( listing->page_index == index ) 
+    {
+        return TRUE;
+    }
+
+    if ( listing->complete && index >= listing->num_pages ) 
+    {
+        ( listing->page != NULL ) ? mosso_object_free_all( listing->page ) : NULL;
+        listing->page       = NULL;
+        listing->page_index = index;
+        listing->page_count = 0;
+        return TRUE;
+    }
+
+    // Walk forward until the marker of the requested page is known
+    while( index >= listing->num_markers ) 
+    {
+        if ( !listing_fetch_page( mosso, listing, listing->num_markers - 1 ) ) 
+        {
+            return FALSE;
+        }
+
+        if ( listing->complete ) 
+        {
+            return listing_load_page( mosso, listing, index );
+        }
+    }
+
+    return listing_fetch_page( mosso, listing, index );
+}
+
+/**
+ * Check whether two listings of the same path describe the same directory
+ * state.
+ *
+ * Only the first page is compared, as it is the only one reliably retrieved
+ * by every listing.
+ */
+int listing_equal( listing_t* a, listing_t* b ) 
+{
+    return ( a->page0_count >= 0 
+          && a->page0_count == b->page0_count
+          && a->page0_hash == b->page0_hash );
+}
@@ -0,0 +1,69 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+#include <pthread.h>
+
+#include "mosso.h"
+
+/**
+ * Page wise view of a possibly huge directory listing
+ *
+ * Only the currently processed page of objects is kept in memory. For every
+ * page already seen the marker needed to request it again is stored, which
+ * allows to resume the listing at any offset with a single request.
+ *
+ * Markers[i] is the marker needed to request page i. Num_markers is the
+ * number of known markers. Complete is set as soon as the last page has been
+ * seen, in which case num_pages holds the total number of pages.
+ *
+ * Page0_hash and page0_count identify the state of the first page. They are
+ * used to detect changes of the listing between two retrievals.
+ *
+ * Prefetched_page is the index of the last page, whose entries have been
+ * handed to the prefetcher with the full configured depth.
+ *
+ * The lock needs to be held while accessing a listing.
+ */
+typedef struct 
+{
+    pthread_mutex_t lock;
+    char* path;
+    char** markers;
+    int num_markers;
+    int complete;
+    int num_pages;
+    int page_index;
+    int page_count;
+    mosso_object_t* page;
+    unsigned long page0_hash;
+    int page0_count;
+    int prefetched_page;
+} listing_t;
+
+listing_t* listing_new( const char* path );
+void listing_free( listing_t* listing );
+int listing_load_page( mosso_connection_t* mosso, listing_t* listing, int index );
+int listing_equal( listing_t* a, listing_t* b );
+
+#endif
@@ -0,0 +1,309 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "salloc.h"
+#include "logger.h"
+
+int logger_level = LOGGER_OFF;
+
+static const char* logger_level_names[] = { "error", "warning", "info", "debug" };
+
+/**
+ * Buffers of all threads which ever logged a message and the one of the
+ * calling thread
+ *
+ * Buffers are never freed. The list is locked to add a buffer, to hand the
+ * buffer of an exited thread to a new one and while the buffers are written.
+ */
+static logger_ring_t* logger_rings = NULL;
+static pthread_mutex_t logger_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t logger_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t logger_key;
+static __thread logger_ring_t* logger_ring = NULL;
+
+/**
+ * Sink and writer thread of a started logger
+ *
+ * Stopping is set to ask the writer thread to write the remaining messages
+ * and exit.
+ */
+static FILE* logger_sink = NULL;
+static pthread_t logger_thread;
+static pthread_mutex_t logger_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logger_wakeup;
+static int logger_stopping = 0;
+
+static void logger_key_create();
+static void logger_ring_release( void* ring );
+static logger_ring_t* logger_ring_get();
+static void logger_drain();
+static void* logger_main( void* data );
+
+/**
+ * Determine the level of the given name
+ *
+ * "off" is accepted as well. -2 is returned for an unknown name.
+ */
+int logger_parse_level( const char* name ) 
+{
+    int level = 0;
+
+    if ( strcasecmp( name, "off" ) == 0 ) 
+    {
+        return LOGGER_OFF;
+    }
+
+    for( level = LOGGER_ERROR; level <= LOGGER_DEBUG; ++level ) 
+    {
+        if ( strcasecmp( name, logger_level_names[level] ) == 0 ) 
+        {
+            return level;
+        }
+    }
+
+    return -2;
+}
+
+/**
+ * Create the key used to detect exiting threads
+ */
+static void logger_key_create() 
+{
+    pthread_key_create( &logger_key, logger_ring_release );
+}
+
+/**
+ * Mark the buffer of an exiting thread as unused
+ */
+static void logger_ring_release( void* ring ) 
+{
+    pthread_mutex_lock( &logger_rings_lock );
+    ( (logger_ring_t*)ring )->in_use = 0;
+    pthread_mutex_unlock( &logger_rings_lock );
+}
+
+/**
+ * Retrieve the buffer of the calling thread
+ *
+ * Upon the first message of a thread an unused buffer, which has been
+ * written completely, is taken over or a new one is created.
+ */
+static logger_ring_t* logger_ring_get() 
+{
+    logger_ring_t* ring = NULL;
+
+    if ( logger_ring != NULL ) 
+    {
+        return logger_ring;
+    }
+
+    pthread_once( &logger_key_once, logger_key_create );
+
+    pthread_mutex_lock( &logger_rings_lock );
+    for( ring = logger_rings; ring != NULL && ( ring->in_use || ring->head != ring->tail ); ring = ring->next );
+    if ( ring == NULL ) 
+    {
+        ring = snew( logger_ring_t );
+        memset( ring, 0, sizeof( logger_ring_t ) );
+        ring->next   = logger_rings;
+        logger_rings = ring;
+    }
+    ring->in_use = 1;
+    ring->tid    = (pid_t)syscall( SYS_gettid );
+    pthread_mutex_unlock( &logger_rings_lock );
+
+    pthread_setspecific( logger_key, ring );
+    return ( logger_ring = ring );
+}
+
+/**
+ * Add a message to the buffer of the calling thread
+ *
+ * Use the LOG macro instead, which does not evaluate any argument if the
+ * level is disabled. The call never blocks. If the buffer is full the
+ * message is dropped.
+ */
+void logger_write( int level, const char* format, ... ) 
+{
+    logger_ring_t* ring = logger_ring_get();
+    uint64_t head = ring->head;
+    logger_record_t* record = NULL;
+    struct timespec now;
+    va_list args;
+
+    if ( head - __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE ) >= LOGGER_RING_SIZE ) 
+    {
+        __atomic_store_n( &ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED );
+        return;
+    }
+
+    clock_gettime( CLOCK_REALTIME, &now );
+
+    record = &ring->records[head % LOGGER_RING_SIZE];
+    record->time  = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    record->level = level;
+    va_start( args, format );
+    vsnprintf( record->message, LOGGER_MESSAGE_SIZE, format, args );
+    va_end( args );
+
+    // Publish the record only after it has been written completely
+    __atomic_store_n( &ring->head, head + 1, __ATOMIC_RELEASE );
+}
+
+/**
+ * Write all buffered messages to the sink
+ *
+ * Messages are written ordered per thread. Dropped messages are reported.
+ */
+static void logger_drain() 
+{
+    logger_ring_t* ring = NULL;
+
+    pthread_mutex_lock( &logger_rings_lock );
+    for( ring = logger_rings; ring != NULL; ring = ring->next ) 
+    {
+        uint64_t head    = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+        uint64_t tail    = ring->tail;
+        uint64_t dropped = __atomic_load_n( &ring->dropped, __ATOMIC_RELAXED );
+
+        for( ; tail != head; ++tail ) 
+        {
+            logger_record_t* record = &ring->records[tail % LOGGER_RING_SIZE];
+            time_t seconds = (time_t)( record->time / 1000000 );
+            struct tm date;
+            char timestamp[32];
+
+            localtime_r( &seconds, &date );
+            strftime( timestamp, sizeof( timestamp ), "%Y-%m-%d %H:%M:%S", &date );
+            fprintf( logger_sink, "%s.%06u [%d] %s: %s\n", 
+                timestamp, (unsigned int)( record->time % 1000000 ), (int)ring->tid, 
+                logger_level_names[record->level], record->message );
+        }
+        __atomic_store_n( &ring->tail, tail, __ATOMIC_RELEASE );
+
+        if ( dropped != ring->reported ) 
+        {
+            fprintf( logger_sink, "[%d] %llu log messages dropped\n", (int)ring->tid, (unsigned long long)( dropped - ring->reported ) );
+            ring->reported = dropped;
+        }
+    }
+    pthread_mutex_unlock( &logger_rings_lock );
+
+    fflush( logger_sink );
+}
+
+/**
+ * Writer thread draining the buffers every LOGGER_INTERVAL milliseconds
+ */
+static void* logger_main( void* data ) 
+{
+    (void)data;
+
+    pthread_mutex_lock( &logger_lock );
+    while( !logger_stopping ) 
+    {
+        struct timespec until;
+
+        clock_gettime( CLOCK_MONOTONIC, &until );
+        until.tv_nsec += LOGGER_INTERVAL * 1000000L;
+        until.tv_sec  += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait( &logger_wakeup, &logger_lock, &until );
+
+        pthread_mutex_unlock( &logger_lock );
+        logger_drain();
+        pthread_mutex_lock( &logger_lock );
+    }
+    pthread_mutex_unlock( &logger_lock );
+
+    logger_drain();
+    return NULL;
+}
+
+/**
+ * Start writing messages up to the given level to the file at the given path
+ *
+ * The file is appended to. If path is NULL messages are written to stderr.
+ * The logger needs to be started by the process actually running the
+ * filesystem, as the writer thread does not survive a fork. FALSE is
+ * returned if the file could not be opened.
+ */
+int logger_start( int level, const char* path ) 
+{
+    pthread_condattr_t attr;
+
+    if ( level == LOGGER_OFF ) 
+    {
+        return 1;
+    }
+
+    if ( ( logger_sink = ( path != NULL ) ? fopen( path, "a" ) : stderr ) == NULL ) 
+    {
+        fprintf( stderr, "The log file '%s' could not be opened: %s\n", path, strerror( errno ) );
+        return 0;
+    }
+
+    pthread_condattr_init( &attr );
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+    pthread_cond_init( &logger_wakeup, &attr );
+    pthread_condattr_destroy( &attr );
+
+    logger_stopping = 0;
+    pthread_create( &logger_thread, NULL, logger_main, NULL );
+    logger_level = level;
+
+    return 1;
+}
+
+/**
+ * Stop logging and write all remaining messages
+ */
+void logger_stop() 
+{
+    if ( logger_sink == NULL ) 
+    {
+        return;
+    }
+
+    logger_level = LOGGER_OFF;
+
+    pthread_mutex_lock( &logger_lock );
+    logger_stopping = 1;
+    pthread_cond_signal( &logger_wakeup );
+    pthread_mutex_unlock( &logger_lock );
+    pthread_join( logger_thread, NULL );
+
+    pthread_cond_destroy( &logger_wakeup );
+    ( logger_sink != stderr ) ? fclose( logger_sink ) : 0;
+    logger_sink = NULL;
+}
@@ -0,0 +1,97 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Levels of log messages, from the most to the least important one
+ *
+ * Messages are written if their level is not larger than the level the
+ * logger has been started with. LOGGER_OFF disables logging completely.
+ */
+#define LOGGER_OFF     -1
+#define LOGGER_ERROR   0
+#define LOGGER_WARNING 1
+#define LOGGER_INFO    2
+#define LOGGER_DEBUG   3
+
+/**
+ * Number of messages buffered per thread and maximal length of a message
+ *
+ * Messages not fitting into the buffer of their thread anymore are dropped
+ * and counted. Longer messages are truncated.
+ */
+#define LOGGER_RING_SIZE    256
+#define LOGGER_MESSAGE_SIZE 240
+
+/**
+ * Interval in milliseconds the buffers are written to the sink in
+ */
+#define LOGGER_INTERVAL 50
+
+typedef struct 
+{
+    uint64_t time;
+    int level;
+    char message[LOGGER_MESSAGE_SIZE];
+} logger_record_t;
+
+/**
+ * Buffer of the messages logged by one thread
+ *
+ * Only the owning thread writes records and advances head. Only the writer
+ * thread of the logger reads records and advances tail. Therefore no locks
+ * are needed. The buffer of an exited thread is handed to the next new
+ * thread.
+ */
+typedef struct logger_ring
+{
+    logger_record_t records[LOGGER_RING_SIZE];
+    uint64_t head;
+    uint64_t tail;
+    uint64_t dropped;
+    uint64_t reported;
+    pid_t tid;
+    int in_use;
+    struct logger_ring* next;
+} logger_ring_t;
+
+/**
+ * Level messages are currently written up to
+ *
+ * It is checked by LOG before any argument is evaluated, so disabled log
+ * messages cost a single comparison.
+ */
+extern int logger_level;
+
+#define LOG( level, ... ) \
+    ( __builtin_expect( (level) <= logger_level, 0 ) ? logger_write( level, __VA_ARGS__ ) : (void)0 )
+
+int logger_parse_level( const char* name );
+int logger_start( int level, const char* path );
+void logger_stop();
+void logger_write( int level, const char* format, ... ) __attribute__(( format( printf, 2, 3 ) ));
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "salloc.h"
+#include "metrics.h"
+
+/**
+ * Names of the filesystem operations and mosso requests used as labels
+ */
+static const char* metrics_op_names[METRICS_OPS] = { 
+    "getattr", "readdir", "open", "read", "release", "getxattr", "setxattr", "listxattr" 
+};
+static const char* metrics_request_names[METRICS_REQUESTS] = { 
+    "auth", "list", "meta", "read", "create", "delete" 
+};
+
+/**
+ * Name and description of the plain counters
+ */
+static const char* metrics_counter_names[METRICS_COUNTERS][2] = { 
+    { "mossofs_cache_hits_total", "Lookups answered by the cache." },
+    { "mossofs_cache_misses_total", "Lookups not answered by the cache." },
+    { "mossofs_received_bytes_total", "Bytes received from mosso." },
+    { "mossofs_sent_bytes_total", "Bytes sent to mosso." },
+    { "mossofs_read_bytes_total", "Bytes returned by read operations." },
+    { "mossofs_cache_rejected_total", "Objects not admitted to the full cache." },
+    { "mossofs_data_cache_hits_total", "Blocks read from the data cache." },
+    { "mossofs_data_cache_misses_total", "Blocks not found in the data cache." },
+    { "mossofs_data_cache_bypassed_total", "Blocks of streaming reads not added to the data cache." }
+};
+
+/**
+ * Quantiles exported for every histogram
+ */
+static const double metrics_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+/**
+ * All shards ever created and the shard of the calling thread
+ *
+ * Shards are never freed. The list is only locked to add a shard or to hand
+ * the shard of an exited thread to a new one.
+ */
+static metrics_shard_t* metrics_shards = NULL;
+static pthread_mutex_t metrics_shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t metrics_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t metrics_key;
+static __thread metrics_shard_t* metrics_shard = NULL;
+
+static void metrics_key_create();
+static void metrics_shard_release( void* shard );
+static metrics_shard_t* metrics_shard_get();
+static inline void metrics_add( uint64_t* target, uint64_t value );
+static int metrics_bucket( uint64_t usec );
+static uint64_t metrics_bucket_limit( int bucket );
+static void metrics_observe( metrics_histogram_t* histogram, uint64_t usec );
+static void metrics_merge( metrics_shard_t* total );
+static void metrics_render_histograms( GString* output, const char* name, const char* help, const char* label, const char** values, metrics_histogram_t* histograms, int count );
+static void metrics_render_errors( GString* output, const char* name, const char* help, const char* label, const char** values, uint64_t* errors, int count );
+
+/**
+ * Current time of the monotonic clock in microseconds
+ */
+uint64_t metrics_now() 
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Create the key used to detect exiting threads
+ */
+static void metrics_key_create() 
+{
+    pthread_key_create( &metrics_key, metrics_shard_release );
+}
+
+/**
+ * Mark the shard of an exiting thread as unused
+ */
+static void metrics_shard_release( void* shard ) 
+{
+    pthread_mutex_lock( &metrics_shards_lock );
+    ( (metrics_shard_t*)shard )->in_use = 0;
+    pthread_mutex_unlock( &metrics_shards_lock );
+}
+
+/**
+ * Retrieve the shard of the calling thread
+ *
+ * Upon the first call of a thread an unused shard is taken over or a new
+ * one is created.
+ */
+static metrics_shard_t* metrics_shard_get() 
+{
+    metrics_shard_t* shard = NULL;
+
+    if ( metrics_shard != NULL ) 
+    {
+        return metrics_shard;
+    }
+
+    pthread_once( &metrics_key_once, metrics_key_create );
+
+    pthread_mutex_lock( &metrics_shards_lock );
+    for( shard = metrics_shards; shard != NULL && shard->in_use; shard = shard->next );
+    if ( shard == NULL ) 
+    {
+        shard = snew( metrics_shard_t );
+        memset( shard, 0, sizeof( metrics_shard_t ) );
+        shard->next    = metrics_shards;
+        metrics_shards = shard;
+    }
+    shard->in_use = 1;
+    pthread_mutex_unlock( &metrics_shards_lock );
+
+    pthread_setspecific( metrics_key, shard );
+    return ( metrics_shard = shard );
+}
+
+/**
+ * Add a value to a field of the shard of the calling thread
+ *
+ * Only the owning thread writes to it. The relaxed atomic accesses ensure
+ * readers never see a torn value.
+ */
+static inline void metrics_add( uint64_t* target, uint64_t value ) 
+{
+    __atomic_store_n( target, __atomic_load_n( target, __ATOMIC_RELAXED ) + value, __ATOMIC_RELAXED );
+}
+
+/**
+ * Determine the histogram bucket of the given latency in microseconds
+ */
+static int metrics_bucket( uint64_t usec ) 
+{
+    int power = 0;
+
+    if ( usec < METRICS_SUB_BUCKETS ) 
+    {
+        return (int)usec;
+    }
+
+    power = 63 - __builtin_clzll( usec );
+    if ( power >= METRICS_MAX_POWER ) 
+    {
+        return METRICS_BUCKETS - 1;
+    }
+
+    return ( power - 2 ) * METRICS_SUB_BUCKETS + (int)( ( usec >> ( power - 3 ) ) & ( METRICS_SUB_BUCKETS - 1 ) );
+}
+
+/**
+ * Smallest latency in microseconds not belonging to the given bucket anymore
+ */
+static uint64_t metrics_bucket_limit( int bucket ) 
+{
+    int power = bucket / METRICS_SUB_BUCKETS + 2;
+
+    if ( bucket < METRICS_SUB_BUCKETS ) 
+    {
+        return bucket + 1;
+    }
+
+    return (uint64_t)( METRICS_SUB_BUCKETS + bucket % METRICS_SUB_BUCKETS + 1 ) << ( power - 3 );
+}
+
+/**
+ * Record a latency in the given histogram of the calling thread
+ */
+static void metrics_observe( metrics_histogram_t* histogram, uint64_t usec ) 
+{
+    metrics_add( &histogram->counts[metrics_bucket( usec )], 1 );
+    metrics_add( &histogram->count, 1 );
+    metrics_add( &histogram->sum, usec );
+}
+
+/**
+ * Increase a plain counter by value
+ */
+void metrics_count( int counter, uint64_t value ) 
+{
+    metrics_add( &metrics_shard_get()->counters[counter], value );
+}
+
+/**
+ * Record a finished filesystem operation started at start
+ *
+ * A negative result is counted as error.
+ */
+void metrics_op( int op, uint64_t start, int result ) 
+{
+    metrics_shard_t* shard = metrics_shard_get();
+
+    metrics_observe( &shard->ops[op], metrics_now() - start );
+    ( result < 0 ) ? metrics_add( &shard->op_errors[op], 1 ) : (void)0;
+}
+
+/**
+ * Record a finished request to mosso started at start
+ *
+ * Requests without any response or with a server error are counted as
+ * errors. Client errors like a 404 are a regular answer to a lookup.
+ */
+void metrics_request( int request, uint64_t start, long response_code ) 
+{
+    metrics_shard_t* shard = metrics_shard_get();
+
+    metrics_observe( &shard->requests[request], metrics_now() - start );
+    ( response_code == 0 || response_code >= 500 ) ? metrics_add( &shard->request_errors[request], 1 ) : (void)0;
+}
+
+/**
+ * Sum up the shards of all threads
+ *
+ * All fields of a shard up to in_use are 64 bit counters, so they are simply
+ * added up as one array.
+ */
+static void metrics_merge( metrics_shard_t* total ) 
+{
+    uint64_t* target = (uint64_t*)total;
+    metrics_shard_t* shard = NULL;
+    size_t fields = offsetof( metrics_shard_t, in_use ) / sizeof( uint64_t );
+    size_t i = 0;
+
+    memset( total, 0, sizeof( metrics_shard_t ) );
+
+    pthread_mutex_lock( &metrics_shards_lock );
+    for( shard = metrics_shards; shard != NULL; shard = shard->next ) 
+    {
+        uint64_t* source = (uint64_t*)shard;
+        for( i = 0; i < fields; ++i ) 
+        {
+            target[i] += __atomic_load_n( &source[i], __ATOMIC_RELAXED );
+        }
+    }
+    pthread_mutex_unlock( &metrics_shards_lock );
+}
+
+/**
+ * Render a family of histograms in the Prometheus text format
+ *
+ * Every value of the given label gets a histogram. Its buckets are reported
+ * at every fourth power of two microseconds. The quantiles are reported as
+ * a separate family of gauges, as they are computed with the full precision
+ * of the histogram.
+ */
+static void metrics_render_histograms( GString* output, const char* name, const char* help, const char* label, const char** values, metrics_histogram_t* histograms, int count ) 
+{
+    int i = 0;
+
+    g_string_append_printf( output, "# HELP %s_seconds %s\n# TYPE %s_seconds histogram\n", name, help, name );
+    for( i = 0; i < count; ++i ) 
+    {
+        uint64_t cumulative = 0;
+        int bucket = 0;
+        int power  = 0;
+
+        for( power = 4; power <= 34; power += 2 ) 
+        {
+            for( ; metrics_bucket_limit( bucket ) <= ( (uint64_t)1 << power ); ++bucket ) 
+            {
+                cumulative += histograms[i].counts[bucket];
+            }
+            g_string_append_printf( output, "%s_seconds_bucket{%s=\"%s\",le=\"%.6f\"} %llu\n", 
+                name, label, values[i], (double)( (uint64_t)1 << power ) / 1000000, (unsigned long long)cumulative );
+        }
+        g_string_append_printf( output, "%s_seconds_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, values[i], (unsigned long long)histograms[i].count );
+        g_string_append_printf( output, "%s_seconds_sum{%s=\"%s\"} %.6f\n", name, label, values[i], (double)histograms[i].sum / 1000000 );
+        g_string_append_printf( output, "%s_seconds_count{%s=\"%s\"} %llu\n", name, label, values[i], (unsigned long long)histograms[i].count );
+    }
+
+    g_string_append_printf( output, "# HELP %s_quantile_seconds Quantiles of %s_seconds.\n# TYPE %s_quantile_seconds gauge\n", name, name, name );
+    for( i = 0; i < count; ++i ) 
+    {
+        size_t q = 0;
+
+        for( q = 0; q < sizeof( metrics_quantiles ) / sizeof( double ); ++q ) 
+        {
+            uint64_t rank = (uint64_t)( metrics_quantiles[q] * histograms[i].count );
+            uint64_t cumulative = 0;
+            int bucket = 0;
+
+            if ( histograms[i].count == 0 ) 
+            {
+                continue;
+            }
+
+            for( bucket = 0; bucket < METRICS_BUCKETS - 1; ++bucket ) 
+            {
+                cumulative += histograms[i].counts[bucket];
+                if ( cumulative > rank ) 
+                {
+                    break;
+                }
+            }
+            g_string_append_printf( output, "%s_quantile_seconds{%s=\"%s\",quantile=\"%g\"} %.6f\n", 
+                name, label, values[i], metrics_quantiles[q], (double)metrics_bucket_limit( bucket ) / 1000000 );
+        }
+    }
+}
+
+/**
+ * Render a family of error counters in the Prometheus text format
+ */
+static void metrics_render_errors( GString* output, const char* name, const char* help, const char* label, const char** values, uint64_t* errors, int count ) 
+{
+    int i = 0;
+
+    g_string_append_printf( output, "# HELP %s %s\n# TYPE %s counter\n", name, help, name );
+    for( i = 0; i < count; ++i ) 
+    {
+        g_string_append_printf( output, "%s{%s=\"%s\"} %llu\n", name, label, values[i], (unsigned long long)errors[i] );
+    }
+}
+
+/**
+ * Append all metrics in the Prometheus text format to the given string
+ */
+void metrics_render( GString* output ) 
+{
+    metrics_shard_t* total = snew( metrics_shard_t );
+    int i = 0;
+
+    metrics_merge( total );
+
+    for( i = 0; i < METRICS_COUNTERS; ++i ) 
+    {
+        g_string_append_printf( output, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", 
+            metrics_counter_names[i][0], metrics_counter_names[i][1], metrics_counter_names[i][0], 
+            metrics_counter_names[i][0], (unsigned long long)total->counters[i] );
+    }
+
+    metrics_render_histograms( output, "mossofs_fuse_op_duration", "Latency of filesystem operations.", "op", metrics_op_names, total->ops, METRICS_OPS );
+    metrics_render_errors( output, "mossofs_fuse_op_errors_total", "Failed filesystem operations.", "op", metrics_op_names, total->op_errors, METRICS_OPS );
+    metrics_render_histograms( output, "mossofs_mosso_request_duration", "Latency of requests to mosso.", "type", metrics_request_names, total->requests, METRICS_REQUESTS );
+    metrics_render_errors( output, "mossofs_mosso_request_errors_total", "Requests to mosso failing without response or with a server error.", "type", metrics_request_names, total->request_errors, METRICS_REQUESTS );
+
+    free( total );
+}
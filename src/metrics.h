@@ -0,0 +1,111 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+#include <stdint.h>
+#include <glib.h>
+
+/**
+ * Filesystem operations timed by metrics_op
+ */
+#define METRICS_OP_GETATTR   0
+#define METRICS_OP_READDIR   1
+#define METRICS_OP_OPEN      2
+#define METRICS_OP_READ      3
+#define METRICS_OP_RELEASE   4
+#define METRICS_OP_GETXATTR  5
+#define METRICS_OP_SETXATTR  6
+#define METRICS_OP_LISTXATTR 7
+#define METRICS_OPS          8
+
+/**
+ * Kinds of requests to mosso timed by metrics_request
+ */
+#define METRICS_REQUEST_AUTH   0
+#define METRICS_REQUEST_LIST   1
+#define METRICS_REQUEST_META   2
+#define METRICS_REQUEST_READ   3
+#define METRICS_REQUEST_CREATE 4
+#define METRICS_REQUEST_DELETE 5
+#define METRICS_REQUESTS       6
+
+/**
+ * Plain counters increased by metrics_count
+ */
+#define METRICS_CACHE_HITS          0
+#define METRICS_CACHE_MISSES        1
+#define METRICS_BYTES_RECEIVED      2
+#define METRICS_BYTES_SENT          3
+#define METRICS_BYTES_READ          4
+#define METRICS_CACHE_REJECTED      5
+#define METRICS_DATA_CACHE_HITS     6
+#define METRICS_DATA_CACHE_MISSES   7
+#define METRICS_DATA_CACHE_BYPASSED 8
+#define METRICS_COUNTERS            9
+
+/**
+ * Latency histogram with a bounded relative error
+ *
+ * Latencies are recorded in microseconds. Every power of two is split into
+ * METRICS_SUB_BUCKETS linear buckets, so the bucket of a value is at most
+ * 12.5% wide relative to it. Values below METRICS_SUB_BUCKETS get an exact
+ * bucket each. Values of 2^40 microseconds and more, which is about twelve
+ * days, end up in the last bucket.
+ */
+#define METRICS_SUB_BUCKETS 8
+#define METRICS_MAX_POWER   40
+#define METRICS_BUCKETS     ( ( METRICS_MAX_POWER - 2 ) * METRICS_SUB_BUCKETS )
+
+typedef struct 
+{
+    uint64_t counts[METRICS_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+} metrics_histogram_t;
+
+/**
+ * Metrics recorded by one thread
+ *
+ * Every thread writes to a shard of its own, so no locking or atomic read
+ * modify write operations are needed. Readers sum up all shards. The shard
+ * of an exited thread is handed to the next new thread, which continues its
+ * counts.
+ */
+typedef struct metrics_shard
+{
+    uint64_t counters[METRICS_COUNTERS];
+    uint64_t op_errors[METRICS_OPS];
+    uint64_t request_errors[METRICS_REQUESTS];
+    metrics_histogram_t ops[METRICS_OPS];
+    metrics_histogram_t requests[METRICS_REQUESTS];
+    int in_use;
+    struct metrics_shard* next;
+} metrics_shard_t;
+
+uint64_t metrics_now();
+void metrics_count( int counter, uint64_t value );
+void metrics_op( int op, uint64_t start, int result );
+void metrics_request( int request, uint64_t start, long response_code );
+void metrics_render( GString* output );
+
+#endif
@@ -23,49 +23,208 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
-#include <locale.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <glib.h>
 #include <curl/curl.h>
 
 #include "mosso.h"
 #include "simple_curl.h"
 #include "salloc.h"
+#include "simd.h"
+#include "metrics.h"
+#include "span.h"
 
-static char* error_string = NULL;
-static long  error_code = MOSSO_ERROR_OK;
-#define set_error(c, e, ...) (error_code = c, ((error_string != NULL) ? free(error_string) : NULL), (( e != NULL ) ? (asprintf( &error_string, e, ##__VA_ARGS__ ), NULL) : (error_string = NULL) ))
-char* mosso_error_string() { return error_string; }
+/**
+ * Error information is stored per thread, to allow concurrent calls on the
+ * same connection from different threads.
+ */
+#define MOSSO_ERROR_STRING_SIZE 512
+static __thread char error_string[MOSSO_ERROR_STRING_SIZE];
+static __thread long error_code = MOSSO_ERROR_OK;
+#define set_error(c, e, ...) (error_code = c, snprintf( error_string, MOSSO_ERROR_STRING_SIZE, e, ##__VA_ARGS__ ))
+char* mosso_error_string() { return ( error_string[0] != 0 ) ? error_string : NULL; }
 long  mosso_error() { return error_code; }
 
+/**
+ * Issue a request and record its latency and response code as the given
+ * kind of request. Evaluates to the response code.
+ *
+ * The request is traced as span of the calling function working on the
+ * given path, which becomes the parent of the spans of its transfers.
+ */
+#define MOSSO_REQUEST( type, request, path ) \
+    ({ \
+        span_t mosso_request_span; \
+        uint64_t mosso_request_start = metrics_now(); \
+        long mosso_request_code = 0; \
+        span_begin( &mosso_request_span, 1 ); \
+        mosso_request_code = (request); \
+        metrics_request( type, mosso_request_start, mosso_request_code ); \
+        span_end( &mosso_request_span, SPAN_MOSSO, __func__, path, mosso_request_code, 0, NULL ); \
+        mosso_request_code; \
+    })
+
 #define MOSSO_PATH_TYPE_PATH 0
 #define MOSSO_PATH_TYPE_FILE 1
 
+#define MOSSO_HEX_DIGITS "0123456789abcdefABCDEF"
+
+/**
+ * Per thread buffer used to construct request urls without allocation
+ */
+typedef struct 
+{
+    char* ptr;
+    size_t size;
+} mosso_url_buffer_t;
+
+static pthread_key_t url_buffer_key;
+static pthread_once_t url_buffer_once = PTHREAD_ONCE_INIT;
+
 
 static void mosso_authenticate( mosso_connection_t** mosso );
 static mosso_object_t* mosso_create_object_list_from_response_body( mosso_object_t* object, char* response_body, char* path_prefix, int type, int* num );
+static mosso_object_t* mosso_create_object_list_from_json( mosso_object_t* object, char* response_body, char* path_prefix, int* num );
+static char* mosso_json_string( sarena_t* arena, char** cur );
 static mosso_object_t* mosso_object_add( mosso_object_t* object, char* name, char* request_path, int type );
 static char* mosso_construct_request_url( mosso_connection_t* mosso, char* request_path, int type, char* marker );
-static char* mosso_container_from_request_path( char* request_path );
-static mosso_object_meta_t* mosso_object_meta_init();
-static char* mosso_name_from_request_path( char* request_path );
-static inline char* mosso_lowercase( char* s );
+static char* mosso_construct_request_url_from_path( mosso_connection_t* mosso, mosso_path_t* path );
+static size_t mosso_read_object_url( mosso_connection_t* mosso, char* request_url, size_t size, char* buffer, off_t offset );
+static char* mosso_container_from_request_path( sarena_t* arena, char* request_path );
+static mosso_object_meta_t* mosso_object_meta_init( char* request_path );
+static char* mosso_name_from_request_path( sarena_t* arena, char* request_path );
+static inline char* mosso_lowercase( sarena_t* arena, char* s );
+static int mosso_parse_http_date( const char* date, struct tm* tm );
 
 /**
- * Convert a given string to lowercase letters and return a newly allocated one
- * containing the new one.
+ * Table of interned strings shared by all connections
+ */
+static GHashTable* intern_table = NULL;
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Pools all object and tag list entries are taken from
+ */
+static spool_t mosso_object_pool = SPOOL_INITIALIZER( mosso_object_t );
+static spool_t mosso_tag_pool    = SPOOL_INITIALIZER( mosso_tag_t );
+
+/**
+ * Return the interned version of the given string
  *
- * The caller is responsible for freeing the returned string if it is not
- * needed any longer.
+ * Interned strings are stored only once for the whole process and are never
+ * freed. They are used for values like content types and tag keys, which are
+ * repeated across huge numbers of objects, but only have a small number of
+ * distinct values.
+ *
+ * Interned strings may be compared by their address.
+ */
+const char* mosso_intern( const char* s ) 
+{
+    char* interned = NULL;
+
+    pthread_mutex_lock( &intern_lock );
+
+    if ( intern_table == NULL ) 
+    {
+        intern_table = g_hash_table_new( g_str_hash, g_str_equal );
+    }
+
+    if ( ( interned = g_hash_table_lookup( intern_table, s ) ) == NULL ) 
+    {
+        interned = strdup( s );
+        g_hash_table_insert( intern_table, interned, interned );
+    }
+
+    pthread_mutex_unlock( &intern_lock );
+    return interned;
+}
+
+/**
+ * Convert a given string to lowercase letters and return a new one allocated
+ * from the given arena.
  */
-static inline char* mosso_lowercase( char* s )
+static inline char* mosso_lowercase( sarena_t* arena, char* s )
 {
     char* src = NULL;
     char* target = NULL;
-    char* tmp_lowercase = (char*)smalloc( sizeof( char ) * strlen( s ) );
+    char* tmp_lowercase = (char*)sarena_alloc( arena, sizeof( char ) * ( strlen( s ) + 1 ) );
     for( src = s, target = tmp_lowercase; *src!= 0; ++src )
         *(target++) = tolower( *src );
     return tmp_lowercase;
 }
 
+/**
+ * Parse a HTTP date as defined by RFC 1123 into a broken down UTC time.
+ *
+ * Dates are expected in the form "Sun, 06 Nov 1994 08:49:37 GMT". The parser
+ * does not depend on the current locale and does not modify any global state,
+ * therefore it is safe to be used from different threads concurrently.
+ *
+ * FALSE is returned if the given string is not a valid date.
+ */
+static int mosso_parse_http_date( const char* date, struct tm* tm ) 
+{
+    static const char* months = "janfebmaraprmayjunjulaugsepoctnovdec";
+    const char* cur = date;
+    int month = 0;
+
+    memset( tm, 0, sizeof( struct tm ) );
+
+    // Skip the weekday, which is redundant information
+    while( *cur != 0 && *cur != ',' ) { ++cur; }
+    if ( *cur++ != ',' ) 
+    {
+        return FALSE;
+    }
+    while( *cur == ' ' ) { ++cur; }
+
+    // Day of month
+    if ( !isdigit( cur[0] ) || !isdigit( cur[1] ) || cur[2] != ' ' ) 
+    {
+        return FALSE;
+    }
+    tm->tm_mday = ( cur[0] - '0' ) * 10 + ( cur[1] - '0' );
+    cur += 3;
+
+    // Three letter month name
+    for( month = 0; month < 12; ++month ) 
+    {
+        if ( tolower( cur[0] ) == months[month * 3] 
+          && tolower( cur[1] ) == months[month * 3 + 1] 
+          && tolower( cur[2] ) == months[month * 3 + 2] ) 
+        {
+            break;
+        }
+    }
+    if ( month == 12 || cur[3] != ' ' ) 
+    {
+        return FALSE;
+    }
+    tm->tm_mon = month;
+    cur += 4;
+
+    // Four digit year followed by hh:mm:ss
+    if ( !isdigit( cur[0] ) || !isdigit( cur[1] ) || !isdigit( cur[2] ) || !isdigit( cur[3] ) || cur[4] != ' '
+      || !isdigit( cur[5] ) || !isdigit( cur[6] ) || cur[7] != ':'
+      || !isdigit( cur[8] ) || !isdigit( cur[9] ) || cur[10] != ':'
+      || !isdigit( cur[11] ) || !isdigit( cur[12] ) ) 
+    {
+        return FALSE;
+    }
+    tm->tm_year = ( cur[0] - '0' ) * 1000 + ( cur[1] - '0' ) * 100 + ( cur[2] - '0' ) * 10 + ( cur[3] - '0' ) - 1900;
+    tm->tm_hour = ( cur[5] - '0' ) * 10 + ( cur[6] - '0' );
+    tm->tm_min  = ( cur[8] - '0' ) * 10 + ( cur[9] - '0' );
+    tm->tm_sec  = ( cur[11] - '0' ) * 10 + ( cur[12] - '0' );
+
+    if ( tm->tm_mday < 1 || tm->tm_mday > 31 || tm->tm_hour > 23 || tm->tm_min > 59 || tm->tm_sec > 60 ) 
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 /**
  * Authenticate with the mosso service
  *
@@ -77,14 +236,14 @@ static inline char* mosso_lowercase( char* s )
 static void mosso_authenticate( mosso_connection_t** mosso )
 {
     simple_curl_header_t* request_headers  = NULL;
-    char* response_body                    = NULL;
-    simple_curl_header_t* response_headers = NULL;
+    char* response_body                     = NULL;
+    simple_curl_headers_t* response_headers = NULL;
     long response_code = 0L;
 
     request_headers = simple_curl_header_add( request_headers, "X-Auth-User", (*mosso)->username );
     request_headers = simple_curl_header_add( request_headers, "X-Auth-Key", (*mosso)->key );
 
-    if ( ( response_code = simple_curl_request_get( "https://api.mosso.com/auth", &response_body, &response_headers, request_headers ) ) != 204 )
+    if ( ( response_code = MOSSO_REQUEST( METRICS_REQUEST_AUTH, simple_curl_request_get( (*mosso)->auth_url, &response_body, &response_headers, request_headers ), NULL ) ) != 204 )
     {
         // Mosso responded with something different than a 204. This indicates
         // an error.
@@ -97,7 +256,7 @@ static void mosso_authenticate( mosso_connection_t** mosso )
         mosso_cleanup( (*mosso) );
         free( response_body );
         simple_curl_header_free_all( request_headers );
-        simple_curl_header_free_all( response_headers );
+        simple_curl_headers_free( response_headers );
         (*mosso) = NULL;
         return;
     }
@@ -109,14 +268,15 @@ static void mosso_authenticate( mosso_connection_t** mosso )
     free( response_body );
 
     // Fillup the mosso_connection structure with the retrieved informations
-    (*mosso)->storage_token      = strdup( simple_curl_header_get_by_key( response_headers, "X-Storage-Token" ) );
-    (*mosso)->auth_token         = strdup( simple_curl_header_get_by_key( response_headers, "X-Auth-Token" ) );
-    (*mosso)->storage_url        = strdup( simple_curl_header_get_by_key( response_headers, "X-Storage-Url" ) );
-    (*mosso)->cdn_management_url = strdup( simple_curl_header_get_by_key( response_headers, "X-CDN-Management-Url" ) );
+    (*mosso)->storage_token      = strdup( simple_curl_headers_get( response_headers, SIMPLE_CURL_HEADER_X_STORAGE_TOKEN ) );
+    (*mosso)->auth_token         = strdup( simple_curl_headers_get( response_headers, SIMPLE_CURL_HEADER_X_AUTH_TOKEN ) );
+    (*mosso)->storage_url        = strdup( simple_curl_headers_get( response_headers, SIMPLE_CURL_HEADER_X_STORAGE_URL ) );
+    (*mosso)->storage_url_length = strlen( (*mosso)->storage_url );
+    (*mosso)->cdn_management_url = strdup( simple_curl_headers_get( response_headers, SIMPLE_CURL_HEADER_X_CDN_MANAGEMENT_URL ) );
 
     // The required information has been copied. Therefore the retrieved
     // headers are not needed any longer.
-    simple_curl_header_free_all( response_headers );
+    simple_curl_headers_free( response_headers );
 
     // Create a simple_curl header structure to be simply provided for each
     // following mosso call to be correctly authenticated.
@@ -130,11 +290,14 @@ static void mosso_authenticate( mosso_connection_t** mosso )
  * Authentication is automatically done upon calling this function.
  *
  * A valid mosso username as well as a valid API key is needed to fulfill the
- * init request.
+ * init request. The auth_url is the endpoint used for authentication. If it
+ * is NULL MOSSO_AUTH_URL is used. All further requests are sent to the
+ * storage url returned by this endpoint.
  */
-mosso_connection_t* mosso_init( char* username, char* key )
+mosso_connection_t* mosso_init( char* auth_url, char* username, char* key )
 {
     mosso_connection_t* mosso = snew( mosso_connection_t );
+    mosso->auth_url = strdup( ( auth_url != NULL ) ? auth_url : MOSSO_AUTH_URL );
     mosso->username = strdup( username );
     mosso->key      = strdup( key );
     mosso->cache    = NULL;
@@ -153,7 +316,7 @@ mosso_connection_t* mosso_init( char* username, char* key )
 static mosso_object_t* mosso_object_add( mosso_object_t* object, char* name, char* request_path, int type )
 {
     // Initialize a new object entry
-    mosso_object_t* new_object = snew( mosso_object_t );
+    mosso_object_t* new_object = (mosso_object_t*)spool_alloc( &mosso_object_pool );
 
     // Copy the data to it
     new_object->type         = type;
@@ -189,7 +352,7 @@ void mosso_object_free_all( mosso_object_t* object )
         mosso_object_t* next = cur->next;
         (cur->name != NULL)         ? free( cur->name )         : NULL;
         (cur->request_path != NULL) ? free( cur->request_path ) : NULL;
-        free( cur );
+        spool_release( &mosso_object_pool, cur );
         cur = next;
     }
 }
@@ -206,6 +369,9 @@ static mosso_object_t* mosso_create_object_list_from_response_body( mosso_object
 {
     int   num_objects = 0;
     char* cur         = response_body;
+    char* body_end    = response_body + strlen( response_body );
+    sarena_t* arena    = sarena_thread();
+    sarena_mark_t mark = sarena_mark( arena );
 
     while( TRUE )
     {
@@ -213,30 +379,30 @@ static mosso_object_t* mosso_create_object_list_from_response_body( mosso_object
         char* fullname     = NULL;
         char* name         = NULL;
         char* start = cur;
-        char* end   = cur;
+        char* end   = NULL;
 
-        // Find the next newline or null terminator
-        while( *end != '\n' && *end != 0 )  { ++end; }
+        // Find the next newline or the end of the body
+        if ( ( end = (char*)simd_find_byte( cur, body_end - cur, '\n' ) ) == NULL ) 
+        {
+            end = body_end;
+        }
 
-        // Allocate some space for the new name and copy it to the target
-        fullname = (char*)smalloc( sizeof( char ) * ( end - start + 1 ) );
-        memcpy( fullname, start, end - start );
+        // Copy the name to the arena
+        fullname = sarena_strndup( arena, start, end - start );
 
         // Create the needed request path
-        asprintf( &request_path, "%s%s", path_prefix, fullname );
+        request_path = sarena_printf( arena, "%s%s", path_prefix, fullname );
 
         // Isolate the objects name. If a vdir is listed the vdir path is part
         // of the fullname
-        name = mosso_name_from_request_path( fullname );
+        name = mosso_name_from_request_path( arena, fullname );
 
         // Add entry to the list
         object = mosso_object_add( object, name, request_path, type );
         ++num_objects;
 
-        // Free all the temporary created strings
-        free( name );
-        free( fullname );
-        free( request_path );
+        // Release all the temporary created strings at once
+        sarena_reset( arena, mark );
 
         if ( *end == 0 || *(end+1) == 0 ) /* Stop char or next start char is 0 stop here */
         {
@@ -255,212 +421,450 @@ static mosso_object_t* mosso_create_object_list_from_response_body( mosso_object
 }
 
 /**
- * Construct the correct request url from a given request_path and the type of
- * the request.
- *
- * The request path will be correclty escaped to based on the request_path given.
- * The initial slash is never escaped as it is part of the path selectors of the url.
- * The second slash is not escaped as well, as it specifies the seperator
- * between container and container content.
- *
- * If the type is set to MOSSO_PATH_TYPE_PATH and more than two slashes are
- * used the "path" parameter is used to select a virtual subpath.
+ * Decode the json string starting at the quote cur points to
  *
- * The marker parameter set to the escaped version of the given marker string
- * is set if it is not NULL.
+ * The decoded string is allocated from the given arena. Cur is advanced
+ * behind the closing quote. NULL is returned if the string is not terminated.
  */
-static char* mosso_construct_request_url( mosso_connection_t* mosso, char* request_path, int type, char* marker )
+static char* mosso_json_string( sarena_t* arena, char** cur )
 {
-    char* request_url = NULL;
-    // All of the empty strings are allocated on the heap, so they always can
-    // be free no matter if they have been used or not.
-    char* base_url    = smalloc( sizeof( char ) );
-    char* path_url    = smalloc( sizeof( char ) );
-    char* parameters  = smalloc( sizeof( char ) );
-
-    // Set the correct base url
+    char* src = *cur + 1;
+    char* end = src;
+    char* target = NULL;
+    char* decoded = NULL;
+
+    // Find the closing quote to know the maximal decoded length
+    while( *end != '"' ) 
     {
-        free( base_url );
-        base_url = strdup( mosso->storage_url );
+        if ( *end == 0 || ( *end == '\\' && *(++end) == 0 ) ) 
+        {
+            return NULL;
+        }
+        ++end;
     }
 
-    // Construct the correct path for the url
+    target = decoded = (char*)sarena_alloc( arena, end - src + 1 );
+    while( src < end ) 
     {
-        char* encoded_path = smalloc( sizeof( char ) );
-        int   seen_slashes = 0;
-        char* start = request_path;
-        char* end   = request_path;
+        unsigned long codepoint = 0;
 
-        while( (*end) != 0 )
+        if ( *src != '\\' ) 
         {
-            char* tmp          = NULL;
-            char* encoded_part = NULL;
-            // Find the next / or string end
-            while( (*end) != '/' && (*end) != 0 ) { ++end; }
+            *(target++) = *(src++);
+            continue;
+        }
 
-            if ( end != start )
-            {
-                encoded_part = simple_curl_urlencode( start, end - start );
-                tmp = encoded_path;
-                asprintf( &encoded_path, "%s%s", tmp, encoded_part );
+        switch( *(++src) ) 
+        {
+            case 'b': *(target++) = '\b'; break;
+            case 'f': *(target++) = '\f'; break;
+            case 'n': *(target++) = '\n'; break;
+            case 'r': *(target++) = '\r'; break;
+            case 't': *(target++) = '\t'; break;
+            case 'u':
+                if ( end - src < 5 || strspn( src + 1, MOSSO_HEX_DIGITS ) < 4 || sscanf( src + 1, "%4lx", &codepoint ) != 1 ) 
+                {
+                    return NULL;
+                }
+                src += 4;
+                // Combine surrogate pairs into a single codepoint
+                if ( codepoint >= 0xd800 && codepoint < 0xdc00 && end - src >= 7 && src[1] == '\\' && src[2] == 'u' ) 
+                {
+                    unsigned long low = 0;
+                    if ( strspn( src + 3, MOSSO_HEX_DIGITS ) >= 4 && sscanf( src + 3, "%4lx", &low ) == 1 && low >= 0xdc00 && low < 0xe000 ) 
+                    {
+                        codepoint = 0x10000 + ( ( codepoint - 0xd800 ) << 10 ) + ( low - 0xdc00 );
+                        src += 6;
+                    }
+                }
+                // Every escape is at least as long as its utf-8 encoding
+                if ( codepoint < 0x80 ) 
+                {
+                    *(target++) = (char)codepoint;
+                }
+                else if ( codepoint < 0x800 ) 
+                {
+                    *(target++) = (char)( 0xc0 | ( codepoint >> 6 ) );
+                    *(target++) = (char)( 0x80 | ( codepoint & 0x3f ) );
+                }
+                else if ( codepoint < 0x10000 ) 
+                {
+                    *(target++) = (char)( 0xe0 | ( codepoint >> 12 ) );
+                    *(target++) = (char)( 0x80 | ( ( codepoint >> 6 ) & 0x3f ) );
+                    *(target++) = (char)( 0x80 | ( codepoint & 0x3f ) );
+                }
+                else 
+                {
+                    *(target++) = (char)( 0xf0 | ( codepoint >> 18 ) );
+                    *(target++) = (char)( 0x80 | ( ( codepoint >> 12 ) & 0x3f ) );
+                    *(target++) = (char)( 0x80 | ( ( codepoint >> 6 ) & 0x3f ) );
+                    *(target++) = (char)( 0x80 | ( codepoint & 0x3f ) );
+                }
+            break;
+            default:
+                // Quotes, backslashes and slashes stand for themselves
+                *(target++) = *src;
+        }
+        ++src;
+    }
+    *target = 0;
 
-                free( tmp );
-                free( encoded_part );
-            }
+    *cur = end + 1;
+    return decoded;
+}
 
-            // Advance to the next string section or to the end of the string
-            if ( (*end) == 0 )
-            {
-                start = end;
-            }
-            else
+/**
+ * Split a json object listing into a list of object structs.
+ *
+ * Contrary to the plain listing every entry carries its content type. Entries
+ * of type "application/directory" are marked as virtual directories, all
+ * others as objects. Listing entries are flat, therefore nested values are
+ * not supported.
+ *
+ * The data will be appended to the given list of objects. If NULL is provided
+ * a new list will be started. The num parameter is filled with the number of
+ * object entries created.
+ */
+static mosso_object_t* mosso_create_object_list_from_json( mosso_object_t* object, char* response_body, char* path_prefix, int* num )
+{
+    int   num_objects = 0;
+    char* cur         = response_body;
+    sarena_t* arena    = sarena_thread();
+    sarena_mark_t mark = sarena_mark( arena );
+
+    *num = 0;
+
+    while( ( cur = strchr( cur, '{' ) ) != NULL )
+    {
+        char* name         = NULL;
+        char* content_type = NULL;
+
+        ++cur;
+        while( TRUE ) 
+        {
+            char* key = NULL;
+            char* value = NULL;
+
+            cur += strspn( cur, " \t\r\n," );
+            if ( *cur != '"' || ( key = mosso_json_string( arena, &cur ) ) == NULL ) 
             {
-                start = ++end;
+                break;
             }
 
-            // Handle the first slash correctly
-            // The initial slash is only appended if the string does not end
-            // after it.
-            if ( seen_slashes == 0 && (*end) != 0 )
+            cur += strspn( cur, " \t\r\n" );
+            if ( *cur != ':' ) 
             {
-                // Initial slash
-                tmp = encoded_path;
-                asprintf( &encoded_path, "%s/", tmp );
-                free( tmp );
+                break;
             }
-            else if ( seen_slashes == 1 && type == MOSSO_PATH_TYPE_FILE && strlen( start ) != 0 )
+            ++cur;
+            cur += strspn( cur, " \t\r\n" );
+
+            if ( *cur == '"' ) 
             {
-                // We are in file mode and have just entered the file part of
-                // the path.
-                
-                /*
-                 * Unfortunately the mosso service does not handle these
-                 * requests correctly, as they are described in the docs. The
-                 * docs propose that the object name needs to be fully url
-                 * encoded that would include all slashes in it. Unfortunately
-                 * the service only accepts urlencoded names accept for the
-                 * slashes they need to be provided unencoded.
-                 */
-
-                end = start;
-                while ( TRUE ) 
+                if ( ( value = mosso_json_string( arena, &cur ) ) == NULL ) 
                 {
-                    if ( (*end) == '/' || (*end) == 0 ) 
-                    {
-                        encoded_part = simple_curl_urlencode( start, end - start );
-                        tmp = encoded_path;
-                        asprintf( &encoded_path, "%s/%s", tmp, encoded_part );
-                        free( tmp );
-                        free( encoded_part );
-
-                        if ( (*end) != 0 ) 
-                        {
-                            start = ++end;
-                            continue;
-                        }
-                        else 
-                        {
-                            // We have reached the end of the string
-                            break;
-                        }
-                    }
-                    ++end;
+                    break;
+                }
+                if ( strcmp( key, "name" ) == 0 ) 
+                {
+                    name = value;
+                }
+                else if ( strcmp( key, "content_type" ) == 0 ) 
+                {
+                    content_type = value;
                 }
-                break;
-
-                /* Behaviour according to the docs. This is left in here, in
-                 * case mosso decides to get conform to there own documentation
-                 * one day.                
-                encoded_part = simple_curl_urlencode( start, 0 );
-                tmp = encoded_path;
-                asprintf( &encoded_path, "%s/%s", tmp, encoded_part );
-                free( tmp );
-                free( encoded_part );
-                break;
-                */
             }
-
-            if ( seen_slashes == 1 && type == MOSSO_PATH_TYPE_PATH )
+            else 
             {
-                // A path parameter is always appended to ensure a directory
-                // like structure is returned without listing all pseudo
-                // subdirectory information. It is filled with the complete
-                // left over string urlencoded. A preceeding slash is not
-                // appended. In case a container has simply been reguested an
-                // empty path parameter is provided which enables virtualpath
-                // handling on the mosso side.
-                free( parameters );
-                encoded_part = simple_curl_urlencode( start, 0 );
-                asprintf( &parameters, "?path=%s", encoded_part );
-                free( encoded_part );
-                break;
+                // Numbers, booleans and null are not needed
+                cur += strcspn( cur, ",}" );
             }
+        }
+
+        if ( *cur != '}' ) 
+        {
+            // The listing is malformed, keep what has been parsed so far
+            break;
+        }
 
-            // Next section
-            ++seen_slashes;
+        if ( name != NULL ) 
+        {
+            char* request_path = sarena_printf( arena, "%s%s", path_prefix, name );
+            int type = ( content_type != NULL && strcmp( content_type, "application/directory" ) == 0 ) 
+                ? MOSSO_OBJECT_TYPE_VDIR 
+                : MOSSO_OBJECT_TYPE_OBJECT;
+            object = mosso_object_add( object, mosso_name_from_request_path( arena, name ), request_path, type );
+            ++num_objects;
         }
 
-        free( path_url );
-        path_url = encoded_path;
+        sarena_reset( arena, mark );
+    }
+
+    *num = num_objects;
+    return object;
+}
+
+/**
+ * Destructor of the per thread url buffer called upon thread exit
+ */
+static void mosso_url_buffer_free( void* data ) 
+{
+    mosso_url_buffer_t* buffer = (mosso_url_buffer_t*)data;
+    free( buffer->ptr );
+    free( buffer );
+}
+
+/**
+ * Create the key used to store the per thread url buffers
+ */
+static void mosso_url_buffer_key_create() 
+{
+    pthread_key_create( &url_buffer_key, mosso_url_buffer_free );
+}
+
+/**
+ * Return the url buffer of the calling thread, making sure it is able to hold
+ * at least the given number of bytes.
+ *
+ * The buffer is reused by every url construction of the same thread. It
+ * is only reallocated if a longer url than ever before is requested.
+ */
+static char* mosso_url_buffer( size_t size ) 
+{
+    mosso_url_buffer_t* buffer = NULL;
+
+    pthread_once( &url_buffer_once, mosso_url_buffer_key_create );
+
+    if ( ( buffer = pthread_getspecific( url_buffer_key ) ) == NULL ) 
+    {
+        buffer = snew( mosso_url_buffer_t );
+        pthread_setspecific( url_buffer_key, buffer );
+    }
+
+    if ( buffer->size < size ) 
+    {
+        buffer->size = ( size < 256 ) ? 256 : size * 2;
+        buffer->ptr  = (char*)srealloc( buffer->ptr, buffer->size );
+    }
+
+    return buffer->ptr;
+}
+
+/**
+ * Urlencode the path part of a request path into the given target.
+ *
+ * The request path is split into the container and the rest. The container is
+ * always fully encoded. The rest is fully encoded as well if keep_slashes is
+ * FALSE, otherwise the slashes in it are written unencoded.
+ *
+ * The target needs to be able to hold three times the length of the
+ * request path plus one byte. The end of the written string is returned. The
+ * string is not null terminated.
+ *
+ * Rest is set to the part of the request path following the container
+ * separator, which may be an empty string.
+ */
+static char* mosso_encode_container( char* target, char* request_path, char** rest ) 
+{
+    char* start = ( *request_path == '/' ) ? ( request_path + 1 ) : request_path;
+    char* end   = start;
+
+    while( *end != '/' && *end != 0 ) { ++end; }
+
+    // The initial slash is only written if a container follows it.
+    if ( end != start ) 
+    {
+        *(target++) = '/';
+        target += simple_curl_urlencode_to( target, start, end - start );
+    }
+
+    *rest = ( *end == '/' ) ? ( end + 1 ) : end;
+    return target;
+}
+
+/**
+ * Write the encoded object path following the container into target
+ *
+ * Unfortunately the mosso service does not handle these requests correctly,
+ * as they are described in the docs. The docs propose that the object name
+ * needs to be fully url encoded that would include all slashes in it.
+ * Unfortunately the service only accepts urlencoded names accept for the
+ * slashes they need to be provided unencoded.
+ */
+static char* mosso_encode_object_name( char* target, char* name ) 
+{
+    char* start = name;
+    char* end   = name;
+
+    if ( *name == 0 ) 
+    {
+        return target;
     }
 
-    // Create the correct parameters string
+    while( TRUE ) 
     {
-        if ( marker != NULL )
+        if ( *end == '/' || *end == 0 ) 
         {
-            char* encoded_part = simple_curl_urlencode( marker, 0 );
+            *(target++) = '/';
+            target += simple_curl_urlencode_to( target, start, end - start );
 
-            if ( strlen( parameters ) == 0 )
-            {
-                // Arguments list is still empty
-                asprintf( &parameters, "?marker=%s", encoded_part );
-            }
-            else
+            if ( *end == 0 ) 
             {
-                // Arguments list does already contain arguments
-                char* tmp = parameters;
-                asprintf( &parameters, "%s&marker=%s", tmp, encoded_part );
+                break;
             }
-
-            free( encoded_part );
+            start = end + 1;
         }
+        ++end;
+    }
+
+    return target;
+}
+
+/**
+ * Construct the correct request url from a given request_path and the type of
+ * the request.
+ *
+ * The request path will be correclty escaped to based on the request_path given.
+ * The initial slash is never escaped as it is part of the path selectors of the url.
+ * The second slash is not escaped as well, as it specifies the seperator
+ * between container and container content.
+ *
+ * If the type is set to MOSSO_PATH_TYPE_PATH and more than two slashes are
+ * used the "path" parameter is used to select a virtual subpath.
+ *
+ * The marker parameter set to the escaped version of the given marker string
+ * is set if it is not NULL.
+ *
+ * The url is written to a buffer owned by the calling thread in a single pass.
+ * It stays valid until the next url is constructed by the same thread and
+ * must not be freed.
+ */
+static char* mosso_construct_request_url( mosso_connection_t* mosso, char* request_path, int type, char* marker )
+{
+    size_t path_length   = strlen( request_path );
+    size_t marker_length = ( marker != NULL ) ? strlen( marker ) : 0;
+    char* request_url = mosso_url_buffer( 
+        mosso->storage_url_length + ( path_length + marker_length ) * 3 + sizeof( "/?path=&format=json&marker=" ) 
+    );
+    char* cur  = request_url;
+    char* rest = NULL;
+    char* path_start = NULL;
+    int has_parameters = FALSE;
+
+    memcpy( cur, mosso->storage_url, mosso->storage_url_length );
+    cur += mosso->storage_url_length;
+
+    path_start = cur;
+    cur = mosso_encode_container( cur, request_path, &rest );
+
+    if ( type == MOSSO_PATH_TYPE_FILE ) 
+    {
+        cur = mosso_encode_object_name( cur, rest );
+    }
+    else if ( cur != path_start ) 
+    {
+        // A path parameter is always appended to ensure a directory
+        // like structure is returned without listing all pseudo
+        // subdirectory information. It is filled with the complete
+        // left over string urlencoded. A preceeding slash is not
+        // appended. In case a container has simply been reguested an
+        // empty path parameter is provided which enables virtualpath
+        // handling on the mosso side. The json format is requested, as
+        // only it reports the content type of every entry.
+        memcpy( cur, "?path=", 6 );
+        cur += 6;
+        cur += simple_curl_urlencode_to( cur, rest, strlen( rest ) );
+        memcpy( cur, "&format=json", 12 );
+        cur += 12;
+        has_parameters = TRUE;
+    }
+
+    if ( marker != NULL ) 
+    {
+        *(cur++) = ( has_parameters ) ? '&' : '?';
+        memcpy( cur, "marker=", 7 );
+        cur += 7;
+        cur += simple_curl_urlencode_to( cur, marker, marker_length );
     }
 
-    asprintf( &request_url, "%s%s%s", base_url, path_url, parameters );
-    free( base_url );
-    free( path_url );
-    free( parameters );
+    *cur = 0;
+    return request_url;
+}
+
+/**
+ * Parse a request path into a reusable form
+ *
+ * The encoded url path of the object is created once. Requests using the
+ * returned structure do not need to allocate or encode anything to construct
+ * their url.
+ *
+ * The caller needs to free the returned structure using mosso_path_free.
+ */
+mosso_path_t* mosso_path_new( char* request_path ) 
+{
+    mosso_path_t* path = snew( mosso_path_t );
+    char* rest = NULL;
+    char* end  = NULL;
+
+    path->request_path = strdup( request_path );
+    path->encoded      = (char*)smalloc( strlen( request_path ) * 3 + 2 );
+
+    end = mosso_encode_container( path->encoded, request_path, &rest );
+    end = mosso_encode_object_name( end, rest );
+    *end = 0;
+
+    path->encoded_length = end - path->encoded;
+    return path;
+}
+
+/**
+ * Free a parsed request path
+ */
+void mosso_path_free( mosso_path_t* path ) 
+{
+    free( path->request_path );
+    free( path->encoded );
+    free( path );
+}
+
+/**
+ * Construct the file request url of a parsed request path
+ *
+ * This is the allocation free equivalent to calling
+ * mosso_construct_request_url with MOSSO_PATH_TYPE_FILE and no marker. The
+ * same buffer rules apply to the returned string.
+ */
+static char* mosso_construct_request_url_from_path( mosso_connection_t* mosso, mosso_path_t* path ) 
+{
+    char* request_url = mosso_url_buffer( mosso->storage_url_length + path->encoded_length + 1 );
+    memcpy( request_url, mosso->storage_url, mosso->storage_url_length );
+    memcpy( request_url + mosso->storage_url_length, path->encoded, path->encoded_length + 1 );
     return request_url;
 }
 
 /**
  * Isolate the container name from a given full request path and return it.
  *
- * The caller needs to free the returned string if it is not needed any longer.
+ * The returned string is allocated from the given arena.
  */
-static char* mosso_container_from_request_path( char* request_path )
+static char* mosso_container_from_request_path( sarena_t* arena, char* request_path )
 {
-    char* container = NULL;
     char* start = request_path + 1; /* skip the initial slash */
     char* end   = request_path + 1;
 
     // Find the next slash or string end
     while( (*end) != '/' && (*end) != 0 ) { ++end; }
 
-    // Allocate the needed memory and copy the string over
-    container = smalloc( sizeof( char ) * ( end - start + 1 ) );
-    memcpy( container, start, end - start );
-    return container;
+    return sarena_strndup( arena, start, end - start );
 }
 
 /**
  * Return the name of an object from a given request path
  *
- * The caller needs to free the returned string if it is not needed any longer.
+ * The returned string is allocated from the given arena.
  */
-static char* mosso_name_from_request_path( char* request_path ) 
+static char* mosso_name_from_request_path( sarena_t* arena, char* request_path ) 
 {    
-    char* name  = NULL;
     char* end   = request_path + strlen( request_path );
     char* start = end;
     
@@ -469,17 +873,25 @@ static char* mosso_name_from_request_path( char* request_path )
     while( *start != '/' && start > request_path ) { --start; };
     
     ( *start == '/' ) ? ( ++start ) : NULL;
-    name = smalloc( sizeof( char ) * ( end - start + 1 ) );
-    memcpy( name, start, end-start ); /* skip the initial slash */
-    return name;
+    return sarena_strndup( arena, start, end - start );
 }
 
 /**
- * Initialize a new object meta structure and return it
+ * Initialize a new object meta structure for the given request path and
+ * return it
  */
-static mosso_object_meta_t* mosso_object_meta_init() 
+static mosso_object_meta_t* mosso_object_meta_init( char* request_path ) 
 {
-    mosso_object_meta_t* meta = snew( mosso_object_meta_t );
+    size_t length = strlen( request_path );
+    mosso_object_meta_t* meta = (mosso_object_meta_t*)smalloc( sizeof( mosso_object_meta_t ) + length + 1 );
+    const char* name = request_path + length;
+
+    memcpy( meta->request_path, request_path, length + 1 );
+
+    // The name is the part after the last slash of the request path
+    while( name > request_path && *( name - 1 ) != '/' ) { --name; }
+    meta->name = meta->request_path + ( name - request_path );
+
     return meta;
 }
 
@@ -490,15 +902,49 @@ void mosso_object_meta_free( mosso_object_meta_t* meta )
 {
     if ( meta != NULL ) 
     {
-        (meta->name != NULL) ? free( meta->name ) : NULL;
-        (meta->request_path != NULL) ? free( meta->request_path ) : NULL;
-        (meta->content_type != NULL) ? free( meta->content_type ) : NULL;
-        (meta->mtime != NULL) ? free( meta->mtime ) : NULL;
+        (meta->raw_tags != NULL) ? free( meta->raw_tags ) : NULL;
         (meta->tag != NULL) ? mosso_tag_free_all( meta->tag ) : NULL;
         free( meta );
     }
 }
 
+/**
+ * Return the list of tags stored with the given meta information
+ *
+ * The tags are parsed from their raw form upon the first call. NULL is
+ * returned if the object does not have any tags. The returned list belongs to
+ * the meta structure and is freed together with it.
+ */
+mosso_tag_t* mosso_object_meta_tags( mosso_object_meta_t* meta ) 
+{
+    mosso_tag_t* tag = NULL;
+    char* cur = meta->raw_tags;
+
+    if ( meta->tag != NULL || meta->raw_tags == NULL ) 
+    {
+        return meta->tag;
+    }
+
+    // The raw tags are stored as a sequence of null terminated key value
+    // pairs, which is terminated by an empty key.
+    while( *cur != 0 ) 
+    {
+        char* key   = cur;
+        char* value = key + strlen( key ) + 1;
+        tag = mosso_tag_add( tag, key, value );
+        cur = value + strlen( value ) + 1;
+    }
+
+    // Another thread may have parsed the tags concurrently. Only one of the
+    // lists is kept.
+    if ( !__sync_bool_compare_and_swap( &meta->tag, NULL, tag ) ) 
+    {
+        mosso_tag_free_all( tag );
+    }
+
+    return meta->tag;
+}
+
 /**
  * Add a new tag to a linked list of tags
  *
@@ -525,14 +971,15 @@ void mosso_object_meta_free( mosso_object_meta_t* meta )
 mosso_tag_t* mosso_tag_add( mosso_tag_t* tag, char* key, char* value ) 
 {
     // Initialize a new tag entry
-    mosso_tag_t* new_tag = snew( mosso_tag_t );
-    
-    // Lowercase the key
-    char* lkey = mosso_lowercase( key );
+    mosso_tag_t* new_tag = (mosso_tag_t*)spool_alloc( &mosso_tag_pool );
+    sarena_t* arena    = sarena_thread();
+    sarena_mark_t mark = sarena_mark( arena );
 
-    // Copy the data to it
-    new_tag->key   = lkey;
+    // Copy the data to it. The lowercased key is shared with all other tags
+    // using it.
+    new_tag->key   = mosso_intern( mosso_lowercase( arena, key ) );
     new_tag->value = strdup( value );
+    sarena_reset( arena, mark );
 
     // Set the root and next accordingly
     new_tag->next = NULL;
@@ -581,7 +1028,9 @@ mosso_tag_t* mosso_tag_replace_or_add( mosso_tag_t* tag, char* key, char* value
     // Check if the key already exists and store the end of the list on our way
     // through it.
     {
-        char* lkey = mosso_lowercase( key );
+        sarena_t* arena    = sarena_thread();
+        sarena_mark_t mark = sarena_mark( arena );
+        char* lkey = mosso_lowercase( arena, key );
 
         mosso_tag_t* cur         = tag->root;
         mosso_tag_t* end         = NULL;
@@ -598,7 +1047,7 @@ mosso_tag_t* mosso_tag_replace_or_add( mosso_tag_t* tag, char* key, char* value
         }
 
         // The lowercased key is not needed any longer
-        free( lkey );
+        sarena_reset( arena, mark );
 
         // If a replacement needs to be done, simply modify the value and
         // return the end of the list
@@ -624,20 +1073,20 @@ mosso_tag_t* mosso_tag_replace_or_add( mosso_tag_t* tag, char* key, char* value
 char* mosso_tag_get_by_key( mosso_tag_t* tag, char* key ) 
 {
     mosso_tag_t* cur = tag->root;
-    
-    char* lkey = mosso_lowercase( key );
+    sarena_t* arena    = sarena_thread();
+    sarena_mark_t mark = sarena_mark( arena );
+    char* lkey = mosso_lowercase( arena, key );
 
     while( cur != NULL ) 
     {
-        if ( strcmp( cur->key, key ) == 0 ) 
+        if ( strcmp( cur->key, lkey ) == 0 ) 
         {
-            free( lkey );
-            return cur->value;
+            break;
         }
         cur = cur->next;
     }
-    free( lkey );
-    return NULL;
+    sarena_reset( arena, mark );
+    return ( cur != NULL ) ? cur->value : NULL;
 }
 
 /**
@@ -651,13 +1100,117 @@ void mosso_tag_free_all( mosso_tag_t* tag )
     while( cur != NULL )
     {
         mosso_tag_t* next = cur->next;
-        (cur->key != NULL) ? free( cur->key ) : NULL;
         (cur->value != NULL ) ? free( cur->value ): NULL;
-        free( cur );
+        spool_release( &mosso_tag_pool, cur );
         cur = next;
     }
 }
 
+/**
+ * Retrieve one page of the object list inside a given container.
+ *
+ * The request_path is handled the same way as by mosso_list_objects. An empty
+ * string requests the list of available containers.
+ *
+ * The listing starts right after the object with the given full name. If the
+ * marker is NULL the first page is returned. mosso_object_marker may be used
+ * to retrieve the marker of the next page from the last object returned.
+ *
+ * Pages contain at most MOSSO_LIST_PAGE_SIZE objects. If a page contains less
+ * objects the listing is complete.
+ *
+ * Count is filled with the number of objects in the page. If the page is empty
+ * NULL is returned, count is set to 0 and the error code is set to
+ * MOSSO_ERROR_NOCONTENT. On any other error NULL is returned and the error
+ * information is set accordingly.
+ */
+mosso_object_t* mosso_list_objects_page( mosso_connection_t* mosso, char* request_path, char* marker, int* count )
+{
+    char* response_body    = NULL;
+    long  response_code    = 0;
+    mosso_object_t* object = NULL;
+    char* request_url      = NULL;
+
+    *count = 0;
+
+    // If no request path is given use an empty one
+    if ( request_path == NULL )
+    {
+        request_path = "";
+    }
+
+    request_url = mosso_construct_request_url( mosso, request_path, MOSSO_PATH_TYPE_PATH, marker );
+
+    if ( ( response_code = MOSSO_REQUEST( METRICS_REQUEST_LIST, simple_curl_request_get( request_url, &response_body, NULL, mosso->auth_headers ), request_path ) ) != 200 )
+    {
+        // Something different than a 200 has been returned this might
+        // indicate an error.
+        switch ( response_code ) 
+        {
+            case 204:
+                set_error( MOSSO_ERROR_NOCONTENT, "No objects found." );
+            break;
+            case 0:
+                set_error( MOSSO_ERROR_TRANSPORT, "The request failed: %s", simple_curl_error() );
+            break;
+            default:
+                set_error( response_code, "Statuscode: %ld, Response body: %s", response_code, response_body );
+        }
+        
+        free( response_body );
+        return NULL;
+    }
+
+    {
+        // Add the objects to the list
+        sarena_t* arena    = sarena_thread();
+        sarena_mark_t mark = sarena_mark( arena );
+        char* prefix       = "/";
+        if ( strlen( request_path ) != 0 && strcmp( request_path, "/" ) != 0 )
+        {
+            // The prefix is a slash followed by the container name followed
+            // by a slash. Container contents are listed in json format.
+            prefix = sarena_printf( arena, "/%s/", mosso_container_from_request_path( arena, request_path ) );
+            object = mosso_create_object_list_from_json( NULL, response_body, prefix, count );
+        }
+        else 
+        {
+            object = mosso_create_object_list_from_response_body( NULL, response_body, prefix, MOSSO_OBJECT_TYPE_CONTAINER, count );
+        }
+        sarena_reset( arena, mark );
+    }
+
+    // Empty json listings are returned as an empty array
+    if ( object == NULL ) 
+    {
+        set_error( MOSSO_ERROR_NOCONTENT, "No objects found." );
+    }
+
+    free( response_body );
+    return object;
+}
+
+/**
+ * Return the marker needed to continue a listing after the given object.
+ *
+ * Listings are continued based on the full object name inside its container,
+ * which includes the virtual path of the object. The returned string points
+ * into the given object and must not be freed.
+ */
+char* mosso_object_marker( mosso_object_t* object ) 
+{
+    char* marker = object->request_path;
+
+    if ( object->type == MOSSO_OBJECT_TYPE_CONTAINER ) 
+    {
+        return object->name;
+    }
+
+    // Skip the "/container/" prefix of the request path
+    marker = strchr( marker + 1, '/' );
+    return ( marker == NULL ) ? object->name : marker + 1;
+}
+
 /**
  * Retrieve a list of objects inside a given container.
  *
@@ -669,7 +1222,9 @@ void mosso_tag_free_all( mosso_tag_t* tag )
  * Given paths deeper than one level, will be automatically translated into a
  * virtual path request.
  *
- * The returned object will be a linked list of objects.
+ * The returned object will be a linked list of objects. All pages of the
+ * listing are retrieved before this function returns. Use
+ * mosso_list_objects_page to process huge listings page by page.
  *
  * If count is a value different to NULL it will be filled with the number of
  * objects retrieved.
@@ -679,83 +1234,54 @@ void mosso_tag_free_all( mosso_tag_t* tag )
  */
 mosso_object_t* mosso_list_objects( mosso_connection_t* mosso, char* request_path, int* count )
 {
-    char* response_body    = NULL;
-    int   response_code    = 0;
     mosso_object_t* object = NULL;
     int   num_objects      = 0;
     int   object_count     = 0;
 
-    // If no request path is given use an empty one
-    if ( request_path == NULL )
-    {
-        request_path = "";
-    }
-
     while( TRUE )
     {
-        char* request_url = NULL;
-
-        if ( object == NULL )
-        {
-            // Initial request no marker needed
-            request_url = mosso_construct_request_url( mosso, request_path, MOSSO_PATH_TYPE_PATH, NULL );
-        }
-        else
-        {
-            // We have fired a request before, therefore a marker needs to be
-            // appended.
-            request_url = mosso_construct_request_url( mosso, request_path, MOSSO_PATH_TYPE_PATH, object->name );
-        }
+        mosso_object_t* page = mosso_list_objects_page( 
+            mosso, 
+            request_path, 
+            ( object == NULL ) ? NULL : mosso_object_marker( object ), 
+            &num_objects 
+        );
 
-        if ( ( response_code = simple_curl_request_get( request_url, &response_body, NULL, mosso->auth_headers ) ) != 200 )
+        if ( page == NULL ) 
         {
-            // Something different than a 200 has been returned this might
-            // indicate an error.
-            switch ( response_code ) 
+            if ( object != NULL && mosso_error() == MOSSO_ERROR_NOCONTENT ) 
             {
-                case 204:
-                    set_error( MOSSO_ERROR_NOCONTENT, "No objects found." );
+                // The previous page has been the last one
                 break;
-                default:
-                    set_error( response_code, "Statuscode: %ld, Response body: %s", response_code, response_body );
             }
-            
-            free( response_body );
-            free( request_url );
 
+            ( object != NULL ) ? mosso_object_free_all( object ) : NULL;
             if ( count != NULL )
             {
                 *count = 0;
             }
             return NULL;
         }
-        free( request_url );
 
+        // Append the retrieved page to the list
+        if ( object != NULL ) 
         {
-            // Add the objects to the list
-            int type = ( strlen( request_path ) == 0 ) ? MOSSO_OBJECT_TYPE_CONTAINER : MOSSO_OBJECT_TYPE_OBJECT_OR_VDIR;
-            char* prefix    = NULL;
-            if ( strlen( request_path ) == 0 || strcmp( request_path, "/" ) == 0 )
+            mosso_object_t* cur = page->root;
+            object->next = cur;
+            for( ; cur != NULL; cur = cur->next ) 
             {
-                // The prefix is a simple slash
-                asprintf( &prefix, "/" );
+                cur->root = object->root;
             }
-            else
-            {
-                // The prefix is a slash followed by the container name followed by a slash
-                char* container = mosso_container_from_request_path( request_path );
-                asprintf( &prefix, "/%s/", container );
-                free( container );
-            }
-            object = mosso_create_object_list_from_response_body( object, response_body, prefix, type, &num_objects );
-            free( prefix );
+            object = page;
+        }
+        else 
+        {
+            object = page;
         }
-
-        free( response_body );
 
         object_count += num_objects;
 
-        if ( num_objects < 10000 )
+        if ( num_objects < MOSSO_LIST_PAGE_SIZE )
         {
             // Objects are retrieved in chunks of 10000 objects max. Therefore
             // if the retrieved object count is lower than this the transfer is
@@ -809,7 +1335,7 @@ int mosso_create_directory( mosso_connection_t* mosso, char* request_path )
     header = simple_curl_header_add( header, "Content-Length", "0" );
     header = simple_curl_header_add( header, "Content-Type", "application/directory" );
     
-    if ( ( response_code = simple_curl_request_put( request_url, NULL, NULL, NULL, header ) ) != 201 ) 
+    if ( ( response_code = MOSSO_REQUEST( METRICS_REQUEST_CREATE, simple_curl_request_put( request_url, NULL, NULL, NULL, header ), request_path ) ) != 201 ) 
     {
         switch( response_code ) 
         {
@@ -821,12 +1347,10 @@ int mosso_create_directory( mosso_connection_t* mosso, char* request_path )
         }
 
         simple_curl_header_free_all( header );
-        free( request_url );
         return FALSE;
     }
     
     simple_curl_header_free_all( header );
-    free( request_url );
     return TRUE;
 }
 
@@ -855,7 +1379,7 @@ int mosso_delete_object( mosso_connection_t* mosso, char* request_path )
     // with a special content type.
     char* request_url = mosso_construct_request_url( mosso, request_path, MOSSO_PATH_TYPE_FILE, NULL );
 
-    if ( ( response_code = simple_curl_request_delete( request_url, NULL, mosso->auth_headers ) ) != 204 ) 
+    if ( ( response_code = MOSSO_REQUEST( METRICS_REQUEST_DELETE, simple_curl_request_delete( request_url, NULL, mosso->auth_headers ), request_path ) ) != 204 ) 
     {
         switch( response_code ) 
         {
@@ -866,36 +1390,51 @@ int mosso_delete_object( mosso_connection_t* mosso, char* request_path )
                     set_error( response_code, "Statuscode: %ld", response_code );
         }
 
-        free( request_url );
         return FALSE;
     }
     
-    free( request_url );
     return TRUE;
 }
 
 /**
- * Isolate all metadata tags available in a list of given simple_curl_headers.
+ * Isolate all metadata tags available in the given response headers.
+ *
+ * The tags are returned in their raw form as a sequence of null terminated
+ * key and value strings, ended by an empty key. They are parsed by
+ * mosso_object_meta_tags on demand.
  *
  * If no tags are defined in the given header information NULL will be
  * returned. This is not considered an error, therefore no error information
  * will be set.
  */
-static mosso_tag_t* mosso_create_tag_list_from_headers( simple_curl_header_t* header ) 
+static char* mosso_create_raw_tags_from_headers( simple_curl_headers_t* headers ) 
 {
-    mosso_tag_t* tag = NULL;
-    simple_curl_header_t* cur = header;
-    while ( cur != NULL ) 
+    char* raw_tags = NULL;
+    size_t length = 0;
+    int i = 0;
+
+    // Tags are never part of the known header table, therefore only the other
+    // fields need to be scanned.
+    for( i = 0; i < headers->num_fields; ++i ) 
     {
+        char* key   = NULL;
+        char* value = NULL;
+        simple_curl_headers_get_field( headers, i, &key, &value );
+
         // Scan for the mosso header indicating a tag
-        if ( strstr( cur->key, "X-Object-Meta-" ) != NULL ) 
+        if ( strncasecmp( key, "X-Object-Meta-", 14 ) == 0 ) 
         {
-            // Found a meta tag. Add it to the list
-            tag = mosso_tag_add( tag, cur->key + 14, cur->value );
+            // Found a meta tag. Append it to the raw data
+            size_t key_length   = strlen( key + 14 ) + 1;
+            size_t value_length = strlen( value ) + 1;
+            raw_tags = (char*)srealloc( raw_tags, length + key_length + value_length + 1 );
+            memcpy( raw_tags + length, key + 14, key_length );
+            memcpy( raw_tags + length + key_length, value, value_length );
+            length += key_length + value_length;
+            raw_tags[length] = 0;
         }
-        cur = cur->next;
     }
-    return tag;
+    return raw_tags;
 }
 
 /**
@@ -910,49 +1449,46 @@ static mosso_tag_t* mosso_create_tag_list_from_headers( simple_curl_header_t* he
 mosso_object_meta_t* mosso_get_object_meta( mosso_connection_t* mosso, char* request_path ) 
 {
     long response_code = 0;
-    simple_curl_header_t* response_header = NULL;
+    simple_curl_headers_t* response_header = NULL;
     char* request_url = mosso_construct_request_url( mosso, request_path, MOSSO_PATH_TYPE_FILE, NULL );
 
-    if ( ( response_code = simple_curl_request_head( request_url, &response_header, mosso->auth_headers ) ) != 204 ) 
+    // Metadata requests are cheap to repeat, therefore a slow one may be
+    // hedged by a duplicate.
+    if ( ( response_code = MOSSO_REQUEST( METRICS_REQUEST_META, simple_curl_request_complex( SIMPLE_CURL_HEAD | SIMPLE_CURL_HEDGE, request_url, NULL, &response_header, NULL, mosso->auth_headers ), request_path ) ) != 204 ) 
     {
         switch( response_code ) 
         {
+            case 0:
+                set_error( MOSSO_ERROR_TRANSPORT, "The request failed: %s", simple_curl_error() );
+            break;
             case 404:
                 set_error( MOSSO_ERROR_NOTFOUND, "The object could not be found." );                
             break;
                 default:
                     set_error( response_code, "Statuscode: %ld", response_code );
         }
-        simple_curl_header_free_all( response_header );
-        free( request_url );
+        simple_curl_headers_free( response_header );
         return NULL;
     }
-    free( request_url );
 
     // Create the new meta object structure based on the retrieved information.
     {
         char* tmp = NULL;
-        mosso_object_meta_t* meta = mosso_object_meta_init();
-
-        meta->name         = mosso_name_from_request_path( request_path );
-        meta->request_path = strdup( request_path );
+        mosso_object_meta_t* meta = mosso_object_meta_init( request_path );
 
         // Isolate the content type from the header list. The default in case
         meta->content_type = (
-            ( ( tmp = simple_curl_header_get_by_key( response_header, "Content-Type" ) ) == NULL ) 
-            ? ( strdup( "text/plain" ) ) 
-            : ( strdup( tmp ) ) 
+            ( ( tmp = simple_curl_headers_get( response_header, SIMPLE_CURL_HEADER_CONTENT_TYPE ) ) == NULL ) 
+            ? ( mosso_intern( "text/plain" ) ) 
+            : ( mosso_intern( tmp ) ) 
         );
 
         // Determine the type of the retrieved object meta data 
         {
-            char* container = mosso_container_from_request_path( request_path );
-            char* name      = mosso_name_from_request_path( request_path );
-
-            if ( strcmp( container, name ) == 0 )
+            if ( meta->name == meta->request_path + 1 )
             {
-                // If the container and the name are the same we have looked up
-                // a container.
+                // If the name directly follows the initial slash we have
+                // looked up a container.
                 meta->type = MOSSO_OBJECT_TYPE_CONTAINER;                
             }
             else 
@@ -975,22 +1511,23 @@ mosso_object_meta_t* mosso_get_object_meta( mosso_connection_t* mosso, char* req
         // array of zeros is used, which is created during the meta struct
         // initialization.
         {
-            char* checksum_string = simple_curl_header_get_by_key( response_header, "Etag" );
+            char* checksum_string = simple_curl_headers_get( response_header, SIMPLE_CURL_HEADER_ETAG );
             // If the checksum_string is NULL nothing needs to be done, as the
             // init value for the checksum after meta structure creation is
             // already a zero byte array.
-            if ( checksum_string != NULL ) 
+            if ( checksum_string != NULL && strlen( checksum_string ) >= 32 ) 
             {
                 // Read the provided hex string and create a byte array out of
-                // it.
-                unsigned int md5[16];
+                // it. The bytes are stored in reverse order. An invalid
+                // string leaves the checksum zeroed.
+                unsigned char md5[16];
                 int i = 0;
-                sscanf( checksum_string, "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-                   &md5[15], &md5[14], &md5[13], &md5[12], &md5[11], &md5[10], &md5[9], &md5[8], &md5[7], &md5[6], &md5[5], &md5[4], &md5[3], &md5[2], &md5[1], &md5[0]
-                );                
-                for ( i=0; i<16; ++i ) 
+                if ( simd_hex_decode( md5, checksum_string, 16 ) ) 
                 {
-                    meta->checksum[i] = (char)md5[i];
+                    for ( i=0; i<16; ++i ) 
+                    {
+                        meta->checksum[i] = md5[15 - i];
+                    }
                 }
             }
         }
@@ -1000,13 +1537,17 @@ mosso_object_meta_t* mosso_get_object_meta( mosso_connection_t* mosso, char* req
             if ( meta->type == MOSSO_OBJECT_TYPE_CONTAINER ) 
             {
                 // A container provides its size in a special header
-                meta->size = atoll( simple_curl_header_get_by_key( response_header, "X-Container-Bytes-Used" ) );                
+                meta->size = (  
+                    ( ( tmp = simple_curl_headers_get( response_header, SIMPLE_CURL_HEADER_X_CONTAINER_BYTES_USED ) ) == NULL ) 
+                    ? ( 0 ) 
+                    : ( atoll( tmp ) ) 
+                );
             }
             else 
             {
                 // The Content-Length header is used or 0 if it is not provided.
                 meta->size = (  
-                    ( ( tmp = simple_curl_header_get_by_key( response_header, "Content-Length" ) ) == NULL ) 
+                    ( ( tmp = simple_curl_headers_get( response_header, SIMPLE_CURL_HEADER_CONTENT_LENGTH ) ) == NULL ) 
                     ? ( 0 ) 
                     : ( atoll( tmp ) ) 
                 );
@@ -1017,35 +1558,29 @@ mosso_object_meta_t* mosso_get_object_meta( mosso_connection_t* mosso, char* req
         // the "X-Container-Object-Count" header. If this header is not present
         // 0 will be assumed.
         meta->object_count = (  
-            ( ( tmp = simple_curl_header_get_by_key( response_header, "X-Container-Object-Count" ) ) == NULL ) 
+            ( ( tmp = simple_curl_headers_get( response_header, SIMPLE_CURL_HEADER_X_CONTAINER_OBJECT_COUNT ) ) == NULL ) 
             ? ( 0 ) 
             : ( atoll( tmp ) ) 
         );
 
-        // Try to isolate possibly available tags
-        meta->tag = mosso_create_tag_list_from_headers( response_header );
+        // Try to isolate possibly available tags. They are only parsed
+        // if they are requested.
+        meta->raw_tags = mosso_create_raw_tags_from_headers( response_header );
 
-        // Try to isolate the mtime
+        // Try to isolate the mtime. It is converted to a timestamp right away,
+        // so it does not need to be converted on every stat call.
         {
-            char* mtime = simple_curl_header_get_by_key( response_header, "Last-Modified" );
-            // If it is NULL the associated mtime struct will simply be null in
-            // the meta struct.
-            if( mtime != NULL ) 
+            char* mtime = simple_curl_headers_get( response_header, SIMPLE_CURL_HEADER_LAST_MODIFIED );
+            struct tm tm;
+            // If it is NULL the associated mtime will simply be 0 in the meta
+            // struct.
+            if( mtime != NULL && mosso_parse_http_date( mtime, &tm ) ) 
             {
-                char* old_locale = setlocale( LC_TIME, NULL );
-                setlocale( LC_TIME, "en_US" );
-                meta->mtime = snew( struct tm );
-                if ( strptime( mtime, "%a, %d %b %Y %H:%M:%S %Z", meta->mtime ) == 0 ) 
-                {
-                    setlocale( LC_TIME, old_locale );
-                    free( meta->mtime );
-                    meta->mtime = NULL;
-                }
-                setlocale( LC_TIME, old_locale );
+                meta->mtime = timegm( &tm );
             }
         }
 
-        simple_curl_header_free_all( response_header );
+        simple_curl_headers_free( response_header );
         return meta;
     }
     
@@ -1083,50 +1618,91 @@ size_t mosso_read_object( mosso_connection_t* mosso, char* request_path, size_t
         return 0;
     }
 
+    return mosso_read_object_url( 
+        mosso, 
+        mosso_construct_request_url( mosso, request_path, MOSSO_PATH_TYPE_FILE, NULL ), 
+        size, 
+        buffer, 
+        offset 
+    );
+}
+
+/**
+ * Read a given amount of bytes from a mosso object identified by a parsed
+ * request path.
+ *
+ * This function behaves exactly like mosso_read_object, but does not need to
+ * construct the request url from scratch. It should be used if the same
+ * object is read multiple times.
+ */
+size_t mosso_read_object_path( mosso_connection_t* mosso, mosso_path_t* path, size_t size, char* buffer, off_t offset ) 
+{
+    if ( size == 0 ) 
+    {
+        return 0;
+    }
+
+    return mosso_read_object_url( 
+        mosso, 
+        mosso_construct_request_url_from_path( mosso, path ), 
+        size, 
+        buffer, 
+        offset 
+    );
+}
+
+/**
+ * Issue the range request needed by the mosso_read_object functions using an
+ * already constructed request url.
+ */
+static size_t mosso_read_object_url( mosso_connection_t* mosso, char* request_url, size_t size, char* buffer, off_t offset ) 
+{
     char* response_body = NULL;
     long response_code  = 0;
-    simple_curl_header_t* response_headers = NULL;
-    simple_curl_header_t* request_headers  = simple_curl_header_copy( mosso->auth_headers );
-    char* request_url = mosso_construct_request_url( mosso, request_path, MOSSO_PATH_TYPE_FILE, NULL );
+    simple_curl_headers_t* response_headers = NULL;
+    sarena_t* arena    = sarena_thread();
+    sarena_mark_t mark = sarena_mark( arena );
+    // The auth headers are extended by the range header for this request
+    // only. Therefore the list is assembled inside the arena.
+    simple_curl_header_t* request_headers = simple_curl_header_copy_to( arena, mosso->auth_headers );
 
     // Construct the needed range header
     {
-        char* range = NULL;
         long  end   = offset + size - 1;
-        asprintf( &range, "bytes=%ld-%ld", (long)offset, (long)end );
-        simple_curl_header_add( request_headers, "Range", range );
-        free( range );
+        simple_curl_header_add_to( arena, request_headers, "Range", sarena_printf( arena, "bytes=%ld-%ld", (long)offset, (long)end ) );
     }
 
     //@TODO: Implement and use a simple_curl function which writes directly to
     //the given buffer instead of allocating space for a new one first.
 
-    if ( ( response_code = simple_curl_request_get( request_url, &response_body, &response_headers, request_headers ) ) != 206 )
+    if ( ( response_code = MOSSO_REQUEST( METRICS_REQUEST_READ, simple_curl_request_complex( SIMPLE_CURL_GET | SIMPLE_CURL_HEDGE | SIMPLE_CURL_DATA, request_url, &response_body, &response_headers, NULL, request_headers ), NULL ) ) != 206 )
     {
         switch( response_code ) 
         {
+            case 0:
+                set_error( MOSSO_ERROR_TRANSPORT, "The request failed: %s", simple_curl_error() );
+            break;
             case 404:
                 set_error( MOSSO_ERROR_NOTFOUND, "The object could not be found." );                
             break;
                 default:
                     set_error( response_code, "Statuscode: %ld", response_code );
         }
-        free( request_url );
-        simple_curl_header_free_all( request_headers );
-        ( response_headers != NULL ) ? simple_curl_header_free_all( response_headers ) : NULL;
+        sarena_reset( arena, mark );
+        simple_curl_headers_free( response_headers );
         ( response_body != NULL )    ? ( free( response_body ) ) : NULL;
         return -1;
     }
-    free( request_url );
-    simple_curl_header_free_all( request_headers );
+    sarena_reset( arena, mark );
 
     // Copy the received data to the provided buffer and return the retrieved
     // data length 
     {
-        uint64_t received_bytes = atoll( simple_curl_header_get_by_key( response_headers, "Content-Length" ) );
+        char* content_length    = simple_curl_headers_get( response_headers, SIMPLE_CURL_HEADER_CONTENT_LENGTH );
+        uint64_t received_bytes = ( content_length == NULL ) ? 0 : atoll( content_length );
         uint64_t bytes_to_copy  = ( received_bytes > size ) ? size : received_bytes;
         memcpy( buffer, response_body, bytes_to_copy );
-        simple_curl_header_free_all( response_headers );
+        simple_curl_headers_free( response_headers );
         free( response_body );
         return bytes_to_copy;
     }
@@ -1139,6 +1715,7 @@ void mosso_cleanup( mosso_connection_t* mosso )
 {
     if ( mosso != NULL )
     {
+        ( mosso->auth_url != NULL )           ? free( mosso->auth_url )                            : NULL;
         ( mosso->username != NULL )           ? free( mosso->username )                            : NULL;
         ( mosso->key != NULL )                ? free( mosso->key )                                 : NULL;
         ( mosso->storage_token != NULL )      ? free( mosso->storage_token )                       : NULL;
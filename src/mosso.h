@@ -31,6 +31,21 @@
 #include "simple_curl.h"
 #include "cache.h"
 
+/*
+ * Thread safety
+ *
+ * Apart from mosso_init and mosso_cleanup all mosso_* functions may be called
+ * concurrently from any number of threads sharing the same connection, e.g.
+ * from the worker threads of a multithreaded fuse session. The connection is
+ * only read after it has been initialized. No global process state like the
+ * current locale is modified.
+ *
+ * Error information is kept per thread. mosso_error and mosso_error_string
+ * always describe the last failed call issued by the calling thread.
+ *
+ * curl_global_init needs to be called once before any thread uses this API.
+ */
+
 /**
  * Error codes accessible through mosso_get_error() in case something bad happened.
  *
@@ -38,6 +53,10 @@
  * REST interface, therefore they are not simple numbered but have a certain
  * structure.
  */
+/* No response has been received at all, because the connection failed or the
+ * deadline of the request passed.
+ */
+#define MOSSO_ERROR_TRANSPORT 0
 #define MOSSO_ERROR_OK 200
 #define MOSSO_ERROR_CREATED 201
 #define MOSSO_ERROR_ACCEPTED 202
@@ -50,23 +69,35 @@
 #define MOSSO_ERROR_DIRECTORY_NOT_EMPTY 409
 #define MOSSO_ERROR_CHECKSUMMISMATCH 422
 
+/**
+ * Endpoint used for authentication if no other one is given
+ */
+#define MOSSO_AUTH_URL "https://api.mosso.com/auth"
+
 /**
  * Data structure to transport all mosso cloudspace connection related data
  * between different function calls.
  */
 typedef struct
 {
+    char* auth_url;
     char* username;
     char* key;
     char* storage_token;
     char* auth_token;
     char* storage_url;
+    size_t storage_url_length;
     char* cdn_management_url;
     simple_curl_header_t* auth_headers;
     cache_t* cache;
 } mosso_connection_t;
 
 
+/**
+ * Maximum number of objects returned by mosso for one listing request
+ */
+#define MOSSO_LIST_PAGE_SIZE 10000
+
 #define MOSSO_OBJECT_TYPE_CONTAINER      0
 #define MOSSO_OBJECT_TYPE_OBJECT_OR_VDIR 1
 #define MOSSO_OBJECT_TYPE_OBJECT         2
@@ -90,12 +121,29 @@ typedef struct mosso_object
 } mosso_object_t;
  
 
+/**
+ * Request path parsed into a form allowing the construction of request urls
+ * without any allocation.
+ *
+ * Encoded holds the urlencoded path part of the object url, which is appended
+ * to the storage url of the connection.
+ */
+typedef struct 
+{
+    char* request_path;
+    char* encoded;
+    size_t encoded_length;
+} mosso_path_t;
+
 /**
  * Structure holding information about a tag associated with any mosso object.
+ *
+ * The key is an interned string, which is shared between all tags using the
+ * same key and never freed.
  */
 typedef struct mosso_tag 
 {
-    char* key;
+    const char* key;
     char* value;
     struct mosso_tag* next;
     struct mosso_tag* root;
@@ -103,24 +151,36 @@ typedef struct mosso_tag
 
 /**
  * Structure representing meta data stored for a given object
+ *
+ * The structure and its request path are allocated as one block. The name
+ * points into the request path. The content type is an interned string,
+ * which must not be freed.
+ *
+ * The mtime is 0 if it is unknown.
+ *
+ * Tags are stored in their raw form as received from mosso and only parsed
+ * into a tag list upon the first call to mosso_object_meta_tags.
  */
 typedef struct 
 {
-    char* name;
-    char* request_path;
+    const char* name;
     int type;
-    char* content_type;
+    const char* content_type;
     unsigned char checksum[16];
-    struct tm* mtime;
+    time_t mtime;
     uint64_t size;    
     uint64_t object_count;
+    char* raw_tags;
     mosso_tag_t* tag;
+    char request_path[];
 } mosso_object_meta_t;
 
 
-mosso_connection_t* mosso_init( char* username, char* key );
+mosso_connection_t* mosso_init( char* auth_url, char* username, char* key );
 void mosso_object_free_all( mosso_object_t* object );
 mosso_object_t* mosso_list_objects( mosso_connection_t* mosso, char* request_path, int* count );
+mosso_object_t* mosso_list_objects_page( mosso_connection_t* mosso, char* request_path, char* marker, int* count );
+char* mosso_object_marker( mosso_object_t* object );
 int mosso_create_directory( mosso_connection_t* mosso, char* request_path ); 
 void mosso_cleanup( mosso_connection_t* mosso );
 mosso_tag_t* mosso_tag_add( mosso_tag_t* tag, char* key, char* value ); 
@@ -129,7 +189,12 @@ void mosso_tag_free_all( mosso_tag_t* tag );
 char* mosso_tag_get_by_key( mosso_tag_t* tag, char* key );
 mosso_object_meta_t* mosso_get_object_meta( mosso_connection_t* mosso, char* request_path ); 
 size_t mosso_read_object( mosso_connection_t* mosso, char* request_path, size_t size, char* buffer, off_t offset ); 
+size_t mosso_read_object_path( mosso_connection_t* mosso, mosso_path_t* path, size_t size, char* buffer, off_t offset ); 
+mosso_path_t* mosso_path_new( char* request_path );
+void mosso_path_free( mosso_path_t* path );
 void mosso_object_meta_free( mosso_object_meta_t* meta );
+mosso_tag_t* mosso_object_meta_tags( mosso_object_meta_t* meta );
+const char* mosso_intern( const char* s );
 
 char* mosso_error_string();
 long mosso_error();
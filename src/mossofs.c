@@ -27,10 +27,23 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <signal.h>
+#include <semaphore.h>
+#include <syslog.h>
+#include <sys/xattr.h>
 
 #include "salloc.h"
 #include "mosso.h"
 #include "cache.h"
+#include "datacache.h"
+#include "listing.h"
+#include "prefetch.h"
+#include "metrics.h"
+#include "logger.h"
+#include "span.h"
+#include "slowlog.h"
+#include "optrace.h"
 
 /**
  * Option structure used to store and transport the initially read fuse options
@@ -39,10 +52,44 @@ typedef struct
 {
     char* username;
     char* apikey;
+    char* auth_url;
     uid_t uid;
     gid_t gid;
+    long ttl;
+    long ttl_min;
+    long ttl_max;
+    char* container_ttl;
+    int prefetch_threads;
+    int prefetch_depth;
+    int prefetch_queue;
+    char* warm;
+    char* fair_share;
+    int fair_share_key;
+    char* uid_bandwidth;
+    unsigned long download_rate;
+    unsigned long upload_rate;
+    char* log;
+    int log_level;
+    char* log_file;
+    unsigned int trace;
+    unsigned long slow_request;
+    unsigned int slow_requests;
+    char* record;
+    unsigned long cache_entries;
+    unsigned long data_cache;
+    unsigned long data_block;
+    char* data_policy;
+    int data_policy_id;
+    simple_curl_options_t curl;
 } mossofs_options_t;
 
+/**
+ * Keys the capacity of the backend is shared fairly between
+ */
+#define MOSSOFS_FAIR_SHARE_OFF 0
+#define MOSSOFS_FAIR_SHARE_PID 1
+#define MOSSOFS_FAIR_SHARE_UID 2
+
 /**
  * Filehandle structure used to store informations between different read and
  * write calls.
@@ -52,26 +99,122 @@ typedef struct
  *
  * If the file does not exist upon a call to open the meta member will be set
  * to NULL. Furthermore the is_new flag is set to true.
+ *
+ * The parsed request path is created once upon opening to allow every read
+ * call to construct its request url without any allocation.
+ *
+ * Files of the control directory are rendered once upon opening. Content
+ * holds the result, meta and path are NULL for them.
+ *
+ * Key identifies the opened version of the file in the data cache. Next
+ * offset is the end of the last read and sequential the number of bytes read
+ * in a row up to it. Last block is the index of the block the last read
+ * ended in. Reads split into pieces of one block count as a single access
+ * of it. All three are updated without locking, as concurrent reads of one
+ * handle merely blur the detection of streaming reads.
  */
 typedef struct
 {
     int is_new;
     mosso_object_meta_t* meta; 
+    mosso_path_t* path;
+    GString* content;
+    uint64_t key;
+    off_t next_offset;
+    uint64_t sequential;
+    uint64_t last_block;
 } mossofs_filehandle_t;
 
+/**
+ * Number of bytes a handle needs to have read sequentially, before further
+ * reads of it are treated as streaming
+ *
+ * Blocks read by streaming reads are only added to the data cache, if they
+ * are read frequently, so a single scan over all files does not displace
+ * the working set.
+ */
+#define MOSSOFS_STREAMING 1048576
+
 /**
  * Global pointer to a mosso option structure
  */
 static mossofs_options_t* mossofs_options = NULL;
 
+/**
+ * Global pointer to the background prefetcher. NULL if prefetching is
+ * disabled.
+ */
+static prefetch_t* mossofs_prefetch = NULL;
+
+/**
+ * Global pointer to the cache of file data. NULL if it is disabled.
+ */
+static datacache_t* mossofs_data_cache = NULL;
+
+/**
+ * Thread writing the slow request log upon SIGUSR1
+ *
+ * The signal handler may only use async signal safe functions, therefore it
+ * merely wakes this thread.
+ */
+static pthread_t mossofs_dump_thread;
+static sem_t mossofs_dump_request;
+static volatile int mossofs_dump_stopping = 0;
+
 #define MOSSOFS_OPT( x, y, z ) {x, offsetof( mossofs_options_t, y ), z }
 
+/**
+ * Map the error of the last failed mosso call issued by this thread for the
+ * given path to a negative errno value
+ *
+ * Only a 404 means the object does not exist. Timeouts, connection problems
+ * and server errors are reported as I/O errors, so a slow or failing backend
+ * is not mistaken for a missing file. They are logged as warning.
+ */
+static inline int mossofs_errno( const char* path )
+{
+    if ( mosso_error() == MOSSO_ERROR_NOTFOUND ) 
+    {
+        return -ENOENT;
+    }
+
+    LOG( LOGGER_WARNING, "%s: %s", path, mosso_error_string() );
+    return -EIO;
+}
+
+/**
+ * Issue all following requests of this thread on behalf of the process
+ * calling the current operation
+ *
+ * Depending on the fair_share option requests are shared fairly between
+ * calling processes, users or not at all. The uid is always passed on to
+ * apply its bandwidth cap.
+ */
+static inline void mossofs_set_caller( struct fuse_context* context )
+{
+    unsigned long flow = 0;
+
+    switch( mossofs_options->fair_share_key ) 
+    {
+        case MOSSOFS_FAIR_SHARE_PID:
+            flow = (unsigned long)context->pid;
+        break;
+        case MOSSOFS_FAIR_SHARE_UID:
+            flow = (unsigned long)context->uid;
+        break;
+    }
+
+    simple_curl_set_caller( flow, context->uid );
+}
+
 /**
  * Retrieve the stored mosso_connection_t object from the current fuse_context
+ *
+ * The caller of the operation is registered for the issued requests as well.
  */
 #define MOSSO_CONNECTION(m) \
     mosso_connection_t* m = NULL; \
-    { struct fuse_context* context = fuse_get_context(); m = (mosso_connection_t*)context->private_data;};
+    { struct fuse_context* context = fuse_get_context(); m = (mosso_connection_t*)context->private_data; mossofs_set_caller( context );};
 
 /**
  * Retrieve the filehandle stored in a fuse_file_info structure
@@ -81,9 +224,32 @@ static inline mossofs_filehandle_t* get_mossofs_filehandle( struct fuse_file_inf
     return ( mossofs_filehandle_t* ) ( uintptr_t ) fi->fh;
 }
 
-#define INIT_DEBUGLOG debuglog = fopen( "debug.log", "a" )
-#define DEBUGLOG(s, ...) fprintf( debuglog, s, ##__VA_ARGS__ ); fflush( debuglog )
-FILE* debuglog = NULL;
+/**
+ * Hidden directory exposing the internal state of the filesystem
+ *
+ * It is not listed in the root directory and shadows a container of the
+ * same name. Every file is rendered by its function upon opening.
+ */
+#define MOSSOFS_CONTROL_DIRECTORY "/.mossofs"
+
+#define MOSSOFS_CONTROL_NONE      -2
+#define MOSSOFS_CONTROL_ROOT      -1
+
+typedef void (*mossofs_control_render_func)( GString* output );
+
+static void mossofs_render_metrics( GString* output );
+
+static const struct 
+{
+    const char* name;
+    mossofs_control_render_func render;
+} mossofs_control_files[] = {
+    { "metrics", mossofs_render_metrics },
+    { "trace", span_render },
+    { "slow_requests", slowlog_render },
+    { NULL, NULL }
+};
+
 
 /**
  * Called whenever a structure stored in the cache needs to be freed
@@ -97,10 +263,201 @@ static void mossofs_cache_object_free( char* prefix, char* identifier, void* ptr
     {
         mosso_object_meta_free( (mosso_object_meta_t*)ptr );
     }
-    else if( strcmp( prefix, "objects" ) == 0 ) 
+    else if( strcmp( prefix, "listing" ) == 0 ) 
+    {
+        listing_free( (listing_t*)ptr );
+    }
+}
+
+/**
+ * Called whenever a cached structure is replaced by a freshly retrieved one
+ *
+ * Returns TRUE if both structures describe the same state of the remote
+ * object. This is used by the cache to adapt the lifetime of each entry to
+ * its observed change rate.
+ */
+static int mossofs_cache_object_equal( char* prefix, char* identifier, void* a, void* b ) 
+{
+    (void)identifier;
+
+    if ( strcmp( prefix, "meta" ) == 0 ) 
+    {
+        mosso_object_meta_t* old_meta = (mosso_object_meta_t*)a;
+        mosso_object_meta_t* new_meta = (mosso_object_meta_t*)b;
+
+        if ( old_meta->type != new_meta->type
+          || old_meta->size != new_meta->size
+          || old_meta->object_count != new_meta->object_count
+          || old_meta->mtime != new_meta->mtime
+          || memcmp( old_meta->checksum, new_meta->checksum, 16 ) != 0 ) 
+        {
+            return FALSE;
+        }
+
+        return TRUE;
+    }
+    else if( strcmp( prefix, "listing" ) == 0 ) 
+    {
+        return listing_equal( (listing_t*)a, (listing_t*)b );
+    }
+
+    return FALSE;
+}
+
+/**
+ * Apply the per container ttl overrides given as mount option
+ *
+ * The option string has the form "container=seconds:container=seconds".
+ * Invalid entries are reported and skipped.
+ */
+static void mossofs_apply_container_ttl( cache_t* cache, char* container_ttl ) 
+{
+    char* list  = strdup( container_ttl );
+    char* entry = NULL;
+    char* saveptr = NULL;
+
+    for( entry = strtok_r( list, ":", &saveptr ); entry != NULL; entry = strtok_r( NULL, ":", &saveptr ) ) 
+    {
+        char* separator = strrchr( entry, '=' );
+        if ( separator == NULL || separator == entry || *(separator + 1) == 0 ) 
+        {
+            fprintf( stderr, "Ignoring invalid container_ttl entry '%s'\n", entry );
+            continue;
+        }
+
+        *separator = 0;
+        cache_set_ttl_override( cache, entry, atol( separator + 1 ) );
+    }
+
+    free( list );
+}
+
+/**
+ * Apply the per user bandwidth caps given as mount option
+ *
+ * The option string has the form "uid=bytes:uid=bytes", the rate being
+ * given in bytes per second. Invalid entries are reported and skipped.
+ */
+static void mossofs_apply_uid_bandwidth( char* uid_bandwidth ) 
+{
+    char* list  = strdup( uid_bandwidth );
+    char* entry = NULL;
+    char* saveptr = NULL;
+
+    for( entry = strtok_r( list, ":", &saveptr ); entry != NULL; entry = strtok_r( NULL, ":", &saveptr ) ) 
+    {
+        unsigned int uid   = 0;
+        unsigned long rate = 0;
+
+        if ( sscanf( entry, "%u=%lu", &uid, &rate ) != 2 ) 
+        {
+            fprintf( stderr, "Ignoring invalid uid_bandwidth entry '%s'\n", entry );
+            continue;
+        }
+
+        simple_curl_set_bandwidth_cap( uid, rate );
+    }
+
+    free( list );
+}
+
+/**
+ * Queue the containers given as warm mount option for prefetching
+ *
+ * The option string has the form "container:container".
+ */
+static void mossofs_warm_containers( prefetch_t* prefetch, char* warm ) 
+{
+    char* list  = strdup( warm );
+    char* entry = NULL;
+    char* saveptr = NULL;
+
+    for( entry = strtok_r( list, ":", &saveptr ); entry != NULL; entry = strtok_r( NULL, ":", &saveptr ) ) 
+    {
+        char* path = NULL;
+        asprintf( &path, "/%s", entry );
+        prefetch_directory( prefetch, path, mossofs_options->prefetch_depth );
+        free( path );
+    }
+
+    free( list );
+}
+
+/**
+ * Write all recorded slow requests
+ *
+ * They are written to the log independent of its level. If logging is
+ * disabled they are sent to syslog instead, as stderr is not available
+ * once the filesystem runs in the background.
+ */
+static void mossofs_dump_slow_requests() 
+{
+    GString* output = g_string_new( NULL );
+    int use_syslog = ( logger_level == LOGGER_OFF );
+    char* line = NULL;
+    char* next = NULL;
+
+    slowlog_render( output );
+
+    if ( use_syslog ) 
+    {
+        openlog( "mossofs", LOG_PID, LOG_DAEMON );
+        syslog( LOG_NOTICE, "Slow requests:" );
+    }
+    else 
     {
-        mosso_object_free_all( (mosso_object_t*)ptr );
+        logger_write( LOGGER_WARNING, "Slow requests:" );
     }
+
+    for( line = output->str; line != NULL && *line != 0; line = next ) 
+    {
+        // The last line may not be terminated
+        if ( ( next = strchr( line, '\n' ) ) != NULL ) 
+        {
+            *next++ = 0;
+        }
+        ( use_syslog ) ? syslog( LOG_NOTICE, "%s", line ) : logger_write( LOGGER_WARNING, "%s", line );
+    }
+
+    if ( use_syslog ) 
+    {
+        closelog();
+    }
+    g_string_free( output, TRUE );
+}
+
+/**
+ * Wake the dump thread upon SIGUSR1
+ */
+static void mossofs_signal_dump( int signal ) 
+{
+    (void)signal;
+
+    sem_post( &mossofs_dump_request );
+}
+
+/**
+ * Dump thread waiting for SIGUSR1 until the filesystem is destroyed
+ */
+static void* mossofs_dump_main( void* data ) 
+{
+    (void)data;
+
+    while( 1 ) 
+    {
+        // Interrupted waits are simply repeated
+        if ( sem_wait( &mossofs_dump_request ) != 0 ) 
+        {
+            continue;
+        }
+        if ( mossofs_dump_stopping ) 
+        {
+            break;
+        }
+        mossofs_dump_slow_requests();
+    }
+
+    return NULL;
 }
 
 /**
@@ -116,10 +473,36 @@ static void* mossofs_init( struct fuse_conn_info *conn )
 {
     mosso_connection_t* mosso = NULL;
 
+    // The writer thread of the logger needs to be started after fuse forked
+    // into the background.
+    logger_start( mossofs_options->log_level, mossofs_options->log_file );
+    span_start( mossofs_options->trace );
+
+    if ( mossofs_options->record != NULL && !optrace_start( mossofs_options->record ) ) 
+    {
+        LOG( LOGGER_ERROR, "Operations are not recorded" );
+    }
+
+    // Record slow requests and write them upon SIGUSR1
+    slowlog_start( mossofs_options->slow_requests, mossofs_options->slow_request );
+    if ( slowlog_threshold != 0 ) 
+    {
+        struct sigaction action;
+
+        sem_init( &mossofs_dump_request, 0, 0 );
+        pthread_create( &mossofs_dump_thread, NULL, mossofs_dump_main, NULL );
+
+        memset( &action, 0, sizeof( struct sigaction ) );
+        action.sa_handler = mossofs_signal_dump;
+        action.sa_flags   = SA_RESTART;
+        sigemptyset( &action.sa_mask );
+        sigaction( SIGUSR1, &action, NULL );
+    }
+
     // Initialize the cURL library enabling SSL support
     curl_global_init( CURL_GLOBAL_SSL );
 
-    if ( ( mosso = mosso_init( mossofs_options->username, mossofs_options->apikey ) ) == NULL )
+    if ( ( mosso = mosso_init( mossofs_options->auth_url, mossofs_options->username, mossofs_options->apikey ) ) == NULL )
     {
         printf( "The connection to Mosso Cloudspace could not be established: %s\n", mosso_error_string() );
         free( mossofs_options->username );
@@ -129,8 +512,43 @@ static void* mossofs_init( struct fuse_conn_info *conn )
         exit( 2 );
     }
 
-    // Initialize new cache with 5 minutes timeout
-    mosso->cache = cache_new( 300, mossofs_cache_object_free );
+    // Initialize the new cache. Every entry starts with the configured ttl,
+    // which is adapted between the given boundaries based on how often the
+    // remote data changes.
+    mosso->cache = cache_new( mossofs_options->ttl, mossofs_cache_object_free );
+    cache_set_adaptive_ttl( mosso->cache, mossofs_options->ttl_min, mossofs_options->ttl_max, mossofs_cache_object_equal );
+
+    if ( mossofs_options->container_ttl != NULL ) 
+    {
+        mossofs_apply_container_ttl( mosso->cache, mossofs_options->container_ttl );
+    }
+
+    // Bounding the cache protects frequently used entries from scans
+    if ( mossofs_options->cache_entries > 0 ) 
+    {
+        cache_set_limit( mosso->cache, mossofs_options->cache_entries );
+    }
+
+    if ( mossofs_options->data_cache > 0 ) 
+    {
+        mossofs_data_cache = datacache_new( 
+            mossofs_options->data_policy_id, 
+            (uint64_t)mossofs_options->data_cache * 1048576, 
+            mossofs_options->data_block * 1024
+        );
+    }
+
+    // Start the background prefetcher, which warms the cache with the
+    // subdirectories of every listed directory.
+    if ( mossofs_options->prefetch_threads > 0 ) 
+    {
+        mossofs_prefetch = prefetch_new( mosso, mossofs_options->prefetch_threads, mossofs_options->prefetch_queue );
+
+        if ( mossofs_options->warm != NULL ) 
+        {
+            mossofs_warm_containers( mossofs_prefetch, mossofs_options->warm );
+        }
+    }
 
     // Return the connection to embed it into every fuse context.
     return mosso;
@@ -144,14 +562,128 @@ static void* mossofs_init( struct fuse_conn_info *conn )
  */
 static void mossofs_destroy( void* mosso ) 
 {
+    // The prefetcher needs to be stopped before the connection it uses is
+    // destroyed
+    ( mossofs_prefetch != NULL ) ? prefetch_free( mossofs_prefetch ) : NULL;
+
     // This one frees the allocated cache structure as well
     mosso_cleanup( ( mosso_connection_t* )mosso );    
+    ( mossofs_data_cache != NULL ) ? datacache_free( mossofs_data_cache ) : NULL;
     curl_global_cleanup();
+    span_stop();
+    optrace_stop();
+
+    if ( slowlog_threshold != 0 ) 
+    {
+        signal( SIGUSR1, SIG_IGN );
+        mossofs_dump_stopping = 1;
+        sem_post( &mossofs_dump_request );
+        pthread_join( mossofs_dump_thread, NULL );
+        sem_destroy( &mossofs_dump_request );
+        slowlog_stop();
+    }
 
     // Free the options struct
     free( mossofs_options->username );
     free( mossofs_options->apikey );
+    ( mossofs_options->container_ttl != NULL ) ? free( mossofs_options->container_ttl ) : NULL;
+    ( mossofs_options->warm != NULL ) ? free( mossofs_options->warm ) : NULL;
+    ( mossofs_options->fair_share != NULL ) ? free( mossofs_options->fair_share ) : NULL;
+    ( mossofs_options->uid_bandwidth != NULL ) ? free( mossofs_options->uid_bandwidth ) : NULL;
+    ( mossofs_options->log != NULL ) ? free( mossofs_options->log ) : NULL;
+    ( mossofs_options->log_file != NULL ) ? free( mossofs_options->log_file ) : NULL;
+    ( mossofs_options->record != NULL ) ? free( mossofs_options->record ) : NULL;
     free( mossofs_options );
+
+    // Write the remaining log messages
+    logger_stop();
+}
+
+/**
+ * Render all metrics in the Prometheus text format
+ *
+ * The request counters of simple_curl and the current bandwidth limits are
+ * appended to the metrics recorded by every thread.
+ */
+static void mossofs_render_metrics( GString* output ) 
+{
+    simple_curl_stats_t stats;
+    unsigned long download = 0;
+    unsigned long upload   = 0;
+    int i = 0;
+    const char* counters[][2] = {
+        { "mossofs_http_requests_total", "Requests issued including all retries and duplicates." },
+        { "mossofs_http_retries_total", "Retries of transient failures." },
+        { "mossofs_http_hedges_total", "Duplicates issued for slow requests." },
+        { "mossofs_http_hedge_wins_total", "Duplicates answering before the original request." },
+        { "mossofs_http_timeouts_total", "Requests failing because of their deadline." },
+        { "mossofs_http_throttled_total", "Transfers rejected by the server because of its load." },
+        { "mossofs_http_preempted_total", "Background transfers stopped in favour of foreground ones." },
+        { "mossofs_http_cancelled_total", "Background transfers cancelled." }
+    };
+    unsigned long values[8];
+
+    simple_curl_get_stats( &stats );
+    simple_curl_get_rate_limit( &download, &upload );
+
+    values[0] = stats.requests;
+    values[1] = stats.retries;
+    values[2] = stats.hedges;
+    values[3] = stats.hedge_wins;
+    values[4] = stats.timeouts;
+    values[5] = stats.throttled;
+    values[6] = stats.preempted;
+    values[7] = stats.cancelled;
+
+    metrics_render( output );
+
+    for( i = 0; i < 8; ++i ) 
+    {
+        g_string_append_printf( output, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", 
+            counters[i][0], counters[i][1], counters[i][0], counters[i][0], values[i] );
+    }
+
+    g_string_append_printf( output, "# HELP mossofs_rate_limit_bytes Bandwidth limit in bytes per second, 0 if unlimited.\n" );
+    g_string_append_printf( output, "# TYPE mossofs_rate_limit_bytes gauge\n" );
+    g_string_append_printf( output, "mossofs_rate_limit_bytes{direction=\"download\"} %lu\n", download );
+    g_string_append_printf( output, "mossofs_rate_limit_bytes{direction=\"upload\"} %lu\n", upload );
+}
+
+/**
+ * Determine which entry of the control directory the given path refers to
+ *
+ * The index of the control file is returned. MOSSOFS_CONTROL_ROOT is
+ * returned for the directory itself and MOSSOFS_CONTROL_NONE for every path
+ * outside of it. Unknown files inside the directory are reported as
+ * MOSSOFS_CONTROL_NONE as well, which makes them not exist.
+ */
+static int mossofs_control_entry( const char* path ) 
+{
+    size_t length = strlen( MOSSOFS_CONTROL_DIRECTORY );
+    int i = 0;
+
+    if ( strncmp( path, MOSSOFS_CONTROL_DIRECTORY, length ) != 0 ) 
+    {
+        return MOSSOFS_CONTROL_NONE;
+    }
+    if ( path[length] == 0 ) 
+    {
+        return MOSSOFS_CONTROL_ROOT;
+    }
+    if ( path[length] != '/' ) 
+    {
+        return MOSSOFS_CONTROL_NONE;
+    }
+
+    for( i = 0; mossofs_control_files[i].name != NULL; ++i ) 
+    {
+        if ( strcmp( path + length + 1, mossofs_control_files[i].name ) == 0 ) 
+        {
+            return i;
+        }
+    }
+
+    return MOSSOFS_CONTROL_NONE;
 }
 
 /**
@@ -161,10 +693,9 @@ static int mossofs_getattr( const char *path, struct stat *stbuf )
 {
     MOSSO_CONNECTION( mosso );
     mosso_object_meta_t* meta = NULL;    
+    int cached = TRUE;
 
-    int id = rand();
-
-    DEBUGLOG( "getattr(%d): %s\n",id, path );
+    LOG( LOGGER_DEBUG, "getattr: %s", path );
 
     // Null the stats buffer
     memset( stbuf, 0, sizeof( struct stat ) );
@@ -181,19 +712,35 @@ static int mossofs_getattr( const char *path, struct stat *stbuf )
         stbuf->st_nlink = 2; /* Link into the dir and link inside the dir (.) */
         return 0;
     }
+
+    // The control directory and its files. The size of the files is not
+    // known before they are rendered, they are read using direct io.
+    switch( mossofs_control_entry( path ) ) 
+    {
+        case MOSSOFS_CONTROL_NONE:
+        break;
+        case MOSSOFS_CONTROL_ROOT:
+            stbuf->st_mode  = S_IFDIR | 0555;
+            stbuf->st_nlink = 2;
+            return 0;
+        default:
+            stbuf->st_mode  = S_IFREG | 0444;
+            stbuf->st_nlink = 1;
+            return 0;
+    }
     
     // Try to retrieve the needed information from the cache
     if ( ( meta = (mosso_object_meta_t*)cache_get_object( mosso->cache, "meta", path ) ) == NULL ) 
     {
-        DEBUGLOG( "Not cached\n" );
+        LOG( LOGGER_DEBUG, "getattr: %s not cached", path );
+        cached = FALSE;
         // Try to retrieve meta information for the given filepath
         if ( ( meta = mosso_get_object_meta( mosso, (char*)path ) ) == NULL ) 
         {
-            // The requested object is not existant
-            return -ENOENT;
+            // The requested object is not existant or could not be
+            // retrieved
+            return mossofs_errno( path );
         }
-        
-        cache_add_object( mosso->cache, "meta", path, meta );
     }
 
 
@@ -203,11 +750,7 @@ static int mossofs_getattr( const char *path, struct stat *stbuf )
         stbuf->st_mode  = S_IFREG | 0444;
         stbuf->st_nlink = 2; /* Link into the dir and link inside the dir (.) */
         stbuf->st_size  = meta->size;
-
-        if ( meta->mtime != NULL ) 
-        {
-            stbuf->st_mtime = mktime( meta->mtime );
-        }
+        stbuf->st_mtime = meta->mtime;
     }
     else 
     {
@@ -221,55 +764,137 @@ static int mossofs_getattr( const char *path, struct stat *stbuf )
         }
 
         // MTime is available for VDIRs but not for containers
-        if ( meta->mtime != NULL ) 
-        {
-            stbuf->st_mtime = mktime( meta->mtime );
-        }
+        stbuf->st_mtime = meta->mtime;
     }   
 
+    // Hand the meta information back to the cache. Freshly retrieved data is
+    // added only after it has been used, as another thread may replace it at
+    // any time afterwards.
+    if ( cached ) 
+    {
+        cache_release_object( mosso->cache, meta );
+    }
+    else 
+    {
+        cache_add_object( mosso->cache, "meta", path, meta );
+    }
+
     /* Everything okey */
     return 0;
 }
 
 /** 
  * Called whenever a directory contents needs to be listed
+ *
+ * The directory is listed page by page using the offset interface of fuse.
+ * Offset 1 and 2 belong to "." and "..". Every object in the listing gets the
+ * offset 3 plus its position inside the listing. Only the page the requested
+ * offset lies in is retrieved, therefore the first entries of even huge
+ * directories are available after a single request. The listing stored in
+ * the cache remembers the markers of all pages seen, so the next call resumes
+ * right where the last one stopped.
  */
 static int mossofs_readdir( const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi ) 
 {
     MOSSO_CONNECTION( mosso );
-    mosso_object_t* objects = NULL;
+    listing_t* listing = NULL;
+    int cached = TRUE;
+    int result = 0;
+    off_t position = ( offset < 3 ) ? 0 : ( offset - 3 );
 
-    DEBUGLOG( "readdir: %s\n", path );
+    LOG( LOGGER_DEBUG, "readdir: %s (%lld)", path, (long long)offset );
 
-    if ( ( objects = cache_get_object( mosso->cache, "objects", (char*)path ) ) == NULL ) 
+    if ( mossofs_control_entry( path ) == MOSSOFS_CONTROL_ROOT ) 
     {
-        DEBUGLOG( "not cached\n" );
-        if ( ( objects = mosso_list_objects( mosso, (char*)path, NULL ) ) == NULL ) 
+        int i = 0;
+
+        filler( buf, ".", NULL, 0 );
+        filler( buf, "..", NULL, 0 );
+        for( i = 0; mossofs_control_files[i].name != NULL; ++i ) 
         {
-            DEBUGLOG( "  path does not exist\n" );
-            return -ENOENT;
+            filler( buf, mossofs_control_files[i].name, NULL, 0 );
         }
+        return 0;
+    }
 
-        cache_add_object( mosso->cache, "objects", (char*)path, objects );
+    if ( ( listing = cache_get_object( mosso->cache, "listing", (char*)path ) ) == NULL ) 
+    {
+        LOG( LOGGER_DEBUG, "readdir: %s not cached", path );
+        cached  = FALSE;
+        listing = listing_new( path );
     }
 
-    DEBUGLOG( "  filling: %s\n", "." );
-    filler( buf, ".", NULL, 0 );
-    DEBUGLOG( "  filling: %s\n", ".." );
-    filler( buf, "..", NULL, 0 );
+    if ( offset < 1 && filler( buf, ".", NULL, 1 ) != 0 ) 
+    {
+        goto done;
+    }
+    if ( offset < 2 && filler( buf, "..", NULL, 2 ) != 0 ) 
+    {
+        goto done;
+    }
 
+    pthread_mutex_lock( &listing->lock );
+    while( TRUE ) 
     {
-        mosso_object_t* cur = objects->root;
-        while( cur != NULL ) 
+        int index  = position / MOSSO_LIST_PAGE_SIZE;
+        int skip   = position % MOSSO_LIST_PAGE_SIZE;
+        int full   = FALSE;
+        mosso_object_t* cur = NULL;
+
+        if ( !listing_load_page( mosso, listing, index ) ) 
+        {
+            LOG( LOGGER_DEBUG, "readdir: %s could not be listed", path );
+            result = ( offset == 0 ) ? mossofs_errno( path ) : -EIO;
+            break;
+        }
+
+        // Tree walks will most likely descend into the listed subdirectories
+        // next
+        if ( mossofs_prefetch != NULL && index > listing->prefetched_page ) 
         {
-            DEBUGLOG( "  filling: %s\n", cur->name );
-            filler( buf, cur->name, NULL, 0 );
-            cur = cur->next;
+            prefetch_entries( mossofs_prefetch, listing->page, mossofs_options->prefetch_depth );
+            listing->prefetched_page = index;
+        }
+
+        for( cur = ( listing->page != NULL ) ? listing->page->root : NULL; cur != NULL; cur = cur->next ) 
+        {
+            if ( skip > 0 ) 
+            {
+                --skip;
+                continue;
+            }
+
+            if ( filler( buf, cur->name, NULL, 3 + position + 1 ) != 0 ) 
+            {
+                // The buffer is full. The next call continues here.
+                full = TRUE;
+                break;
+            }
+            ++position;
+        }
+
+        if ( full || listing->page_count < MOSSO_LIST_PAGE_SIZE ) 
+        {
+            break;
         }
     }
+    pthread_mutex_unlock( &listing->lock );
 
-    /* Everything okey */
-    return 0;
+done:
+    if ( cached ) 
+    {
+        cache_release_object( mosso->cache, listing );
+    }
+    else if ( result == 0 ) 
+    {
+        cache_add_object( mosso->cache, "listing", (char*)path, listing );
+    }
+    else 
+    {
+        listing_free( listing );
+    }
+
+    return result;
 }
 
 /**
@@ -280,18 +905,40 @@ static int mossofs_open( const char *path, struct fuse_file_info *fi )
     MOSSO_CONNECTION( mosso );
     mosso_object_meta_t* meta = NULL;    
 
-    DEBUGLOG( "open: %s\n", path );
+    LOG( LOGGER_DEBUG, "open: %s", path );
 
     if ( ( fi->flags & 3 ) != O_RDONLY ) 
     {
         return -EACCES;
     }
 
+    // Files of the control directory are rendered right away, so every
+    // reader gets a consistent snapshot.
+    {
+        int entry = mossofs_control_entry( path );
+
+        if ( entry == MOSSOFS_CONTROL_ROOT ) 
+        {
+            return -EISDIR;
+        }
+        if ( entry != MOSSOFS_CONTROL_NONE ) 
+        {
+            mossofs_filehandle_t* filehandle = snew( mossofs_filehandle_t );
+            filehandle->meta    = NULL;
+            filehandle->path    = NULL;
+            filehandle->content = g_string_new( NULL );
+            mossofs_control_files[entry].render( filehandle->content );
+            fi->fh        = (unsigned long)(filehandle);
+            fi->direct_io = 1;
+            return 0;
+        }
+    }
+
     // Try to retrieve meta information for the given filepath
     if ( ( meta = mosso_get_object_meta( mosso, (char*)path ) ) == NULL ) 
     {
-        // The requested object is not existant
-        return -ENOENT;
+        // The requested object is not existant or could not be retrieved
+        return mossofs_errno( path );
     }
 
     // Allocate a new filehandle structure and store the retrieved metadata
@@ -300,13 +947,108 @@ static int mossofs_open( const char *path, struct fuse_file_info *fi )
     // be created. This should be changed.
     {
         mossofs_filehandle_t* filehandle = snew( mossofs_filehandle_t );
-        filehandle->meta = meta;
+        filehandle->meta    = meta;
+        filehandle->path    = mosso_path_new( (char*)path );
+        filehandle->content = NULL;
+        filehandle->last_block = UINT64_MAX;
         fi->fh = (unsigned long)(filehandle);
+
+        // The checksum is part of the key, so a changed file never hits the
+        // cached blocks of its previous version
+        memcpy( &filehandle->key, meta->checksum, sizeof( uint64_t ) );
+        filehandle->key ^= optrace_hash( path );
     }
     
     return 0;
 }
 
+/**
+ * Read data of a file block by block using the data cache
+ *
+ * Missing blocks are retrieved completely and added to the cache. Blocks
+ * missing during a streaming read are only added, if they are frequently
+ * read. Otherwise only the requested part of them is retrieved.
+ *
+ * The number of bytes read is returned or -1 if a request failed.
+ */
+static size_t mossofs_read_cached( mosso_connection_t* mosso, mossofs_filehandle_t* filehandle, char* buf, uint64_t size, off_t offset, int streaming ) 
+{
+    uint64_t block_size = mossofs_data_cache->block_size;
+    uint64_t done = 0;
+
+    while( done < size ) 
+    {
+        uint64_t index  = ( offset + done ) / block_size;
+        uint64_t within = ( offset + done ) % block_size;
+        uint64_t length = ( block_size - within < size - done ) ? block_size - within : size - done;
+        uint64_t start  = index * block_size;
+        uint64_t block_length = ( filehandle->meta->size - start < block_size ) ? filehandle->meta->size - start : block_size;
+        ssize_t cached = 0;
+        size_t read_bytes = 0;
+        size_t available = 0;
+        char* block = NULL;
+
+        // A block is accessed once per pass, however many reads it is split
+        // into, so a single sequential pass never makes it look frequent
+        if ( index != filehandle->last_block ) 
+        {
+            datacache_touch( mossofs_data_cache, filehandle->key, index );
+            filehandle->last_block = index;
+        }
+
+        if ( ( cached = datacache_read( mossofs_data_cache, filehandle->key, index, buf + done, within, length ) ) >= 0 ) 
+        {
+            metrics_count( METRICS_DATA_CACHE_HITS, 1 );
+            done += cached;
+            if ( (uint64_t)cached < length ) 
+            {
+                break;
+            }
+            continue;
+        }
+        metrics_count( METRICS_DATA_CACHE_MISSES, 1 );
+
+        if ( streaming && !datacache_frequent( mossofs_data_cache, filehandle->key, index ) ) 
+        {
+            metrics_count( METRICS_DATA_CACHE_BYPASSED, 1 );
+            if ( ( read_bytes = mosso_read_object_path( mosso, filehandle->path, length, buf + done, offset + done ) ) == (size_t)-1 ) 
+            {
+                return -1;
+            }
+            done += read_bytes;
+            if ( read_bytes < length ) 
+            {
+                break;
+            }
+            continue;
+        }
+
+        // A block requested completely is read into the buffer right away
+        block = ( within == 0 && length == block_length ) ? buf + done : (char*)smalloc( block_length );
+        if ( ( read_bytes = mosso_read_object_path( mosso, filehandle->path, block_length, block, start ) ) == (size_t)-1 ) 
+        {
+            ( block != buf + done ) ? free( block ) : NULL;
+            return -1;
+        }
+
+        datacache_add( mossofs_data_cache, filehandle->key, index, block, read_bytes );
+        available = ( read_bytes > within ) ? read_bytes - within : 0;
+        available = ( available < length ) ? available : length;
+        if ( block != buf + done ) 
+        {
+            memcpy( buf + done, block + within, available );
+            free( block );
+        }
+        done += available;
+        if ( available < length ) 
+        {
+            break;
+        }
+    }
+
+    return done;
+}
+
 /**
  * Called every time data needs to be read from a file
  */
@@ -316,20 +1058,48 @@ static int mossofs_read( const char *path, char *buf, size_t size, off_t offset,
     mossofs_filehandle_t* filehandle = get_mossofs_filehandle( fi );
 
     size_t read_bytes = 0;
-    uint64_t bytes_to_read = ( filehandle->meta->size < offset + size )
-                           ? ( filehandle->meta->size - offset )
-                           : ( size );
+    uint64_t bytes_to_read = 0;
+    int streaming = FALSE;
+
+    // Rendered control file
+    if ( filehandle->content != NULL ) 
+    {
+        if ( (gsize)offset >= filehandle->content->len ) 
+        {
+            return 0;
+        }
+        read_bytes = ( filehandle->content->len - (gsize)offset < size ) ? filehandle->content->len - (gsize)offset : size;
+        memcpy( buf, filehandle->content->str + offset, read_bytes );
+        return read_bytes;
+    }
 
-    DEBUGLOG( "toread: %lld\n", bytes_to_read );
+    bytes_to_read = ( filehandle->meta->size < offset + size )
+                  ? ( filehandle->meta->size - offset )
+                  : ( size );
 
-    DEBUGLOG( "read( %s, %ld, %ld )\n", path, (long)size, (long)offset );
+    LOG( LOGGER_DEBUG, "read: %s (%ld, %ld) reading %llu bytes", path, (long)size, (long)offset, (unsigned long long)bytes_to_read );
 
-    if ( ( read_bytes = mosso_read_object( mosso, (char*)path, bytes_to_read, buf, offset ) ) == -1 ) 
+    // Reads continuing where the previous one ended form a sequential run
+    streaming = ( offset == filehandle->next_offset && filehandle->sequential >= MOSSOFS_STREAMING );
+    filehandle->sequential  = ( offset == filehandle->next_offset ) ? filehandle->sequential + bytes_to_read : bytes_to_read;
+    filehandle->next_offset = offset + bytes_to_read;
+
+    if ( mossofs_data_cache != NULL ) 
     {
-        return -ENOENT;
+        read_bytes = mossofs_read_cached( mosso, filehandle, buf, bytes_to_read, offset, streaming );
+    }
+    else 
+    {
+        read_bytes = mosso_read_object_path( mosso, filehandle->path, bytes_to_read, buf, offset );
+    }
+
+    if ( read_bytes == (size_t)-1 ) 
+    {
+        return mossofs_errno( path );
     }
 
-    DEBUGLOG( "read_bytes: %ld\n", (long)read_bytes );
+    LOG( LOGGER_DEBUG, "read: %s read %ld bytes", path, (long)read_bytes );
+    metrics_count( METRICS_BYTES_READ, read_bytes );
 
     return read_bytes;
 }
@@ -342,7 +1112,197 @@ static int mossofs_release( const char* path, struct fuse_file_info* fi )
 {
     mossofs_filehandle_t* filehandle = get_mossofs_filehandle( fi );
     ( filehandle->meta != NULL ) ? ( mosso_object_meta_free( filehandle->meta ) ) : NULL;
+    ( filehandle->path != NULL ) ? ( mosso_path_free( filehandle->path ) ) : NULL;
+    ( filehandle->content != NULL ) ? g_string_free( filehandle->content, TRUE ) : NULL;
     free( filehandle );
+    return 0;
+}
+
+/**
+ * Extended attributes of the mount root exposing the bandwidth limits
+ *
+ * The limits are given in bytes per second. They may be changed at runtime
+ * by the owner of the mount, e.g. using
+ * "setfattr -n user.mossofs.download_rate -v 1048576 <MOUNTPOINT>".
+ */
+#define MOSSOFS_XATTR_DOWNLOAD_RATE "user.mossofs.download_rate"
+#define MOSSOFS_XATTR_UPLOAD_RATE   "user.mossofs.upload_rate"
+
+/**
+ * Called to read the value of an extended attribute
+ */
+static int mossofs_getxattr( const char* path, const char* name, char* value, size_t size ) 
+{
+    unsigned long download = 0;
+    unsigned long upload   = 0;
+    char buffer[32];
+    int length = 0;
+
+    simple_curl_get_rate_limit( &download, &upload );
+
+    if ( strcmp( path, "/" ) != 0 ) 
+    {
+        return -ENODATA;
+    }
+    else if ( strcmp( name, MOSSOFS_XATTR_DOWNLOAD_RATE ) == 0 ) 
+    {
+        length = snprintf( buffer, sizeof( buffer ), "%lu", download );
+    }
+    else if ( strcmp( name, MOSSOFS_XATTR_UPLOAD_RATE ) == 0 ) 
+    {
+        length = snprintf( buffer, sizeof( buffer ), "%lu", upload );
+    }
+    else 
+    {
+        return -ENODATA;
+    }
+
+    // A size of 0 asks for the length of the value only
+    if ( size == 0 ) 
+    {
+        return length;
+    }
+    if ( size < (size_t)length ) 
+    {
+        return -ERANGE;
+    }
+
+    memcpy( value, buffer, length );
+    return length;
+}
+
+/**
+ * Called to change an extended attribute
+ *
+ * Only the bandwidth limits of the mount root may be changed, and only by
+ * the owner of the mount. As the attributes always exist, they can not be
+ * created.
+ */
+static int mossofs_setxattr( const char* path, const char* name, const char* value, size_t size, int flags ) 
+{
+    struct fuse_context* context = fuse_get_context();
+    unsigned long download = 0;
+    unsigned long upload   = 0;
+    unsigned long rate     = 0;
+    char buffer[32];
+    char* end = NULL;
+
+    if ( strcmp( path, "/" ) != 0 
+      || ( strcmp( name, MOSSOFS_XATTR_DOWNLOAD_RATE ) != 0 && strcmp( name, MOSSOFS_XATTR_UPLOAD_RATE ) != 0 ) ) 
+    {
+        return -ENOTSUP;
+    }
+
+    if ( context->uid != 0 && context->uid != mossofs_options->uid ) 
+    {
+        return -EPERM;
+    }
+
+    if ( flags & XATTR_CREATE ) 
+    {
+        return -EEXIST;
+    }
+
+    // The value is not terminated
+    if ( size == 0 || size >= sizeof( buffer ) ) 
+    {
+        return -EINVAL;
+    }
+    memcpy( buffer, value, size );
+    buffer[size] = 0;
+
+    rate = strtoul( buffer, &end, 10 );
+    if ( *end != 0 && *end != '\n' ) 
+    {
+        return -EINVAL;
+    }
+
+    simple_curl_get_rate_limit( &download, &upload );
+    ( strcmp( name, MOSSOFS_XATTR_DOWNLOAD_RATE ) == 0 ) ? ( download = rate ) : ( upload = rate );
+    simple_curl_set_rate_limit( download, upload );
+
+    return 0;
+}
+
+/**
+ * Called to list the names of all extended attributes of a path
+ */
+static int mossofs_listxattr( const char* path, char* list, size_t size ) 
+{
+    static const char names[] = MOSSOFS_XATTR_DOWNLOAD_RATE "\0" MOSSOFS_XATTR_UPLOAD_RATE;
+
+    if ( strcmp( path, "/" ) != 0 ) 
+    {
+        return 0;
+    }
+
+    if ( size == 0 ) 
+    {
+        return sizeof( names );
+    }
+    if ( size < sizeof( names ) ) 
+    {
+        return -ERANGE;
+    }
+
+    memcpy( list, names, sizeof( names ) );
+    return sizeof( names );
+}
+
+/**
+ * Wrap a filesystem operation to record its latency and failures
+ *
+ * Every operation is traced as root span of all requests it issues. If
+ * recording is enabled, it is written to the trace together with the given
+ * offset and size, apart from accesses to the control directory. The
+ * wrappers are registered with fuse instead of the operations themselves.
+ */
+#define MOSSOFS_METERED( op, id, parameters, arguments, offset, size ) \
+    static int mossofs_metered_##op parameters \
+    { \
+        span_t span; \
+        uint64_t start = metrics_now(); \
+        int result = 0; \
+        span_begin( &span, 1 ); \
+        result = mossofs_##op arguments; \
+        metrics_op( id, start, result ); \
+        span_end( &span, SPAN_OP, #op, path, result, 0, NULL ); \
+        if ( optrace_enabled && mossofs_control_entry( path ) == MOSSOFS_CONTROL_NONE ) \
+        { \
+            optrace_record( id, path, offset, size, start, result ); \
+        } \
+        return result; \
+    }
+
+MOSSOFS_METERED( getattr, METRICS_OP_GETATTR, ( const char* path, struct stat* stbuf ), ( path, stbuf ), 0, 0 )
+MOSSOFS_METERED( readdir, METRICS_OP_READDIR, ( const char* path, void* buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* fi ), ( path, buf, filler, offset, fi ), 0, 0 )
+MOSSOFS_METERED( open, METRICS_OP_OPEN, ( const char* path, struct fuse_file_info* fi ), ( path, fi ), 0, 0 )
+MOSSOFS_METERED( read, METRICS_OP_READ, ( const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi ), ( path, buf, size, offset, fi ), offset, size )
+MOSSOFS_METERED( release, METRICS_OP_RELEASE, ( const char* path, struct fuse_file_info* fi ), ( path, fi ), 0, 0 )
+MOSSOFS_METERED( getxattr, METRICS_OP_GETXATTR, ( const char* path, const char* name, char* value, size_t size ), ( path, name, value, size ), 0, 0 )
+MOSSOFS_METERED( setxattr, METRICS_OP_SETXATTR, ( const char* path, const char* name, const char* value, size_t size, int flags ), ( path, name, value, size, flags ), 0, 0 )
+MOSSOFS_METERED( listxattr, METRICS_OP_LISTXATTR, ( const char* path, char* list, size_t size ), ( path, list, size ), 0, 0 )
+
+/**
+ * Replace a relative path given as option by an absolute one
+ *
+ * Fuse changes the working directory when forking into the background, so
+ * relative paths would be resolved against / afterwards. NULL is kept.
+ */
+static void mossofs_absolute_path( char** path ) 
+{
+    char* relative = *path;
+    char* cwd = NULL;
+
+    if ( relative == NULL || relative[0] == '/' ) 
+    {
+        return;
+    }
+
+    cwd = getcwd( NULL, 0 );
+    asprintf( path, "%s/%s", cwd, relative );
+    free( cwd );
+    free( relative );
 }
 
 /**
@@ -353,7 +1313,41 @@ static void show_usage( char* executable )
     printf( "Mossofs FUSE module DEVELOPMENT SNAPSHOT r59\n" );
     printf( "Jakob Westhoff <jakob@westhoffswelt.de>\n\n" );
     printf( "Usage:\n" );
-    printf( "%s mosso_username@mosso_apikey <MOUNTPOINT>\n\n", executable );
+    printf( "%s mosso_username@mosso_apikey <MOUNTPOINT> [-o options]\n\n", executable );
+    printf( "Mossofs options:\n" );
+    printf( "    -o auth_url=URL          authentication endpoint (%s)\n", MOSSO_AUTH_URL );
+    printf( "    -o ttl=SECONDS           initial lifetime of cached entries (300)\n" );
+    printf( "    -o ttl_min=SECONDS       lower bound of the adaptive lifetime (5)\n" );
+    printf( "    -o ttl_max=SECONDS       upper bound of the adaptive lifetime (86400)\n" );
+    printf( "    -o container_ttl=C=S:... fixed lifetime S for all entries in container C\n" );
+    printf( "    -o prefetch_threads=N    concurrent background prefetch requests, 0 disables (4)\n" );
+    printf( "    -o prefetch_depth=N      directory levels prefetched below a listing (1)\n" );
+    printf( "    -o prefetch_queue=N      maximum number of queued prefetch requests (10000)\n" );
+    printf( "    -o warm=C:...            prefetch the given containers at mount time\n" );
+    printf( "    -o cache_entries=N       limit of cached entries admitting frequently used ones, 0 disables (0)\n" );
+    printf( "    -o data_cache=MB         size of the cache of file data, 0 disables (0)\n" );
+    printf( "    -o data_block=KB         size of the blocks file data is cached in (128)\n" );
+    printf( "    -o data_policy=POLICY    eviction of cached data: lru, clock, tinylfu or arc (tinylfu)\n" );
+    printf( "    -o timeout=MS            deadline of a request including all retries, 0 disables (0)\n" );
+    printf( "    -o connect_timeout=MS    time allowed to establish a connection (5000)\n" );
+    printf( "    -o stall_timeout=SECONDS abort transfers not receiving any data, 0 disables (15)\n" );
+    printf( "    -o retries=N             retries of transient failures (3)\n" );
+    printf( "    -o retry_backoff=MS      initial limit of the random delay before a retry (100)\n" );
+    printf( "    -o retry_backoff_max=MS  maximal delay before a retry (5000)\n" );
+    printf( "    -o hedge=PERCENTILE      duplicate reads slower than this latency percentile, 0 disables (0)\n" );
+    printf( "    -o hedge_min=MS          minimal delay before a read is duplicated (10)\n" );
+    printf( "    -o concurrency=N         initial number of concurrent requests per endpoint (8)\n" );
+    printf( "    -o concurrency_max=N     upper bound of the adaptive concurrency, 0 disables the limit (64)\n" );
+    printf( "    -o fair_share=KEY        share requests fairly between each pid, uid or off (pid)\n" );
+    printf( "    -o uid_bandwidth=U=B:... limit the requests of user U to B bytes per second\n" );
+    printf( "    -o download_rate=BYTES   limit of the received bytes per second, 0 disables (0)\n" );
+    printf( "    -o upload_rate=BYTES     limit of the sent bytes per second, 0 disables (0)\n" );
+    printf( "    -o log=LEVEL             log messages up to error, warning, info or debug (off)\n" );
+    printf( "    -o log_file=PATH         file log messages are appended to (stderr)\n" );
+    printf( "    -o trace=SPANS           number of recent spans kept for .mossofs/trace, 0 disables (0)\n" );
+    printf( "    -o slow_request=MS       latency of requests recorded as slow, 0 disables (1000)\n" );
+    printf( "    -o slow_requests=N       number of recent slow requests kept (100)\n" );
+    printf( "    -o record=PATH           record all operations to a trace file for mossofs-replay\n\n" );
 }
 
 /**
@@ -414,15 +1408,60 @@ int mossofs_parse_opts( void* data, const char* arg, int key, struct fuse_args *
  */
 int main( int argc, char **argv )
 {
-    INIT_DEBUGLOG;
-
     struct fuse_opt mossofs_opts[] = {
+        MOSSOFS_OPT( "auth_url=%s", auth_url, 0 ),
+        MOSSOFS_OPT( "ttl=%li", ttl, 0 ),
+        MOSSOFS_OPT( "ttl_min=%li", ttl_min, 0 ),
+        MOSSOFS_OPT( "ttl_max=%li", ttl_max, 0 ),
+        MOSSOFS_OPT( "container_ttl=%s", container_ttl, 0 ),
+        MOSSOFS_OPT( "prefetch_threads=%i", prefetch_threads, 0 ),
+        MOSSOFS_OPT( "prefetch_depth=%i", prefetch_depth, 0 ),
+        MOSSOFS_OPT( "prefetch_queue=%i", prefetch_queue, 0 ),
+        MOSSOFS_OPT( "warm=%s", warm, 0 ),
+        MOSSOFS_OPT( "cache_entries=%lu", cache_entries, 0 ),
+        MOSSOFS_OPT( "data_cache=%lu", data_cache, 0 ),
+        MOSSOFS_OPT( "data_block=%lu", data_block, 0 ),
+        MOSSOFS_OPT( "data_policy=%s", data_policy, 0 ),
+        MOSSOFS_OPT( "timeout=%li", curl.deadline, 0 ),
+        MOSSOFS_OPT( "connect_timeout=%li", curl.connect_timeout, 0 ),
+        MOSSOFS_OPT( "stall_timeout=%li", curl.stall_timeout, 0 ),
+        MOSSOFS_OPT( "retries=%i", curl.retries, 0 ),
+        MOSSOFS_OPT( "retry_backoff=%li", curl.backoff, 0 ),
+        MOSSOFS_OPT( "retry_backoff_max=%li", curl.backoff_max, 0 ),
+        MOSSOFS_OPT( "hedge=%lf", curl.hedge_percentile, 0 ),
+        MOSSOFS_OPT( "hedge_min=%li", curl.hedge_min, 0 ),
+        MOSSOFS_OPT( "concurrency=%i", curl.concurrency, 0 ),
+        MOSSOFS_OPT( "concurrency_max=%i", curl.concurrency_max, 0 ),
+        MOSSOFS_OPT( "fair_share=%s", fair_share, 0 ),
+        MOSSOFS_OPT( "uid_bandwidth=%s", uid_bandwidth, 0 ),
+        MOSSOFS_OPT( "download_rate=%lu", download_rate, 0 ),
+        MOSSOFS_OPT( "upload_rate=%lu", upload_rate, 0 ),
+        MOSSOFS_OPT( "log=%s", log, 0 ),
+        MOSSOFS_OPT( "log_file=%s", log_file, 0 ),
+        MOSSOFS_OPT( "trace=%u", trace, 0 ),
+        MOSSOFS_OPT( "slow_request=%lu", slow_request, 0 ),
+        MOSSOFS_OPT( "slow_requests=%u", slow_requests, 0 ),
+        MOSSOFS_OPT( "record=%s", record, 0 ),
         FUSE_OPT_END
     };
 
     struct fuse_args args = FUSE_ARGS_INIT( argc, argv );
+    simple_curl_options_t curl_defaults = SIMPLE_CURL_OPTIONS_DEFAULT;
 
     mossofs_options = snew( mossofs_options_t );
+    mossofs_options->ttl     = 300;
+    mossofs_options->ttl_min = 5;
+    mossofs_options->ttl_max = 86400;
+    mossofs_options->prefetch_threads = 4;
+    mossofs_options->prefetch_depth   = 1;
+    mossofs_options->prefetch_queue   = 10000;
+    mossofs_options->data_cache       = 0;
+    mossofs_options->data_block       = 128;
+    mossofs_options->data_policy_id   = DATACACHE_POLICY_TINYLFU;
+    mossofs_options->curl = curl_defaults;
+    mossofs_options->fair_share_key = MOSSOFS_FAIR_SHARE_PID;
+    mossofs_options->slow_request   = 1000;
+    mossofs_options->slow_requests  = 100;
 
     if( fuse_opt_parse( &args, mossofs_options, mossofs_opts, mossofs_parse_opts ) == -1 ) 
     {
@@ -437,6 +1476,55 @@ int main( int argc, char **argv )
         exit( 1 );
     }
     
+    // The request options need to be known before the first request is
+    // issued during the initialization of the filesystem.
+    simple_curl_set_options( &mossofs_options->curl );
+    simple_curl_set_rate_limit( mossofs_options->download_rate, mossofs_options->upload_rate );
+
+    if ( mossofs_options->fair_share != NULL ) 
+    {
+        if ( strcmp( mossofs_options->fair_share, "off" ) == 0 ) 
+        {
+            mossofs_options->fair_share_key = MOSSOFS_FAIR_SHARE_OFF;
+        }
+        else if ( strcmp( mossofs_options->fair_share, "uid" ) == 0 ) 
+        {
+            mossofs_options->fair_share_key = MOSSOFS_FAIR_SHARE_UID;
+        }
+        else if ( strcmp( mossofs_options->fair_share, "pid" ) != 0 ) 
+        {
+            fprintf( stderr, "Invalid fair_share '%s', expected pid, uid or off\n", mossofs_options->fair_share );
+            exit( 1 );
+        }
+    }
+
+    if ( mossofs_options->data_policy != NULL 
+      && ( mossofs_options->data_policy_id = datacache_policy( mossofs_options->data_policy ) ) < 0 ) 
+    {
+        fprintf( stderr, "Invalid data_policy '%s', expected lru, clock, tinylfu or arc\n", mossofs_options->data_policy );
+        exit( 1 );
+    }
+    if ( mossofs_options->data_block == 0 ) 
+    {
+        fprintf( stderr, "Invalid data_block 0, expected a size in kilobytes\n" );
+        exit( 1 );
+    }
+
+    if ( mossofs_options->uid_bandwidth != NULL ) 
+    {
+        mossofs_apply_uid_bandwidth( mossofs_options->uid_bandwidth );
+    }
+
+    mossofs_options->log_level = ( mossofs_options->log != NULL ) ? logger_parse_level( mossofs_options->log ) : LOGGER_OFF;
+    if ( mossofs_options->log_level < LOGGER_OFF ) 
+    {
+        fprintf( stderr, "Invalid log level '%s', expected error, warning, info, debug or off\n", mossofs_options->log );
+        exit( 1 );
+    }
+
+    mossofs_absolute_path( &mossofs_options->log_file );
+    mossofs_absolute_path( &mossofs_options->record );
+
     // Retrieve the uid and the gid of the caller to set the filesystem
     // permissions accordingly
     mossofs_options->uid = getuid();
@@ -446,13 +1534,16 @@ int main( int argc, char **argv )
     {
         struct fuse_operations mossofs_operations = 
         {
-            .init    = mossofs_init,
-            .destroy = mossofs_destroy,
-            .getattr = mossofs_getattr,
-            .readdir = mossofs_readdir,
-            .open    = mossofs_open,
-            .read    = mossofs_read,
-            .release = mossofs_release            
+            .init      = mossofs_init,
+            .destroy   = mossofs_destroy,
+            .getattr   = mossofs_metered_getattr,
+            .readdir   = mossofs_metered_readdir,
+            .open      = mossofs_metered_open,
+            .read      = mossofs_metered_read,
+            .release   = mossofs_metered_release,
+            .getxattr  = mossofs_metered_getxattr,
+            .setxattr  = mossofs_metered_setxattr,
+            .listxattr = mossofs_metered_listxattr
         };
 
         return fuse_main( args.argc, args.argv, &mossofs_operations, NULL );
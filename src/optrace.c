@@ -0,0 +1,288 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "salloc.h"
+#include "optrace.h"
+
+int optrace_enabled = 0;
+
+/**
+ * Recording state
+ *
+ * Operations are appended to the active one of two buffers. The writer
+ * thread swaps them and writes the filled one to the file without holding
+ * the lock, so operations never wait for the disk.
+ *
+ * Times are taken from the monotonic clock, origin is its value at the
+ * start of the recording.
+ */
+static FILE* optrace_file = NULL;
+static optrace_record_t* optrace_buffers[2] = { NULL, NULL };
+static int optrace_active = 0;
+static int optrace_count = 0;
+static uint64_t optrace_dropped = 0;
+static uint64_t optrace_origin = 0;
+static int optrace_stopping = 0;
+static pthread_t optrace_thread;
+static pthread_mutex_t optrace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t optrace_wakeup;
+
+static uint64_t optrace_now();
+static void optrace_flush();
+static void* optrace_main( void* data );
+
+/**
+ * Retrieve the current time of the monotonic clock in microseconds
+ */
+static uint64_t optrace_now() 
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Hash a path using 64 bit FNV-1a
+ *
+ * The hash is stable between runs and hosts, so every occurrence of a path
+ * in a trace can be matched.
+ */
+uint64_t optrace_hash( const char* path ) 
+{
+    uint64_t hash = 14695981039346656037ULL;
+    const unsigned char* c = NULL;
+
+    for( c = (const unsigned char*)path; *c != 0; ++c ) 
+    {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Start recording all operations to the trace file at the given path
+ *
+ * An existing file is overwritten. FALSE is returned if it could not be
+ * created.
+ */
+int optrace_start( const char* path ) 
+{
+    optrace_header_t header;
+    pthread_condattr_t attr;
+    struct timespec now;
+
+    if ( ( optrace_file = fopen( path, "w" ) ) == NULL ) 
+    {
+        fprintf( stderr, "The trace file '%s' could not be created: %s\n", path, strerror( errno ) );
+        return 0;
+    }
+
+    clock_gettime( CLOCK_REALTIME, &now );
+    memset( &header, 0, sizeof( optrace_header_t ) );
+    memcpy( header.magic, OPTRACE_MAGIC, sizeof( header.magic ) );
+    header.version     = OPTRACE_VERSION;
+    header.record_size = sizeof( optrace_record_t );
+    header.start       = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    fwrite( &header, sizeof( optrace_header_t ), 1, optrace_file );
+
+    optrace_buffers[0] = snewlen( optrace_record_t, OPTRACE_BUFFER_SIZE );
+    optrace_buffers[1] = snewlen( optrace_record_t, OPTRACE_BUFFER_SIZE );
+    optrace_active   = 0;
+    optrace_count    = 0;
+    optrace_dropped  = 0;
+    optrace_stopping = 0;
+    optrace_origin   = optrace_now();
+
+    pthread_condattr_init( &attr );
+    pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+    pthread_cond_init( &optrace_wakeup, &attr );
+    pthread_condattr_destroy( &attr );
+
+    pthread_create( &optrace_thread, NULL, optrace_main, NULL );
+    optrace_enabled = 1;
+
+    return 1;
+}
+
+/**
+ * Stop recording, write all remaining records and close the file
+ *
+ * No operation may be recorded anymore while this is called.
+ */
+void optrace_stop() 
+{
+    if ( optrace_file == NULL ) 
+    {
+        return;
+    }
+
+    optrace_enabled = 0;
+
+    pthread_mutex_lock( &optrace_lock );
+    optrace_stopping = 1;
+    pthread_cond_signal( &optrace_wakeup );
+    pthread_mutex_unlock( &optrace_lock );
+    pthread_join( optrace_thread, NULL );
+
+    // Store the number of dropped records in the header
+    fseek( optrace_file, offsetof( optrace_header_t, dropped ), SEEK_SET );
+    fwrite( &optrace_dropped, sizeof( uint64_t ), 1, optrace_file );
+    fclose( optrace_file );
+    optrace_file = NULL;
+
+    pthread_cond_destroy( &optrace_wakeup );
+    free( optrace_buffers[0] );
+    free( optrace_buffers[1] );
+    optrace_buffers[0] = optrace_buffers[1] = NULL;
+}
+
+/**
+ * Record an operation on the given path started at start
+ *
+ * Start is given in microseconds of the monotonic clock. The record is
+ * dropped if the buffer is full.
+ */
+void optrace_record( int op, const char* path, uint64_t offset, uint32_t size, uint64_t start, int result ) 
+{
+    optrace_record_t record;
+    uint64_t latency = optrace_now() - start;
+
+    record.time    = ( start > optrace_origin ) ? start - optrace_origin : 0;
+    record.path    = optrace_hash( path );
+    record.offset  = offset;
+    record.size    = size;
+    record.latency = ( latency > UINT32_MAX ) ? UINT32_MAX : (uint32_t)latency;
+    record.result  = result;
+    record.op      = op;
+
+    pthread_mutex_lock( &optrace_lock );
+    if ( optrace_count < OPTRACE_BUFFER_SIZE ) 
+    {
+        optrace_buffers[optrace_active][optrace_count++] = record;
+    }
+    else 
+    {
+        ++optrace_dropped;
+    }
+    pthread_mutex_unlock( &optrace_lock );
+}
+
+/**
+ * Write the filled buffer to the file
+ *
+ * Only called by the writer thread.
+ */
+static void optrace_flush() 
+{
+    optrace_record_t* buffer = NULL;
+    int count = 0;
+
+    pthread_mutex_lock( &optrace_lock );
+    buffer = optrace_buffers[optrace_active];
+    count  = optrace_count;
+    optrace_active = !optrace_active;
+    optrace_count  = 0;
+    pthread_mutex_unlock( &optrace_lock );
+
+    if ( count > 0 ) 
+    {
+        fwrite( buffer, sizeof( optrace_record_t ), count, optrace_file );
+        fflush( optrace_file );
+    }
+}
+
+/**
+ * Writer thread flushing the buffer every OPTRACE_INTERVAL milliseconds
+ */
+static void* optrace_main( void* data ) 
+{
+    (void)data;
+
+    pthread_mutex_lock( &optrace_lock );
+    while( !optrace_stopping ) 
+    {
+        struct timespec until;
+
+        clock_gettime( CLOCK_MONOTONIC, &until );
+        until.tv_nsec += OPTRACE_INTERVAL * 1000000L;
+        until.tv_sec  += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait( &optrace_wakeup, &optrace_lock, &until );
+
+        pthread_mutex_unlock( &optrace_lock );
+        optrace_flush();
+        pthread_mutex_lock( &optrace_lock );
+    }
+    pthread_mutex_unlock( &optrace_lock );
+
+    optrace_flush();
+    return NULL;
+}
+
+/**
+ * Open a trace file for reading and read its header
+ *
+ * NULL is returned and the reason is printed if the file can not be opened
+ * or is no trace of a compatible version.
+ */
+FILE* optrace_open( const char* path, optrace_header_t* header ) 
+{
+    FILE* trace = NULL;
+
+    if ( ( trace = fopen( path, "r" ) ) == NULL ) 
+    {
+        fprintf( stderr, "The trace file '%s' could not be opened: %s\n", path, strerror( errno ) );
+        return NULL;
+    }
+
+    if ( fread( header, sizeof( optrace_header_t ), 1, trace ) != 1 
+      || memcmp( header->magic, OPTRACE_MAGIC, sizeof( header->magic ) ) != 0 
+      || header->version != OPTRACE_VERSION 
+      || header->record_size != sizeof( optrace_record_t ) ) 
+    {
+        fprintf( stderr, "The file '%s' is no trace of this version of mossofs\n", path );
+        fclose( trace );
+        return NULL;
+    }
+
+    return trace;
+}
+
+/**
+ * Read the next record of a trace
+ *
+ * FALSE is returned at the end of the trace.
+ */
+int optrace_read( FILE* trace, optrace_record_t* record ) 
+{
+    return fread( record, sizeof( optrace_record_t ), 1, trace ) == 1;
+}
@@ -0,0 +1,96 @@
+#ifndef OPTRACE_H
+#define OPTRACE_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * Identification of a trace file and the version of its format
+ */
+#define OPTRACE_MAGIC   "MOSSOFSTRACE"
+#define OPTRACE_VERSION 1
+
+/**
+ * Number of records buffered before they are written and interval in
+ * milliseconds the buffer is written in
+ *
+ * Records not fitting into the buffer are dropped and counted.
+ */
+#define OPTRACE_BUFFER_SIZE 16384
+#define OPTRACE_INTERVAL    100
+
+/**
+ * Header at the start of every trace file
+ *
+ * Start is the wall clock time the recording started at in microseconds
+ * since the epoch. Record size is the size of every following record.
+ * Dropped is the number of operations which could not be recorded. It is
+ * written once the recording stops. All values are stored in the byte order
+ * of the recording host.
+ */
+typedef struct 
+{
+    char magic[12];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t start;
+    uint64_t dropped;
+} optrace_header_t;
+
+/**
+ * One recorded filesystem operation
+ *
+ * Op is one of the METRICS_OP_* constants. The path is only stored as hash,
+ * so traces of production mounts can be shared without revealing any names.
+ * Offset and size are those of a read and 0 for all other operations. Time
+ * is the start of the operation in microseconds since the start of the
+ * recording, latency its duration in microseconds. Result is the value
+ * returned to fuse: the number of bytes read or a negative errno value.
+ */
+typedef struct 
+{
+    uint64_t time;
+    uint64_t path;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t latency;
+    int32_t result;
+    uint32_t op;
+} optrace_record_t;
+
+/**
+ * Set while operations are recorded
+ */
+extern int optrace_enabled;
+
+uint64_t optrace_hash( const char* path );
+int optrace_start( const char* path );
+void optrace_stop();
+void optrace_record( int op, const char* path, uint64_t offset, uint32_t size, uint64_t start, int result );
+FILE* optrace_open( const char* path, optrace_header_t* header );
+int optrace_read( FILE* trace, optrace_record_t* record );
+
+#endif
@@ -0,0 +1,329 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include "salloc.h"
+#include "mosso.h"
+#include "cache.h"
+#include "listing.h"
+#include "prefetch.h"
+
+static void* prefetch_worker( void* data );
+static void prefetch_enqueue( prefetch_t* prefetch, int type, const char* path, int depth );
+static void prefetch_run_meta( prefetch_t* prefetch, prefetch_job_t* job );
+static void prefetch_run_list( prefetch_t* prefetch, prefetch_job_t* job );
+static char* prefetch_job_key( int type, const char* path );
+
+/**
+ * Create a new prefetcher using the given mosso connection
+ *
+ * The given number of worker threads is started, which limits the amount of
+ * concurrently issued prefetch requests. At most max_queued jobs are waiting
+ * to be processed at any time. Further jobs are silently dropped, as
+ * prefetching is only an optimization.
+ *
+ * The cache of the mosso connection needs to be initialized before calling
+ * this function.
+ */
+prefetch_t* prefetch_new( mosso_connection_t* mosso, int num_threads, int max_queued ) 
+{
+    int i = 0;
+    prefetch_t* prefetch = snew( prefetch_t );
+
+    prefetch->mosso       = mosso;
+    prefetch->num_threads = num_threads;
+    prefetch->max_queued  = max_queued;
+    prefetch->queued      = 0;
+    prefetch->shutdown    = FALSE;
+    prefetch->head        = NULL;
+    prefetch->tail        = NULL;
+    prefetch->pending     = g_hash_table_new_full( g_str_hash, g_str_equal, free, NULL );
+    pthread_mutex_init( &prefetch->lock, NULL );
+    pthread_cond_init( &prefetch->cond, NULL );
+
+    prefetch->threads = snewlen( pthread_t, num_threads );
+    for( i = 0; i < num_threads; ++i ) 
+    {
+        pthread_create( &prefetch->threads[i], NULL, prefetch_worker, prefetch );
+    }
+
+    return prefetch;
+}
+
+/**
+ * Stop all worker threads and free the prefetcher
+ *
+ * Currently running requests are cancelled, all queued jobs are discarded.
+ */
+void prefetch_free( prefetch_t* prefetch ) 
+{
+    int i = 0;
+
+    pthread_mutex_lock( &prefetch->lock );
+    prefetch->shutdown = TRUE;
+    pthread_cond_broadcast( &prefetch->cond );
+    pthread_mutex_unlock( &prefetch->lock );
+
+    simple_curl_cancel( SIMPLE_CURL_PRIORITY_PREFETCH );
+
+    for( i = 0; i < prefetch->num_threads; ++i ) 
+    {
+        pthread_join( prefetch->threads[i], NULL );
+    }
+
+    while( prefetch->head != NULL ) 
+    {
+        prefetch_job_t* next = prefetch->head->next;
+        free( prefetch->head->path );
+        free( prefetch->head );
+        prefetch->head = next;
+    }
+
+    g_hash_table_destroy( prefetch->pending );
+    pthread_mutex_destroy( &prefetch->lock );
+    pthread_cond_destroy( &prefetch->cond );
+    free( prefetch->threads );
+    free( prefetch );
+}
+
+/**
+ * Warm the cache for the given directory path
+ *
+ * The meta information of the path itself is retrieved. Afterwards depth
+ * levels of directory listings below it are fetched, including the meta
+ * information of every listed entry.
+ */
+void prefetch_directory( prefetch_t* prefetch, const char* path, int depth ) 
+{
+    prefetch_enqueue( prefetch, PREFETCH_JOB_META, path, depth );
+}
+
+/**
+ * Warm the cache for the subdirectories of a just listed directory
+ *
+ * Only entries the listing reports as containers or virtual directories are
+ * queued, at most PREFETCH_MAX_ENTRIES of them. Plain objects are skipped, as
+ * retrieving their meta information would cost one request each. The queued
+ * directories are listed recursively until depth levels have been prefetched.
+ */
+void prefetch_entries( prefetch_t* prefetch, mosso_object_t* objects, int depth ) 
+{
+    mosso_object_t* cur = NULL;
+    int queued = 0;
+
+    if ( depth < 0 || objects == NULL ) 
+    {
+        return;
+    }
+
+    for( cur = objects->root; cur != NULL && queued < PREFETCH_MAX_ENTRIES; cur = cur->next ) 
+    {
+        if ( cur->type != MOSSO_OBJECT_TYPE_CONTAINER && cur->type != MOSSO_OBJECT_TYPE_VDIR ) 
+        {
+            continue;
+        }
+        prefetch_enqueue( prefetch, PREFETCH_JOB_META, cur->request_path, depth );
+        ++queued;
+    }
+}
+
+/**
+ * Create the key used to detect already queued or running jobs
+ */
+static char* prefetch_job_key( int type, const char* path ) 
+{
+    char* key = NULL;
+    asprintf( &key, "%d%s", type, path );
+    return key;
+}
+
+/**
+ * Append a new job to the queue, unless the same job is already pending or
+ * the queue is full.
+ */
+static void prefetch_enqueue( prefetch_t* prefetch, int type, const char* path, int depth ) 
+{
+    prefetch_job_t* job = NULL;
+    char* key = prefetch_job_key( type, path );
+
+    pthread_mutex_lock( &prefetch->lock );
+
+    if ( prefetch->shutdown 
+      || prefetch->queued >= prefetch->max_queued 
+      || g_hash_table_lookup( prefetch->pending, key ) != NULL ) 
+    {
+        pthread_mutex_unlock( &prefetch->lock );
+        free( key );
+        return;
+    }
+
+    g_hash_table_insert( prefetch->pending, key, (gpointer)prefetch );
+
+    job = snew( prefetch_job_t );
+    job->type  = type;
+    job->path  = strdup( path );
+    job->depth = depth;
+    job->next  = NULL;
+
+    if ( prefetch->tail == NULL ) 
+    {
+        prefetch->head = job;
+    }
+    else 
+    {
+        prefetch->tail->next = job;
+    }
+    prefetch->tail = job;
+    ++prefetch->queued;
+
+    pthread_cond_signal( &prefetch->cond );
+    pthread_mutex_unlock( &prefetch->lock );
+}
+
+/**
+ * Main loop of every prefetch worker thread
+ *
+ * Jobs are taken from the queue in the order they have been added, which
+ * results in a breadth first walk of the directory tree.
+ *
+ * All requests are issued with prefetch priority, so they give way to the
+ * requests of the filesystem operations.
+ */
+static void* prefetch_worker( void* data ) 
+{
+    prefetch_t* prefetch = (prefetch_t*)data;
+
+    simple_curl_set_priority( SIMPLE_CURL_PRIORITY_PREFETCH );
+
+    while( TRUE ) 
+    {
+        prefetch_job_t* job = NULL;
+
+        pthread_mutex_lock( &prefetch->lock );
+        while( !prefetch->shutdown && prefetch->head == NULL ) 
+        {
+            pthread_cond_wait( &prefetch->cond, &prefetch->lock );
+        }
+
+        if ( prefetch->shutdown ) 
+        {
+            pthread_mutex_unlock( &prefetch->lock );
+            break;
+        }
+
+        job = prefetch->head;
+        prefetch->head = job->next;
+        ( prefetch->head == NULL ) ? ( prefetch->tail = NULL ) : NULL;
+        --prefetch->queued;
+        pthread_mutex_unlock( &prefetch->lock );
+
+        switch( job->type ) 
+        {
+            case PREFETCH_JOB_META:
+                prefetch_run_meta( prefetch, job );
+            break;
+            case PREFETCH_JOB_LIST:
+                prefetch_run_list( prefetch, job );
+            break;
+        }
+
+        // The job is finished and may be queued again from now on
+        {
+            char* key = prefetch_job_key( job->type, job->path );
+            pthread_mutex_lock( &prefetch->lock );
+            g_hash_table_remove( prefetch->pending, key );
+            pthread_mutex_unlock( &prefetch->lock );
+            free( key );
+        }
+
+        free( job->path );
+        free( job );
+    }
+
+    return NULL;
+}
+
+/**
+ * Retrieve the meta information of the job path, if it is not cached already.
+ *
+ * Directories are queued for listing if there is depth left.
+ */
+static void prefetch_run_meta( prefetch_t* prefetch, prefetch_job_t* job ) 
+{
+    cache_t* cache = prefetch->mosso->cache;
+    mosso_object_meta_t* meta = NULL;
+    int type = MOSSO_OBJECT_TYPE_OBJECT;
+
+    if ( ( meta = cache_peek_object( cache, "meta", job->path ) ) != NULL ) 
+    {
+        type = meta->type;
+        cache_release_object( cache, meta );
+    }
+    else 
+    {
+        if ( ( meta = mosso_get_object_meta( prefetch->mosso, job->path ) ) == NULL ) 
+        {
+            return;
+        }
+        type = meta->type;
+        cache_add_object( cache, "meta", job->path, meta );
+    }
+
+    if ( job->depth > 0 && ( type == MOSSO_OBJECT_TYPE_CONTAINER || type == MOSSO_OBJECT_TYPE_VDIR ) ) 
+    {
+        prefetch_enqueue( prefetch, PREFETCH_JOB_LIST, job->path, job->depth );
+    }
+}
+
+/**
+ * Retrieve the first page of the listing of the job path, if it is not cached
+ * already.
+ *
+ * The meta information of every listed entry is queued afterwards.
+ */
+static void prefetch_run_list( prefetch_t* prefetch, prefetch_job_t* job ) 
+{
+    cache_t* cache = prefetch->mosso->cache;
+    listing_t* listing = NULL;
+
+    if ( ( listing = cache_peek_object( cache, "listing", job->path ) ) != NULL ) 
+    {
+        cache_release_object( cache, listing );
+        return;
+    }
+
+    listing = listing_new( job->path );
+    if ( !listing_load_page( prefetch->mosso, listing, 0 ) ) 
+    {
+        listing_free( listing );
+        return;
+    }
+
+    // The entries are queued before the listing is handed over to the cache,
+    // as it might be replaced by another thread right afterwards.
+    prefetch_entries( prefetch, listing->page, job->depth - 1 );
+    cache_add_object( cache, "listing", job->path, listing );
+}
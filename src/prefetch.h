@@ -0,0 +1,80 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+#include <pthread.h>
+#include <glib.h>
+
+#include "mosso.h"
+
+#define PREFETCH_JOB_META 0
+#define PREFETCH_JOB_LIST 1
+
+/**
+ * Maximal number of directories queued for a single listed page
+ */
+#define PREFETCH_MAX_ENTRIES 64
+
+/**
+ * One queued prefetch request
+ *
+ * A meta job retrieves and caches the meta information of the given path. A
+ * list job retrieves and caches the first page of the listing of the given
+ * directory path.
+ *
+ * Depth is the number of directory levels below this job, which may still be
+ * prefetched.
+ */
+typedef struct prefetch_job
+{
+    int type;
+    char* path;
+    int depth;
+    struct prefetch_job* next;
+} prefetch_job_t;
+
+/**
+ * Background crawler warming the cache with meta information and directory
+ * listings, before they are requested by a directory walk.
+ */
+typedef struct 
+{
+    mosso_connection_t* mosso;
+    pthread_t* threads;
+    int num_threads;
+    int max_queued;
+    int queued;
+    int shutdown;
+    prefetch_job_t* head;
+    prefetch_job_t* tail;
+    GHashTable* pending;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} prefetch_t;
+
+prefetch_t* prefetch_new( mosso_connection_t* mosso, int num_threads, int max_queued );
+void prefetch_free( prefetch_t* prefetch );
+void prefetch_directory( prefetch_t* prefetch, const char* path, int depth );
+void prefetch_entries( prefetch_t* prefetch, mosso_object_t* objects, int depth );
+
+#endif
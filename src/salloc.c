@@ -22,6 +22,21 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include "salloc.h"
+
+/**
+ * All arena allocations are aligned to this boundary
+ */
+#define SARENA_ALIGNMENT ( 2 * sizeof( void* ) )
+
+static pthread_key_t sarena_thread_key;
+static pthread_once_t sarena_thread_key_once = PTHREAD_ONCE_INIT;
+
+static void sarena_thread_key_init();
+static void sarena_thread_free( void* data );
 
 void* smalloc( size_t size )
 {
@@ -60,3 +75,230 @@ void* srealloc( void* ptr, size_t size )
 
     return new_ptr;
 }
+
+/**
+ * Create a new arena
+ *
+ * Block_size is the size of the blocks the memory is taken from. Allocations
+ * bigger than the block size get a block of their own. If 0 is given
+ * SARENA_BLOCK_SIZE is used.
+ */
+sarena_t* sarena_new( size_t block_size )
+{
+    sarena_t* arena = snew( sarena_t );
+    arena->block_size = ( block_size == 0 ) ? SARENA_BLOCK_SIZE : block_size;
+    return arena;
+}
+
+/**
+ * Free an arena including all memory allocated from it
+ */
+void sarena_free( sarena_t* arena )
+{
+    sarena_mark_t empty = { NULL, 0 };
+    sarena_reset( arena, empty );
+    ( arena->spare != NULL ) ? free( arena->spare ) : NULL;
+    free( arena );
+}
+
+/**
+ * Create the key used to store the arena of each thread
+ */
+static void sarena_thread_key_init()
+{
+    pthread_key_create( &sarena_thread_key, sarena_thread_free );
+}
+
+/**
+ * Destructor of the thread arena called on thread exit
+ */
+static void sarena_thread_free( void* data )
+{
+    sarena_free( (sarena_t*)data );
+}
+
+/**
+ * Return the arena of the calling thread
+ *
+ * The arena is created on first use and freed once the thread exits. Every
+ * user needs to take a mark before allocating from it and reset it to this
+ * mark before returning. This way nested operations can share the same arena.
+ */
+sarena_t* sarena_thread()
+{
+    sarena_t* arena = NULL;
+
+    pthread_once( &sarena_thread_key_once, sarena_thread_key_init );
+
+    if ( ( arena = (sarena_t*)pthread_getspecific( sarena_thread_key ) ) == NULL )
+    {
+        arena = sarena_new( 0 );
+        pthread_setspecific( sarena_thread_key, arena );
+    }
+
+    return arena;
+}
+
+/**
+ * Allocate size bytes from the given arena
+ *
+ * Like smalloc the returned memory is initialized with zeros. It is valid
+ * until the arena is reset to a mark taken before this allocation.
+ */
+void* sarena_alloc( sarena_t* arena, size_t size )
+{
+    void* ptr = NULL;
+    size = ( size + SARENA_ALIGNMENT - 1 ) & ~( SARENA_ALIGNMENT - 1 );
+
+    if ( arena->block == NULL || arena->block->size - arena->block->used < size )
+    {
+        sarena_block_t* block = NULL;
+        if ( arena->spare != NULL && arena->spare->size >= size )
+        {
+            // Reuse the block released by the last reset
+            block = arena->spare;
+            arena->spare = NULL;
+        }
+        else
+        {
+            size_t block_size = ( size > arena->block_size ) ? size : arena->block_size;
+            block = (sarena_block_t*)smalloc( sizeof( sarena_block_t ) + block_size );
+            block->size = block_size;
+        }
+        block->used = 0;
+        block->next = arena->block;
+        arena->block = block;
+    }
+
+    ptr = arena->block->data + arena->block->used;
+    arena->block->used += size;
+    memset( ptr, 0, size );
+    return ptr;
+}
+
+/**
+ * Copy length bytes of the given string into the arena and null terminate
+ * the copy
+ */
+char* sarena_strndup( sarena_t* arena, const char* s, size_t length )
+{
+    char* copy = (char*)sarena_alloc( arena, length + 1 );
+    memcpy( copy, s, length );
+    return copy;
+}
+
+/**
+ * Format a string like sprintf does into memory allocated from the arena
+ */
+char* sarena_printf( sarena_t* arena, const char* format, ... )
+{
+    va_list args;
+    char* result = NULL;
+    int length = 0;
+
+    va_start( args, format );
+    length = vsnprintf( NULL, 0, format, args );
+    va_end( args );
+
+    result = (char*)sarena_alloc( arena, length + 1 );
+
+    va_start( args, format );
+    vsnprintf( result, length + 1, format, args );
+    va_end( args );
+
+    return result;
+}
+
+/**
+ * Remember the current fill state of the arena
+ */
+sarena_mark_t sarena_mark( sarena_t* arena )
+{
+    sarena_mark_t mark;
+    mark.block = arena->block;
+    mark.used  = ( arena->block != NULL ) ? arena->block->used : 0;
+    return mark;
+}
+
+/**
+ * Release all allocations done since the given mark has been taken
+ *
+ * One block of the default size is kept for the next allocations, so an
+ * arena used in a loop does not need to allocate memory from the system
+ * anymore once it is warmed up.
+ */
+void sarena_reset( sarena_t* arena, sarena_mark_t mark )
+{
+    while( arena->block != mark.block )
+    {
+        sarena_block_t* block = arena->block;
+        arena->block = block->next;
+
+        if ( arena->spare == NULL && block->size == arena->block_size )
+        {
+            arena->spare = block;
+        }
+        else
+        {
+            free( block );
+        }
+    }
+
+    if ( arena->block != NULL )
+    {
+        arena->block->used = mark.used;
+    }
+}
+
+/**
+ * Retrieve an object from the given pool
+ *
+ * If no released object is available a new block of objects is allocated.
+ * The returned memory is initialized with zeros.
+ */
+void* spool_alloc( spool_t* pool )
+{
+    void* ptr = NULL;
+
+    pthread_mutex_lock( &pool->lock );
+
+    if ( pool->free_list == NULL )
+    {
+        // Allocate a new block. The first pointer sized field of each block
+        // links it to the previously allocated ones.
+        size_t header = ( sizeof( void* ) + SARENA_ALIGNMENT - 1 ) & ~( SARENA_ALIGNMENT - 1 );
+        char* block = (char*)smalloc( header + pool->object_size * pool->per_block );
+        size_t i = 0;
+
+        *(void**)block = pool->blocks;
+        pool->blocks = block;
+
+        for( i = 0; i < pool->per_block; ++i )
+        {
+            void* object = block + header + i * pool->object_size;
+            *(void**)object = pool->free_list;
+            pool->free_list = object;
+        }
+    }
+
+    ptr = pool->free_list;
+    pool->free_list = *(void**)ptr;
+
+    pthread_mutex_unlock( &pool->lock );
+
+    memset( ptr, 0, pool->object_size );
+    return ptr;
+}
+
+/**
+ * Return an object retrieved by spool_alloc to its pool
+ *
+ * The memory is kept by the pool for future allocations.
+ */
+void spool_release( spool_t* pool, void* ptr )
+{
+    pthread_mutex_lock( &pool->lock );
+    *(void**)ptr = pool->free_list;
+    pool->free_list = ptr;
+    pthread_mutex_unlock( &pool->lock );
+}
@@ -22,6 +22,9 @@
  * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
  */
 
+#include <stddef.h>
+#include <pthread.h>
+
 void* smalloc( size_t size );
 void* scalloc( size_t nelem, size_t elsize );
 void* srealloc( void* ptr, size_t size );
@@ -32,4 +35,69 @@ void* srealloc( void* ptr, size_t size );
 #define snew( t ) \
     snewlen( t, 1 )
 
+/**
+ * Default size of the blocks requested by an arena
+ */
+#define SARENA_BLOCK_SIZE 4096
+
+typedef struct sarena_block_t
+{
+    struct sarena_block_t* next;
+    size_t size;
+    size_t used;
+    char data[];
+} sarena_block_t;
+
+/**
+ * Arena used for short lived allocations
+ *
+ * Memory is taken from larger blocks by simply advancing a pointer. Single
+ * allocations can not be freed. Instead a mark is taken before a sequence of
+ * allocations and all of them are released at once by resetting the arena to
+ * this mark.
+ */
+typedef struct 
+{
+    sarena_block_t* block;
+    sarena_block_t* spare;
+    size_t block_size;
+} sarena_t;
+
+typedef struct 
+{
+    sarena_block_t* block;
+    size_t used;
+} sarena_mark_t;
+
+/**
+ * Pool of fixed size objects
+ *
+ * Released objects are kept on a free list to be handed out again by the
+ * next allocation. Pools are thread safe and may be defined statically using
+ * SPOOL_INITIALIZER.
+ */
+typedef struct 
+{
+    size_t object_size;
+    size_t per_block;
+    void* free_list;
+    void* blocks;
+    pthread_mutex_t lock;
+} spool_t;
+
+#define SPOOL_INITIALIZER( t ) \
+    { ( sizeof( t ) > sizeof( void* ) ) ? sizeof( t ) : sizeof( void* ), 64, NULL, NULL, PTHREAD_MUTEX_INITIALIZER }
+
+sarena_t* sarena_new( size_t block_size );
+void sarena_free( sarena_t* arena );
+sarena_t* sarena_thread();
+void* sarena_alloc( sarena_t* arena, size_t size );
+char* sarena_strndup( sarena_t* arena, const char* s, size_t length );
+char* sarena_printf( sarena_t* arena, const char* format, ... );
+sarena_mark_t sarena_mark( sarena_t* arena );
+void sarena_reset( sarena_t* arena, sarena_mark_t mark );
+
+void* spool_alloc( spool_t* pool );
+void spool_release( spool_t* pool, void* ptr );
+
 #endif
@@ -0,0 +1,512 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "mosso.h"
+#include "simd.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+static const char* simd_find_byte_scalar( const char* s, size_t length, char c );
+static size_t simd_urlencode_scalar( char* target, const char* source, size_t size );
+static int simd_hex_decode_scalar( unsigned char* target, const char* hex, size_t size );
+
+static void simd_resolve();
+
+#ifdef SIMD_X86
+static const char* simd_find_byte_sse2( const char* s, size_t length, char c );
+static size_t simd_urlencode_sse2( char* target, const char* source, size_t size );
+static int simd_hex_decode_sse2( unsigned char* target, const char* hex, size_t size );
+static const char* simd_find_byte_avx2( const char* s, size_t length, char c );
+static size_t simd_urlencode_avx2( char* target, const char* source, size_t size );
+static int simd_hex_decode_avx2( unsigned char* target, const char* hex, size_t size );
+#endif
+
+/**
+ * Set of implementations making up one variant
+ */
+typedef struct 
+{
+    int variant;
+    const char* (*find_byte)( const char*, size_t, char );
+    size_t (*urlencode)( char*, const char*, size_t );
+    int (*hex_decode)( unsigned char*, const char*, size_t );
+} simd_kernels_t;
+
+static const simd_kernels_t simd_kernels_scalar = { 
+    SIMD_VARIANT_SCALAR, simd_find_byte_scalar, simd_urlencode_scalar, simd_hex_decode_scalar 
+};
+#ifdef SIMD_X86
+static const simd_kernels_t simd_kernels_sse2 = { 
+    SIMD_VARIANT_SSE2, simd_find_byte_sse2, simd_urlencode_sse2, simd_hex_decode_sse2 
+};
+static const simd_kernels_t simd_kernels_avx2 = { 
+    SIMD_VARIANT_AVX2, simd_find_byte_avx2, simd_urlencode_avx2, simd_hex_decode_avx2 
+};
+#endif
+
+/**
+ * Currently used implementations
+ *
+ * The pointer is NULL until a variant has been selected. The best supported
+ * variant is resolved exactly once on first use. Switching variants replaces
+ * the whole set at once, so no caller ever mixes kernels of two variants.
+ */
+static const simd_kernels_t* simd_kernels = NULL;
+static pthread_once_t simd_kernels_once = PTHREAD_ONCE_INIT;
+
+static const char* simd_hex_code = "0123456789abcdef";
+
+/**
+ * Check if the given variant can be used on the running CPU
+ */
+int simd_supported( int variant ) 
+{
+    switch( variant ) 
+    {
+        case SIMD_VARIANT_AUTO:
+        case SIMD_VARIANT_SCALAR:
+            return TRUE;
+#ifdef SIMD_X86
+        case SIMD_VARIANT_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports( "sse2" );
+        case SIMD_VARIANT_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports( "avx2" );
+#endif
+    }
+    return FALSE;
+}
+
+/**
+ * Return the implementations currently in use, resolving them if necessary
+ */
+static inline const simd_kernels_t* simd_current() 
+{
+    const simd_kernels_t* kernels = __atomic_load_n( &simd_kernels, __ATOMIC_ACQUIRE );
+
+    if ( kernels == NULL ) 
+    {
+        pthread_once( &simd_kernels_once, simd_resolve );
+        kernels = __atomic_load_n( &simd_kernels, __ATOMIC_ACQUIRE );
+    }
+    return kernels;
+}
+
+/**
+ * Select the best supported variant, unless one has been set explicitly
+ */
+static void simd_resolve() 
+{
+    if ( __atomic_load_n( &simd_kernels, __ATOMIC_ACQUIRE ) == NULL ) 
+    {
+        simd_set_variant( SIMD_VARIANT_AUTO );
+    }
+}
+
+/**
+ * Return the variant currently in use
+ */
+int simd_variant() 
+{
+    return simd_current()->variant;
+}
+
+/**
+ * Select the implementations to use
+ *
+ * SIMD_VARIANT_AUTO selects the best one supported by the CPU. Forcing a
+ * specific variant is meant for benchmarks and verification. An unsupported
+ * variant falls back to the scalar implementations.
+ */
+void simd_set_variant( int variant ) 
+{
+    const simd_kernels_t* kernels = &simd_kernels_scalar;
+
+    if ( variant == SIMD_VARIANT_AUTO ) 
+    {
+        variant = simd_supported( SIMD_VARIANT_AVX2 ) ? SIMD_VARIANT_AVX2 
+                : simd_supported( SIMD_VARIANT_SSE2 ) ? SIMD_VARIANT_SSE2 
+                : SIMD_VARIANT_SCALAR;
+    }
+    else if ( !simd_supported( variant ) ) 
+    {
+        variant = SIMD_VARIANT_SCALAR;
+    }
+
+    switch( variant ) 
+    {
+#ifdef SIMD_X86
+        case SIMD_VARIANT_AVX2:
+            kernels = &simd_kernels_avx2;
+        break;
+        case SIMD_VARIANT_SSE2:
+            kernels = &simd_kernels_sse2;
+        break;
+#endif
+    }
+    __atomic_store_n( &simd_kernels, kernels, __ATOMIC_RELEASE );
+}
+
+/**
+ * Return a pointer to the first occurence of c within the first length bytes
+ * of s or NULL if it is not found
+ */
+const char* simd_find_byte( const char* s, size_t length, char c ) 
+{
+    return simd_current()->find_byte( s, length, c );
+}
+
+/**
+ * Url encode size bytes from source into target
+ *
+ * Only ASCII letters and digits are written unencoded. Everything else is
+ * encoded using the %hexcode notation. Target needs to provide space for at
+ * least three times size bytes. The result is not null terminated. The
+ * number of bytes written is returned.
+ */
+size_t simd_urlencode( char* target, const char* source, size_t size ) 
+{
+    return simd_current()->urlencode( target, source, size );
+}
+
+/**
+ * Decode size bytes from the hexadecimal string hex into target
+ *
+ * Hex needs to provide two digits for every byte. Upper and lower case digits
+ * are accepted. FALSE is returned if an invalid digit is encountered, in
+ * which case the contents of target are undefined.
+ */
+int simd_hex_decode( unsigned char* target, const char* hex, size_t size ) 
+{
+    return simd_current()->hex_decode( target, hex, size );
+}
+
+/*
+ * Scalar implementations
+ *
+ * These are the reference implementations. They are used to process the
+ * remaining bytes of the vectorized versions as well.
+ */
+
+static const char* simd_find_byte_scalar( const char* s, size_t length, char c ) 
+{
+    const char* end = s + length;
+    for( ; s < end; ++s ) 
+    {
+        if ( *s == c ) 
+        {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static inline int simd_is_unreserved( unsigned char c ) 
+{
+    return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' );
+}
+
+static size_t simd_urlencode_scalar( char* target, const char* source, size_t size ) 
+{
+    const unsigned char* cur = (const unsigned char*)source;
+    const unsigned char* end = cur + size;
+    char* cur_result = target;
+
+    for( ; cur < end; ++cur ) 
+    {
+        if ( simd_is_unreserved( *cur ) ) 
+        {
+            *(cur_result++) = *cur;
+        }
+        else 
+        {
+            *(cur_result++) = '%';
+            *(cur_result++) = simd_hex_code[ (*cur) >> 4 ];
+            *(cur_result++) = simd_hex_code[ (*cur) & 15 ];
+        }
+    }
+
+    return cur_result - target;
+}
+
+static inline int simd_hex_digit( char c ) 
+{
+    if ( c >= '0' && c <= '9' ) return c - '0';
+    if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    return -1;
+}
+
+static int simd_hex_decode_scalar( unsigned char* target, const char* hex, size_t size ) 
+{
+    size_t i = 0;
+    for( i = 0; i < size; ++i ) 
+    {
+        int high = simd_hex_digit( hex[i * 2] );
+        int low  = simd_hex_digit( hex[i * 2 + 1] );
+        if ( high < 0 || low < 0 ) 
+        {
+            return FALSE;
+        }
+        target[i] = ( high << 4 ) | low;
+    }
+    return TRUE;
+}
+
+#ifdef SIMD_X86
+
+/*
+ * SSE2 implementations
+ */
+
+/**
+ * Create a mask of all bytes in v which lie inside of the range [low, high]
+ *
+ * Bytes are compared as signed values. Therefore bytes >= 0x80 never match
+ * any of the ASCII ranges used here.
+ */
+#define SIMD_RANGE_SSE2( v, low, high ) \
+    _mm_and_si128( _mm_cmpgt_epi8( (v), _mm_set1_epi8( (low) - 1 ) ), _mm_cmplt_epi8( (v), _mm_set1_epi8( (high) + 1 ) ) )
+
+__attribute__(( target( "sse2" ) ))
+static const char* simd_find_byte_sse2( const char* s, size_t length, char c ) 
+{
+    const char* end = s + length;
+    __m128i needle = _mm_set1_epi8( c );
+
+    for( ; end - s >= 16; s += 16 ) 
+    {
+        int mask = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)s ), needle ) );
+        if ( mask != 0 ) 
+        {
+            return s + __builtin_ctz( mask );
+        }
+    }
+
+    return simd_find_byte_scalar( s, end - s, c );
+}
+
+__attribute__(( target( "sse2" ) ))
+static size_t simd_urlencode_sse2( char* target, const char* source, size_t size ) 
+{
+    const char* cur = source;
+    const char* end = source + size;
+    char* cur_result = target;
+
+    for( ; end - cur >= 16; cur += 16 ) 
+    {
+        __m128i v = _mm_loadu_si128( (const __m128i*)cur );
+        __m128i unreserved = _mm_or_si128( 
+            _mm_or_si128( SIMD_RANGE_SSE2( v, 'a', 'z' ), SIMD_RANGE_SSE2( v, 'A', 'Z' ) ), 
+            SIMD_RANGE_SSE2( v, '0', '9' ) 
+        );
+        int mask = _mm_movemask_epi8( unreserved );
+
+        if ( mask == 0xFFFF ) 
+        {
+            // Common case. Nothing to escape in this block.
+            _mm_storeu_si128( (__m128i*)cur_result, v );
+            cur_result += 16;
+        }
+        else 
+        {
+            int i = 0;
+            for( i = 0; i < 16; ++i ) 
+            {
+                unsigned char c = cur[i];
+                if ( mask & ( 1 << i ) ) 
+                {
+                    *(cur_result++) = c;
+                }
+                else 
+                {
+                    *(cur_result++) = '%';
+                    *(cur_result++) = simd_hex_code[ c >> 4 ];
+                    *(cur_result++) = simd_hex_code[ c & 15 ];
+                }
+            }
+        }
+    }
+
+    return ( cur_result - target ) + simd_urlencode_scalar( cur_result, cur, end - cur );
+}
+
+/**
+ * Convert 16 hex digits into their values. Invalid digits are flagged in the
+ * returned mask.
+ */
+__attribute__(( target( "sse2" ) ))
+static inline __m128i simd_hex_values_sse2( __m128i v, int* invalid ) 
+{
+    __m128i lower  = _mm_or_si128( v, _mm_set1_epi8( 0x20 ) );
+    __m128i digit  = SIMD_RANGE_SSE2( v, '0', '9' );
+    __m128i letter = SIMD_RANGE_SSE2( lower, 'a', 'f' );
+    __m128i values = _mm_or_si128( 
+        _mm_and_si128( digit, _mm_sub_epi8( v, _mm_set1_epi8( '0' ) ) ), 
+        _mm_and_si128( letter, _mm_sub_epi8( lower, _mm_set1_epi8( 'a' - 10 ) ) ) 
+    );
+
+    *invalid |= _mm_movemask_epi8( _mm_or_si128( digit, letter ) ) ^ 0xFFFF;
+
+    // Every 16 bit lane contains the high nibble in its low byte and the low
+    // nibble in its high byte. Combine them into one byte value per lane.
+    return _mm_or_si128( 
+        _mm_slli_epi16( _mm_and_si128( values, _mm_set1_epi16( 0x00FF ) ), 4 ), 
+        _mm_srli_epi16( values, 8 ) 
+    );
+}
+
+__attribute__(( target( "sse2" ) ))
+static int simd_hex_decode_sse2( unsigned char* target, const char* hex, size_t size ) 
+{
+    int invalid = 0;
+
+    for( ; size >= 16; size -= 16, hex += 32, target += 16 ) 
+    {
+        __m128i first  = simd_hex_values_sse2( _mm_loadu_si128( (const __m128i*)hex ), &invalid );
+        __m128i second = simd_hex_values_sse2( _mm_loadu_si128( (const __m128i*)( hex + 16 ) ), &invalid );
+        _mm_storeu_si128( (__m128i*)target, _mm_packus_epi16( first, second ) );
+    }
+
+    if ( invalid ) 
+    {
+        return FALSE;
+    }
+
+    return simd_hex_decode_scalar( target, hex, size );
+}
+
+/*
+ * AVX2 implementations
+ */
+
+#define SIMD_RANGE_AVX2( v, low, high ) \
+    _mm256_and_si256( _mm256_cmpgt_epi8( (v), _mm256_set1_epi8( (low) - 1 ) ), _mm256_cmpgt_epi8( _mm256_set1_epi8( (high) + 1 ), (v) ) )
+
+__attribute__(( target( "avx2" ) ))
+static const char* simd_find_byte_avx2( const char* s, size_t length, char c ) 
+{
+    const char* end = s + length;
+    __m256i needle = _mm256_set1_epi8( c );
+
+    for( ; end - s >= 32; s += 32 ) 
+    {
+        unsigned int mask = _mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_loadu_si256( (const __m256i*)s ), needle ) );
+        if ( mask != 0 ) 
+        {
+            return s + __builtin_ctz( mask );
+        }
+    }
+
+    return simd_find_byte_sse2( s, end - s, c );
+}
+
+__attribute__(( target( "avx2" ) ))
+static size_t simd_urlencode_avx2( char* target, const char* source, size_t size ) 
+{
+    const char* cur = source;
+    const char* end = source + size;
+    char* cur_result = target;
+
+    for( ; end - cur >= 32; cur += 32 ) 
+    {
+        __m256i v = _mm256_loadu_si256( (const __m256i*)cur );
+        __m256i unreserved = _mm256_or_si256( 
+            _mm256_or_si256( SIMD_RANGE_AVX2( v, 'a', 'z' ), SIMD_RANGE_AVX2( v, 'A', 'Z' ) ), 
+            SIMD_RANGE_AVX2( v, '0', '9' ) 
+        );
+        unsigned int mask = _mm256_movemask_epi8( unreserved );
+
+        if ( mask == 0xFFFFFFFFu ) 
+        {
+            _mm256_storeu_si256( (__m256i*)cur_result, v );
+            cur_result += 32;
+        }
+        else 
+        {
+            int i = 0;
+            for( i = 0; i < 32; ++i ) 
+            {
+                unsigned char c = cur[i];
+                if ( mask & ( 1u << i ) ) 
+                {
+                    *(cur_result++) = c;
+                }
+                else 
+                {
+                    *(cur_result++) = '%';
+                    *(cur_result++) = simd_hex_code[ c >> 4 ];
+                    *(cur_result++) = simd_hex_code[ c & 15 ];
+                }
+            }
+        }
+    }
+
+    return ( cur_result - target ) + simd_urlencode_sse2( cur_result, cur, end - cur );
+}
+
+__attribute__(( target( "avx2" ) ))
+static int simd_hex_decode_avx2( unsigned char* target, const char* hex, size_t size ) 
+{
+    int invalid = 0;
+
+    for( ; size >= 16; size -= 16, hex += 32, target += 16 ) 
+    {
+        __m256i v      = _mm256_loadu_si256( (const __m256i*)hex );
+        __m256i lower  = _mm256_or_si256( v, _mm256_set1_epi8( 0x20 ) );
+        __m256i digit  = SIMD_RANGE_AVX2( v, '0', '9' );
+        __m256i letter = SIMD_RANGE_AVX2( lower, 'a', 'f' );
+        __m256i values = _mm256_or_si256( 
+            _mm256_and_si256( digit, _mm256_sub_epi8( v, _mm256_set1_epi8( '0' ) ) ), 
+            _mm256_and_si256( letter, _mm256_sub_epi8( lower, _mm256_set1_epi8( 'a' - 10 ) ) ) 
+        );
+        __m256i bytes = _mm256_or_si256( 
+            _mm256_slli_epi16( _mm256_and_si256( values, _mm256_set1_epi16( 0x00FF ) ), 4 ), 
+            _mm256_srli_epi16( values, 8 ) 
+        );
+
+        invalid |= ~_mm256_movemask_epi8( _mm256_or_si256( digit, letter ) );
+
+        // Packing works on each 128 bit lane separately. The two quadwords
+        // holding the results need to be moved next to each other.
+        bytes = _mm256_permute4x64_epi64( _mm256_packus_epi16( bytes, bytes ), 0xD8 );
+        _mm_storeu_si128( (__m128i*)target, _mm256_castsi256_si128( bytes ) );
+    }
+
+    if ( invalid ) 
+    {
+        return FALSE;
+    }
+
+    return simd_hex_decode_scalar( target, hex, size );
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stddef.h>
+
+/*
+ * Byte loops of the hot paths implemented using SSE2 and AVX2
+ *
+ * Every kernel exists as a scalar version as well. The best variant supported
+ * by the running CPU is selected on first use. On other architectures only
+ * the scalar versions are compiled.
+ */
+
+#define SIMD_VARIANT_AUTO   0
+#define SIMD_VARIANT_SCALAR 1
+#define SIMD_VARIANT_SSE2   2
+#define SIMD_VARIANT_AVX2   3
+
+int simd_supported( int variant );
+int simd_variant();
+void simd_set_variant( int variant );
+
+const char* simd_find_byte( const char* s, size_t length, char c );
+size_t simd_urlencode( char* target, const char* source, size_t size );
+int simd_hex_decode( unsigned char* target, const char* hex, size_t size );
+
+#endif
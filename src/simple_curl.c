@@ -22,21 +22,67 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <regex.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <curl/curl.h>
 
 #include "salloc.h"
+#include "simd.h"
+#include "limiter.h"
+#include "bucket.h"
+#include "metrics.h"
+#include "logger.h"
+#include "span.h"
+#include "slowlog.h"
 #include "simple_curl.h"
 
 /**
- * Stream used to transport all the needed data between different write_header
- * calls
+ * Names of all headers stored in the fixed table of simple_curl_headers_t. The
+ * order needs to match the SIMPLE_CURL_HEADER_* constants.
  */
-typedef struct
-{
-    simple_curl_header_t* ptr;
-    long unsigned length;
-} simple_curl_receive_header_stream_t;
+static const char* simple_curl_known_headers[SIMPLE_CURL_HEADER_KNOWN] = {
+    "Content-Length",
+    "Content-Type",
+    "Etag",
+    "Last-Modified",
+    "X-Container-Bytes-Used",
+    "X-Container-Object-Count",
+    "X-Auth-Token",
+    "X-Storage-Token",
+    "X-Storage-Url",
+    "X-CDN-Management-Url"
+};
+
+/**
+ * Lengths of the known header names, computed at compile time so the table
+ * can be read by all threads without any initialization
+ */
+#define SIMPLE_CURL_LENGTH( s ) ( sizeof( s ) - 1 )
+static const size_t simple_curl_known_header_lengths[SIMPLE_CURL_HEADER_KNOWN] = {
+    SIMPLE_CURL_LENGTH( "Content-Length" ),
+    SIMPLE_CURL_LENGTH( "Content-Type" ),
+    SIMPLE_CURL_LENGTH( "Etag" ),
+    SIMPLE_CURL_LENGTH( "Last-Modified" ),
+    SIMPLE_CURL_LENGTH( "X-Container-Bytes-Used" ),
+    SIMPLE_CURL_LENGTH( "X-Container-Object-Count" ),
+    SIMPLE_CURL_LENGTH( "X-Auth-Token" ),
+    SIMPLE_CURL_LENGTH( "X-Storage-Token" ),
+    SIMPLE_CURL_LENGTH( "X-Storage-Url" ),
+    SIMPLE_CURL_LENGTH( "X-CDN-Management-Url" )
+};
+
+/**
+ * Names of the request methods indexed by their operation
+ */
+static const char* simple_curl_methods[] = { "GET", "HEAD", "POST", "PUT", "DELETE" };
+
+/**
+ * Pool all header list entries are taken from
+ */
+static spool_t simple_curl_header_pool = SPOOL_INITIALIZER( simple_curl_header_t );
 
 /**
  * Structure holding all information needed to be transported between different
@@ -60,20 +106,194 @@ typedef struct
     size_t length;
 } simple_curl_request_body_t;
 
+/**
+ * Everything needed to issue the same request multiple times, as done by
+ * retries and hedging
+ *
+ * The deadline is given in microseconds of the monotonic clock. It is 0 if
+ * the request may take arbitrarily long. The limiter belongs to the endpoint
+ * of the url. It is NULL if the concurrency is not limited. Priority is the
+ * class the request is scheduled in by the limiter. Flow and cost are used
+ * to share it fairly between callers. Limited is set if the transfers are
+ * subject to the bandwidth limits.
+ */
+typedef struct
+{
+    int operation;
+    int hedge;
+    char* url;
+    char* request_body;
+    struct curl_slist* headers;
+    uint64_t deadline;
+    limiter_t* limiter;
+    int priority;
+    unsigned long flow;
+    uint64_t cost;
+    int limited;
+} simple_curl_call_t;
+
+/**
+ * One transfer issued for a request
+ *
+ * Enqueued is the time the transfer began to wait for its place, start the
+ * time it has actually been started in microseconds. Result, response code
+ * and the number of transferred bytes are set as soon as it is finished. Slot_held is set as
+ * long as the transfer holds the place in the window of the limiter
+ * described by slot. Paused holds the directions paused by the bandwidth
+ * limits until resume_at. The span covers the whole transfer including the
+ * time it waited for its place.
+ */
+typedef struct
+{
+    CURL* ch;
+    limiter_slot_t slot;
+    int slot_held;
+    simple_curl_headers_t* headers;
+    simple_curl_receive_body_t* body;
+    simple_curl_request_body_t* request_body;
+    uint64_t enqueued;
+    uint64_t start;
+    int paused;
+    uint64_t resume_at;
+    CURLcode result;
+    long response_code;
+    uint64_t bytes;
+    char error[CURL_ERROR_SIZE];
+    span_t span;
+} simple_curl_transfer_t;
+
+/**
+ * Histogram of the latencies of one kind of hedged requests
+ *
+ * Every power of two is split into four logarithmic buckets, which covers
+ * latencies of more than an hour in microseconds. Hedging starts once
+ * SIMPLE_CURL_LATENCY_MIN_SAMPLES latencies are known. All counts are halved
+ * every time the window has been filled twice.
+ */
+#define SIMPLE_CURL_LATENCY_BUCKETS     128
+#define SIMPLE_CURL_LATENCY_MIN_SAMPLES 50
+#define SIMPLE_CURL_LATENCY_WINDOW      2048
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    unsigned long counts[SIMPLE_CURL_LATENCY_BUCKETS];
+    unsigned long total;
+} simple_curl_latency_t;
+
+/**
+ * Latencies of hedged GET and HEAD requests indexed by their operation
+ */
+static simple_curl_latency_t simple_curl_latencies[2] = { 
+    { PTHREAD_MUTEX_INITIALIZER, { 0 }, 0 }, 
+    { PTHREAD_MUTEX_INITIALIZER, { 0 }, 0 } 
+};
+
+/**
+ * Options used for all requests and counters of the issued ones
+ */
+static simple_curl_options_t simple_curl_options = SIMPLE_CURL_OPTIONS_DEFAULT;
+static simple_curl_stats_t simple_curl_stats;
+
+/**
+ * Priority of the requests issued by the calling thread. If it is
+ * SIMPLE_CURL_PRIORITY_AUTO the priority is derived from every request.
+ */
+static __thread int simple_curl_priority = SIMPLE_CURL_PRIORITY_AUTO;
+
+/**
+ * Caller the requests of the calling thread are issued for
+ *
+ * The flow is used to share the capacity of an endpoint fairly. The uid
+ * selects the bandwidth cap applied to the requests.
+ */
+static __thread unsigned long simple_curl_flow = 0;
+static __thread unsigned int simple_curl_uid = 0;
+
+/**
+ * Bandwidth cap of the requests issued on behalf of one user
+ *
+ * The rate is given in bytes per second. Next is the time in microseconds of
+ * the monotonic clock the next request may be started at.
+ */
+typedef struct simple_curl_cap
+{
+    unsigned int uid;
+    unsigned long rate;
+    uint64_t next_start;
+    struct simple_curl_cap* next;
+} simple_curl_cap_t;
+
+static simple_curl_cap_t* simple_curl_caps = NULL;
+static pthread_mutex_t simple_curl_caps_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static char* error_string = NULL;
-#define set_error(e, ...) (((error_string != NULL) ? free(error_string) : NULL), asprintf( &error_string, e, ##__VA_ARGS__ ))
-char* simple_curl_error() { return error_string; }
+/**
+ * Concurrency limiters of all endpoints requests have been sent to
+ *
+ * A limiter is created upon the first request to an endpoint and kept until
+ * the process exits. A short term latency of more than twice the long term
+ * one is considered an overload.
+ */
+#define SIMPLE_CURL_LATENCY_TOLERANCE 2.0
+
+static limiter_t* simple_curl_limiters = NULL;
+static pthread_mutex_t simple_curl_limiters_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Bandwidth limits of all received and all sent data
+ *
+ * The burst of both buckets is a tenth of a second worth of data, but at
+ * least one chunk curl hands to its callbacks. A smaller burst would never
+ * let the bucket hold a positive amount of tokens at low rates, pausing the
+ * transfers forever.
+ */
+#define SIMPLE_CURL_RATE_BURST 10
+#define SIMPLE_CURL_RATE_BURST_MIN CURL_MAX_WRITE_SIZE
+
+static bucket_t simple_curl_download = BUCKET_INITIALIZER;
+static bucket_t simple_curl_upload = BUCKET_INITIALIZER;
+
+/**
+ * The last error is stored per thread, to allow concurrent requests from
+ * different threads.
+ */
+static __thread char error_string[CURL_ERROR_SIZE];
+#define set_error(e, ...) snprintf( error_string, CURL_ERROR_SIZE, e, ##__VA_ARGS__ )
+char* simple_curl_error() { return ( error_string[0] != 0 ) ? error_string : NULL; }
 
 static size_t simple_curl_write_body( void *ptr, size_t size, size_t nmemb, void *stream );
 static size_t simple_curl_write_header( void *ptr, size_t size, size_t nmemb, void *stream );
+static size_t simple_curl_write_limited( void *ptr, size_t size, size_t nmemb, void *stream );
+static size_t simple_curl_read_body( void *ptr, size_t size, size_t nmemb, void *stream );
+static size_t simple_curl_read_limited( void *ptr, size_t size, size_t nmemb, void *stream );
+static int simple_curl_header_classify( const char* key, size_t length );
+static simple_curl_headers_t* simple_curl_headers_init();
+static void simple_curl_headers_reset( simple_curl_headers_t* headers );
 static simple_curl_receive_body_t* simple_curl_receive_body_init();
 static void simple_curl_receive_body_free( simple_curl_receive_body_t* body );
-static simple_curl_receive_header_stream_t* simple_curl_receive_header_stream_init();
-static void simple_curl_receive_header_stream_free( simple_curl_receive_header_stream_t* stream );
 static void simple_curl_prepare_curl_headers( simple_curl_header_t* headers, struct curl_slist** curl_headers );
 static simple_curl_request_body_t* simple_curl_request_body_init( char* data, long size );
 static void simple_curl_request_body_free( simple_curl_request_body_t* body );
+static uint64_t simple_curl_now();
+static void simple_curl_sleep( uint64_t usec );
+static int simple_curl_latency_bucket( uint64_t usec );
+static uint64_t simple_curl_latency_bucket_limit( int bucket );
+static void simple_curl_latency_record( simple_curl_latency_t* latency, uint64_t usec );
+static uint64_t simple_curl_latency_percentile( simple_curl_latency_t* latency, double percentile );
+static uint64_t simple_curl_hedge_delay( int operation );
+static limiter_t* simple_curl_limiter( char* url );
+static uint64_t simple_curl_request_cost( int operation, char* request_body, simple_curl_header_t* request_headers );
+static void simple_curl_pace( simple_curl_call_t* call );
+static int simple_curl_transfer_start( simple_curl_call_t* call, simple_curl_transfer_t* transfer, int wait );
+static int simple_curl_progress( void* data, curl_off_t download_total, curl_off_t download_now, curl_off_t upload_total, curl_off_t upload_now );
+static void simple_curl_transfer_finish( simple_curl_call_t* call, simple_curl_transfer_t* transfer, CURLcode result );
+static void simple_curl_transfer_timing( simple_curl_transfer_t* transfer, span_timing_t* timing );
+static void simple_curl_transfer_span( simple_curl_call_t* call, simple_curl_transfer_t* transfer );
+static void simple_curl_record_slow( simple_curl_call_t* call, simple_curl_transfer_t* transfer, uint64_t start, int retries, simple_curl_header_t* request_headers );
+static void simple_curl_transfer_free( simple_curl_call_t* call, simple_curl_transfer_t* transfer );
+static int simple_curl_transient( simple_curl_transfer_t* transfer );
+static uint64_t simple_curl_backoff( int attempt, simple_curl_transfer_t* transfer );
+static simple_curl_transfer_t* simple_curl_perform( simple_curl_call_t* call, simple_curl_transfer_t* transfers, uint64_t delay );
 
 
 /**
@@ -93,62 +313,112 @@ static size_t simple_curl_write_body( void *ptr, size_t size, size_t nmemb, void
     return (size*nmemb);
 }
 
+/**
+ * Determine the index of a header in the fixed table of known headers
+ *
+ * The comparison is case insensitive. -1 is returned if the given key is not
+ * one of the known headers.
+ */
+static int simple_curl_header_classify( const char* key, size_t length ) 
+{
+    int i = 0;
+
+    for( i = 0; i < SIMPLE_CURL_HEADER_KNOWN; ++i ) 
+    {
+        if ( simple_curl_known_header_lengths[i] == length 
+          && strncasecmp( simple_curl_known_headers[i], key, length ) == 0 ) 
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
 /**
  * Callback function for cURL called every time a new header line is received
  *
- * This function is used internally to store newly received headers to a linked
- * list of key/value pairs, which are splitted using a simple regex.
+ * The line is split into its key and value directly inside the data provided
+ * by cURL. Both are copied once into the string buffer of the header
+ * structure. Known headers are put into the fixed table, everything else is
+ * appended to the list of other fields.
+ *
+ * A new status line indicates a new response, like after a redirect or a
+ * "100 Continue". Only the headers of the last response are kept.
  *
  * cURL calls this callback method one for each new header line received.
  */
 static size_t simple_curl_write_header( void *ptr, size_t size, size_t nmemb, void *stream )
 {
-    regex_t re;
-    regmatch_t matches[4];
-    int error = 0;
+    simple_curl_headers_t* headers = ( simple_curl_headers_t* )stream;
+    char* line  = (char*)ptr;
+    char* end   = line + size * nmemb;
+    char* colon = NULL;
+    char* value = NULL;
+    size_t key_length   = 0;
+    size_t value_length = 0;
+    int id = 0;
 
-    simple_curl_receive_header_stream_t* header_stream = ( simple_curl_receive_header_stream_t* )stream;
+    // Strip the line ending
+    while( end > line && ( *( end - 1 ) == '\r' || *( end - 1 ) == '\n' ) ) { --end; }
 
-    // Using a simple regex the header is splitted into a key value pair.
-    memset( &matches, 0, 4 * sizeof( regmatch_t ) );
+    if ( end - line >= 5 && memcmp( line, "HTTP/", 5 ) == 0 ) 
+    {
+        simple_curl_headers_reset( headers );
+        return size * nmemb;
+    }
 
-    if ( ( error = regcomp( &re, "^([^:]+): ([^\r\n]*)[\r\n]*$", REG_EXTENDED | REG_ICASE | REG_NEWLINE ) ) != 0 )
+    if ( ( colon = memchr( line, ':', end - line ) ) == NULL || colon == line ) 
     {
-        // An error occured during the compile of the regex.
-        // This should never happen. But if it does we simply skip this
-        // header extraction call
-        return size*nmemb;
+        // Empty or malformed line. Just skip it.
+        return size * nmemb;
     }
 
-    // Create a null terminated string based on the data given by curl and
-    // match it against the regex
+    // Isolate the value without surrounding whitespace
+    for( value = colon + 1; value < end && ( *value == ' ' || *value == '\t' ); ++value );
+    while( end > value && ( *( end - 1 ) == ' ' || *( end - 1 ) == '\t' ) ) { --end; }
+
+    key_length   = colon - line;
+    value_length = end - value;
+
+    // Make sure both strings including their terminators fit into the buffer
+    if ( headers->length + key_length + value_length + 2 > headers->size ) 
     {
-        char* key    = NULL;
-        char* value  = NULL;
-        char* source = (char*)smalloc( (size*nmemb) + 1 );
-        memcpy( source, ptr, size*nmemb );
+        headers->size = ( headers->size + key_length + value_length + 2 ) * 2;
+        headers->buffer = (char*)srealloc( headers->buffer, headers->size );
+    }
 
-        if ( ( error = regexec( &re, source, 3, matches, 0 ) ) != 0 )
-        {
-            // Match failed. Just skip the given line.
-            return size*nmemb;
-        }
+    {
+        simple_curl_header_field_t field;
 
-        // Allocate the strings needed to hold subexpression 1 and 2 ( Our
-        // key / value pair )
-        key   = (char*)smalloc( sizeof( char ) * ( matches[1].rm_eo - matches[1].rm_so + 1 ) );
-        value = (char*)smalloc( sizeof( char ) * ( matches[2].rm_eo - matches[2].rm_so + 1 ) );
+        field.key = headers->length;
+        memcpy( headers->buffer + headers->length, line, key_length );
+        headers->buffer[headers->length + key_length] = 0;
+        headers->length += key_length + 1;
 
-        // Copy the matched strings to their new homes
-        memcpy( key,   source + matches[1].rm_so, matches[1].rm_eo - matches[1].rm_so );
-        memcpy( value, source + matches[2].rm_so, matches[2].rm_eo - matches[2].rm_so );
+        field.value = headers->length;
+        memcpy( headers->buffer + headers->length, value, value_length );
+        headers->buffer[headers->length + value_length] = 0;
+        headers->length += value_length + 1;
 
-        // Store key value strings in the struct and free the temporary
-        // strings.
-        header_stream->ptr = simple_curl_header_add( header_stream->ptr, key, value );
+        if ( ( id = simple_curl_header_classify( line, key_length ) ) != -1 ) 
+        {
+            headers->known[id] = field;
+        }
+        else 
+        {
+            if ( headers->num_fields == headers->size_fields ) 
+            {
+                headers->size_fields = ( headers->size_fields == 0 ) ? 8 : headers->size_fields * 2;
+                headers->fields = (simple_curl_header_field_t*)srealloc( 
+                    headers->fields, 
+                    sizeof( simple_curl_header_field_t ) * headers->size_fields 
+                );
+            }
+            headers->fields[headers->num_fields++] = field;
+        }
     }
 
-    ++(header_stream->length);
     return size * nmemb;
 }
 
@@ -169,6 +439,58 @@ static size_t simple_curl_read_body( void *ptr, size_t size, size_t nmemb, void
     return copy_size;
 }
 
+/**
+ * Callback receiving the body of transfers subject to the download limit
+ *
+ * If the limit is exhausted the transfer is paused until enough tokens have
+ * been accumulated. Curl keeps the data and hands it in again once the
+ * transfer has been resumed.
+ */
+static size_t simple_curl_write_limited( void *ptr, size_t size, size_t nmemb, void *stream )
+{
+    simple_curl_transfer_t* transfer = (simple_curl_transfer_t*)stream;
+    uint64_t now  = simple_curl_now();
+    uint64_t wait = bucket_take( &simple_curl_download, size * nmemb, now );
+
+    if ( wait != 0 ) 
+    {
+        transfer->paused   |= CURLPAUSE_RECV;
+        transfer->resume_at = now + wait;
+        return CURL_WRITEFUNC_PAUSE;
+    }
+
+    return simple_curl_write_body( ptr, size, nmemb, (void*)transfer->body );
+}
+
+/**
+ * Callback providing the request body of transfers subject to the upload
+ * limit
+ *
+ * If the limit is exhausted the transfer is paused until enough tokens have
+ * been accumulated.
+ */
+static size_t simple_curl_read_limited( void *ptr, size_t size, size_t nmemb, void *stream )
+{
+    simple_curl_transfer_t* transfer = (simple_curl_transfer_t*)stream;
+    long remainder_size = transfer->request_body->length - transfer->request_body->offset;
+    uint64_t now  = simple_curl_now();
+    uint64_t wait = 0;
+
+    if ( remainder_size > 0 ) 
+    {
+        wait = bucket_take( &simple_curl_upload, ( size * nmemb > (size_t)remainder_size ) ? (size_t)remainder_size : size * nmemb, now );
+    }
+
+    if ( wait != 0 ) 
+    {
+        transfer->paused   |= CURLPAUSE_SEND;
+        transfer->resume_at = now + wait;
+        return CURL_READFUNC_PAUSE;
+    }
+
+    return simple_curl_read_body( ptr, size, nmemb, (void*)transfer->request_body );
+}
+
 /**
  * Initialize and return a new receive_body struct
  *
@@ -200,33 +522,97 @@ static void simple_curl_receive_body_free( simple_curl_receive_body_t* body )
 }
 
 /**
- * Initialize a new header_stream.
+ * Initialize a new empty response header structure
+ */
+static simple_curl_headers_t* simple_curl_headers_init()
+{
+    simple_curl_headers_t* headers = snew( simple_curl_headers_t );
+    simple_curl_headers_reset( headers );
+    return headers;
+}
+
+/**
+ * Forget all headers stored in the given structure. The allocated buffers are
+ * kept for reuse.
+ */
+static void simple_curl_headers_reset( simple_curl_headers_t* headers )
+{
+    int i = 0;
+    for( i = 0; i < SIMPLE_CURL_HEADER_KNOWN; ++i ) 
+    {
+        headers->known[i].key   = SIMPLE_CURL_HEADER_UNSET;
+        headers->known[i].value = SIMPLE_CURL_HEADER_UNSET;
+    }
+    headers->length     = 0;
+    headers->num_fields = 0;
+}
+
+/**
+ * Free a response header structure including all stored strings
+ */
+void simple_curl_headers_free( simple_curl_headers_t* headers )
+{
+    if ( headers != NULL )
+    {
+        ( headers->buffer != NULL ) ? free( headers->buffer ) : NULL;
+        ( headers->fields != NULL ) ? free( headers->fields ) : NULL;
+        free( headers );
+    }
+}
+
+/**
+ * Retrieve the value of one of the known headers in constant time
  *
- * The header stream struct is used to store a pointer to the last linked list
- * elements of headers as well as the number of header entries already stored.
+ * The id is one of the SIMPLE_CURL_HEADER_* constants. NULL is returned if
+ * the header has not been received. The returned string belongs to the
+ * header structure.
  */
-static simple_curl_receive_header_stream_t* simple_curl_receive_header_stream_init()
+char* simple_curl_headers_get( simple_curl_headers_t* headers, int id )
 {
-    simple_curl_receive_header_stream_t* stream = snew( simple_curl_receive_header_stream_t );
-    stream->ptr = NULL;
-    stream->length = 0;
-    return stream;
+    return ( headers->known[id].value == SIMPLE_CURL_HEADER_UNSET ) 
+        ? NULL 
+        : headers->buffer + headers->known[id].value;
 }
 
 /**
- * Free a header_stream
+ * Retrieve a header value by its name
  *
- * Free a header stream struct including the linked list inside it storing the
- * header information. Every linked list element including all its data will be
- * freed as well.
+ * The name is compared case insensitive. Known headers are looked up in
+ * constant time, all others by scanning the list of other fields. NULL is
+ * returned if the header has not been received.
  */
-static void simple_curl_receive_header_stream_free( simple_curl_receive_header_stream_t* stream )
+char* simple_curl_headers_get_by_key( simple_curl_headers_t* headers, char* key )
 {
-    if ( stream != NULL )
+    int i = 0;
+    int id = simple_curl_header_classify( key, strlen( key ) );
+
+    if ( id != -1 ) 
+    {
+        return simple_curl_headers_get( headers, id );
+    }
+
+    for( i = 0; i < headers->num_fields; ++i ) 
     {
-        (stream->ptr != NULL) ? simple_curl_header_free_all( stream->ptr ) : NULL;
-        free( stream );
+        if ( strcasecmp( headers->buffer + headers->fields[i].key, key ) == 0 ) 
+        {
+            return headers->buffer + headers->fields[i].value;
+        }
     }
+
+    return NULL;
+}
+
+/**
+ * Retrieve one of the headers not contained in the table of known headers
+ *
+ * Index needs to be smaller than the number of other fields stored in
+ * num_fields. The key and value pointers are set to strings belonging to the
+ * header structure.
+ */
+void simple_curl_headers_get_field( simple_curl_headers_t* headers, int index, char** key, char** value )
+{
+    *key   = headers->buffer + headers->fields[index].key;
+    *value = headers->buffer + headers->fields[index].value;
 }
 
 /**
@@ -236,14 +622,16 @@ static void simple_curl_receive_header_stream_free( simple_curl_receive_header_s
 static void simple_curl_prepare_curl_headers( simple_curl_header_t* headers, struct curl_slist** curl_headers )
 {
     simple_curl_header_t* cur = headers->root;
+    sarena_t* arena = sarena_thread();
+    sarena_mark_t mark = sarena_mark( arena );
     while( cur != NULL )
     {
-        char* data = NULL;
-        asprintf( &data, "%s: %s", cur->key, cur->value );
-        (*curl_headers) = curl_slist_append( (*curl_headers), data );
-        free( data );
+        // The string is copied by curl, therefore the arena can be reset
+        // right after all headers have been converted.
+        (*curl_headers) = curl_slist_append( (*curl_headers), sarena_printf( arena, "%s: %s", cur->key, cur->value ) );
         cur = cur->next;
     }
+    sarena_reset( arena, mark );
 }
 
 /**
@@ -266,7 +654,7 @@ static void simple_curl_prepare_curl_headers( simple_curl_header_t* headers, str
 simple_curl_header_t* simple_curl_header_add( simple_curl_header_t* header, char* key, char* value )
 {
     // Initialize a new header entry
-    simple_curl_header_t* new_header = snew( simple_curl_header_t );
+    simple_curl_header_t* new_header = (simple_curl_header_t*)spool_alloc( &simple_curl_header_pool );
 
     // Copy the data to it
     new_header->key   = strdup( key );
@@ -299,7 +687,7 @@ char* simple_curl_header_get_by_key( simple_curl_header_t* headers, char* key )
     simple_curl_header_t* cur = headers->root;
     while( cur != NULL )
     {
-        if ( strcmp( cur->key, key ) == 0 )
+        if ( strcasecmp( cur->key, key ) == 0 )
         {
             return cur->value;
         }
@@ -333,6 +721,55 @@ simple_curl_header_t* simple_curl_header_copy( simple_curl_header_t* header )
     return copy;
 }
 
+/**
+ * Add a new header entry to a header linked list using memory of the given
+ * arena
+ *
+ * This works like simple_curl_header_add, but neither the entry nor the key
+ * and value strings are copied to the heap. The strings are referenced
+ * directly and need to stay valid as long as the list is used. The list must
+ * not be freed using simple_curl_header_free_all. It is released together
+ * with the arena.
+ */
+simple_curl_header_t* simple_curl_header_add_to( sarena_t* arena, simple_curl_header_t* header, char* key, char* value )
+{
+    simple_curl_header_t* new_header = (simple_curl_header_t*)sarena_alloc( arena, sizeof( simple_curl_header_t ) );
+
+    new_header->key   = key;
+    new_header->value = value;
+
+    new_header->next = NULL;
+    if ( header == NULL )
+    {
+        new_header->root = new_header;
+    }
+    else
+    {
+        new_header->root = header->root;
+        header->next = new_header;
+    }
+
+    return new_header;
+}
+
+/**
+ * Copy a given header linked list into the given arena
+ *
+ * The same rules as for simple_curl_header_add_to apply. This is the cheap
+ * way to extend a long lived header list by a few entries for one request.
+ */
+simple_curl_header_t* simple_curl_header_copy_to( sarena_t* arena, simple_curl_header_t* header ) 
+{
+    simple_curl_header_t* copy = NULL;
+    simple_curl_header_t* cur  = header->root;
+    while( cur != NULL ) 
+    {
+        copy = simple_curl_header_add_to( arena, copy, cur->key, cur->value );
+        cur = cur->next;
+    }
+    return copy;
+}
+
 /**
  * Free a header linked list
  *
@@ -351,11 +788,28 @@ void simple_curl_header_free_all( simple_curl_header_t* header )
             next = next->next;
             free( cur->key );
             free( cur->value );
-            free( cur );
+            spool_release( &simple_curl_header_pool, cur );
         }
     }
 }
 
+/**
+ * Url encode the given number of bytes from url into target
+ *
+ * Only ASCII letters and digits will be written unencoded. Everything else
+ * will be encoded using the %hexcode notation.
+ *
+ * The target needs to provide space for at least three times size bytes. The
+ * written string is not null terminated. The number of bytes written is
+ * returned.
+ */
+size_t simple_curl_urlencode_to( char* target, char* url, size_t size )
+{
+    // The vectorized implementation copies whole blocks of letters and digits
+    // at once.
+    return simd_urlencode( target, url, size );
+}
+
 /**
  * Url encode a given string
  *
@@ -371,7 +825,8 @@ void simple_curl_header_free_all( simple_curl_header_t* header )
  */
 char* simple_curl_urlencode( char* url, int size )
 {
-    char* hex_code = "0123456789abcdef";
+    char* result = NULL;
+    size_t length = 0;
 
     if ( size == 0 )
     {
@@ -381,123 +836,518 @@ char* simple_curl_urlencode( char* url, int size )
     // For the initial space requirement assume the worst case, aka every char
     // needs to be encoded. The string be reallocated after the encoding is
     // complete to free the not space not needed.
-    char* result = (char*)smalloc( sizeof( char ) * ( ( size * 3 ) + 1 ) );
-
-    char* cur        = url;
-    char* cur_result = result;
+    result = (char*)smalloc( sizeof( char ) * ( ( size * 3 ) + 1 ) );
+    length = simple_curl_urlencode_to( result, url, size );
+    result[length] = 0;
 
-    while( cur - url < size )
-    {
-        if ( ( (*cur) >= 'a' && (*cur) <= 'z' )
-          || ( (*cur) >= 'A' && (*cur) <= 'Z' )
-          || ( (*cur) >= '0' && (*cur) <= '9' ) )
-        {
-            // ASCII letter or digit. Simple write out the given character.
-            *(cur_result++) = *cur;
-        }
-        else
-        {
-            // Escaped character needs to be written.
-            *(cur_result++) = '%';
-            *(cur_result++) = hex_code[ (*cur) >> 4 ];
-            *(cur_result++) = hex_code[ (*cur) & 15 ];
-        }
-        ++cur;
-    }
     // Reallocate the string to occupy only the needed space.
-    result = (char*)srealloc( result, sizeof( char ) * ( cur_result - result + 1 ) );
+    result = (char*)srealloc( result, sizeof( char ) * ( length + 1 ) );
     return result;
 }
 
 /**
- * Execute a curl request using the given information
- *
- * Operation and url are mandatory informations.
- *
- * Operation is one of the following values:
- *  - SIMPLE_CURL_GET
- *  - SIMPLE_CURL_POST
- *  - SIMPLE_CURL_PUT
- *  - SIMPLE_CURL_HEAD
- *  - SIMPLE_CURL_DELETE
- *
- * Url is the url where the request is send to.
- *
- * Response_body will be filled with the body content of the response. It may
- * be NULL, in which case it is simple ignored and the received body content is
- * ignored.
+ * Set the timeouts, retry and hedging behaviour used for all following
+ * requests
  *
- * Response_header will be filled with a header linked list of received header
- * data splitted into key value pairs as defined by the used struct. If it is
- * NULL the headers will simply be ignored.
+ * The options are copied. This function needs to be called before any
+ * request is issued, as they are read without locking.
+ */
+void simple_curl_set_options( simple_curl_options_t* options )
+{
+    simple_curl_options = *options;
+}
+
+/**
+ * Retrieve a snapshot of the request counters
+ */
+void simple_curl_get_stats( simple_curl_stats_t* stats )
+{
+    stats->requests   = __sync_fetch_and_add( &simple_curl_stats.requests, 0 );
+    stats->retries    = __sync_fetch_and_add( &simple_curl_stats.retries, 0 );
+    stats->hedges     = __sync_fetch_and_add( &simple_curl_stats.hedges, 0 );
+    stats->hedge_wins = __sync_fetch_and_add( &simple_curl_stats.hedge_wins, 0 );
+    stats->timeouts   = __sync_fetch_and_add( &simple_curl_stats.timeouts, 0 );
+    stats->throttled  = __sync_fetch_and_add( &simple_curl_stats.throttled, 0 );
+    stats->preempted  = __sync_fetch_and_add( &simple_curl_stats.preempted, 0 );
+    stats->cancelled  = __sync_fetch_and_add( &simple_curl_stats.cancelled, 0 );
+}
+
+/**
+ * Set the priority of all following requests issued by the calling thread
  *
- * Request_body is the body content to be send in the request. This is
- * especially interesting if the operation is not a default GET but a POST or a
- * PUT. It may be NULL in which case not request body will be transmitted.
+ * Threads doing background work, like prefetching, use this to keep their
+ * requests from delaying the foreground ones. Foreground threads should keep
+ * the default SIMPLE_CURL_PRIORITY_AUTO.
+ */
+void simple_curl_set_priority( int priority )
+{
+    simple_curl_priority = priority;
+}
+
+/**
+ * Cancel all waiting and running requests of the given background priority
  *
- * Request_headers is a linked list of header key/value pairs send to the
- * server within the request. It may be NULL in which case only the default
- * headers will be send.
+ * Cancelled requests fail with a response code of 0. This is used to stop
+ * background work quickly, e.g. upon unmounting.
  */
-long simple_curl_request_complex( int operation, char* url, char** response_body, simple_curl_header_t** response_headers, char* request_body, simple_curl_header_t* request_headers )
+void simple_curl_cancel( int priority )
 {
-    CURL* ch = NULL;
-    struct curl_slist *curl_request_headers = NULL;
-    char curl_error[CURL_ERROR_SIZE];
-    simple_curl_receive_header_stream_t* received_header_stream = simple_curl_receive_header_stream_init();
-    simple_curl_receive_body_t*          received_body          = simple_curl_receive_body_init();
-    simple_curl_request_body_t*          request_body_stream    = NULL;
-    long response_code = 0L;
+    limiter_t* limiter = NULL;
 
-    // Initialize the request_body struct if a request body is supplied
-    if ( request_body != NULL )
+    pthread_mutex_lock( &simple_curl_limiters_lock );
+    for( limiter = simple_curl_limiters; limiter != NULL; limiter = limiter->next ) 
     {
-        request_body_stream = simple_curl_request_body_init( request_body, 0 );
+        limiter_cancel( limiter, priority );
     }
+    pthread_mutex_unlock( &simple_curl_limiters_lock );
+}
 
-    ch = curl_easy_init();
-    curl_easy_setopt( ch, CURLOPT_NOPROGRESS, 1 );
-    curl_easy_setopt( ch, CURLOPT_ERRORBUFFER, curl_error );
+/**
+ * Set the caller all following requests of the calling thread are issued for
+ *
+ * Waiting requests of different flows are served fairly, so a single caller
+ * issuing lots of requests does not starve the others. The uid selects the
+ * bandwidth cap set using simple_curl_set_bandwidth_cap.
+ */
+void simple_curl_set_caller( unsigned long flow, unsigned int uid )
+{
+    simple_curl_flow = flow;
+    simple_curl_uid  = uid;
+}
 
-    // Set the given url
-    curl_easy_setopt( ch, CURLOPT_URL, url );
+/**
+ * Limit the bandwidth of all requests issued on behalf of the given user to
+ * rate bytes per second
+ *
+ * A rate of 0 removes the cap. Caps may be changed at any time.
+ */
+void simple_curl_set_bandwidth_cap( unsigned int uid, unsigned long rate )
+{
+    simple_curl_cap_t** cap = NULL;
 
-    // Set all the needed callbacks to receive the body and header data
-    curl_easy_setopt( ch, CURLOPT_WRITEFUNCTION, simple_curl_write_body );
-    curl_easy_setopt( ch, CURLOPT_WRITEDATA, (void*)received_body );
-    curl_easy_setopt( ch, CURLOPT_HEADERFUNCTION, simple_curl_write_header );
-    curl_easy_setopt( ch, CURLOPT_HEADERDATA, (void*)received_header_stream );
+    pthread_mutex_lock( &simple_curl_caps_lock );
+    for( cap = &simple_curl_caps; *cap != NULL && (*cap)->uid != uid; cap = &(*cap)->next );
 
-    // The different request types need special kinds of options to be executed
-    // correctly
-    switch( operation )
+    if ( rate == 0 && *cap != NULL ) 
     {
-        case SIMPLE_CURL_GET:
-            curl_easy_setopt( ch, CURLOPT_HTTPGET, 1 );
-        break;
-        case SIMPLE_CURL_HEAD:
-            curl_easy_setopt( ch, CURLOPT_NOBODY, 1 );
-        break;
-        case SIMPLE_CURL_DELETE:
-            curl_easy_setopt( ch, CURLOPT_NOBODY, 1 );
-            curl_easy_setopt( ch, CURLOPT_CUSTOMREQUEST, "DELETE" );
+        simple_curl_cap_t* removed = *cap;
+        *cap = removed->next;
+        free( removed );
+    }
+    else if ( rate != 0 ) 
+    {
+        if ( *cap == NULL ) 
+        {
+            *cap = snew( simple_curl_cap_t );
+            (*cap)->uid = uid;
+        }
+        (*cap)->rate = rate;
+    }
+    pthread_mutex_unlock( &simple_curl_caps_lock );
+}
+
+/**
+ * Determine the number of bytes a request is expected to transfer
+ *
+ * Range requests transfer the requested range and uploads their body. The
+ * size of all other requests is not known in advance, so they are assumed
+ * to cost SIMPLE_CURL_REQUEST_COST.
+ */
+static uint64_t simple_curl_request_cost( int operation, char* request_body, simple_curl_header_t* request_headers )
+{
+    char* range = NULL;
+    unsigned long long first = 0;
+    unsigned long long last  = 0;
+
+    if ( operation == SIMPLE_CURL_PUT && request_body != NULL ) 
+    {
+        return strlen( request_body );
+    }
+
+    if ( request_headers != NULL 
+      && ( range = simple_curl_header_get_by_key( request_headers, "Range" ) ) != NULL 
+      && sscanf( range, "bytes=%llu-%llu", &first, &last ) == 2 
+      && last >= first ) 
+    {
+        return last - first + 1;
+    }
+
+    return SIMPLE_CURL_REQUEST_COST;
+}
+
+/**
+ * Delay a request until the bandwidth cap of its user allows it
+ *
+ * Every request reserves the time its cost takes at the capped rate, so
+ * concurrent requests of one user are spaced out evenly. The delay never
+ * extends beyond the deadline of the request.
+ */
+static void simple_curl_pace( simple_curl_call_t* call )
+{
+    simple_curl_cap_t* cap = NULL;
+    uint64_t now   = 0;
+    uint64_t start = 0;
+
+    // Without any caps the lock is not taken at all
+    if ( simple_curl_caps == NULL ) 
+    {
+        return;
+    }
+
+    now = simple_curl_now();
+
+    pthread_mutex_lock( &simple_curl_caps_lock );
+    for( cap = simple_curl_caps; cap != NULL && cap->uid != simple_curl_uid; cap = cap->next );
+    if ( cap != NULL ) 
+    {
+        start = ( cap->next_start > now ) ? cap->next_start : now;
+        cap->next_start = start + call->cost * 1000000 / cap->rate;
+    }
+    pthread_mutex_unlock( &simple_curl_caps_lock );
+
+    start = ( call->deadline != 0 && start > call->deadline ) ? call->deadline : start;
+    if ( start > now ) 
+    {
+        simple_curl_sleep( start - now );
+    }
+}
+
+/**
+ * Limit the bandwidth of all received and all sent data to the given number
+ * of bytes per second
+ *
+ * A rate of 0 disables the respective limit. The limits may be changed at
+ * any time. Requests started afterwards are subject to the new limits.
+ */
+void simple_curl_set_rate_limit( unsigned long download, unsigned long upload )
+{
+    unsigned long download_burst = download / SIMPLE_CURL_RATE_BURST;
+    unsigned long upload_burst   = upload / SIMPLE_CURL_RATE_BURST;
+
+    download_burst = ( download_burst < SIMPLE_CURL_RATE_BURST_MIN ) ? SIMPLE_CURL_RATE_BURST_MIN : download_burst;
+    upload_burst   = ( upload_burst < SIMPLE_CURL_RATE_BURST_MIN ) ? SIMPLE_CURL_RATE_BURST_MIN : upload_burst;
+
+    bucket_set_rate( &simple_curl_download, download, download_burst );
+    bucket_set_rate( &simple_curl_upload, upload, upload_burst );
+}
+
+/**
+ * Retrieve the current bandwidth limits in bytes per second
+ */
+void simple_curl_get_rate_limit( unsigned long* download, unsigned long* upload )
+{
+    *download = bucket_rate( &simple_curl_download );
+    *upload   = bucket_rate( &simple_curl_upload );
+}
+
+/**
+ * Current time of the monotonic clock in microseconds
+ */
+static uint64_t simple_curl_now()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Sleep the given number of microseconds
+ */
+static void simple_curl_sleep( uint64_t usec )
+{
+    struct timespec duration;
+    duration.tv_sec  = usec / 1000000;
+    duration.tv_nsec = ( usec % 1000000 ) * 1000;
+    while( nanosleep( &duration, &duration ) == -1 && errno == EINTR );
+}
+
+/**
+ * Determine the histogram bucket of the given latency in microseconds
+ *
+ * Latencies below 8 microseconds get a bucket of their own. Above that every
+ * power of two is split into four buckets.
+ */
+static int simple_curl_latency_bucket( uint64_t usec )
+{
+    int msb    = 0;
+    int bucket = 0;
+
+    if ( usec < 8 ) 
+    {
+        return usec;
+    }
+
+    msb    = 63 - __builtin_clzll( usec );
+    bucket = msb * 4 + ( ( usec >> ( msb - 2 ) ) & 3 );
+    return ( bucket < SIMPLE_CURL_LATENCY_BUCKETS ) ? bucket : SIMPLE_CURL_LATENCY_BUCKETS - 1;
+}
+
+/**
+ * Upper bound of the latencies stored in the given bucket in microseconds
+ */
+static uint64_t simple_curl_latency_bucket_limit( int bucket )
+{
+    if ( bucket < 8 ) 
+    {
+        return bucket + 1;
+    }
+
+    return (uint64_t)( 4 + ( bucket & 3 ) + 1 ) << ( bucket / 4 - 2 );
+}
+
+/**
+ * Add the latency of a finished transfer to the given histogram
+ */
+static void simple_curl_latency_record( simple_curl_latency_t* latency, uint64_t usec )
+{
+    int i = 0;
+
+    pthread_mutex_lock( &latency->lock );
+    ++latency->counts[simple_curl_latency_bucket( usec )];
+
+    // Age all samples once the window is full, so the histogram follows
+    // changing conditions of the backend.
+    if ( ++latency->total >= 2 * SIMPLE_CURL_LATENCY_WINDOW ) 
+    {
+        latency->total = 0;
+        for( i = 0; i < SIMPLE_CURL_LATENCY_BUCKETS; ++i ) 
+        {
+            latency->counts[i] /= 2;
+            latency->total += latency->counts[i];
+        }
+    }
+    pthread_mutex_unlock( &latency->lock );
+}
+
+/**
+ * Estimate the given percentile of the recorded latencies in microseconds
+ *
+ * 0 is returned if not enough samples have been recorded yet.
+ */
+static uint64_t simple_curl_latency_percentile( simple_curl_latency_t* latency, double percentile )
+{
+    uint64_t result = 0;
+    unsigned long target = 0;
+    unsigned long seen   = 0;
+    int i = 0;
+
+    pthread_mutex_lock( &latency->lock );
+    if ( latency->total >= SIMPLE_CURL_LATENCY_MIN_SAMPLES ) 
+    {
+        target = (unsigned long)( latency->total * percentile / 100.0 );
+        for( i = 0; i < SIMPLE_CURL_LATENCY_BUCKETS; ++i ) 
+        {
+            if ( ( seen += latency->counts[i] ) > target ) 
+            {
+                break;
+            }
+        }
+        result = simple_curl_latency_bucket_limit( ( i < SIMPLE_CURL_LATENCY_BUCKETS ) ? i : SIMPLE_CURL_LATENCY_BUCKETS - 1 );
+    }
+    pthread_mutex_unlock( &latency->lock );
+
+    return result;
+}
+
+/**
+ * Determine after how many microseconds a duplicate of a request with the
+ * given operation is started
+ *
+ * 0 is returned if the request should not be hedged, because hedging is
+ * disabled or not enough latencies are known yet.
+ */
+static uint64_t simple_curl_hedge_delay( int operation )
+{
+    uint64_t delay = 0;
+
+    if ( simple_curl_options.hedge_percentile <= 0 ) 
+    {
+        return 0;
+    }
+
+    if ( ( delay = simple_curl_latency_percentile( &simple_curl_latencies[operation], simple_curl_options.hedge_percentile ) ) == 0 ) 
+    {
+        return 0;
+    }
+
+    return ( delay < (uint64_t)simple_curl_options.hedge_min * 1000 ) ? (uint64_t)simple_curl_options.hedge_min * 1000 : delay;
+}
+
+/**
+ * Retrieve the concurrency limiter of the endpoint the given url belongs to
+ *
+ * The endpoint consists of the scheme, the host and the port of the url.
+ * NULL is returned if the concurrency is not limited.
+ */
+static limiter_t* simple_curl_limiter( char* url )
+{
+    limiter_t* limiter = NULL;
+    char* host = strstr( url, "://" );
+    size_t length = 0;
+
+    if ( simple_curl_options.concurrency_max <= 0 ) 
+    {
+        return NULL;
+    }
+
+    host   = ( host == NULL ) ? url : host + 3;
+    length = ( host - url ) + strcspn( host, "/" );
+
+    pthread_mutex_lock( &simple_curl_limiters_lock );
+    for( limiter = simple_curl_limiters; limiter != NULL; limiter = limiter->next ) 
+    {
+        if ( strncmp( limiter->endpoint, url, length ) == 0 && limiter->endpoint[length] == 0 ) 
+        {
+            break;
+        }
+    }
+
+    if ( limiter == NULL ) 
+    {
+        char* endpoint = strndup( url, length );
+        limiter = limiter_new( 
+            endpoint, 
+            simple_curl_options.concurrency, 
+            1, 
+            simple_curl_options.concurrency_max, 
+            SIMPLE_CURL_LATENCY_TOLERANCE 
+        );
+        limiter->next = simple_curl_limiters;
+        simple_curl_limiters = limiter;
+        free( endpoint );
+    }
+    pthread_mutex_unlock( &simple_curl_limiters_lock );
+
+    return limiter;
+}
+
+/**
+ * Create and configure the curl handle of a new transfer of the given call
+ *
+ * The transfer may not take longer than the deadline of the call. Before it
+ * is started a place in the window of the endpoint is taken. If wait is set
+ * the call blocks until one is available. FALSE is returned if no place
+ * could be taken, in which case the transfer is marked as timed out without
+ * a curl handle.
+ */
+static int simple_curl_transfer_start( simple_curl_call_t* call, simple_curl_transfer_t* transfer, int wait )
+{
+    CURL* ch = NULL;
+
+    memset( transfer, 0, sizeof( simple_curl_transfer_t ) );
+    span_begin( &transfer->span, 0 );
+    transfer->enqueued = simple_curl_now();
+
+    if ( call->limiter != NULL ) 
+    {
+        int state = ( wait ) 
+            ? limiter_acquire( call->limiter, &transfer->slot, call->priority, call->flow, call->cost, call->deadline ) 
+            : ( limiter_try_acquire( call->limiter, &transfer->slot, call->priority ) ? LIMITER_SLOT_GRANTED : LIMITER_SLOT_TIMEOUT );
+
+        if ( state == LIMITER_SLOT_CANCELLED ) 
+        {
+            transfer->result = CURLE_ABORTED_BY_CALLBACK;
+            snprintf( transfer->error, CURL_ERROR_SIZE, "The request has been cancelled" );
+            simple_curl_transfer_span( call, transfer );
+            return 0;
+        }
+        if ( state != LIMITER_SLOT_GRANTED ) 
+        {
+            transfer->result = CURLE_OPERATION_TIMEDOUT;
+            snprintf( transfer->error, CURL_ERROR_SIZE, "No request slot for %s became available before the deadline", call->limiter->endpoint );
+            simple_curl_transfer_span( call, transfer );
+            return 0;
+        }
+        transfer->slot_held = 1;
+    }
+
+    transfer->ch      = ch = curl_easy_init();
+    transfer->headers = simple_curl_headers_init();
+    transfer->body    = simple_curl_receive_body_init();
+    transfer->start   = simple_curl_now();
+
+    // Every transfer needs its own request body stream, as the data is read
+    // from the start again by a retry or a duplicate.
+    if ( call->request_body != NULL )
+    {
+        transfer->request_body = simple_curl_request_body_init( call->request_body, 0 );
+    }
+
+    curl_easy_setopt( ch, CURLOPT_NOPROGRESS, 1 );
+    // Signals can not be used for timeouts if requests are issued from
+    // multiple threads.
+    curl_easy_setopt( ch, CURLOPT_NOSIGNAL, 1 );
+    curl_easy_setopt( ch, CURLOPT_ERRORBUFFER, transfer->error );
+
+    // Set the given url
+    curl_easy_setopt( ch, CURLOPT_URL, call->url );
+
+    // Set all the needed callbacks to receive the body and header data
+    if ( call->limited ) 
+    {
+        curl_easy_setopt( ch, CURLOPT_WRITEFUNCTION, simple_curl_write_limited );
+        curl_easy_setopt( ch, CURLOPT_WRITEDATA, (void*)transfer );
+    }
+    else 
+    {
+        curl_easy_setopt( ch, CURLOPT_WRITEFUNCTION, simple_curl_write_body );
+        curl_easy_setopt( ch, CURLOPT_WRITEDATA, (void*)transfer->body );
+    }
+    curl_easy_setopt( ch, CURLOPT_HEADERFUNCTION, simple_curl_write_header );
+    curl_easy_setopt( ch, CURLOPT_HEADERDATA, (void*)transfer->headers );
+
+    // Bound the time the transfer may take. A timeout of 0 means no timeout
+    // for curl, therefore at least one millisecond is used.
+    curl_easy_setopt( ch, CURLOPT_CONNECTTIMEOUT_MS, simple_curl_options.connect_timeout );
+    if ( call->deadline != 0 ) 
+    {
+        long remaining = ( call->deadline > transfer->start ) ? (long)( ( call->deadline - transfer->start ) / 1000 ) : 0;
+        curl_easy_setopt( ch, CURLOPT_TIMEOUT_MS, ( remaining > 0 ) ? remaining : 1L );
+    }
+    if ( simple_curl_options.stall_timeout > 0 ) 
+    {
+        curl_easy_setopt( ch, CURLOPT_LOW_SPEED_LIMIT, 1L );
+        curl_easy_setopt( ch, CURLOPT_LOW_SPEED_TIME, simple_curl_options.stall_timeout );
+    }
+
+    // Background requests may be preempted or cancelled while they run
+    if ( transfer->slot_held && call->priority >= SIMPLE_CURL_PRIORITY_PREFETCH ) 
+    {
+        curl_easy_setopt( ch, CURLOPT_NOPROGRESS, 0 );
+        curl_easy_setopt( ch, CURLOPT_XFERINFOFUNCTION, simple_curl_progress );
+        curl_easy_setopt( ch, CURLOPT_XFERINFODATA, (void*)transfer );
+    }
+
+    // The different request types need special kinds of options to be executed
+    // correctly
+    switch( call->operation )
+    {
+        case SIMPLE_CURL_GET:
+            curl_easy_setopt( ch, CURLOPT_HTTPGET, 1 );
+        break;
+        case SIMPLE_CURL_HEAD:
+            curl_easy_setopt( ch, CURLOPT_NOBODY, 1 );
+        break;
+        case SIMPLE_CURL_DELETE:
+            curl_easy_setopt( ch, CURLOPT_NOBODY, 1 );
+            curl_easy_setopt( ch, CURLOPT_CUSTOMREQUEST, "DELETE" );
         break;
         case SIMPLE_CURL_POST:
             curl_easy_setopt( ch, CURLOPT_POST, 1 );
-            if ( request_body != NULL )
+            if ( transfer->request_body != NULL )
             {
-                curl_easy_setopt( ch, CURLOPT_POSTFIELDSIZE_LARGE, strlen( request_body ) );
-                curl_easy_setopt( ch, CURLOPT_READDATA, (void*)request_body );
-                curl_easy_setopt( ch, CURLOPT_READFUNCTION, simple_curl_read_body );
+                curl_easy_setopt( ch, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)transfer->request_body->length );
+                curl_easy_setopt( ch, CURLOPT_READDATA, ( call->limited ) ? (void*)transfer : (void*)transfer->request_body );
+                curl_easy_setopt( ch, CURLOPT_READFUNCTION, ( call->limited ) ? simple_curl_read_limited : simple_curl_read_body );
             }
         break;
         case SIMPLE_CURL_PUT:
-            if ( request_body != NULL )
+            if ( transfer->request_body != NULL )
             {
                 curl_easy_setopt( ch, CURLOPT_UPLOAD, 1 );
-                curl_easy_setopt( ch, CURLOPT_INFILESIZE_LARGE, strlen( request_body ) );
-                curl_easy_setopt( ch, CURLOPT_READDATA, (void*)request_body );
-                curl_easy_setopt( ch, CURLOPT_READFUNCTION, simple_curl_read_body );
+                curl_easy_setopt( ch, CURLOPT_INFILESIZE_LARGE, (curl_off_t)transfer->request_body->length );
+                curl_easy_setopt( ch, CURLOPT_READDATA, ( call->limited ) ? (void*)transfer : (void*)transfer->request_body );
+                curl_easy_setopt( ch, CURLOPT_READFUNCTION, ( call->limited ) ? simple_curl_read_limited : simple_curl_read_body );
             }
             else 
             {
@@ -507,61 +1357,581 @@ long simple_curl_request_complex( int operation, char* url, char** response_body
         break;
     }
 
-    if ( request_headers != NULL )
+    if ( call->headers != NULL )
     {
-        simple_curl_prepare_curl_headers( request_headers, &curl_request_headers );
-        curl_easy_setopt( ch, CURLOPT_HTTPHEADER, curl_request_headers );
+        curl_easy_setopt( ch, CURLOPT_HTTPHEADER, call->headers );
     }
 
-    if ( curl_easy_perform( ch ) != 0 )
+    return 1;
+}
+
+/**
+ * Progress callback of background transfers aborting them as soon as they
+ * are cancelled
+ */
+static int simple_curl_progress( void* data, curl_off_t download_total, curl_off_t download_now, curl_off_t upload_total, curl_off_t upload_now )
+{
+    (void)download_total;
+    (void)download_now;
+    (void)upload_total;
+    (void)upload_now;
+
+    return ( (simple_curl_transfer_t*)data )->slot.cancelled;
+}
+
+/**
+ * Store the result of a finished transfer
+ *
+ * The latency of successful transfers which may be hedged is recorded to
+ * determine the hedging delay of following requests. The place in the window
+ * of the limiter is freed. Throttling responses and timeouts shrink the
+ * window, as does an increasing time to the first byte.
+ */
+static void simple_curl_transfer_finish( simple_curl_call_t* call, simple_curl_transfer_t* transfer, CURLcode result )
+{
+    uint64_t end = simple_curl_now();
+    double first_byte = 0;
+    curl_off_t received = 0;
+    curl_off_t sent     = 0;
+    int outcome  = LIMITER_IGNORED;
+
+    transfer->result = result;
+
+    // Count the body bytes of every transfer including the failed ones, as
+    // they have been transferred nevertheless.
+    curl_easy_getinfo( transfer->ch, CURLINFO_SIZE_DOWNLOAD_T, &received );
+    curl_easy_getinfo( transfer->ch, CURLINFO_SIZE_UPLOAD_T, &sent );
+    metrics_count( METRICS_BYTES_RECEIVED, (uint64_t)received );
+    metrics_count( METRICS_BYTES_SENT, (uint64_t)sent );
+    transfer->bytes = (uint64_t)( received + sent );
+    if ( result == CURLE_OK ) 
     {
-        set_error( "%s", curl_error );
-        curl_easy_cleanup( ch );
-        simple_curl_receive_header_stream_free( received_header_stream );
-        simple_curl_receive_body_free( received_body );
-        ( request_body_stream != NULL )  ? simple_curl_request_body_free( request_body_stream ) : NULL;
-        ( curl_request_headers != NULL ) ? curl_slist_free_all( curl_request_headers )   : NULL;
-        return 0;
+        curl_easy_getinfo( transfer->ch, CURLINFO_RESPONSE_CODE, &transfer->response_code );
+        curl_easy_getinfo( transfer->ch, CURLINFO_STARTTRANSFER_TIME, &first_byte );
     }
 
-    curl_easy_getinfo( ch, CURLINFO_RESPONSE_CODE, &response_code );
+    if ( call->hedge && !simple_curl_transient( transfer ) ) 
+    {
+        simple_curl_latency_record( &simple_curl_latencies[call->operation], end - transfer->start );
+    }
 
-    curl_easy_cleanup( ch );
+    if ( transfer->response_code == 429 || transfer->response_code == 503 ) 
+    {
+        __sync_fetch_and_add( &simple_curl_stats.throttled, 1 );
+        outcome = LIMITER_DROPPED;
+    }
+    else if ( result == CURLE_OPERATION_TIMEDOUT ) 
+    {
+        outcome = LIMITER_DROPPED;
+    }
+    else if ( result == CURLE_ABORTED_BY_CALLBACK ) 
+    {
+        __sync_fetch_and_add( ( transfer->slot.preempted ) ? &simple_curl_stats.preempted : &simple_curl_stats.cancelled, 1 );
+        snprintf( transfer->error, CURL_ERROR_SIZE, ( transfer->slot.preempted ) 
+            ? "The request has been preempted by a foreground request" 
+            : "The request has been cancelled" 
+        );
+    }
+    else if ( !simple_curl_transient( transfer ) ) 
+    {
+        outcome = LIMITER_SUCCESS;
+    }
 
-    // Free the converted request headers if there are any
-    ( curl_request_headers != NULL ) ? curl_slist_free_all( curl_request_headers ) : NULL;
+    if ( transfer->slot_held ) 
+    {
+        limiter_release( call->limiter, &transfer->slot, transfer->start, end, (uint64_t)( first_byte * 1000000 ), outcome );
+        transfer->slot_held = 0;
+    }
+
+    simple_curl_transfer_span( call, transfer );
+}
+
+/**
+ * Determine the phases of a finished transfer as reported by cURL
+ *
+ * Transfers which never got a place in the window of their limiter spent
+ * all of their time queued.
+ */
+static void simple_curl_transfer_timing( simple_curl_transfer_t* transfer, span_timing_t* timing )
+{
+    const CURLINFO infos[] = { CURLINFO_NAMELOOKUP_TIME_T, CURLINFO_CONNECT_TIME_T, CURLINFO_APPCONNECT_TIME_T, CURLINFO_STARTTRANSFER_TIME_T };
+    uint32_t* phases[] = { &timing->namelookup, &timing->connect, &timing->appconnect, &timing->starttransfer };
+    uint32_t previous = 0;
+    int i = 0;
+
+    timing->queued = previous = (uint32_t)( ( ( transfer->ch != NULL ) ? transfer->start : simple_curl_now() ) - transfer->enqueued );
+
+    // Every phase includes the previous ones. Phases which did not happen,
+    // like the TLS handshake of a plain connection, are reported as 0 by
+    // cURL and end at the previous phase.
+    for( i = 0; i < 4; ++i ) 
+    {
+        curl_off_t phase = 0;
+
+        if ( transfer->ch != NULL ) 
+        {
+            curl_easy_getinfo( transfer->ch, infos[i], &phase );
+        }
+        if ( timing->queued + (uint32_t)phase > previous ) 
+        {
+            previous = timing->queued + (uint32_t)phase;
+        }
+        *phases[i] = previous;
+    }
+}
+
+/**
+ * Record the span of a finished transfer
+ */
+static void simple_curl_transfer_span( simple_curl_call_t* call, simple_curl_transfer_t* transfer )
+{
+    span_timing_t timing;
+
+    if ( transfer->span.id == 0 ) 
+    {
+        return;
+    }
+
+    simple_curl_transfer_timing( transfer, &timing );
+    span_end( &transfer->span, SPAN_HTTP, simple_curl_methods[call->operation], call->url, transfer->response_code, transfer->bytes, &timing );
+}
+
+/**
+ * Record a request started at start in the slow request log if it took
+ * longer than its threshold
+ *
+ * The given transfer is the last one issued for the request.
+ */
+static void simple_curl_record_slow( simple_curl_call_t* call, simple_curl_transfer_t* transfer, uint64_t start, int retries, simple_curl_header_t* request_headers )
+{
+    slowlog_entry_t entry;
+    uint64_t duration = simple_curl_now() - start;
+    char* range = NULL;
+
+    if ( slowlog_threshold == 0 || duration < slowlog_threshold ) 
+    {
+        return;
+    }
+
+    memset( &entry, 0, sizeof( slowlog_entry_t ) );
+    entry.duration = duration;
+    entry.method   = simple_curl_methods[call->operation];
+    entry.status   = transfer->response_code;
+    entry.bytes    = transfer->bytes;
+    entry.retries  = retries;
+    simple_curl_transfer_timing( transfer, &entry.timing );
+    strncpy( entry.url, call->url, SLOWLOG_URL_SIZE - 1 );
+    if ( request_headers != NULL && ( range = simple_curl_header_get_by_key( request_headers, "Range" ) ) != NULL ) 
+    {
+        strncpy( entry.range, range, SLOWLOG_RANGE_SIZE - 1 );
+    }
+    if ( transfer->result != CURLE_OK ) 
+    {
+        strncpy( entry.error, ( transfer->error[0] != 0 ) ? transfer->error : curl_easy_strerror( transfer->result ), SLOWLOG_ERROR_SIZE - 1 );
+    }
 
-    // Free the request body struct if there was any created
+    slowlog_add( &entry );
+}
+
+/**
+ * Free everything belonging to a transfer
+ *
+ * A transfer which has been cancelled before it finished frees its place in
+ * the window of the limiter without influencing it. Transfers which have
+ * never been started are ignored.
+ */
+static void simple_curl_transfer_free( simple_curl_call_t* call, simple_curl_transfer_t* transfer )
+{
+    if ( transfer->slot_held ) 
+    {
+        limiter_release( call->limiter, &transfer->slot, transfer->start, simple_curl_now(), 0, LIMITER_IGNORED );
+        transfer->slot_held = 0;
+    }
+
+    if ( transfer->ch == NULL ) 
+    {
+        return;
+    }
+
+    curl_easy_cleanup( transfer->ch );
+    transfer->ch = NULL;
+    simple_curl_headers_free( transfer->headers );
+    simple_curl_receive_body_free( transfer->body );
     // This frees only the struct itself not the attached data. The data needs
     // to be freed by the calling function, which supplied this information.
-    ( request_body_stream != NULL ) ? simple_curl_request_body_free( request_body_stream ) : NULL;
+    ( transfer->request_body != NULL ) ? simple_curl_request_body_free( transfer->request_body ) : NULL;
+}
 
-    if ( response_body == NULL )
+/**
+ * Check if a finished transfer failed in a way a retry might fix
+ *
+ * Connection problems, timeouts, throttling and temporary server errors are
+ * considered transient. Everything else is a valid answer, even if it is an
+ * error like a 404.
+ */
+static int simple_curl_transient( simple_curl_transfer_t* transfer )
+{
+    switch( transfer->result ) 
     {
-        // Destroy the received body
-        simple_curl_receive_body_free( received_body );
+        case CURLE_OK:
+            switch( transfer->response_code ) 
+            {
+                case 429:
+                case 500:
+                case 502:
+                case 503:
+                case 504:
+                    return 1;
+            }
+            return 0;
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_GOT_NOTHING:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+            return 1;
+        default:
+            return 0;
     }
-    else
+}
+
+/**
+ * Determine the delay in microseconds before the given attempt is retried
+ *
+ * The delay is chosen randomly up to an exponentially growing limit, so
+ * clients failing at the same time do not retry at the same time. A
+ * Retry-After header given in seconds overrides a shorter delay. Without a
+ * deadline it is capped at the maximal backoff.
+ */
+static uint64_t simple_curl_backoff( int attempt, simple_curl_transfer_t* transfer )
+{
+    static __thread unsigned int seed = 0;
+    uint64_t limit = (uint64_t)simple_curl_options.backoff_max * 1000;
+    uint64_t delay = 0;
+    char* retry_after = NULL;
+
+    if ( attempt < 32 && ( (uint64_t)simple_curl_options.backoff * 1000 << attempt ) < limit ) 
     {
-        // Set the return value
-        (*response_body) = received_body->ptr;
-        // Free only the receive body struct without the inner string
-        free( received_body );
+        limit = (uint64_t)simple_curl_options.backoff * 1000 << attempt;
     }
 
-    if ( response_headers == NULL )
+    if ( seed == 0 ) 
     {
-        // Destroy the received headers
-        simple_curl_receive_header_stream_free( received_header_stream );
+        seed = (unsigned int)simple_curl_now() ^ (unsigned int)(uintptr_t)&seed;
     }
-    else
+    delay = (uint64_t)( ( rand_r( &seed ) / ( RAND_MAX + 1.0 ) ) * limit );
+
+    if ( transfer->result == CURLE_OK 
+      && ( retry_after = simple_curl_headers_get_by_key( transfer->headers, "Retry-After" ) ) != NULL ) 
     {
-        // Set the return value
-        (*response_headers) = received_header_stream->ptr->root;
-        // Free only the header stream struct not the internal list
-        free( received_header_stream );
+        uint64_t requested = strtoull( retry_after, NULL, 10 ) * 1000000;
+        if ( simple_curl_options.deadline == 0 && requested > (uint64_t)simple_curl_options.backoff_max * 1000 ) 
+        {
+            requested = (uint64_t)simple_curl_options.backoff_max * 1000;
+        }
+        delay = ( requested > delay ) ? requested : delay;
     }
 
+    return delay;
+}
+
+/**
+ * Run a transfer and start a duplicate of it once it took longer than the
+ * given delay in microseconds
+ *
+ * Transfers needs to provide space for two transfers, the first one already
+ * being started. The transfer answering first is returned. A transient
+ * failure is only returned if no other transfer is running anymore. A delay
+ * of 0 never starts a duplicate.
+ *
+ * Transfers paused by the bandwidth limits are resumed once their tokens
+ * are available. Until then the call sleeps in curl_multi_poll.
+ */
+static simple_curl_transfer_t* simple_curl_perform( simple_curl_call_t* call, simple_curl_transfer_t* transfers, uint64_t delay )
+{
+    CURLM* multi = curl_multi_init();
+    simple_curl_transfer_t* winner = NULL;
+    simple_curl_transfer_t* failed = NULL;
+    uint64_t hedge_at = ( delay != 0 ) ? transfers[0].start + delay : UINT64_MAX;
+    int launched = 1;
+    int running  = 0;
+
+    curl_multi_add_handle( multi, transfers[0].ch );
+
+    while( winner == NULL ) 
+    {
+        CURLMsg* message = NULL;
+        int pending = 0;
+        int timeout = 100;
+
+        curl_multi_perform( multi, &running );
+
+        while( winner == NULL && ( message = curl_multi_info_read( multi, &pending ) ) != NULL ) 
+        {
+            simple_curl_transfer_t* transfer = ( message->easy_handle == transfers[0].ch ) ? &transfers[0] : &transfers[1];
+
+            if ( message->msg != CURLMSG_DONE ) 
+            {
+                continue;
+            }
+
+            simple_curl_transfer_finish( call, transfer, message->data.result );
+            if ( !simple_curl_transient( transfer ) ) 
+            {
+                winner = transfer;
+            }
+            else 
+            {
+                failed = transfer;
+            }
+        }
+
+        if ( winner == NULL && running == 0 && failed != NULL ) 
+        {
+            winner = failed;
+        }
+        if ( winner != NULL ) 
+        {
+            break;
+        }
+
+        if ( call->limited ) 
+        {
+            uint64_t now = simple_curl_now();
+            int i = 0;
+
+            for( i = 0; i < launched; ++i ) 
+            {
+                if ( transfers[i].paused && now >= transfers[i].resume_at ) 
+                {
+                    // The callbacks may pause the transfer again right away
+                    transfers[i].paused = 0;
+                    curl_easy_pause( transfers[i].ch, CURLPAUSE_CONT );
+                }
+                if ( transfers[i].paused && ( transfers[i].resume_at - now ) / 1000 + 1 < (uint64_t)timeout ) 
+                {
+                    timeout = ( transfers[i].resume_at - now ) / 1000 + 1;
+                }
+            }
+        }
+
+        if ( launched == 1 && hedge_at != UINT64_MAX ) 
+        {
+            uint64_t now = simple_curl_now();
+            if ( now >= hedge_at ) 
+            {
+                // A duplicate is only sent if the window of the endpoint has
+                // room for it. Otherwise it would only add to the load.
+                if ( simple_curl_transfer_start( call, &transfers[1], 0 ) ) 
+                {
+                    curl_multi_add_handle( multi, transfers[1].ch );
+                    launched = 2;
+                    __sync_fetch_and_add( &simple_curl_stats.hedges, 1 );
+                    continue;
+                }
+                hedge_at = UINT64_MAX;
+            }
+            if ( ( hedge_at - now ) / 1000 + 1 < (uint64_t)timeout ) 
+            {
+                timeout = (int)( ( hedge_at - now ) / 1000 + 1 );
+            }
+        }
+
+#if LIBCURL_VERSION_NUM >= 0x074200
+        curl_multi_poll( multi, NULL, 0, timeout, NULL );
+#else
+        curl_multi_wait( multi, NULL, 0, timeout, NULL );
+#endif
+    }
+
+    curl_multi_remove_handle( multi, transfers[0].ch );
+    if ( launched == 2 ) 
+    {
+        curl_multi_remove_handle( multi, transfers[1].ch );
+        if ( winner == &transfers[1] ) 
+        {
+            __sync_fetch_and_add( &simple_curl_stats.hedge_wins, 1 );
+        }
+    }
+    curl_multi_cleanup( multi );
+
+    return winner;
+}
+
+/**
+ * Execute a curl request using the given information
+ *
+ * Operation and url are mandatory informations.
+ *
+ * Operation is one of the following values:
+ *  - SIMPLE_CURL_GET
+ *  - SIMPLE_CURL_POST
+ *  - SIMPLE_CURL_PUT
+ *  - SIMPLE_CURL_HEAD
+ *  - SIMPLE_CURL_DELETE
+ *
+ * GET and HEAD may be combined with SIMPLE_CURL_HEDGE to allow a duplicate
+ * request to be issued if the first one is slow.
+ *
+ * Url is the url where the request is send to.
+ *
+ * Response_body will be filled with the body content of the response. It may
+ * be NULL, in which case it is simple ignored and the received body content is
+ * ignored.
+ *
+ * Response_header will be filled with a structure containing all received
+ * headers. It needs to be freed using simple_curl_headers_free. If it is NULL
+ * the headers will simply be ignored.
+ *
+ * Request_body is the body content to be send in the request. This is
+ * especially interesting if the operation is not a default GET but a POST or a
+ * PUT. It may be NULL in which case not request body will be transmitted.
+ *
+ * Request_headers is a linked list of header key/value pairs send to the
+ * server within the request. It may be NULL in which case only the default
+ * headers will be send.
+ *
+ * Transient failures of all requests but POST are retried according to the
+ * options set using simple_curl_set_options. If the last attempt failed
+ * without any response 0 is returned and the reason is available through
+ * simple_curl_error. Otherwise the status code of the last response is
+ * returned.
+ */
+long simple_curl_request_complex( int operation, char* url, char** response_body, simple_curl_headers_t** response_headers, char* request_body, simple_curl_header_t* request_headers )
+{
+    simple_curl_call_t call;
+    simple_curl_transfer_t transfers[2];
+    simple_curl_transfer_t* result = NULL;
+    long response_code = 0L;
+    int attempt = 0;
+    uint64_t start = simple_curl_now();
+
+    call.operation    = SIMPLE_CURL_OPERATION( operation );
+    call.url          = url;
+    call.request_body = request_body;
+    call.headers      = NULL;
+    call.hedge        = ( operation & SIMPLE_CURL_HEDGE ) && ( call.operation == SIMPLE_CURL_GET || call.operation == SIMPLE_CURL_HEAD );
+    call.deadline     = ( simple_curl_options.deadline > 0 ) ? simple_curl_now() + (uint64_t)simple_curl_options.deadline * 1000 : 0;
+    call.limiter      = simple_curl_limiter( url );
+    call.priority     = simple_curl_priority;
+    call.flow         = simple_curl_flow;
+    call.cost         = simple_curl_request_cost( call.operation, request_body, request_headers );
+    call.limited      = ( bucket_rate( &simple_curl_download ) > 0 || bucket_rate( &simple_curl_upload ) > 0 );
+
+    if ( call.priority == SIMPLE_CURL_PRIORITY_AUTO ) 
+    {
+        if ( operation & SIMPLE_CURL_DATA ) 
+        {
+            call.priority = SIMPLE_CURL_PRIORITY_DATA;
+        }
+        else if ( call.operation == SIMPLE_CURL_PUT && request_body != NULL ) 
+        {
+            call.priority = SIMPLE_CURL_PRIORITY_UPLOAD;
+        }
+        else 
+        {
+            call.priority = SIMPLE_CURL_PRIORITY_METADATA;
+        }
+    }
+
+    __sync_fetch_and_add( &simple_curl_stats.requests, 1 );
+    simple_curl_pace( &call );
+
+    if ( request_headers != NULL )
+    {
+        simple_curl_prepare_curl_headers( request_headers, &call.headers );
+    }
+
+    for( attempt = 0; ; ++attempt ) 
+    {
+        uint64_t delay = ( call.hedge ) ? simple_curl_hedge_delay( call.operation ) : 0;
+
+        transfers[1].ch   = NULL;
+        transfers[1].slot_held = 0;
+
+        if ( !simple_curl_transfer_start( &call, &transfers[0], 1 ) ) 
+        {
+            result = &transfers[0];
+        }
+        else if ( delay == 0 && !call.limited ) 
+        {
+            simple_curl_transfer_finish( &call, &transfers[0], curl_easy_perform( transfers[0].ch ) );
+            result = &transfers[0];
+        }
+        else 
+        {
+            result = simple_curl_perform( &call, transfers, delay );
+        }
+
+        if ( !simple_curl_transient( result ) 
+          || call.operation == SIMPLE_CURL_POST 
+          || attempt >= simple_curl_options.retries ) 
+        {
+            break;
+        }
+
+        // Give up if the deadline would pass before the next attempt
+        {
+            uint64_t backoff = simple_curl_backoff( attempt, result );
+            if ( call.deadline != 0 && simple_curl_now() + backoff >= call.deadline ) 
+            {
+                break;
+            }
+
+            if ( result->result != CURLE_OK ) 
+            {
+                LOG( LOGGER_INFO, "Retrying %s in %llu ms: %s", url, (unsigned long long)( backoff / 1000 ), curl_easy_strerror( result->result ) );
+            }
+            else 
+            {
+                LOG( LOGGER_INFO, "Retrying %s in %llu ms: status %ld", url, (unsigned long long)( backoff / 1000 ), result->response_code );
+            }
+            simple_curl_transfer_free( &call, &transfers[0] );
+            simple_curl_transfer_free( &call, &transfers[1] );
+            __sync_fetch_and_add( &simple_curl_stats.retries, 1 );
+            simple_curl_sleep( backoff );
+        }
+    }
+
+    simple_curl_record_slow( &call, result, start, attempt, request_headers );
+
+    // Free the converted request headers if there are any
+    ( call.headers != NULL ) ? curl_slist_free_all( call.headers ) : NULL;
+
+    if ( result->result != CURLE_OK )
+    {
+        if ( result->result == CURLE_OPERATION_TIMEDOUT ) 
+        {
+            __sync_fetch_and_add( &simple_curl_stats.timeouts, 1 );
+        }
+        set_error( "%s", ( result->error[0] != 0 ) ? result->error : curl_easy_strerror( result->result ) );
+        simple_curl_transfer_free( &call, &transfers[0] );
+        simple_curl_transfer_free( &call, &transfers[1] );
+        return 0;
+    }
+
+    response_code = result->response_code;
+
+    if ( response_body != NULL )
+    {
+        // Hand out the received string, which is not freed together with
+        // the transfer anymore.
+        (*response_body) = result->body->ptr;
+        result->body->ptr = NULL;
+    }
+
+    if ( response_headers != NULL )
+    {
+        (*response_headers) = result->headers;
+        result->headers = NULL;
+    }
+
+    simple_curl_transfer_free( &call, &transfers[0] );
+    simple_curl_transfer_free( &call, &transfers[1] );
+
     return response_code;
 }
 
@@ -577,7 +1947,7 @@ static simple_curl_request_body_t* simple_curl_request_body_init( char* data, lo
 {
     simple_curl_request_body_t* body = snew( simple_curl_request_body_t );
     body->ptr  = data;
-    body->length = ( size == 0 ) ? strlen( data ) : size;
+    body->length = ( size == 0 ) ? strlen( data ) : (size_t)size;
 
     return body;
 }
@@ -22,12 +22,124 @@
  * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
  */
 
+#include "salloc.h"
+
+/*
+ * All simple_curl functions may be called concurrently from different
+ * threads. Every request uses its own curl handle and the last error is
+ * stored per thread.
+ */
+
 #define SIMPLE_CURL_GET    0
 #define SIMPLE_CURL_HEAD   1
 #define SIMPLE_CURL_POST   2
 #define SIMPLE_CURL_PUT    3
 #define SIMPLE_CURL_DELETE 4
 
+/**
+ * Flag which may be added to a GET or HEAD operation to allow a duplicate
+ * request to be issued, if the first one takes unusually long. The response
+ * arriving first is used. This is only sensible for requests which are cheap
+ * to repeat, like HEAD or range requests.
+ */
+#define SIMPLE_CURL_HEDGE 0x100
+#define SIMPLE_CURL_OPERATION( operation ) ( (operation) & 0xff )
+
+/**
+ * Flag marking a request as reading file contents instead of metadata. It
+ * is scheduled with SIMPLE_CURL_PRIORITY_DATA.
+ */
+#define SIMPLE_CURL_DATA 0x200
+
+/**
+ * Priorities requests are scheduled with if the concurrency is limited
+ *
+ * The values match the LIMITER_CLASS_* constants. By default the priority is
+ * derived from the request: PUT requests with a body are uploads, requests
+ * flagged with SIMPLE_CURL_DATA are data requests and everything else is a
+ * metadata request. Prefetch and upload requests are background work, which
+ * may be preempted by waiting foreground requests.
+ */
+#define SIMPLE_CURL_PRIORITY_AUTO     -1
+#define SIMPLE_CURL_PRIORITY_METADATA 0
+#define SIMPLE_CURL_PRIORITY_DATA     1
+#define SIMPLE_CURL_PRIORITY_PREFETCH 2
+#define SIMPLE_CURL_PRIORITY_UPLOAD   3
+
+/**
+ * Cost of a request the size of which is not known in advance, like a HEAD
+ * or a listing, in bytes
+ *
+ * Range requests and uploads cost the number of bytes they transfer.
+ * Waiting requests of the same priority are shared fairly between callers
+ * according to their cost. Bandwidth caps are enforced based on it as well.
+ */
+#define SIMPLE_CURL_REQUEST_COST 4096
+
+/**
+ * Timeouts and retry behaviour used for all requests
+ *
+ * The deadline is the time in milliseconds one call to
+ * simple_curl_request_complex may take including all retries. 0 disables it,
+ * which is the default, as a fixed deadline fails large transfers on slow
+ * links.
+ * The connect timeout is given in milliseconds as well. A transfer which did
+ * not receive a single byte for stall_timeout seconds is aborted.
+ *
+ * Failed GET, HEAD, PUT and DELETE requests are retried up to retries times
+ * if the failure is transient, like a connection error, a timeout or a 429
+ * or 5xx status. The delay before a retry is chosen randomly between 0 and
+ * backoff * 2^attempt milliseconds, but never larger than backoff_max. A
+ * Retry-After header sent by the server is honoured.
+ *
+ * If hedge_percentile is not 0, a duplicate of a request issued with the
+ * SIMPLE_CURL_HEDGE flag is started once the request takes longer than the
+ * given percentile of the recent latencies of its kind, but at least
+ * hedge_min milliseconds.
+ *
+ * The number of concurrent requests to every endpoint is limited by a window
+ * starting at concurrency, which adapts to throttling responses and
+ * increasing latencies up to concurrency_max. A concurrency_max of 0
+ * disables the limit.
+ */
+typedef struct 
+{
+    long deadline;
+    long connect_timeout;
+    long stall_timeout;
+    int retries;
+    long backoff;
+    long backoff_max;
+    double hedge_percentile;
+    long hedge_min;
+    int concurrency;
+    int concurrency_max;
+} simple_curl_options_t;
+
+#define SIMPLE_CURL_OPTIONS_DEFAULT { 0, 5000, 15, 3, 100, 5000, 0, 10, 8, 64 }
+
+/**
+ * Counters of the requests issued since the start of the process
+ *
+ * Requests counts calls to simple_curl_request_complex, which may consist of
+ * multiple transfers due to retries and hedging. Hedge_wins counts the
+ * hedged requests which answered first. Throttled counts the transfers
+ * rejected by the server because of its load. Preempted and cancelled count
+ * the background transfers stopped in favour of foreground ones or by
+ * simple_curl_cancel.
+ */
+typedef struct 
+{
+    unsigned long requests;
+    unsigned long retries;
+    unsigned long hedges;
+    unsigned long hedge_wins;
+    unsigned long timeouts;
+    unsigned long throttled;
+    unsigned long preempted;
+    unsigned long cancelled;
+} simple_curl_stats_t;
+
 /**
  * Linked list element to store header lines
  *
@@ -45,14 +157,75 @@ typedef struct simple_curl_header
 } simple_curl_header_t;
 
 
+/**
+ * Indices of the headers stored in the fixed table of simple_curl_headers_t
+ */
+#define SIMPLE_CURL_HEADER_CONTENT_LENGTH           0
+#define SIMPLE_CURL_HEADER_CONTENT_TYPE             1
+#define SIMPLE_CURL_HEADER_ETAG                     2
+#define SIMPLE_CURL_HEADER_LAST_MODIFIED            3
+#define SIMPLE_CURL_HEADER_X_CONTAINER_BYTES_USED   4
+#define SIMPLE_CURL_HEADER_X_CONTAINER_OBJECT_COUNT 5
+#define SIMPLE_CURL_HEADER_X_AUTH_TOKEN             6
+#define SIMPLE_CURL_HEADER_X_STORAGE_TOKEN          7
+#define SIMPLE_CURL_HEADER_X_STORAGE_URL            8
+#define SIMPLE_CURL_HEADER_X_CDN_MANAGEMENT_URL     9
+#define SIMPLE_CURL_HEADER_KNOWN                    10
+
+#define SIMPLE_CURL_HEADER_UNSET ((size_t)-1)
+
+/**
+ * Position of one received header inside the string buffer of
+ * simple_curl_headers_t
+ */
+typedef struct 
+{
+    size_t key;
+    size_t value;
+} simple_curl_header_field_t;
+
+/**
+ * Headers of a received response
+ *
+ * All keys and values are stored as null terminated strings inside one
+ * buffer. Headers used by the mosso layer are stored in a fixed table indexed
+ * by the SIMPLE_CURL_HEADER_* constants, which allows constant time lookups.
+ * All other headers are stored in the fields array.
+ */
+typedef struct 
+{
+    char* buffer;
+    size_t length;
+    size_t size;
+    simple_curl_header_field_t known[SIMPLE_CURL_HEADER_KNOWN];
+    simple_curl_header_field_t* fields;
+    int num_fields;
+    int size_fields;
+} simple_curl_headers_t;
+
 char* simple_curl_error();
+void simple_curl_set_options( simple_curl_options_t* options );
+void simple_curl_get_stats( simple_curl_stats_t* stats );
+void simple_curl_set_priority( int priority );
+void simple_curl_cancel( int priority );
+void simple_curl_set_caller( unsigned long flow, unsigned int uid );
+void simple_curl_set_bandwidth_cap( unsigned int uid, unsigned long rate );
+void simple_curl_set_rate_limit( unsigned long download, unsigned long upload );
+void simple_curl_get_rate_limit( unsigned long* download, unsigned long* upload );
 simple_curl_header_t* simple_curl_header_add( simple_curl_header_t* header, char* key, char* value );
 char* simple_curl_header_get_by_key( simple_curl_header_t* headers, char* key );
 simple_curl_header_t* simple_curl_header_copy( simple_curl_header_t* header );
 void simple_curl_header_free_all( simple_curl_header_t* header );
+simple_curl_header_t* simple_curl_header_add_to( sarena_t* arena, simple_curl_header_t* header, char* key, char* value );
+simple_curl_header_t* simple_curl_header_copy_to( sarena_t* arena, simple_curl_header_t* header );
+char* simple_curl_headers_get( simple_curl_headers_t* headers, int id );
+char* simple_curl_headers_get_by_key( simple_curl_headers_t* headers, char* key );
+void simple_curl_headers_get_field( simple_curl_headers_t* headers, int index, char** key, char** value );
+void simple_curl_headers_free( simple_curl_headers_t* headers );
 char* simple_curl_urlencode( char* url, int size );
+size_t simple_curl_urlencode_to( char* target, char* url, size_t size );
 
-long simple_curl_request_complex( int operation, char* url, char** response_body, simple_curl_header_t** response_header, char* request_body, simple_curl_header_t* request_headers );
+long simple_curl_request_complex( int operation, char* url, char** response_body, simple_curl_headers_t** response_header, char* request_body, simple_curl_header_t* request_headers );
 #define simple_curl_request_get( url, response_body, response_header, request_header ) \
     simple_curl_request_complex( SIMPLE_CURL_GET, url, response_body, response_header, NULL, request_header )
 #define simple_curl_request_head( url, response_header, request_header ) \
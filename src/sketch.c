@@ -0,0 +1,150 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "salloc.h"
+#include "sketch.h"
+
+static inline uint64_t sketch_index( sketch_t* sketch, uint64_t key, int row );
+static void sketch_reset( sketch_t* sketch );
+
+/**
+ * Seeds mixed into the key to get independent hash functions per row
+ */
+static const uint64_t sketch_seeds[SKETCH_DEPTH] = {
+    0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL
+};
+
+/**
+ * Create a sketch able to tell apart the frequencies of about capacity
+ * keys
+ *
+ * The history taken into account covers ten accesses per counter of a row.
+ */
+sketch_t* sketch_new( uint64_t capacity ) 
+{
+    sketch_t* sketch = snew( sketch_t );
+
+    sketch->width = 64;
+    while( sketch->width < SKETCH_WIDTH * capacity ) 
+    {
+        sketch->width <<= 1;
+    }
+    sketch->sample   = 10 * sketch->width;
+    sketch->counters = (uint8_t*)smalloc( SKETCH_DEPTH * sketch->width );
+
+    return sketch;
+}
+
+/**
+ * Free the given sketch
+ */
+void sketch_free( sketch_t* sketch ) 
+{
+    free( sketch->counters );
+    free( sketch );
+}
+
+/**
+ * Position of the counter of the given key in the given row
+ *
+ * The key is mixed using the finalizer of splitmix64, as path hashes or
+ * block numbers are not evenly distributed in the lower bits.
+ */
+static inline uint64_t sketch_index( sketch_t* sketch, uint64_t key, int row ) 
+{
+    uint64_t hash = key + sketch_seeds[row];
+
+    hash = ( hash ^ ( hash >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    hash = ( hash ^ ( hash >> 27 ) ) * 0x94d049bb133111ebULL;
+    hash = hash ^ ( hash >> 31 );
+
+    return row * sketch->width + ( hash & ( sketch->width - 1 ) );
+}
+
+/**
+ * Count one access to the given key
+ *
+ * Only the smallest counters of the key are incremented. This conservative
+ * update keeps collisions from inflating the estimates of other keys.
+ */
+void sketch_increment( sketch_t* sketch, uint64_t key ) 
+{
+    uint64_t index[SKETCH_DEPTH];
+    int minimum = SKETCH_MAX;
+    int row = 0;
+
+    for( row = 0; row < SKETCH_DEPTH; ++row ) 
+    {
+        index[row] = sketch_index( sketch, key, row );
+        minimum = ( sketch->counters[index[row]] < minimum ) ? sketch->counters[index[row]] : minimum;
+    }
+
+    if ( minimum == SKETCH_MAX ) 
+    {
+        return;
+    }
+
+    for( row = 0; row < SKETCH_DEPTH; ++row ) 
+    {
+        ( sketch->counters[index[row]] == minimum ) ? ++sketch->counters[index[row]] : 0;
+    }
+
+    if ( ++sketch->additions >= sketch->sample ) 
+    {
+        sketch_reset( sketch );
+    }
+}
+
+/**
+ * Estimate the number of recent accesses to the given key
+ */
+int sketch_estimate( sketch_t* sketch, uint64_t key ) 
+{
+    int minimum = SKETCH_MAX;
+    int row = 0;
+
+    for( row = 0; row < SKETCH_DEPTH; ++row ) 
+    {
+        uint8_t counter = sketch->counters[sketch_index( sketch, key, row )];
+        minimum = ( counter < minimum ) ? counter : minimum;
+    }
+
+    return minimum;
+}
+
+/**
+ * Halve all counters, which ages the recorded history
+ */
+static void sketch_reset( sketch_t* sketch ) 
+{
+    uint64_t i = 0;
+
+    for( i = 0; i < SKETCH_DEPTH * sketch->width; ++i ) 
+    {
+        sketch->counters[i] >>= 1;
+    }
+    sketch->additions /= 2;
+}
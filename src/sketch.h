@@ -0,0 +1,70 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdint.h>
+
+/**
+ * Number of rows of the sketch and maximal value of a counter
+ *
+ * Every key is counted in one counter of each row. Counters saturate at
+ * SKETCH_MAX, which suffices to tell frequently used keys from rarely used
+ * ones.
+ */
+#define SKETCH_DEPTH 4
+#define SKETCH_MAX   15
+
+/**
+ * Counters per row for every key the sketch is created for
+ *
+ * Fewer counters let keys used once collide often enough to appear to be
+ * used repeatedly.
+ */
+#define SKETCH_WIDTH 8
+
+/**
+ * Approximate access frequencies of the recently used keys
+ *
+ * This is a count-min sketch: the estimated frequency of a key is the
+ * smallest of its counters, which only overestimates due to collisions.
+ * Width is the number of counters per row, a power of two. Once sample
+ * increments have been counted all counters are halved, so the frequencies
+ * reflect the recent history only.
+ *
+ * The sketch is not synchronized. Callers need to serialize the access.
+ */
+typedef struct 
+{
+    uint8_t* counters;
+    uint64_t width;
+    uint64_t additions;
+    uint64_t sample;
+} sketch_t;
+
+sketch_t* sketch_new( uint64_t capacity );
+void sketch_free( sketch_t* sketch );
+void sketch_increment( sketch_t* sketch, uint64_t key );
+int sketch_estimate( sketch_t* sketch, uint64_t key );
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "salloc.h"
+#include "slowlog.h"
+
+uint64_t slowlog_threshold = 0;
+
+/**
+ * Ring buffer of the most recent slow requests
+ *
+ * Next is the number of requests recorded so far. The oldest entry is
+ * overwritten once size entries are stored. Slow requests are rare, so a
+ * simple lock is sufficient.
+ */
+static slowlog_entry_t* slowlog_entries = NULL;
+static unsigned int slowlog_size = 0;
+static uint64_t slowlog_next = 0;
+static pthread_mutex_t slowlog_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Start recording the given number of most recent requests taking longer
+ * than threshold milliseconds
+ *
+ * A size or threshold of 0 leaves the recorder disabled.
+ */
+void slowlog_start( unsigned int size, unsigned long threshold ) 
+{
+    if ( size == 0 || threshold == 0 ) 
+    {
+        return;
+    }
+
+    pthread_mutex_lock( &slowlog_lock );
+    slowlog_entries = (slowlog_entry_t*)scalloc( size, sizeof( slowlog_entry_t ) );
+    slowlog_size = size;
+    slowlog_next = 0;
+    pthread_mutex_unlock( &slowlog_lock );
+
+    slowlog_threshold = (uint64_t)threshold * 1000;
+}
+
+/**
+ * Stop recording and free all entries
+ */
+void slowlog_stop() 
+{
+    slowlog_threshold = 0;
+
+    pthread_mutex_lock( &slowlog_lock );
+    ( slowlog_entries != NULL ) ? free( slowlog_entries ) : NULL;
+    slowlog_entries = NULL;
+    slowlog_size = 0;
+    pthread_mutex_unlock( &slowlog_lock );
+}
+
+/**
+ * Store a copy of the given request
+ *
+ * The time of the entry is set to the current time.
+ */
+void slowlog_add( slowlog_entry_t* entry ) 
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_REALTIME, &now );
+    entry->time = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+
+    pthread_mutex_lock( &slowlog_lock );
+    if ( slowlog_entries != NULL ) 
+    {
+        memcpy( &slowlog_entries[slowlog_next++ % slowlog_size], entry, sizeof( slowlog_entry_t ) );
+    }
+    pthread_mutex_unlock( &slowlog_lock );
+}
+
+/**
+ * Render all recorded requests from the oldest to the newest one
+ *
+ * Every request is written as one line. The phases of the last transfer
+ * are given as the milliseconds spent in each of them: waiting for a
+ * request slot, resolving the name, connecting, the TLS handshake and
+ * waiting for the first byte of the response.
+ */
+void slowlog_render( GString* output ) 
+{
+    uint64_t position = 0;
+
+    pthread_mutex_lock( &slowlog_lock );
+    for( position = ( slowlog_next > slowlog_size ) ? slowlog_next - slowlog_size : 0; position < slowlog_next; ++position ) 
+    {
+        slowlog_entry_t* entry = &slowlog_entries[position % slowlog_size];
+        span_timing_t* timing = &entry->timing;
+        time_t seconds = (time_t)( entry->time / 1000000 );
+        struct tm date;
+        char timestamp[32];
+
+        localtime_r( &seconds, &date );
+        strftime( timestamp, sizeof( timestamp ), "%Y-%m-%d %H:%M:%S", &date );
+
+        g_string_append_printf( output, 
+            "%s.%03u %.1fms %s %s %ld bytes=%llu retries=%d range=%s queue=%.1f dns=%.1f connect=%.1f tls=%.1f wait=%.1f", 
+            timestamp, (unsigned int)( entry->time % 1000000 / 1000 ), entry->duration / 1000.0, 
+            entry->method, entry->url, entry->status, (unsigned long long)entry->bytes, entry->retries, 
+            ( entry->range[0] != 0 ) ? entry->range : "-", 
+            timing->queued / 1000.0, 
+            ( timing->namelookup - timing->queued ) / 1000.0, 
+            ( timing->connect - timing->namelookup ) / 1000.0, 
+            ( timing->appconnect - timing->connect ) / 1000.0, 
+            ( timing->starttransfer - timing->appconnect ) / 1000.0 );
+        if ( entry->error[0] != 0 ) 
+        {
+            g_string_append_printf( output, " error=\"%s\"", entry->error );
+        }
+        g_string_append_c( output, '\n' );
+    }
+    pthread_mutex_unlock( &slowlog_lock );
+}
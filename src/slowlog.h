@@ -0,0 +1,75 @@
+#ifndef SLOWLOG_H
+#define SLOWLOG_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdint.h>
+#include <glib.h>
+
+#include "span.h"
+
+/**
+ * Maximal lengths of the strings stored with a request
+ *
+ * Longer ones are truncated.
+ */
+#define SLOWLOG_URL_SIZE   256
+#define SLOWLOG_RANGE_SIZE 48
+#define SLOWLOG_ERROR_SIZE 128
+
+/**
+ * One request which took longer than the threshold
+ *
+ * Time is the wall clock time the request finished at in microseconds since
+ * the epoch, duration its latency including all retries. Status is 0 if no
+ * response has been received, in which case error describes the reason.
+ * Bytes and timing belong to the last transfer issued.
+ */
+typedef struct 
+{
+    uint64_t time;
+    uint64_t duration;
+    const char* method;
+    long status;
+    uint64_t bytes;
+    int retries;
+    span_timing_t timing;
+    char url[SLOWLOG_URL_SIZE];
+    char range[SLOWLOG_RANGE_SIZE];
+    char error[SLOWLOG_ERROR_SIZE];
+} slowlog_entry_t;
+
+/**
+ * Latency in microseconds a request needs to exceed to be recorded
+ *
+ * It is 0 while the recorder is stopped. Callers check it before they
+ * collect the data of a request.
+ */
+extern uint64_t slowlog_threshold;
+
+void slowlog_start( unsigned int size, unsigned long threshold );
+void slowlog_stop();
+void slowlog_add( slowlog_entry_t* entry );
+void slowlog_render( GString* output );
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "salloc.h"
+#include "span.h"
+
+int span_enabled = 0;
+
+/**
+ * Ring buffer of the most recently finished spans
+ *
+ * Next is the position the next span is written to. It only grows, the
+ * record used is next modulo size. Writers claim their position atomically
+ * and never wait for each other or for readers.
+ */
+static span_record_t* span_ring = NULL;
+static unsigned int span_size = 0;
+static uint64_t span_next = 0;
+static uint64_t span_ids = 0;
+
+/**
+ * Innermost nested span of the calling thread, which becomes the parent of
+ * all spans begun by it
+ */
+static __thread uint64_t span_current = 0;
+static __thread pid_t span_tid = 0;
+
+/**
+ * Minimal number of records, which keeps writers from lapping each other
+ * while writing the same record
+ */
+#define SPAN_MIN_SIZE 1024
+
+/**
+ * Names of the layers used as categories of the trace events
+ */
+static const char* span_layer_names[] = { "op", "mosso", "http" };
+
+static uint64_t span_now();
+static void span_escape( GString* output, const char* string );
+static void span_render_phase( GString* output, span_record_t* record, const char* name, uint32_t from, uint32_t to );
+static void span_render_record( GString* output, span_record_t* record );
+
+/**
+ * Retrieve the current time of the monotonic clock in microseconds
+ */
+static uint64_t span_now() 
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Start recording the given number of most recent spans
+ *
+ * It needs to be called before any thread records spans. A size of 0 leaves
+ * tracing disabled.
+ */
+void span_start( unsigned int size ) 
+{
+    if ( size == 0 ) 
+    {
+        return;
+    }
+
+    span_size = ( size < SPAN_MIN_SIZE ) ? SPAN_MIN_SIZE : size;
+    span_ring = (span_record_t*)scalloc( span_size, sizeof( span_record_t ) );
+    span_next = 0;
+    span_enabled = 1;
+}
+
+/**
+ * Stop recording spans and free the ring buffer
+ *
+ * No thread may record a span anymore while this is called.
+ */
+void span_stop() 
+{
+    span_enabled = 0;
+    ( span_ring != NULL ) ? free( span_ring ) : NULL;
+    span_ring = NULL;
+    span_size = 0;
+}
+
+/**
+ * Begin a span of the calling thread
+ *
+ * The innermost nested span of the thread becomes its parent. If nested is
+ * set the span becomes the parent of all spans begun until it ends itself.
+ * Spans which may overlap with their siblings on the same thread, like
+ * concurrent transfers, must not be nested.
+ */
+void span_begin( span_t* span, int nested ) 
+{
+    if ( !span_enabled ) 
+    {
+        span->id = 0;
+        return;
+    }
+
+    span->id     = __atomic_add_fetch( &span_ids, 1, __ATOMIC_RELAXED );
+    span->parent = span_current;
+    span->start  = span_now();
+
+    if ( nested ) 
+    {
+        span_current = span->id;
+    }
+}
+
+/**
+ * End a span and store it in the ring buffer
+ *
+ * Detail is the path or url the span worked on, timing the phases of an
+ * HTTP transfer. Both may be NULL.
+ */
+void span_end( span_t* span, int layer, const char* name, const char* detail, long result, uint64_t bytes, span_timing_t* timing ) 
+{
+    uint64_t end = 0;
+    uint64_t position = 0;
+    span_record_t* record = NULL;
+
+    if ( span->id == 0 ) 
+    {
+        return;
+    }
+
+    end = span_now();
+
+    if ( span_current == span->id ) 
+    {
+        span_current = span->parent;
+    }
+
+    if ( span_tid == 0 ) 
+    {
+        span_tid = (pid_t)syscall( SYS_gettid );
+    }
+
+    position = __atomic_fetch_add( &span_next, 1, __ATOMIC_RELAXED );
+    record   = &span_ring[position % span_size];
+
+    // Invalidate the record before it is changed, so readers do not mistake
+    // a partially written record for a complete one.
+    __atomic_store_n( &record->sequence, 0, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_RELEASE );
+
+    record->id       = span->id;
+    record->parent   = span->parent;
+    record->start    = span->start;
+    record->duration = end - span->start;
+    record->tid      = span_tid;
+    record->layer    = layer;
+    record->name     = name;
+    record->result   = result;
+    record->bytes    = bytes;
+    ( timing != NULL ) 
+        ? memcpy( &record->timing, timing, sizeof( span_timing_t ) ) 
+        : memset( &record->timing, 0, sizeof( span_timing_t ) );
+    strncpy( record->detail, ( detail != NULL ) ? detail : "", SPAN_DETAIL_SIZE - 1 );
+    record->detail[SPAN_DETAIL_SIZE - 1] = 0;
+
+    __atomic_store_n( &record->sequence, position + 1, __ATOMIC_RELEASE );
+}
+
+/**
+ * Append the given string as JSON string literal
+ */
+static void span_escape( GString* output, const char* string ) 
+{
+    const unsigned char* c = NULL;
+
+    g_string_append_c( output, '"' );
+    for( c = (const unsigned char*)string; *c != 0; ++c ) 
+    {
+        if ( *c == '"' || *c == '\\' ) 
+        {
+            g_string_append_c( output, '\\' );
+            g_string_append_c( output, *c );
+        }
+        else if ( *c < 0x20 ) 
+        {
+            g_string_append_printf( output, "\\u%04x", *c );
+        }
+        else 
+        {
+            g_string_append_c( output, *c );
+        }
+    }
+    g_string_append_c( output, '"' );
+}
+
+/**
+ * Append one phase of an HTTP transfer as child event of its span
+ *
+ * Phases without any duration are left out.
+ */
+static void span_render_phase( GString* output, span_record_t* record, const char* name, uint32_t from, uint32_t to ) 
+{
+    if ( to <= from ) 
+    {
+        return;
+    }
+
+    g_string_append_printf( output, 
+        ",\n{\"name\":\"%s\",\"cat\":\"http.phase\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%u,\"pid\":%d,\"tid\":%d}", 
+        name, (unsigned long long)( record->start + from ), to - from, (int)getpid(), (int)record->tid );
+}
+
+/**
+ * Append one span as complete event of the trace event format
+ *
+ * Transfers are followed by one event for each of their phases.
+ */
+static void span_render_record( GString* output, span_record_t* record ) 
+{
+    span_timing_t* timing = &record->timing;
+
+    g_string_append_printf( output, 
+        ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%d,\"args\":{\"id\":%llu,\"parent\":%llu,\"%s\":", 
+        record->name, span_layer_names[record->layer], 
+        (unsigned long long)record->start, (unsigned long long)record->duration, (int)getpid(), (int)record->tid, 
+        (unsigned long long)record->id, (unsigned long long)record->parent, 
+        ( record->layer == SPAN_HTTP ) ? "url" : "path" );
+    span_escape( output, record->detail );
+    g_string_append_printf( output, ",\"%s\":%ld,\"bytes\":%llu}}", 
+        ( record->layer == SPAN_OP ) ? "result" : "status", record->result, (unsigned long long)record->bytes );
+
+    if ( record->layer != SPAN_HTTP ) 
+    {
+        return;
+    }
+
+    span_render_phase( output, record, "queue", 0, timing->queued );
+    span_render_phase( output, record, "dns", timing->queued, timing->namelookup );
+    span_render_phase( output, record, "connect", timing->namelookup, timing->connect );
+    span_render_phase( output, record, "tls", timing->connect, timing->appconnect );
+    span_render_phase( output, record, "wait", timing->appconnect, timing->starttransfer );
+    span_render_phase( output, record, "transfer", timing->starttransfer, (uint32_t)record->duration );
+}
+
+/**
+ * Render the recorded spans in the trace event format
+ *
+ * The result can be loaded into chrome://tracing or Perfetto. Spans are
+ * written from the oldest to the newest one. Records overwritten while they
+ * are rendered are skipped.
+ */
+void span_render( GString* output ) 
+{
+    uint64_t next = __atomic_load_n( &span_next, __ATOMIC_ACQUIRE );
+    uint64_t position = 0;
+
+    g_string_append_printf( output, 
+        "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"mossofs\"}}", 
+        (int)getpid() );
+
+    if ( span_enabled ) 
+    {
+        for( position = ( next > span_size ) ? next - span_size : 0; position < next; ++position ) 
+        {
+            span_record_t* shared = &span_ring[position % span_size];
+            span_record_t record;
+
+            if ( __atomic_load_n( &shared->sequence, __ATOMIC_ACQUIRE ) != position + 1 ) 
+            {
+                continue;
+            }
+            memcpy( &record, shared, sizeof( span_record_t ) );
+            __atomic_thread_fence( __ATOMIC_ACQUIRE );
+            if ( __atomic_load_n( &shared->sequence, __ATOMIC_RELAXED ) != position + 1 ) 
+            {
+                continue;
+            }
+
+            span_render_record( output, &record );
+        }
+    }
+
+    g_string_append( output, "\n]}\n" );
+}
@@ -0,0 +1,117 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <glib.h>
+
+/**
+ * Layers spans are recorded for
+ *
+ * Filesystem operations are the roots. Calls into the mosso api are their
+ * children, which in turn contain the HTTP transfers issued for them.
+ */
+#define SPAN_OP    0
+#define SPAN_MOSSO 1
+#define SPAN_HTTP  2
+
+/**
+ * Maximal length of the path or url stored with a span
+ *
+ * Longer ones are truncated.
+ */
+#define SPAN_DETAIL_SIZE 160
+
+/**
+ * Phases of an HTTP transfer as reported by cURL
+ *
+ * All values are microseconds since the start of the transfer, which is
+ * the point it started to wait for a place in the window of its limiter.
+ * Queued is the time the place was granted and the actual transfer started.
+ * The remaining values are relative to the start of the span as well and
+ * each one includes all previous phases. Phases not needed by a transfer,
+ * like the name lookup of a reused connection, end at the previous one.
+ */
+typedef struct 
+{
+    uint32_t queued;
+    uint32_t namelookup;
+    uint32_t connect;
+    uint32_t appconnect;
+    uint32_t starttransfer;
+} span_timing_t;
+
+/**
+ * One finished span stored in the ring buffer
+ *
+ * Sequence is the position the span has been written to plus one. It is 0
+ * while the record is written, so a reader can detect records being
+ * overwritten concurrently. Name is a static string. Result is the return
+ * value of an operation or the status code of a request.
+ */
+typedef struct 
+{
+    uint64_t sequence;
+    uint64_t id;
+    uint64_t parent;
+    uint64_t start;
+    uint64_t duration;
+    pid_t tid;
+    int layer;
+    const char* name;
+    long result;
+    uint64_t bytes;
+    span_timing_t timing;
+    char detail[SPAN_DETAIL_SIZE];
+} span_record_t;
+
+/**
+ * Span currently in progress
+ *
+ * It is owned by the code recording it, usually on its stack. An id of 0
+ * marks a span which is not recorded, because tracing is disabled.
+ */
+typedef struct 
+{
+    uint64_t id;
+    uint64_t parent;
+    uint64_t start;
+} span_t;
+
+/**
+ * Set if spans are recorded
+ *
+ * It is checked by span_begin before anything else is done, so disabled
+ * tracing costs a function call and a comparison per span.
+ */
+extern int span_enabled;
+
+void span_start( unsigned int size );
+void span_stop();
+void span_begin( span_t* span, int nested );
+void span_end( span_t* span, int layer, const char* name, const char* detail, long result, uint64_t bytes, span_timing_t* timing );
+void span_render( GString* output );
+
+#endif
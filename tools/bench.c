@@ -0,0 +1,1097 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+/*
+ * End to end benchmark of mossofs
+ *
+ * A local mossofs-server is started and mounted using mossofs. Afterwards a
+ * set of scripted workloads is run on the mountpoint. Throughput, latency
+ * percentiles of every filesystem operation, the number of HTTP requests
+ * issued and the peak memory usage of mossofs are written as JSON. If a
+ * baseline file is given, the results are compared against it and every
+ * regression beyond the threshold is reported.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "bench.h"
+
+#define TRUE  1
+#define FALSE 0
+
+#define BENCH_READ_SIZE   131072
+#define BENCH_RANDOM_SIZE 4096
+
+static void bench_parse_options( int argc, char** argv );
+static int bench_start( bench_environment_t* environment );
+static void bench_stop( bench_environment_t* environment );
+static unsigned long bench_server_request( bench_environment_t* environment, char* method, char* path, const char* body, char* response, size_t size );
+static void bench_server_stats( bench_environment_t* environment, bench_result_t* result );
+static int bench_server_faults( bench_environment_t* environment, const char* faults );
+static long bench_peak_rss( pid_t pid );
+static uint64_t bench_now();
+static bench_op_t* bench_op( bench_result_t* result, const char* name );
+static void bench_record( bench_result_t* result, bench_op_t* op, uint64_t start );
+static void bench_record_error( bench_result_t* result, bench_op_t* op, uint64_t start );
+static uint64_t bench_percentile( bench_op_t* op, double percentile );
+static void bench_write_results( FILE* out, bench_result_t* results, int num_results, long peak_rss );
+static int bench_compare_baseline( bench_result_t* results, int num_results );
+
+static void bench_ls_lr( bench_environment_t* environment, bench_result_t* result );
+static void bench_sequential_read( bench_environment_t* environment, bench_result_t* result );
+static void bench_random_read( bench_environment_t* environment, bench_result_t* result );
+static void bench_small_files( bench_environment_t* environment, bench_result_t* result );
+static void bench_parallel_read( bench_environment_t* environment, bench_result_t* result );
+
+static bench_options_t bench_options;
+
+/**
+ * All available workloads in the order they are run
+ */
+static struct {
+    const char* name;
+    bench_workload_func func;
+} bench_workloads[] = {
+    { "ls_lR",           bench_ls_lr },
+    { "sequential_read", bench_sequential_read },
+    { "random_read",     bench_random_read },
+    { "small_files",     bench_small_files },
+    { "parallel_read",   bench_parallel_read },
+    { NULL, NULL }
+};
+
+/**
+ * Fault scenarios the workloads can be run under
+ *
+ * The faults of the custom scenario are given on the commandline.
+ */
+static bench_scenario_t bench_scenarios[] = {
+    { "baseline",  "" },
+    { "slow_tail", "latency,delay=pareto:2:1.2,max=5000\n" },
+    { "stalls",    "stall,rate=0.005,delay=uniform:1000:5000\n" },
+    { "drip",      "drip,rate=0.02,bandwidth=262144,method=GET\n" },
+    { "resets",    "reset,rate=0.005\n"
+                   "reset,rate=0.005,after=2048,method=GET\n" },
+    { "errors",    "error,rate=0.01,status=500\n"
+                   "error,rate=0.02,status=503,retry_after=1\n"
+                   "error,rate=0.01,status=429,retry_after=1\n" },
+    { "brownout",  "error,rate=0.5,status=503,every=20,duration=5\n"
+                   "stall,rate=0.2,delay=2000,every=20,duration=5\n" },
+    { "custom",    NULL },
+    { NULL, NULL }
+};
+
+int main( int argc, char** argv )
+{
+    bench_environment_t environment;
+    bench_result_t results[BENCH_MAX_RESULTS];
+    int num_results = 0;
+    long peak_rss = 0;
+    int failed = FALSE;
+    int i = 0;
+    int j = 0;
+
+    bench_parse_options( argc, argv );
+    signal( SIGPIPE, SIG_IGN );
+
+    memset( &environment, 0, sizeof( environment ) );
+    memset( results, 0, sizeof( results ) );
+
+    if ( !bench_start( &environment ) )
+    {
+        bench_stop( &environment );
+        return 2;
+    }
+
+    for( j = 0; bench_scenarios[j].name != NULL; ++j )
+    {
+        bench_scenario_t* scenario = &bench_scenarios[j];
+
+        if ( scenario->faults == NULL || strstr( bench_options.scenarios, scenario->name ) == NULL )
+        {
+            continue;
+        }
+
+        if ( !bench_server_faults( &environment, scenario->faults ) )
+        {
+            fprintf( stderr, "The server did not accept the faults of scenario %s\n", scenario->name );
+            failed = TRUE;
+            continue;
+        }
+
+        for( i = 0; bench_workloads[i].name != NULL && num_results < BENCH_MAX_RESULTS; ++i )
+        {
+            bench_result_t* result = &results[num_results];
+            uint64_t start = 0;
+
+            if ( bench_options.workloads != NULL && strstr( bench_options.workloads, bench_workloads[i].name ) == NULL )
+            {
+                continue;
+            }
+
+            // Results of the baseline keep the plain workload name to stay
+            // comparable with older baselines
+            if ( strcmp( scenario->name, "baseline" ) == 0 )
+            {
+                result->name = bench_workloads[i].name;
+            }
+            else
+            {
+                size_t length = strlen( bench_workloads[i].name ) + strlen( scenario->name ) + 2;
+                char* name = (char*)malloc( length );
+                snprintf( name, length, "%s@%s", bench_workloads[i].name, scenario->name );
+                result->name = name;
+            }
+
+            fprintf( stderr, "Running %s\n", result->name );
+            pthread_mutex_init( &result->lock, NULL );
+
+            bench_server_request( &environment, "POST", "/stats", NULL, NULL, 0 );
+            start = bench_now();
+            bench_workloads[i].func( &environment, result );
+            result->seconds = ( bench_now() - start ) / 1000000.0;
+            bench_server_stats( &environment, result );
+            ++num_results;
+        }
+    }
+
+    peak_rss = bench_peak_rss( environment.mossofs_pid );
+    bench_stop( &environment );
+
+    if ( bench_options.output != NULL )
+    {
+        FILE* out = fopen( bench_options.output, "w" );
+        if ( out == NULL )
+        {
+            perror( bench_options.output );
+            return 2;
+        }
+        bench_write_results( out, results, num_results, peak_rss );
+        fclose( out );
+    }
+    bench_write_results( stdout, results, num_results, peak_rss );
+
+    if ( bench_options.baseline != NULL )
+    {
+        failed = !bench_compare_baseline( results, num_results );
+    }
+
+    return failed ? 1 : 0;
+}
+
+/**
+ * Print the usage information of the benchmark
+ */
+static void bench_usage( char* executable )
+{
+    printf( "End to end benchmark of mossofs against a local mossofs-server\n\n" );
+    printf( "Usage: %s --server=PATH --mossofs=PATH [options]\n\n", executable );
+    printf( "    --server=PATH         mossofs-server executable\n" );
+    printf( "    --mossofs=PATH        mossofs executable\n" );
+    printf( "    --mountpoint=DIR      directory to mount on (temporary directory)\n" );
+    printf( "    --output=FILE         write the results as JSON to this file\n" );
+    printf( "    --baseline=FILE       compare the results against this file\n" );
+    printf( "    --threshold=PERCENT   allowed deviation from the baseline (10)\n" );
+    printf( "    --workloads=A,B       workloads to run (all)\n" );
+    printf( "    --scenarios=A,B       fault scenarios to run the workloads under (baseline)\n" );
+    printf( "    --faults=SPEC;SPEC    faults of the custom scenario, see mossofs-server --help\n" );
+    printf( "    --server-args=ARGS    additional arguments passed to the server\n" );
+    printf( "    --objects=N           objects of the synthetic tree (1000000)\n" );
+    printf( "    --fanout=N            subdirectories per directory (10)\n" );
+    printf( "    --depth=N             levels of subdirectories (2)\n" );
+    printf( "    --large-files=N       number of large files (8)\n" );
+    printf( "    --large-size=BYTES    size of the large files (67108864)\n" );
+    printf( "    --random-reads=N      number of random 4 KiB reads (2000)\n" );
+    printf( "    --small-files=N       number of small files read (2000)\n" );
+    printf( "    --threads=N           number of parallel readers (8)\n\n" );
+    printf( "Workloads: ls_lR, sequential_read, random_read, small_files, parallel_read\n" );
+    printf( "Scenarios: baseline, slow_tail, stalls, drip, resets, errors, brownout, custom\n" );
+}
+
+/**
+ * Read the commandline options into bench_options
+ */
+static void bench_parse_options( int argc, char** argv )
+{
+    static struct option long_options[] = {
+        { "server",       required_argument, NULL, 's' },
+        { "mossofs",      required_argument, NULL, 'm' },
+        { "mountpoint",   required_argument, NULL, 'M' },
+        { "output",       required_argument, NULL, 'o' },
+        { "baseline",     required_argument, NULL, 'b' },
+        { "threshold",    required_argument, NULL, 't' },
+        { "workloads",    required_argument, NULL, 'w' },
+        { "scenarios",    required_argument, NULL, 'c' },
+        { "faults",       required_argument, NULL, 'x' },
+        { "server-args",  required_argument, NULL, 'a' },
+        { "objects",      required_argument, NULL, 'O' },
+        { "fanout",       required_argument, NULL, 'f' },
+        { "depth",        required_argument, NULL, 'd' },
+        { "large-files",  required_argument, NULL, 'L' },
+        { "large-size",   required_argument, NULL, 'S' },
+        { "random-reads", required_argument, NULL, 'r' },
+        { "small-files",  required_argument, NULL, 'F' },
+        { "threads",      required_argument, NULL, 'T' },
+        { "help",         no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c = 0;
+
+    bench_options.threshold    = 10.0;
+    bench_options.objects      = 1000000;
+    bench_options.fanout       = 10;
+    bench_options.depth        = 2;
+    bench_options.large_files  = 8;
+    bench_options.large_size   = 64 * 1024 * 1024;
+    bench_options.random_reads = 2000;
+    bench_options.small_files  = 2000;
+    bench_options.threads      = 8;
+
+    while( ( c = getopt_long( argc, argv, "h", long_options, NULL ) ) != -1 )
+    {
+        switch( c )
+        {
+            case 's': bench_options.server       = optarg;                    break;
+            case 'm': bench_options.mossofs      = optarg;                    break;
+            case 'M': bench_options.mountpoint   = optarg;                    break;
+            case 'o': bench_options.output       = optarg;                    break;
+            case 'b': bench_options.baseline     = optarg;                    break;
+            case 't': bench_options.threshold    = atof( optarg );            break;
+            case 'w': bench_options.workloads    = optarg;                    break;
+            case 'c': bench_options.scenarios    = optarg;                    break;
+            case 'x': bench_options.faults       = optarg;                    break;
+            case 'a': bench_options.server_args  = optarg;                    break;
+            case 'O': bench_options.objects      = strtoul( optarg, NULL, 10 ); break;
+            case 'f': bench_options.fanout       = atoi( optarg );            break;
+            case 'd': bench_options.depth        = atoi( optarg );            break;
+            case 'L': bench_options.large_files  = atoi( optarg );            break;
+            case 'S': bench_options.large_size   = strtoul( optarg, NULL, 10 ); break;
+            case 'r': bench_options.random_reads = atoi( optarg );            break;
+            case 'F': bench_options.small_files  = atoi( optarg );            break;
+            case 'T': bench_options.threads      = atoi( optarg );            break;
+            case 'h':
+                bench_usage( argv[0] );
+                exit( 0 );
+            default:
+                bench_usage( argv[0] );
+                exit( 2 );
+        }
+    }
+
+    if ( bench_options.server == NULL || bench_options.mossofs == NULL )
+    {
+        bench_usage( argv[0] );
+        exit( 2 );
+    }
+
+    // The custom scenario is run by default as soon as its faults are given
+    if ( bench_options.faults != NULL )
+    {
+        char* faults = strdup( bench_options.faults );
+        char* cur = NULL;
+        int i = 0;
+
+        for( cur = strchr( faults, ';' ); cur != NULL; cur = strchr( cur, ';' ) )
+        {
+            *cur = '\n';
+        }
+        for( i = 0; bench_scenarios[i].name != NULL; ++i )
+        {
+            if ( strcmp( bench_scenarios[i].name, "custom" ) == 0 )
+            {
+                bench_scenarios[i].faults = faults;
+            }
+        }
+    }
+
+    if ( bench_options.scenarios == NULL )
+    {
+        bench_options.scenarios = ( bench_options.faults != NULL ) ? "custom" : "baseline";
+    }
+}
+
+/*
+ * Environment handling
+ */
+
+/**
+ * Start the server, mount mossofs and wait until the mount is usable
+ *
+ * The server is started on a free port, which is read from its first line of
+ * output. FALSE is returned if any of the steps fails.
+ */
+static int bench_start( bench_environment_t* environment )
+{
+    char arguments[4096];
+    char auth_url[256];
+    char line[512];
+    char* argv[64];
+    int argc = 0;
+    int pipe_fds[2];
+    FILE* server_output = NULL;
+    char* cur = NULL;
+    char* save = NULL;
+    struct stat parent;
+    struct stat mounted;
+    int i = 0;
+
+    if ( bench_options.mountpoint == NULL )
+    {
+        static char mountpoint[] = "/tmp/mossofs-bench-XXXXXX";
+        if ( mkdtemp( mountpoint ) == NULL )
+        {
+            perror( "mkdtemp" );
+            return FALSE;
+        }
+        bench_options.mountpoint = mountpoint;
+    }
+
+    // Start the server
+    snprintf(
+        arguments, sizeof( arguments ),
+        "%s --port=0 --objects=%lu --fanout=%d --depth=%d --large-files=%d --large-size=%lu %s",
+        bench_options.server, bench_options.objects, bench_options.fanout, bench_options.depth,
+        bench_options.large_files, bench_options.large_size,
+        ( bench_options.server_args != NULL ) ? bench_options.server_args : ""
+    );
+    for( cur = strtok_r( arguments, " ", &save ); cur != NULL && argc < 63; cur = strtok_r( NULL, " ", &save ) )
+    {
+        argv[argc++] = cur;
+    }
+    argv[argc] = NULL;
+
+    if ( pipe( pipe_fds ) == -1 )
+    {
+        perror( "pipe" );
+        return FALSE;
+    }
+    if ( ( environment->server_pid = fork() ) == 0 )
+    {
+        dup2( pipe_fds[1], STDOUT_FILENO );
+        close( pipe_fds[0] );
+        execv( argv[0], argv );
+        perror( argv[0] );
+        _exit( 127 );
+    }
+    close( pipe_fds[1] );
+
+    server_output = fdopen( pipe_fds[0], "r" );
+    if ( fgets( line, sizeof( line ), server_output ) == NULL || ( cur = strstr( line, "http://" ) ) == NULL )
+    {
+        fprintf( stderr, "The server could not be started\n" );
+        return FALSE;
+    }
+    snprintf( auth_url, sizeof( auth_url ), "%s", cur );
+    auth_url[strcspn( auth_url, "\r\n" )] = 0;
+    environment->port = atoi( strrchr( auth_url, ':' ) + 1 );
+    fprintf( stderr, "%s", line );
+
+    // Mount mossofs in the foreground, so it stays a child of this process
+    stat( bench_options.mountpoint, &parent );
+    snprintf( arguments, sizeof( arguments ), "auth_url=%s", auth_url );
+    if ( ( environment->mossofs_pid = fork() ) == 0 )
+    {
+        execl( bench_options.mossofs, bench_options.mossofs, "bench@bench", bench_options.mountpoint, "-f", "-o", arguments, (char*)NULL );
+        perror( bench_options.mossofs );
+        _exit( 127 );
+    }
+
+    for( i = 0; i < 300; ++i )
+    {
+        int status = 0;
+        if ( stat( bench_options.mountpoint, &mounted ) == 0 && mounted.st_dev != parent.st_dev )
+        {
+            break;
+        }
+        if ( waitpid( environment->mossofs_pid, &status, WNOHANG ) == environment->mossofs_pid )
+        {
+            environment->mossofs_pid = 0;
+            fprintf( stderr, "mossofs exited before the filesystem has been mounted\n" );
+            return FALSE;
+        }
+        usleep( 100000 );
+    }
+    if ( i == 300 )
+    {
+        fprintf( stderr, "Timeout while waiting for the mount\n" );
+        return FALSE;
+    }
+
+    snprintf( environment->root, sizeof( environment->root ), "%s/container000", bench_options.mountpoint );
+    return TRUE;
+}
+
+/**
+ * Unmount mossofs and stop the server
+ */
+static void bench_stop( bench_environment_t* environment )
+{
+    if ( environment->mossofs_pid > 0 )
+    {
+        pid_t pid = fork();
+        if ( pid == 0 )
+        {
+            execlp( "fusermount", "fusermount", "-u", bench_options.mountpoint, (char*)NULL );
+            _exit( 127 );
+        }
+        waitpid( pid, NULL, 0 );
+        waitpid( environment->mossofs_pid, NULL, 0 );
+    }
+    if ( environment->server_pid > 0 )
+    {
+        kill( environment->server_pid, SIGTERM );
+        waitpid( environment->server_pid, NULL, 0 );
+    }
+}
+
+/**
+ * Send a request with an optional body to the server and store the
+ * response body
+ *
+ * The returned value is the status code or 0 if the request failed.
+ */
+static unsigned long bench_server_request( bench_environment_t* environment, char* method, char* path, const char* body, char* response, size_t size )
+{
+    struct sockaddr_in address;
+    char buffer[4096];
+    size_t length = 0;
+    ssize_t received = 0;
+    unsigned long status = 0;
+    char* response_body = NULL;
+    int fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+    memset( &address, 0, sizeof( address ) );
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons( environment->port );
+    address.sin_addr.s_addr = inet_addr( "127.0.0.1" );
+
+    if ( fd == -1 || connect( fd, (struct sockaddr*)&address, sizeof( address ) ) == -1 )
+    {
+        ( fd != -1 ) ? close( fd ) : 0;
+        return 0;
+    }
+
+    length = snprintf(
+        buffer, sizeof( buffer ), "%s %s HTTP/1.0\r\nContent-Length: %lu\r\n\r\n%s",
+        method, path, ( body != NULL ) ? (unsigned long)strlen( body ) : 0UL, ( body != NULL ) ? body : ""
+    );
+    send( fd, buffer, length, 0 );
+
+    length = 0;
+    while( length < sizeof( buffer ) - 1 && ( received = recv( fd, buffer + length, sizeof( buffer ) - 1 - length, 0 ) ) > 0 )
+    {
+        length += received;
+    }
+    buffer[length] = 0;
+    close( fd );
+
+    sscanf( buffer, "HTTP/%*s %lu", &status );
+    if ( response != NULL && size > 0 )
+    {
+        response_body = strstr( buffer, "\r\n\r\n" );
+        snprintf( response, size, "%s", ( response_body != NULL ) ? response_body + 4 : "" );
+    }
+    return status;
+}
+
+/**
+ * Store the number of requests handled and faults injected by the server
+ * since the last reset inside the result
+ */
+static void bench_server_stats( bench_environment_t* environment, bench_result_t* result )
+{
+    static const char* faults[] = { "\"stall\":", "\"drip\":", "\"reset\":", "\"error\":", NULL };
+    char response[1024];
+    char* value = NULL;
+    int i = 0;
+
+    if ( bench_server_request( environment, "GET", "/stats", NULL, response, sizeof( response ) ) != 200 )
+    {
+        return;
+    }
+    if ( ( value = strstr( response, "\"requests\":" ) ) != NULL )
+    {
+        result->requests = strtoul( value + strlen( "\"requests\":" ), NULL, 10 );
+    }
+    for( i = 0; faults[i] != NULL; ++i )
+    {
+        if ( ( value = strstr( response, faults[i] ) ) != NULL )
+        {
+            result->faults += strtoul( value + strlen( faults[i] ), NULL, 10 );
+        }
+    }
+}
+
+/**
+ * Replace the faults injected by the server
+ *
+ * FALSE is returned if the server did not accept them.
+ */
+static int bench_server_faults( bench_environment_t* environment, const char* faults )
+{
+    return bench_server_request( environment, "PUT", "/faults", faults, NULL, 0 ) == 204;
+}
+
+/**
+ * Peak resident set size of the given process in KiB
+ */
+static long bench_peak_rss( pid_t pid )
+{
+    char path[64];
+    char line[256];
+    long rss = 0;
+    FILE* status = NULL;
+
+    snprintf( path, sizeof( path ), "/proc/%d/status", (int)pid );
+    if ( ( status = fopen( path, "r" ) ) == NULL )
+    {
+        return 0;
+    }
+    while( fgets( line, sizeof( line ), status ) != NULL )
+    {
+        if ( sscanf( line, "VmHWM: %ld kB", &rss ) == 1 )
+        {
+            break;
+        }
+    }
+    fclose( status );
+    return rss;
+}
+
+/*
+ * Measurement
+ */
+
+/**
+ * Current monotonic time in microseconds
+ */
+static uint64_t bench_now()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Return the operation with the given name, creating it on first use
+ */
+static bench_op_t* bench_op( bench_result_t* result, const char* name )
+{
+    int i = 0;
+    for( i = 0; i < result->num_ops; ++i )
+    {
+        if ( strcmp( result->ops[i].name, name ) == 0 )
+        {
+            return &result->ops[i];
+        }
+    }
+    result->ops[result->num_ops].name = name;
+    return &result->ops[result->num_ops++];
+}
+
+/**
+ * Record the latency of an operation started at the given time
+ */
+static void bench_record( bench_result_t* result, bench_op_t* op, uint64_t start )
+{
+    uint64_t latency = bench_now() - start;
+
+    pthread_mutex_lock( &result->lock );
+    if ( op->num_samples == op->size_samples )
+    {
+        op->size_samples = ( op->size_samples == 0 ) ? 1024 : op->size_samples * 2;
+        op->samples = (uint64_t*)realloc( op->samples, sizeof( uint64_t ) * op->size_samples );
+    }
+    op->samples[op->num_samples++] = latency;
+    pthread_mutex_unlock( &result->lock );
+}
+
+/**
+ * Record the latency of a failed operation started at the given time
+ *
+ * Failures are part of the latency distribution, as a caller waits for them
+ * just like for a successful operation.
+ */
+static void bench_record_error( bench_result_t* result, bench_op_t* op, uint64_t start )
+{
+    bench_record( result, op, start );
+
+    pthread_mutex_lock( &result->lock );
+    ++op->errors;
+    pthread_mutex_unlock( &result->lock );
+}
+
+static int bench_compare_samples( const void* a, const void* b )
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return ( x > y ) - ( x < y );
+}
+
+/**
+ * Return the given percentile of the samples of an operation
+ *
+ * The samples are sorted on the first call.
+ */
+static uint64_t bench_percentile( bench_op_t* op, double percentile )
+{
+    size_t index = 0;
+    if ( op->num_samples == 0 )
+    {
+        return 0;
+    }
+    qsort( op->samples, op->num_samples, sizeof( uint64_t ), bench_compare_samples );
+    index = (size_t)( percentile / 100.0 * ( op->num_samples - 1 ) + 0.5 );
+    return op->samples[index];
+}
+
+/**
+ * Write all results as JSON
+ */
+static void bench_write_results( FILE* out, bench_result_t* results, int num_results, long peak_rss )
+{
+    int i = 0;
+    int j = 0;
+
+    fprintf( out, "{\n  \"peak_rss_kb\": %ld,\n  \"workloads\": {\n", peak_rss );
+    for( i = 0; i < num_results; ++i )
+    {
+        bench_result_t* result = &results[i];
+        uint64_t ops = 0;
+
+        for( j = 0; j < result->num_ops; ++j )
+        {
+            ops += result->ops[j].num_samples;
+        }
+
+        fprintf( out, "    \"%s\": {\n", result->name );
+        fprintf( out, "      \"seconds\": %.6f,\n", result->seconds );
+        fprintf( out, "      \"ops_per_second\": %.1f,\n", ( result->seconds > 0 ) ? ops / result->seconds : 0.0 );
+        fprintf( out, "      \"bytes_per_second\": %.1f,\n", ( result->seconds > 0 ) ? result->bytes / result->seconds : 0.0 );
+        fprintf( out, "      \"requests\": %lu,\n", result->requests );
+        fprintf( out, "      \"faults\": %lu,\n", result->faults );
+        fprintf( out, "      \"ops\": {\n" );
+        for( j = 0; j < result->num_ops; ++j )
+        {
+            bench_op_t* op = &result->ops[j];
+            fprintf(
+                out, "        \"%s\": { \"count\": %lu, \"errors\": %lu, \"p50_us\": %lu, \"p99_us\": %lu, \"p999_us\": %lu, \"max_us\": %lu }%s\n",
+                op->name, (unsigned long)op->num_samples, op->errors,
+                (unsigned long)bench_percentile( op, 50 ), (unsigned long)bench_percentile( op, 99 ),
+                (unsigned long)bench_percentile( op, 99.9 ), (unsigned long)bench_percentile( op, 100 ),
+                ( j + 1 < result->num_ops ) ? "," : ""
+            );
+        }
+        fprintf( out, "      }\n    }%s\n", ( i + 1 < num_results ) ? "," : "" );
+    }
+    fprintf( out, "  }\n}\n" );
+}
+
+/**
+ * Find a numeric value inside the baseline
+ *
+ * The baseline is a file written by bench_write_results. The value is
+ * searched for inside the section of the given workload and optionally the
+ * given operation. FALSE is returned if it does not exist.
+ */
+static int bench_baseline_value( char* baseline, const char* workload, const char* op, const char* key, double* value )
+{
+    char pattern[256];
+    char* cur = NULL;
+    char* end = NULL;
+
+    snprintf( pattern, sizeof( pattern ), "\"%s\": {", workload );
+    if ( ( cur = strstr( baseline, pattern ) ) == NULL )
+    {
+        return FALSE;
+    }
+    // The workload section ends where the next workload at the same level
+    // starts
+    end = strstr( cur + 1, "\n    \"" );
+
+    if ( op != NULL )
+    {
+        snprintf( pattern, sizeof( pattern ), "\"%s\": {", op );
+        if ( ( cur = strstr( cur, pattern ) ) == NULL || ( end != NULL && cur > end ) )
+        {
+            return FALSE;
+        }
+    }
+
+    snprintf( pattern, sizeof( pattern ), "\"%s\": ", key );
+    if ( ( cur = strstr( cur, pattern ) ) == NULL || ( end != NULL && cur > end ) )
+    {
+        return FALSE;
+    }
+    *value = strtod( cur + strlen( pattern ), NULL );
+    return TRUE;
+}
+
+/**
+ * Report the deviation of a value from the baseline
+ *
+ * Higher_is_better specifies the direction of a regression. FALSE is returned
+ * if the value regressed beyond the threshold.
+ */
+static int bench_check( const char* workload, const char* metric, double baseline, double current, int higher_is_better )
+{
+    double change = ( baseline != 0 ) ? ( current - baseline ) / baseline * 100.0 : 0.0;
+    int regressed = higher_is_better ? ( change < -bench_options.threshold ) : ( change > bench_options.threshold );
+
+    fprintf(
+        stderr, "%-28s %-28s %14.1f %14.1f %+8.1f%%%s\n",
+        workload, metric, baseline, current, change, regressed ? "  REGRESSION" : ""
+    );
+    return !regressed;
+}
+
+/**
+ * Compare the results with the baseline file
+ *
+ * Throughput and p99 latencies are checked. FALSE is returned if any of them
+ * regressed beyond the threshold, or if the baseline can not be read.
+ */
+static int bench_compare_baseline( bench_result_t* results, int num_results )
+{
+    char* baseline = NULL;
+    long length = 0;
+    int ok = TRUE;
+    FILE* in = fopen( bench_options.baseline, "r" );
+    int i = 0;
+    int j = 0;
+
+    if ( in == NULL )
+    {
+        fprintf( 
+            stderr, "Can not read the baseline %s: %s\nStore the results of this run as the baseline using \"make bench-baseline\".\n", 
+            bench_options.baseline, strerror( errno ) 
+        );
+        return FALSE;
+    }
+    fseek( in, 0, SEEK_END );
+    length = ftell( in );
+    fseek( in, 0, SEEK_SET );
+    baseline = (char*)calloc( length + 1, 1 );
+    length = fread( baseline, 1, length, in );
+    fclose( in );
+
+    fprintf( stderr, "\n%-28s %-28s %14s %14s %9s\n", "workload", "metric", "baseline", "current", "change" );
+    for( i = 0; i < num_results; ++i )
+    {
+        bench_result_t* result = &results[i];
+        double value = 0;
+
+        if ( bench_baseline_value( baseline, result->name, NULL, "ops_per_second", &value ) )
+        {
+            uint64_t ops = 0;
+            for( j = 0; j < result->num_ops; ++j )
+            {
+                ops += result->ops[j].num_samples;
+            }
+            ok &= bench_check( result->name, "ops_per_second", value, ( result->seconds > 0 ) ? ops / result->seconds : 0.0, TRUE );
+        }
+        if ( result->bytes > 0 && bench_baseline_value( baseline, result->name, NULL, "bytes_per_second", &value ) )
+        {
+            ok &= bench_check( result->name, "bytes_per_second", value, result->bytes / result->seconds, TRUE );
+        }
+        if ( bench_baseline_value( baseline, result->name, NULL, "requests", &value ) )
+        {
+            ok &= bench_check( result->name, "requests", value, result->requests, FALSE );
+        }
+        for( j = 0; j < result->num_ops; ++j )
+        {
+            char metric[64];
+            snprintf( metric, sizeof( metric ), "%s p99_us", result->ops[j].name );
+            if ( bench_baseline_value( baseline, result->name, result->ops[j].name, "p99_us", &value ) )
+            {
+                ok &= bench_check( result->name, metric, value, bench_percentile( &result->ops[j], 99 ), FALSE );
+            }
+        }
+    }
+
+    free( baseline );
+    return ok;
+}
+
+/*
+ * Workloads
+ */
+
+/**
+ * Recursively list and stat a directory like ls -lR does
+ */
+static void bench_walk( bench_result_t* result, char* path )
+{
+    bench_op_t* readdir_op = bench_op( result, "readdir" );
+    bench_op_t* stat_op    = bench_op( result, "stat" );
+    char** directories = NULL;
+    int num_directories = 0;
+    struct dirent* entry = NULL;
+    uint64_t start = bench_now();
+    DIR* dir = opendir( path );
+    int i = 0;
+
+    if ( dir == NULL )
+    {
+        bench_record_error( result, readdir_op, start );
+        return;
+    }
+
+    // The stat calls are issued while reading the directory, just like ls
+    // does it for every returned batch of entries.
+    while( ( entry = readdir( dir ) ) != NULL )
+    {
+        char child[4096];
+        struct stat stbuf;
+        uint64_t stat_start = 0;
+
+        if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
+        {
+            continue;
+        }
+
+        snprintf( child, sizeof( child ), "%s/%s", path, entry->d_name );
+        stat_start = bench_now();
+        if ( lstat( child, &stbuf ) == 0 )
+        {
+            bench_record( result, stat_op, stat_start );
+            if ( S_ISDIR( stbuf.st_mode ) )
+            {
+                directories = (char**)realloc( directories, sizeof( char* ) * ( num_directories + 1 ) );
+                directories[num_directories++] = strdup( child );
+            }
+        }
+        else
+        {
+            bench_record_error( result, stat_op, stat_start );
+        }
+    }
+    closedir( dir );
+    bench_record( result, readdir_op, start );
+
+    for( i = 0; i < num_directories; ++i )
+    {
+        bench_walk( result, directories[i] );
+        free( directories[i] );
+    }
+    free( directories );
+}
+
+static void bench_ls_lr( bench_environment_t* environment, bench_result_t* result )
+{
+    bench_walk( result, environment->root );
+}
+
+/**
+ * Read a file sequentially using large reads
+ */
+static void bench_read_file( bench_result_t* result, char* path )
+{
+    bench_op_t* open_op = bench_op( result, "open" );
+    bench_op_t* read_op = bench_op( result, "read" );
+    char* buffer = (char*)malloc( BENCH_READ_SIZE );
+    uint64_t start = bench_now();
+    uint64_t bytes = 0;
+    ssize_t length = 0;
+    int fd = open( path, O_RDONLY );
+
+    if ( fd == -1 )
+    {
+        bench_record_error( result, open_op, start );
+        free( buffer );
+        return;
+    }
+    bench_record( result, open_op, start );
+
+    while( TRUE )
+    {
+        start = bench_now();
+        if ( ( length = read( fd, buffer, BENCH_READ_SIZE ) ) <= 0 )
+        {
+            if ( length == -1 )
+            {
+                bench_record_error( result, read_op, start );
+            }
+            break;
+        }
+        bench_record( result, read_op, start );
+        bytes += length;
+    }
+    close( fd );
+    free( buffer );
+
+    pthread_mutex_lock( &result->lock );
+    result->bytes += bytes;
+    pthread_mutex_unlock( &result->lock );
+}
+
+static void bench_sequential_read( bench_environment_t* environment, bench_result_t* result )
+{
+    char path[4096];
+    snprintf( path, sizeof( path ), "%s/large000.bin", environment->root );
+    bench_read_file( result, path );
+}
+
+static void bench_random_read( bench_environment_t* environment, bench_result_t* result )
+{
+    bench_op_t* read_op = bench_op( result, "read" );
+    char buffer[BENCH_RANDOM_SIZE];
+    uint64_t state = 1;
+    int fds[BENCH_MAX_WORKLOADS];
+    int num_fds = 0;
+    int i = 0;
+
+    for( i = 0; i < bench_options.large_files && num_fds < BENCH_MAX_WORKLOADS; ++i )
+    {
+        char path[4096];
+        snprintf( path, sizeof( path ), "%s/large%03d.bin", environment->root, i );
+        if ( ( fds[num_fds] = open( path, O_RDONLY ) ) != -1 )
+        {
+            ++num_fds;
+        }
+    }
+    if ( num_fds == 0 || bench_options.large_size < BENCH_RANDOM_SIZE )
+    {
+        return;
+    }
+
+    for( i = 0; i < bench_options.random_reads; ++i )
+    {
+        uint64_t start = 0;
+        ssize_t length = 0;
+        off_t offset = 0;
+
+        // Deterministic sequence of aligned offsets
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        offset = ( ( state >> 16 ) % ( bench_options.large_size / BENCH_RANDOM_SIZE ) ) * BENCH_RANDOM_SIZE;
+
+        start = bench_now();
+        if ( ( length = pread( fds[i % num_fds], buffer, BENCH_RANDOM_SIZE, offset ) ) > 0 )
+        {
+            bench_record( result, read_op, start );
+            result->bytes += length;
+        }
+        else
+        {
+            bench_record_error( result, read_op, start );
+        }
+    }
+
+    for( i = 0; i < num_fds; ++i )
+    {
+        close( fds[i] );
+    }
+}
+
+static void bench_small_files( bench_environment_t* environment, bench_result_t* result )
+{
+    char path[4096];
+    struct dirent* entry = NULL;
+    int count = 0;
+    DIR* dir = NULL;
+
+    snprintf( path, sizeof( path ), "%s/dir000", environment->root );
+    if ( ( dir = opendir( path ) ) == NULL )
+    {
+        return;
+    }
+    while( count < bench_options.small_files && ( entry = readdir( dir ) ) != NULL )
+    {
+        if ( strncmp( entry->d_name, "file", 4 ) == 0 )
+        {
+            char file[4096];
+            snprintf( file, sizeof( file ), "%s/%s", path, entry->d_name );
+            bench_read_file( result, file );
+            ++count;
+        }
+    }
+    closedir( dir );
+}
+
+/**
+ * Arguments of a parallel reader thread
+ */
+typedef struct
+{
+    bench_environment_t* environment;
+    bench_result_t* result;
+    int index;
+} bench_reader_t;
+
+static void* bench_reader( void* data )
+{
+    bench_reader_t* reader = (bench_reader_t*)data;
+    char path[4096];
+
+    snprintf( path, sizeof( path ), "%s/large%03d.bin", reader->environment->root, reader->index % bench_options.large_files );
+    bench_read_file( reader->result, path );
+    return NULL;
+}
+
+static void bench_parallel_read( bench_environment_t* environment, bench_result_t* result )
+{
+    pthread_t* threads = (pthread_t*)calloc( bench_options.threads, sizeof( pthread_t ) );
+    bench_reader_t* readers = (bench_reader_t*)calloc( bench_options.threads, sizeof( bench_reader_t ) );
+    int i = 0;
+
+    if ( bench_options.large_files == 0 )
+    {
+        free( threads );
+        free( readers );
+        return;
+    }
+
+    // Make sure the operations exist before threads start adding to them
+    bench_op( result, "open" );
+    bench_op( result, "read" );
+
+    for( i = 0; i < bench_options.threads; ++i )
+    {
+        readers[i].environment = environment;
+        readers[i].result      = result;
+        readers[i].index       = i;
+        pthread_create( &threads[i], NULL, bench_reader, &readers[i] );
+    }
+    for( i = 0; i < bench_options.threads; ++i )
+    {
+        pthread_join( threads[i], NULL );
+    }
+
+    free( threads );
+    free( readers );
+}
@@ -0,0 +1,117 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define BENCH_MAX_OPS       8
+#define BENCH_MAX_WORKLOADS 16
+#define BENCH_MAX_RESULTS   128
+
+/**
+ * Latency samples of one kind of filesystem operation
+ *
+ * Samples are stored in microseconds. Failed operations are sampled as well
+ * and additionally counted as errors. The structure is shared by all threads
+ * of a workload and protected by its lock.
+ */
+typedef struct
+{
+    const char* name;
+    uint64_t* samples;
+    size_t num_samples;
+    size_t size_samples;
+    unsigned long errors;
+} bench_op_t;
+
+/**
+ * Results of one workload
+ *
+ * Faults is the number of faults injected by the server while the workload
+ * ran. Added latency is not counted.
+ */
+typedef struct
+{
+    const char* name;
+    double seconds;
+    uint64_t bytes;
+    unsigned long requests;
+    unsigned long faults;
+    bench_op_t ops[BENCH_MAX_OPS];
+    int num_ops;
+    pthread_mutex_t lock;
+} bench_result_t;
+
+/**
+ * Options given on the commandline
+ */
+typedef struct
+{
+    char* server;
+    char* mossofs;
+    char* mountpoint;
+    char* output;
+    char* baseline;
+    char* workloads;
+    char* scenarios;
+    char* faults;
+    char* server_args;
+    double threshold;
+    unsigned long objects;
+    int fanout;
+    int depth;
+    int large_files;
+    unsigned long large_size;
+    int random_reads;
+    int small_files;
+    int threads;
+} bench_options_t;
+
+/**
+ * Processes and addresses of a running benchmark environment
+ */
+typedef struct
+{
+    pid_t server_pid;
+    pid_t mossofs_pid;
+    int port;
+    char root[4096];
+} bench_environment_t;
+
+typedef void (*bench_workload_func)( bench_environment_t* environment, bench_result_t* result );
+
+/**
+ * Set of faults injected by the server while the workloads are run
+ *
+ * The faults are given as newline separated specifications understood by
+ * the faults endpoint of mossofs-server.
+ */
+typedef struct
+{
+    const char* name;
+    const char* faults;
+} bench_scenario_t;
+
+#endif
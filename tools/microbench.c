@@ -0,0 +1,472 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+/*
+ * Microbenchmarks of the cpu bound hot paths
+ *
+ * Every benchmark is run with an increasing number of iterations until a
+ * single run takes at least the configured minimum time. The time per
+ * iteration of this last run is reported. Multithreaded benchmarks are
+ * additionally run with 1, 2, 4, ... threads to show how they scale.
+ *
+ * Before any benchmark is run all SIMD kernels are checked to produce the
+ * same results as their scalar versions.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <regex.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "simd.h"
+#include "microbench.h"
+
+#define TRUE  1
+#define FALSE 0
+
+/**
+ * Options given on the commandline
+ */
+static struct
+{
+    char* filter;
+    char* output;
+    double min_time;
+    int threads;
+    int list;
+} microbench_options;
+
+/**
+ * Result of the final run of one benchmark
+ */
+typedef struct
+{
+    char name[256];
+    unsigned long iterations;
+    int threads;
+    double seconds;
+    size_t bytes;
+} microbench_result_t;
+
+/**
+ * Arguments of a single benchmark thread
+ */
+typedef struct
+{
+    microbench_t* benchmark;
+    microbench_state_t state;
+    pthread_barrier_t* barrier;
+    uint64_t elapsed;
+} microbench_thread_t;
+
+static void microbench_parse_options( int argc, char** argv );
+static void microbench_usage( char* name );
+static void* microbench_thread( void* data );
+static uint64_t microbench_measure( microbench_t* benchmark, void* data, int threads, unsigned long iterations );
+static void microbench_run( microbench_t* benchmark, void* data, int threads, microbench_result_t* result );
+static void microbench_report( microbench_result_t* result );
+static void microbench_write_results( FILE* out, microbench_result_t* results, int num_results );
+
+/**
+ * All benchmarked modules in the order they are run
+ */
+static microbench_t* microbench_modules[] = {
+    microbench_mosso,
+    microbench_simple_curl,
+    microbench_simd,
+    microbench_cache,
+    microbench_mossofs,
+    NULL
+};
+
+int main( int argc, char** argv )
+{
+    microbench_result_t* results = NULL;
+    int num_results = 0;
+    int size_results = 0;
+    regex_t filter;
+    int i = 0;
+    int j = 0;
+
+    microbench_parse_options( argc, argv );
+
+    if ( microbench_options.filter != NULL && regcomp( &filter, microbench_options.filter, REG_EXTENDED | REG_NOSUB ) != 0 )
+    {
+        fprintf( stderr, "Invalid filter expression: %s\n", microbench_options.filter );
+        return 2;
+    }
+
+    if ( !microbench_options.list )
+    {
+        if ( !microbench_simd_verify() )
+        {
+            fprintf( stderr, "SIMD kernels do not match their scalar versions\n" );
+            return 1;
+        }
+
+        fprintf( stderr, "%-56s %14s %12s %16s\n", "Benchmark", "Time", "Iterations", "Throughput" );
+    }
+
+    for( i = 0; microbench_modules[i] != NULL; ++i )
+    {
+        for( j = 0; microbench_modules[i][j].name != NULL; ++j )
+        {
+            microbench_t* benchmark = &microbench_modules[i][j];
+            void* data = NULL;
+            int threads = ( benchmark->threads == MICROBENCH_THREADS_SCALE ) ? 1 : benchmark->threads;
+
+            if ( microbench_options.filter != NULL && regexec( &filter, benchmark->name, 0, NULL, 0 ) != 0 )
+            {
+                continue;
+            }
+
+            if ( microbench_options.list )
+            {
+                printf( "%s\n", benchmark->name );
+                continue;
+            }
+
+            if ( benchmark->setup != NULL && ( data = benchmark->setup( benchmark->arg ) ) == MICROBENCH_SKIP )
+            {
+                fprintf( stderr, "%-56s %14s\n", benchmark->name, "skipped" );
+                continue;
+            }
+
+            for( ; threads <= microbench_options.threads; threads *= 2 )
+            {
+                if ( num_results == size_results )
+                {
+                    size_results = ( size_results == 0 ) ? 32 : size_results * 2;
+                    results = (microbench_result_t*)realloc( results, sizeof( microbench_result_t ) * size_results );
+                }
+
+                microbench_run( benchmark, data, threads, &results[num_results] );
+                microbench_report( &results[num_results] );
+                ++num_results;
+
+                if ( benchmark->threads != MICROBENCH_THREADS_SCALE )
+                {
+                    break;
+                }
+            }
+
+            ( benchmark->teardown != NULL ) ? benchmark->teardown( data ) : NULL;
+        }
+    }
+
+    if ( microbench_options.output != NULL )
+    {
+        FILE* out = NULL;
+
+        if ( ( out = fopen( microbench_options.output, "w" ) ) == NULL )
+        {
+            perror( "Could not write results" );
+            return 2;
+        }
+
+        microbench_write_results( out, results, num_results );
+        fclose( out );
+    }
+
+    ( microbench_options.filter != NULL ) ? regfree( &filter ) : NULL;
+    ( results != NULL ) ? free( results ) : NULL;
+    return 0;
+}
+
+static void microbench_usage( char* name )
+{
+    fprintf( stderr, "Usage: %s [options]\n", name );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "Options:\n" );
+    fprintf( stderr, "  --filter=REGEX    only run benchmarks whose name matches\n" );
+    fprintf( stderr, "  --min-time=SEC    minimal duration of a measured run (default 0.5)\n" );
+    fprintf( stderr, "  --threads=N       maximal number of threads (default: number of cpus)\n" );
+    fprintf( stderr, "  --output=FILE     write the results as JSON to FILE\n" );
+    fprintf( stderr, "  --list            list all benchmarks without running them\n" );
+}
+
+static void microbench_parse_options( int argc, char** argv )
+{
+    static struct option long_options[] = {
+        { "filter",   required_argument, NULL, 'f' },
+        { "min-time", required_argument, NULL, 'm' },
+        { "threads",  required_argument, NULL, 'T' },
+        { "output",   required_argument, NULL, 'o' },
+        { "list",     no_argument,       NULL, 'l' },
+        { "help",     no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c = 0;
+
+    microbench_options.min_time = 0.5;
+    microbench_options.threads  = (int)sysconf( _SC_NPROCESSORS_ONLN );
+
+    while( ( c = getopt_long( argc, argv, "h", long_options, NULL ) ) != -1 )
+    {
+        switch( c )
+        {
+            case 'f': microbench_options.filter   = optarg;         break;
+            case 'm': microbench_options.min_time = atof( optarg ); break;
+            case 'T': microbench_options.threads  = atoi( optarg ); break;
+            case 'o': microbench_options.output   = optarg;         break;
+            case 'l': microbench_options.list     = TRUE;           break;
+            case 'h':
+                microbench_usage( argv[0] );
+                exit( 0 );
+            default:
+                microbench_usage( argv[0] );
+                exit( 2 );
+        }
+    }
+
+    if ( microbench_options.threads < 1 )
+    {
+        microbench_options.threads = 1;
+    }
+
+    if ( microbench_options.min_time <= 0 )
+    {
+        microbench_options.min_time = 0.5;
+    }
+}
+
+/*
+ * Measurement
+ */
+
+/**
+ * Current value of the monotonic clock in nanoseconds
+ */
+uint64_t microbench_now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Stop measuring the time of the current run
+ */
+void microbench_pause( microbench_state_t* state )
+{
+    state->pause_start = microbench_now();
+}
+
+/**
+ * Continue measuring the time of the current run
+ */
+void microbench_resume( microbench_state_t* state )
+{
+    state->paused += microbench_now() - state->pause_start;
+}
+
+/**
+ * Execute a benchmark in one thread
+ *
+ * All threads of a run are started at once using the barrier.
+ */
+static void* microbench_thread( void* data )
+{
+    microbench_thread_t* thread = (microbench_thread_t*)data;
+    uint64_t start = 0;
+
+    pthread_barrier_wait( thread->barrier );
+
+    start = microbench_now();
+    thread->benchmark->run( &thread->state );
+    thread->elapsed = microbench_now() - start - thread->state.paused;
+
+    return NULL;
+}
+
+/**
+ * Run a benchmark once with the given number of iterations and threads
+ *
+ * The measured time of the slowest thread is returned in nanoseconds.
+ */
+static uint64_t microbench_measure( microbench_t* benchmark, void* data, int threads, unsigned long iterations )
+{
+    microbench_thread_t* thread = (microbench_thread_t*)calloc( threads, sizeof( microbench_thread_t ) );
+    pthread_t* ids = (pthread_t*)calloc( threads, sizeof( pthread_t ) );
+    pthread_barrier_t barrier;
+    uint64_t elapsed = 0;
+    int i = 0;
+
+    pthread_barrier_init( &barrier, NULL, threads );
+
+    for( i = 0; i < threads; ++i )
+    {
+        thread[i].benchmark        = benchmark;
+        thread[i].barrier          = &barrier;
+        thread[i].state.iterations = iterations;
+        thread[i].state.arg        = benchmark->arg;
+        thread[i].state.thread     = i;
+        thread[i].state.threads    = threads;
+        thread[i].state.data       = data;
+    }
+
+    // A single threaded benchmark is run in the main thread to keep its
+    // caches warm between runs
+    if ( threads == 1 )
+    {
+        microbench_thread( &thread[0] );
+    }
+    else
+    {
+        for( i = 0; i < threads; ++i )
+        {
+            pthread_create( &ids[i], NULL, microbench_thread, &thread[i] );
+        }
+        for( i = 0; i < threads; ++i )
+        {
+            pthread_join( ids[i], NULL );
+        }
+    }
+
+    for( i = 0; i < threads; ++i )
+    {
+        elapsed = ( thread[i].elapsed > elapsed ) ? thread[i].elapsed : elapsed;
+    }
+
+    pthread_barrier_destroy( &barrier );
+    free( thread );
+    free( ids );
+
+    return elapsed;
+}
+
+/**
+ * Determine the number of iterations needed and measure the final run
+ *
+ * The number of iterations is scaled by the ratio between the minimal time
+ * and the last measured one, but at most by a factor of ten each step.
+ */
+static void microbench_run( microbench_t* benchmark, void* data, int threads, microbench_result_t* result )
+{
+    uint64_t min_time = (uint64_t)( microbench_options.min_time * 1e9 );
+    unsigned long iterations = 1;
+    uint64_t elapsed = 0;
+
+    while( TRUE )
+    {
+        double multiplier = 10.0;
+
+        elapsed = microbench_measure( benchmark, data, threads, iterations );
+
+        if ( elapsed >= min_time || iterations >= 1000000000UL )
+        {
+            break;
+        }
+
+        if ( elapsed > min_time / 10 )
+        {
+            multiplier = (double)min_time * 1.4 / elapsed;
+        }
+
+        iterations = ( iterations * multiplier > iterations + 1 ) ? (unsigned long)( iterations * multiplier ) : iterations + 1;
+    }
+
+    if ( benchmark->threads == MICROBENCH_THREADS_SCALE )
+    {
+        snprintf( result->name, sizeof( result->name ), "%s/threads:%d", benchmark->name, threads );
+    }
+    else
+    {
+        snprintf( result->name, sizeof( result->name ), "%s", benchmark->name );
+    }
+
+    result->iterations = iterations;
+    result->threads    = threads;
+    result->seconds    = elapsed / 1e9;
+    result->bytes      = benchmark->bytes;
+}
+
+/*
+ * Reporting
+ */
+
+/**
+ * Print the result of one benchmark in a human readable form
+ *
+ * The time is given per iteration of one thread. The throughput covers all
+ * threads.
+ */
+static void microbench_report( microbench_result_t* result )
+{
+    double ns = result->seconds * 1e9 / result->iterations;
+    double total = (double)result->iterations * result->threads / result->seconds;
+    char time[32];
+    char throughput[32];
+
+    snprintf( time, sizeof( time ), "%.1f ns", ns );
+
+    if ( result->bytes != 0 )
+    {
+        snprintf( throughput, sizeof( throughput ), "%.1f MB/s", total * result->bytes / ( 1024 * 1024 ) );
+    }
+    else
+    {
+        snprintf( throughput, sizeof( throughput ), "%.3fM/s", total / 1e6 );
+    }
+
+    fprintf( stderr, "%-56s %14s %12lu %16s\n", result->name, time, result->iterations, throughput );
+}
+
+/**
+ * Write all results as JSON
+ */
+static void microbench_write_results( FILE* out, microbench_result_t* results, int num_results )
+{
+    static const char* variants[] = { "auto", "scalar", "sse2", "avx2" };
+    int i = 0;
+
+    fprintf( out, "{\n" );
+    fprintf( out, "  \"context\": {\n" );
+    fprintf( out, "    \"cpus\": %ld,\n", sysconf( _SC_NPROCESSORS_ONLN ) );
+    fprintf( out, "    \"simd\": \"%s\",\n", variants[simd_variant()] );
+    fprintf( out, "    \"min_time\": %.3f\n", microbench_options.min_time );
+    fprintf( out, "  },\n" );
+    fprintf( out, "  \"benchmarks\": [\n" );
+
+    for( i = 0; i < num_results; ++i )
+    {
+        microbench_result_t* result = &results[i];
+        double total = (double)result->iterations * result->threads / result->seconds;
+
+        fprintf( out, "    {\n" );
+        fprintf( out, "      \"name\": \"%s\",\n", result->name );
+        fprintf( out, "      \"threads\": %d,\n", result->threads );
+        fprintf( out, "      \"iterations\": %lu,\n", result->iterations );
+        fprintf( out, "      \"ns_per_iteration\": %.3f,\n", result->seconds * 1e9 / result->iterations );
+        fprintf( out, "      \"items_per_second\": %.1f,\n", total );
+        fprintf( out, "      \"bytes_per_second\": %.1f\n", total * result->bytes );
+        fprintf( out, "    }%s\n", ( i + 1 < num_results ) ? "," : "" );
+    }
+
+    fprintf( out, "  ]\n" );
+    fprintf( out, "}\n" );
+}
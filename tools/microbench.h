@@ -0,0 +1,118 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Value returned by a setup function if the benchmark can not be run on this
+ * machine, e.g. because the needed instruction set is not available.
+ */
+#define MICROBENCH_SKIP ((void*)-1)
+
+/**
+ * Thread count of benchmarks, which are run with 1, 2, 4, ... threads up to
+ * the configured maximum.
+ */
+#define MICROBENCH_THREADS_SCALE 0
+
+/**
+ * State handed to every run of a benchmark
+ *
+ * The run function needs to execute its operation exactly iterations times.
+ * Multithreaded benchmarks are run by threads threads at once, each one with
+ * its own state, sharing the data returned by the setup function.
+ *
+ * Work which should not be measured, like the creation of the input of a
+ * destructive operation, needs to be enclosed by microbench_pause and
+ * microbench_resume.
+ */
+typedef struct
+{
+    unsigned long iterations;
+    long arg;
+    int thread;
+    int threads;
+    void* data;
+    uint64_t paused;
+    uint64_t pause_start;
+} microbench_state_t;
+
+typedef void* (*microbench_setup_func)( long arg );
+typedef void (*microbench_run_func)( microbench_state_t* state );
+typedef void (*microbench_teardown_func)( void* data );
+
+/**
+ * Definition of one benchmark
+ *
+ * Setup and teardown are optional and called once around all runs of the
+ * benchmark. Bytes is the amount of data processed by a single iteration. It
+ * is used to report the throughput, if it is not 0.
+ */
+typedef struct
+{
+    const char* name;
+    microbench_setup_func setup;
+    microbench_run_func run;
+    microbench_teardown_func teardown;
+    long arg;
+    int threads;
+    size_t bytes;
+} microbench_t;
+
+/*
+ * Benchmarks of the different modules. Every list is terminated by an entry
+ * without a name.
+ */
+extern microbench_t microbench_mosso[];
+extern microbench_t microbench_simple_curl[];
+extern microbench_t microbench_simd[];
+extern microbench_t microbench_cache[];
+extern microbench_t microbench_mossofs[];
+
+int microbench_simd_verify();
+
+/*
+ * Fixtures shared between modules
+ */
+struct mosso_object;
+struct mosso_object* microbench_mosso_object_list( int count );
+void* microbench_mosso_meta( char* request_path );
+char* microbench_listing_body( int count, size_t* length );
+
+uint64_t microbench_now();
+void microbench_pause( microbench_state_t* state );
+void microbench_resume( microbench_state_t* state );
+
+/**
+ * Prevent the compiler from optimizing away the computation of a value,
+ * which is not used otherwise.
+ */
+static inline void microbench_use( const void* ptr )
+{
+    __asm__ __volatile__( "" : : "g"( ptr ) : "memory" );
+}
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+/*
+ * Microbenchmarks of the cache
+ *
+ * All benchmarks operate on a cache filled with the meta information of
+ * MICROBENCH_CACHE_ENTRIES objects. Their identifiers are precomputed, to
+ * only measure the cache itself.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "salloc.h"
+#include "cache.h"
+#include "microbench.h"
+
+#define MICROBENCH_CACHE_ENTRIES 10000
+
+/**
+ * Cache shared by all threads of a benchmark
+ */
+typedef struct
+{
+    cache_t* cache;
+    char* identifiers[MICROBENCH_CACHE_ENTRIES];
+    char* missing[MICROBENCH_CACHE_ENTRIES];
+} microbench_cache_t;
+
+static void microbench_cache_free( char* prefix, char* identifier, void* ptr )
+{
+    (void)prefix;
+    (void)identifier;
+
+    free( ptr );
+}
+
+static void* microbench_cache_setup( long arg )
+{
+    microbench_cache_t* data = snew( microbench_cache_t );
+    int i = 0;
+
+    (void)arg;
+
+    data->cache = cache_new( 3600, microbench_cache_free );
+
+    for( i = 0; i < MICROBENCH_CACHE_ENTRIES; ++i )
+    {
+        asprintf( &data->identifiers[i], "/photos/2009/IMG %05d.jpg", i );
+        asprintf( &data->missing[i], "/photos/2010/IMG %05d.jpg", i );
+        cache_add_object( data->cache, "meta", data->identifiers[i], smalloc( 64 ) );
+    }
+
+    return data;
+}
+
+static void microbench_cache_teardown( void* ptr )
+{
+    microbench_cache_t* data = (microbench_cache_t*)ptr;
+    int i = 0;
+
+    cache_free( data->cache );
+
+    for( i = 0; i < MICROBENCH_CACHE_ENTRIES; ++i )
+    {
+        free( data->identifiers[i] );
+        free( data->missing[i] );
+    }
+
+    free( data );
+}
+
+/**
+ * Index of the entry used by the given iteration
+ *
+ * Every thread walks through the entries using a different offset and a
+ * stride, which is coprime to the number of entries.
+ */
+static inline int microbench_cache_index( microbench_state_t* state, unsigned long i )
+{
+    return ( i * 7919 + state->thread * ( MICROBENCH_CACHE_ENTRIES / state->threads ) ) % MICROBENCH_CACHE_ENTRIES;
+}
+
+static void microbench_cache_get_hit( microbench_state_t* state )
+{
+    microbench_cache_t* data = (microbench_cache_t*)state->data;
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        void* ptr = cache_get_object( data->cache, "meta", data->identifiers[microbench_cache_index( state, i )] );
+        cache_release_object( data->cache, ptr );
+    }
+}
+
+static void microbench_cache_get_miss( microbench_state_t* state )
+{
+    microbench_cache_t* data = (microbench_cache_t*)state->data;
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        microbench_use( cache_get_object( data->cache, "meta", data->missing[microbench_cache_index( state, i )] ) );
+    }
+}
+
+/**
+ * Replace existing entries, which frees the old ones
+ */
+static void microbench_cache_add( microbench_state_t* state )
+{
+    microbench_cache_t* data = (microbench_cache_t*)state->data;
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        cache_add_object( data->cache, "meta", data->identifiers[microbench_cache_index( state, i )], smalloc( 64 ) );
+    }
+}
+
+/**
+ * Mix of nine lookups per replacement, like a mostly cached directory tree
+ * being walked
+ */
+static void microbench_cache_mixed( microbench_state_t* state )
+{
+    microbench_cache_t* data = (microbench_cache_t*)state->data;
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        char* identifier = data->identifiers[microbench_cache_index( state, i )];
+
+        if ( i % 10 == 0 )
+        {
+            cache_add_object( data->cache, "meta", identifier, smalloc( 64 ) );
+        }
+        else
+        {
+            cache_release_object( data->cache, cache_get_object( data->cache, "meta", identifier ) );
+        }
+    }
+}
+
+microbench_t microbench_cache[] = {
+    { "cache_get_object/hit",      microbench_cache_setup, microbench_cache_get_hit,  microbench_cache_teardown, 0, MICROBENCH_THREADS_SCALE, 0 },
+    { "cache_get_object/miss",     microbench_cache_setup, microbench_cache_get_miss, microbench_cache_teardown, 0, MICROBENCH_THREADS_SCALE, 0 },
+    { "cache_add_object/replace",  microbench_cache_setup, microbench_cache_add,      microbench_cache_teardown, 0, MICROBENCH_THREADS_SCALE, 0 },
+    { "cache/mixed_90_10",         microbench_cache_setup, microbench_cache_mixed,    microbench_cache_teardown, 0, MICROBENCH_THREADS_SCALE, 0 },
+    { NULL }
+};
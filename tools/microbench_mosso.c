@@ -0,0 +1,198 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+/*
+ * Microbenchmarks of the mosso api
+ *
+ * The implementation is included directly to be able to measure its static
+ * functions.
+ */
+
+#include "mosso.c"
+
+#include "microbench.h"
+
+#define MICROBENCH_STORAGE_URL "https://storage.clouddrive.com/v1/MossoCloudFS_0e1f2a3b-4c5d-6e7f-8091-a2b3c4d5e6f7"
+
+/**
+ * Input of the url construction benchmarks
+ */
+static struct {
+    char* request_path;
+    int type;
+    char* marker;
+} microbench_urls[] = {
+    { "/photos/2009/summer holidays/IMG 0042.jpg", MOSSO_PATH_TYPE_FILE, NULL },
+    { "/photos/2009/summer holidays", MOSSO_PATH_TYPE_PATH, NULL },
+    { "/photos/2009/summer holidays", MOSSO_PATH_TYPE_PATH, "2009/summer holidays/IMG 4711.jpg" },
+};
+
+/**
+ * Create a list of the given number of object entries
+ */
+mosso_object_t* microbench_mosso_object_list( int count )
+{
+    mosso_object_t* object = NULL;
+    char request_path[64];
+    int i = 0;
+
+    for( i = 0; i < count; ++i )
+    {
+        snprintf( request_path, sizeof( request_path ), "/photos/2009/IMG %05d.jpg", i );
+        object = mosso_object_add( object, request_path + 13, request_path, MOSSO_OBJECT_TYPE_OBJECT );
+    }
+
+    return ( object != NULL ) ? object->root : NULL;
+}
+
+/**
+ * Create the meta information of an object like it is retrieved by a HEAD
+ * request, including its tags.
+ */
+void* microbench_mosso_meta( char* request_path )
+{
+    static const char raw_tags[] = "author\0jakob\0camera\0ixus 70\0location\0rome\0";
+    mosso_object_meta_t* meta = mosso_object_meta_init( request_path );
+
+    meta->type         = MOSSO_OBJECT_TYPE_OBJECT;
+    meta->content_type = mosso_intern( "image/jpeg" );
+    meta->size         = 1048576;
+    meta->mtime        = 1234567890;
+    meta->raw_tags     = (char*)smalloc( sizeof( raw_tags ) );
+    memcpy( meta->raw_tags, raw_tags, sizeof( raw_tags ) );
+    mosso_object_meta_tags( meta );
+
+    return meta;
+}
+
+/**
+ * Create the body of a listing response with count lines
+ *
+ * The entries are named like the objects of a vdir listing, which contain the
+ * path of the vdir.
+ */
+char* microbench_listing_body( int count, size_t* length )
+{
+    char* body = (char*)smalloc( count * 48 + 1 );
+    char* cur  = body;
+    int i = 0;
+
+    for( i = 0; i < count; ++i )
+    {
+        cur += sprintf( cur, "2009/summer holidays/IMG %05d.jpg\n", i );
+    }
+
+    if ( length != NULL )
+    {
+        *length = cur - body;
+    }
+
+    return body;
+}
+
+/*
+ * Url construction
+ */
+
+static void* microbench_url_setup( long arg )
+{
+    mosso_connection_t* mosso = snew( mosso_connection_t );
+
+    (void)arg;
+
+    mosso->storage_url        = strdup( MICROBENCH_STORAGE_URL );
+    mosso->storage_url_length = strlen( mosso->storage_url );
+
+    return mosso;
+}
+
+static void microbench_url_teardown( void* data )
+{
+    mosso_connection_t* mosso = (mosso_connection_t*)data;
+
+    free( mosso->storage_url );
+    free( mosso );
+}
+
+static void microbench_construct_request_url( microbench_state_t* state )
+{
+    mosso_connection_t* mosso = (mosso_connection_t*)state->data;
+    char* request_path = microbench_urls[state->arg].request_path;
+    char* marker       = microbench_urls[state->arg].marker;
+    int type           = microbench_urls[state->arg].type;
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        microbench_use( mosso_construct_request_url( mosso, request_path, type, marker ) );
+    }
+}
+
+static void microbench_construct_request_url_from_path( microbench_state_t* state )
+{
+    mosso_connection_t* mosso = (mosso_connection_t*)state->data;
+    mosso_path_t* path = mosso_path_new( microbench_urls[state->arg].request_path );
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        microbench_use( mosso_construct_request_url_from_path( mosso, path ) );
+    }
+
+    mosso_path_free( path );
+}
+
+/*
+ * Listing parsing
+ */
+
+static void* microbench_listing_setup( long arg )
+{
+    return microbench_listing_body( (int)arg, NULL );
+}
+
+static void microbench_create_object_list( microbench_state_t* state )
+{
+    char* body = (char*)state->data;
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        mosso_object_t* object = NULL;
+        int num = 0;
+
+        object = mosso_create_object_list_from_response_body( NULL, body, "/photos/", MOSSO_OBJECT_TYPE_OBJECT_OR_VDIR, &num );
+
+        microbench_pause( state );
+        mosso_object_free_all( object );
+        microbench_resume( state );
+    }
+}
+
+microbench_t microbench_mosso[] = {
+    { "mosso_construct_request_url/object",           microbench_url_setup, microbench_construct_request_url,           microbench_url_teardown, 0, MICROBENCH_THREADS_SCALE, 0 },
+    { "mosso_construct_request_url/listing",          microbench_url_setup, microbench_construct_request_url,           microbench_url_teardown, 1, 1, 0 },
+    { "mosso_construct_request_url/listing_marker",   microbench_url_setup, microbench_construct_request_url,           microbench_url_teardown, 2, 1, 0 },
+    { "mosso_construct_request_url_from_path/object", microbench_url_setup, microbench_construct_request_url_from_path, microbench_url_teardown, 0, 1, 0 },
+    { "mosso_create_object_list_from_response_body/10000", microbench_listing_setup, microbench_create_object_list, free, 10000, 1, 10000 * 35 },
+    { NULL }
+};
@@ -0,0 +1,88 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+/*
+ * Microbenchmarks of the fuse frontend
+ *
+ * The implementation is included directly to be able to measure its static
+ * functions. Its main function is renamed to not collide with the one of the
+ * benchmark.
+ */
+
+#define main mossofs_main
+#include "mossofs.c"
+#undef main
+
+#include "microbench.h"
+
+#define MICROBENCH_FREE_BATCH 1024
+
+/**
+ * Free cached structures in batches
+ *
+ * The structures are created while the time measurement is paused. The arg
+ * selects the kind of structure: 0 for object meta information, otherwise the
+ * number of entries of a listing page.
+ */
+static void microbench_cache_object_free( microbench_state_t* state )
+{
+    void* objects[MICROBENCH_FREE_BATCH];
+    unsigned long done = 0;
+
+    while( done < state->iterations )
+    {
+        unsigned long count = state->iterations - done;
+        unsigned long i = 0;
+
+        count = ( count > MICROBENCH_FREE_BATCH ) ? MICROBENCH_FREE_BATCH : count;
+
+        microbench_pause( state );
+        for( i = 0; i < count; ++i )
+        {
+            if ( state->arg == 0 )
+            {
+                objects[i] = microbench_mosso_meta( "/photos/2009/IMG 0042.jpg" );
+            }
+            else
+            {
+                listing_t* listing = listing_new( "/photos/2009" );
+                listing->page = microbench_mosso_object_list( (int)state->arg );
+                listing->page_count = (int)state->arg;
+                objects[i] = listing;
+            }
+        }
+        microbench_resume( state );
+
+        for( i = 0; i < count; ++i )
+        {
+            mossofs_cache_object_free( ( state->arg == 0 ) ? "meta" : "listing", NULL, objects[i] );
+        }
+
+        done += count;
+    }
+}
+
+microbench_t microbench_mossofs[] = {
+    { "mossofs_cache_object_free/meta",         NULL, microbench_cache_object_free, NULL, 0,   1, 0 },
+    { "mossofs_cache_object_free/listing_100",  NULL, microbench_cache_object_free, NULL, 100, 1, 0 },
+    { NULL }
+};
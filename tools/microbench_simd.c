@@ -0,0 +1,218 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+/*
+ * Microbenchmarks and verification of the SIMD kernels
+ *
+ * Every kernel is measured in all variants supported by the running CPU.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "simd.h"
+#include "microbench.h"
+
+#define TRUE  1
+#define FALSE 0
+
+#define MICROBENCH_SIMD_ROUNDS     20000
+#define MICROBENCH_SIMD_MAX_LENGTH 300
+#define MICROBENCH_LISTING_LINES   10000
+#define MICROBENCH_LISTING_SIZE    ( MICROBENCH_LISTING_LINES * 35 )
+
+static const char* microbench_simd_etag = "7a9a9c3f1f4a7d1b8b2b0c5d6e7f8091";
+static const char* microbench_simd_name = "2009/summer holidays/rome/colosseum/IMG 0042 - the view from the upper ring at sunset (final version).jpg";
+
+/**
+ * Fill a buffer with random bytes, biased towards the characters the kernels
+ * treat specially
+ */
+static void microbench_simd_random( char* buffer, size_t length )
+{
+    static const char interesting[] = "azAZ09/ -%\n\xff\x80" "0123456789abcdefABCDEFgG";
+    size_t i = 0;
+
+    for( i = 0; i < length; ++i )
+    {
+        buffer[i] = ( rand() % 2 ) ? interesting[rand() % ( sizeof( interesting ) - 1 )] : (char)rand();
+    }
+}
+
+/**
+ * Check all SIMD kernels to produce the same results as their scalar
+ * versions
+ *
+ * Random inputs of all lengths up to a few vector widths and every possible
+ * alignment are used. FALSE is returned on the first mismatch, which is
+ * reported on stderr.
+ */
+int microbench_simd_verify()
+{
+    static const char* names[] = { "auto", "scalar", "sse2", "avx2" };
+    char source[MICROBENCH_SIMD_MAX_LENGTH + 64];
+    char expected[MICROBENCH_SIMD_MAX_LENGTH * 4];
+    char actual[MICROBENCH_SIMD_MAX_LENGTH * 4];
+    int variant = 0;
+    int round = 0;
+    int ok = TRUE;
+
+    srand( 4711 );
+
+    for( variant = SIMD_VARIANT_SSE2; variant <= SIMD_VARIANT_AVX2 && ok; ++variant )
+    {
+        if ( !simd_supported( variant ) )
+        {
+            continue;
+        }
+
+        for( round = 0; round < MICROBENCH_SIMD_ROUNDS && ok; ++round )
+        {
+            size_t length = rand() % MICROBENCH_SIMD_MAX_LENGTH;
+            char* input = source + rand() % 64;
+            char c = ( rand() % 2 ) ? '\n' : (char)rand();
+            const char* found_expected = NULL;
+            const char* found_actual = NULL;
+            size_t size_expected = 0;
+            size_t size_actual = 0;
+            int valid_expected = 0;
+            int valid_actual = 0;
+
+            microbench_simd_random( input, length );
+
+            simd_set_variant( SIMD_VARIANT_SCALAR );
+            found_expected = simd_find_byte( input, length, c );
+            size_expected  = simd_urlencode( expected, input, length );
+            valid_expected = simd_hex_decode( (unsigned char*)expected + size_expected, input, length / 2 );
+
+            simd_set_variant( variant );
+            found_actual = simd_find_byte( input, length, c );
+            size_actual  = simd_urlencode( actual, input, length );
+            valid_actual = simd_hex_decode( (unsigned char*)actual + size_actual, input, length / 2 );
+
+            if ( found_expected != found_actual )
+            {
+                fprintf( stderr, "simd_find_byte (%s) differs for a length of %zu\n", names[variant], length );
+                ok = FALSE;
+            }
+            else if ( size_expected != size_actual || memcmp( expected, actual, size_expected ) != 0 )
+            {
+                fprintf( stderr, "simd_urlencode (%s) differs for a length of %zu\n", names[variant], length );
+                ok = FALSE;
+            }
+            else if ( valid_expected != valid_actual 
+                   || ( valid_expected && memcmp( expected + size_expected, actual + size_actual, length / 2 ) != 0 ) )
+            {
+                fprintf( stderr, "simd_hex_decode (%s) differs for a length of %zu\n", names[variant], length );
+                ok = FALSE;
+            }
+        }
+    }
+
+    simd_set_variant( SIMD_VARIANT_AUTO );
+    return ok;
+}
+
+/*
+ * Kernels
+ */
+
+/**
+ * Select the variant given as argument
+ *
+ * The returned data is a listing body, which is only used by the find byte
+ * benchmark.
+ */
+static void* microbench_simd_setup( long arg )
+{
+    if ( !simd_supported( (int)arg ) )
+    {
+        return MICROBENCH_SKIP;
+    }
+
+    simd_set_variant( (int)arg );
+    return microbench_listing_body( MICROBENCH_LISTING_LINES, NULL );
+}
+
+static void microbench_simd_teardown( void* data )
+{
+    free( data );
+    simd_set_variant( SIMD_VARIANT_AUTO );
+}
+
+/**
+ * Split a listing into its lines, like the listing parser does
+ */
+static void microbench_simd_find_byte( microbench_state_t* state )
+{
+    const char* body = (const char*)state->data;
+    const char* end  = body + MICROBENCH_LISTING_SIZE;
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        const char* cur = body;
+        while( ( cur = simd_find_byte( cur, end - cur, '\n' ) ) != NULL )
+        {
+            ++cur;
+        }
+    }
+}
+
+static void microbench_simd_urlencode( microbench_state_t* state )
+{
+    size_t length = strlen( microbench_simd_name );
+    char target[512];
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        simd_urlencode( target, microbench_simd_name, length );
+        microbench_use( target );
+    }
+}
+
+static void microbench_simd_hex_decode( microbench_state_t* state )
+{
+    unsigned char target[16];
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        simd_hex_decode( target, microbench_simd_etag, 16 );
+        microbench_use( target );
+    }
+}
+
+microbench_t microbench_simd[] = {
+    { "simd_find_byte/scalar",  microbench_simd_setup, microbench_simd_find_byte,  microbench_simd_teardown, SIMD_VARIANT_SCALAR, 1, MICROBENCH_LISTING_SIZE },
+    { "simd_find_byte/sse2",    microbench_simd_setup, microbench_simd_find_byte,  microbench_simd_teardown, SIMD_VARIANT_SSE2,   1, MICROBENCH_LISTING_SIZE },
+    { "simd_find_byte/avx2",    microbench_simd_setup, microbench_simd_find_byte,  microbench_simd_teardown, SIMD_VARIANT_AVX2,   1, MICROBENCH_LISTING_SIZE },
+    { "simd_urlencode/scalar",  microbench_simd_setup, microbench_simd_urlencode,  microbench_simd_teardown, SIMD_VARIANT_SCALAR, 1, 105 },
+    { "simd_urlencode/sse2",    microbench_simd_setup, microbench_simd_urlencode,  microbench_simd_teardown, SIMD_VARIANT_SSE2,   1, 105 },
+    { "simd_urlencode/avx2",    microbench_simd_setup, microbench_simd_urlencode,  microbench_simd_teardown, SIMD_VARIANT_AVX2,   1, 105 },
+    { "simd_hex_decode/scalar", microbench_simd_setup, microbench_simd_hex_decode, microbench_simd_teardown, SIMD_VARIANT_SCALAR, 1, 32 },
+    { "simd_hex_decode/sse2",   microbench_simd_setup, microbench_simd_hex_decode, microbench_simd_teardown, SIMD_VARIANT_SSE2,   1, 32 },
+    { "simd_hex_decode/avx2",   microbench_simd_setup, microbench_simd_hex_decode, microbench_simd_teardown, SIMD_VARIANT_AVX2,   1, 32 },
+    { NULL }
+};
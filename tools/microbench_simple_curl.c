@@ -0,0 +1,125 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+/*
+ * Microbenchmarks of the cURL wrapper
+ *
+ * The implementation is included directly to be able to measure its static
+ * functions.
+ */
+
+#include "simple_curl.c"
+
+#include "microbench.h"
+
+/**
+ * Header lines of a typical response to a HEAD request of an object
+ */
+static char* microbench_header_lines[] = {
+    "HTTP/1.1 204 No Content\r\n",
+    "Date: Sat, 14 Feb 2009 12:34:56 GMT\r\n",
+    "Server: Apache\r\n",
+    "Last-Modified: Fri, 13 Feb 2009 23:31:30 GMT\r\n",
+    "ETag: 7a9a9c3f1f4a7d1b8b2b0c5d6e7f8091\r\n",
+    "X-Object-Meta-Author: jakob\r\n",
+    "X-Object-Meta-Camera: ixus 70\r\n",
+    "X-Object-Meta-Location: rome\r\n",
+    "Content-Length: 1048576\r\n",
+    "Content-Type: image/jpeg\r\n",
+    "X-Trans-Id: tx0123456789abcdef0123456789abcdef\r\n",
+    "Connection: keep-alive\r\n",
+    "\r\n",
+    NULL
+};
+
+/**
+ * Input of the urlencode benchmarks
+ */
+static char* microbench_urlencode_input[] = {
+    "IMG 0042.jpg",
+    "2009/summer holidays/rome/colosseum/IMG 0042 - the view from the upper ring at sunset (final version).jpg"
+};
+
+/*
+ * Url encoding
+ */
+
+static void microbench_urlencode( microbench_state_t* state )
+{
+    char* input = microbench_urlencode_input[state->arg];
+    int length = strlen( input );
+    unsigned long i = 0;
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        char* encoded = simple_curl_urlencode( input, length );
+        microbench_use( encoded );
+        free( encoded );
+    }
+}
+
+/*
+ * Response header parsing
+ */
+
+static void* microbench_header_setup( long arg )
+{
+    (void)arg;
+
+    return simple_curl_headers_init();
+}
+
+static void microbench_header_teardown( void* data )
+{
+    simple_curl_headers_free( (simple_curl_headers_t*)data );
+}
+
+static void microbench_write_header( microbench_state_t* state )
+{
+    simple_curl_headers_t* headers = (simple_curl_headers_t*)state->data;
+    size_t lengths[16];
+    unsigned long i = 0;
+    int j = 0;
+
+    for( j = 0; microbench_header_lines[j] != NULL; ++j )
+    {
+        lengths[j] = strlen( microbench_header_lines[j] );
+    }
+
+    for( i = 0; i < state->iterations; ++i )
+    {
+        // Every response starts with its status line, which resets the
+        // stored headers
+        for( j = 0; microbench_header_lines[j] != NULL; ++j )
+        {
+            simple_curl_write_header( microbench_header_lines[j], 1, lengths[j], headers );
+        }
+        microbench_use( simple_curl_headers_get( headers, SIMPLE_CURL_HEADER_ETAG ) );
+    }
+}
+
+microbench_t microbench_simple_curl[] = {
+    { "simple_curl_urlencode/short",           NULL, microbench_urlencode, NULL, 0, 1, 12 },
+    { "simple_curl_urlencode/long",            NULL, microbench_urlencode, NULL, 1, 1, 105 },
+    { "simple_curl_write_header/head_response", microbench_header_setup, microbench_write_header, microbench_header_teardown, 0, 1, 0 },
+    { NULL }
+};
@@ -0,0 +1,542 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+/*
+ * Replay of recorded filesystem operations
+ *
+ * A trace recorded by mossofs using the record option is replayed on a
+ * mountpoint, usually a mount of the local mossofs-server. Traces only
+ * contain hashes of the paths, so every path is mapped to a file or
+ * directory of the replayed namespace by its hash. Operations on the same
+ * path therefore hit the same file again, which keeps the locality of the
+ * original workload. The operations are issued by a pool of threads at
+ * their original time, scaled by the given speed, so concurrent operations
+ * of the trace overlap during the replay as well.
+ *
+ * Afterwards the latency percentiles of every kind of operation are printed
+ * next to those recorded in the trace.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "replay.h"
+
+#define TRUE  1
+#define FALSE 0
+
+/**
+ * Delay in microseconds after which an operation is counted as late
+ */
+#define REPLAY_LATE 10000
+
+static void replay_parse_options( int argc, char** argv );
+static uint64_t replay_now();
+static void replay_walk( replay_t* replay, const char* relative );
+static replay_file_t* replay_file_acquire( replay_t* replay, uint64_t hash );
+static void replay_file_release( replay_t* replay, replay_file_t* file );
+static int replay_execute( replay_t* replay, optrace_record_t* record, char** buffer, size_t* buffer_size );
+static void* replay_worker( void* data );
+static void replay_sample( replay_t* replay, optrace_record_t* record, uint64_t latency, int failed );
+static uint64_t replay_percentile( uint64_t* samples, size_t num_samples, double percentile );
+static void replay_report( replay_t* replay, double seconds );
+
+static replay_options_t replay_options;
+
+static const char* replay_op_names[METRICS_OPS] = {
+    "getattr", "readdir", "open", "read", "release", "getxattr", "setxattr", "listxattr"
+};
+
+int main( int argc, char** argv )
+{
+    replay_t replay;
+    optrace_header_t header;
+    pthread_t* threads = NULL;
+    uint64_t start = 0;
+    int i = 0;
+
+    replay_parse_options( argc, argv );
+
+    memset( &replay, 0, sizeof( replay ) );
+    pthread_mutex_init( &replay.lock, NULL );
+
+    if ( ( replay.trace = optrace_open( replay_options.trace, &header ) ) == NULL )
+    {
+        return 2;
+    }
+    if ( header.dropped > 0 )
+    {
+        fprintf( stderr, "The trace misses %llu operations dropped while recording\n", (unsigned long long)header.dropped );
+    }
+
+    // The root of the namespace is its first directory
+    fprintf( stderr, "Reading the namespace below %s\n", replay_options.namespace );
+    replay.directories = (char**)malloc( sizeof( char* ) );
+    replay.directories[replay.num_directories++] = strdup( "" );
+    replay_walk( &replay, "" );
+    if ( replay.num_files == 0 )
+    {
+        fprintf( stderr, "The namespace does not contain any file\n" );
+        return 2;
+    }
+    fprintf( stderr, "Mapping the trace onto %lu files and %lu directories\n", (unsigned long)replay.num_files, (unsigned long)replay.num_directories );
+
+    threads = (pthread_t*)malloc( sizeof( pthread_t ) * replay_options.threads );
+    replay.start = start = replay_now();
+    for( i = 0; i < replay_options.threads; ++i )
+    {
+        pthread_create( &threads[i], NULL, replay_worker, &replay );
+    }
+    for( i = 0; i < replay_options.threads; ++i )
+    {
+        pthread_join( threads[i], NULL );
+    }
+
+    replay_report( &replay, ( replay_now() - start ) / 1000000.0 );
+
+    for( i = 0; i < (int)replay.num_files; ++i )
+    {
+        ( replay.files[i].fd != -1 ) ? close( replay.files[i].fd ) : 0;
+    }
+    fclose( replay.trace );
+    return 0;
+}
+
+/**
+ * Print the usage information of the replay tool
+ */
+static void replay_usage( char* executable )
+{
+    printf( "Replay a trace recorded by mossofs on a mountpoint\n\n" );
+    printf( "Usage: %s --trace=FILE --mountpoint=DIR [options]\n\n", executable );
+    printf( "    --trace=FILE          trace recorded using -o record=FILE\n" );
+    printf( "    --mountpoint=DIR      mountpoint the operations are issued on\n" );
+    printf( "    --namespace=DIR       mount of the same data the files are read from (mountpoint)\n" );
+    printf( "    --speed=FACTOR        speedup of the original timing, 0 replays as fast as possible (1)\n" );
+    printf( "    --threads=N           number of threads issuing operations (8)\n" );
+    printf( "    --files=N             maximal number of files the trace is mapped onto (100000)\n" );
+}
+
+/**
+ * Read the commandline options into replay_options
+ */
+static void replay_parse_options( int argc, char** argv )
+{
+    static struct option long_options[] = {
+        { "trace",      required_argument, NULL, 't' },
+        { "mountpoint", required_argument, NULL, 'm' },
+        { "namespace",  required_argument, NULL, 'n' },
+        { "speed",      required_argument, NULL, 's' },
+        { "threads",    required_argument, NULL, 'T' },
+        { "files",      required_argument, NULL, 'f' },
+        { "help",       no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c = 0;
+
+    replay_options.speed     = 1.0;
+    replay_options.threads   = 8;
+    replay_options.max_files = 100000;
+
+    while( ( c = getopt_long( argc, argv, "h", long_options, NULL ) ) != -1 )
+    {
+        switch( c )
+        {
+            case 't': replay_options.trace      = optarg;                      break;
+            case 'm': replay_options.mountpoint = optarg;                      break;
+            case 'n': replay_options.namespace  = optarg;                      break;
+            case 's': replay_options.speed      = atof( optarg );              break;
+            case 'T': replay_options.threads    = atoi( optarg );              break;
+            case 'f': replay_options.max_files  = strtoul( optarg, NULL, 10 ); break;
+            case 'h':
+                replay_usage( argv[0] );
+                exit( 0 );
+            default:
+                replay_usage( argv[0] );
+                exit( 2 );
+        }
+    }
+
+    if ( replay_options.trace == NULL || replay_options.mountpoint == NULL || replay_options.threads < 1 )
+    {
+        replay_usage( argv[0] );
+        exit( 2 );
+    }
+
+    if ( replay_options.namespace == NULL )
+    {
+        replay_options.namespace = replay_options.mountpoint;
+    }
+}
+
+/**
+ * Current monotonic time in microseconds
+ */
+static uint64_t replay_now()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Collect the files and directories below the given directory of the
+ * namespace
+ *
+ * Paths are stored relative to the namespace, so they can be used on the
+ * mountpoint. The walk stops once the maximal number of files is reached.
+ */
+static void replay_walk( replay_t* replay, const char* relative )
+{
+    char path[4096];
+    struct dirent* entry = NULL;
+    DIR* dir = NULL;
+
+    snprintf( path, sizeof( path ), "%s%s", replay_options.namespace, relative );
+    if ( ( dir = opendir( path ) ) == NULL )
+    {
+        return;
+    }
+
+    while( ( entry = readdir( dir ) ) != NULL && replay->num_files < replay_options.max_files )
+    {
+        char child[4096];
+        struct stat stbuf;
+
+        // The control directory of mossofs is not part of the data
+        if ( entry->d_name[0] == '.' )
+        {
+            continue;
+        }
+
+        snprintf( child, sizeof( child ), "%s/%s", relative, entry->d_name );
+        snprintf( path, sizeof( path ), "%s%s", replay_options.namespace, child );
+        if ( lstat( path, &stbuf ) != 0 )
+        {
+            continue;
+        }
+
+        if ( S_ISDIR( stbuf.st_mode ) )
+        {
+            replay->directories = (char**)realloc( replay->directories, sizeof( char* ) * ( replay->num_directories + 1 ) );
+            replay->directories[replay->num_directories++] = strdup( child );
+            replay_walk( replay, child );
+        }
+        else
+        {
+            replay_file_t* file = NULL;
+
+            replay->files = (replay_file_t*)realloc( replay->files, sizeof( replay_file_t ) * ( replay->num_files + 1 ) );
+            file = &replay->files[replay->num_files++];
+            memset( file, 0, sizeof( replay_file_t ) );
+            file->path = strdup( child );
+            file->size = (uint64_t)stbuf.st_size;
+            file->fd   = -1;
+        }
+    }
+    closedir( dir );
+}
+
+/**
+ * Retrieve the file a path hash is mapped to with an open descriptor
+ *
+ * Reads of files which have not been opened in the trace, because the
+ * recording started later, open them implicitly. NULL is returned if the
+ * file can not be opened.
+ */
+static replay_file_t* replay_file_acquire( replay_t* replay, uint64_t hash )
+{
+    replay_file_t* file = &replay->files[hash % replay->num_files];
+
+    pthread_mutex_lock( &replay->lock );
+    if ( file->fd == -1 )
+    {
+        char path[4096];
+
+        snprintf( path, sizeof( path ), "%s%s", replay_options.mountpoint, file->path );
+        if ( ( file->fd = open( path, O_RDONLY ) ) == -1 )
+        {
+            pthread_mutex_unlock( &replay->lock );
+            return NULL;
+        }
+    }
+    ++file->users;
+    pthread_mutex_unlock( &replay->lock );
+
+    return file;
+}
+
+/**
+ * Give back a file retrieved using replay_file_acquire
+ */
+static void replay_file_release( replay_t* replay, replay_file_t* file )
+{
+    pthread_mutex_lock( &replay->lock );
+    --file->users;
+    pthread_mutex_unlock( &replay->lock );
+}
+
+/**
+ * Issue the operation of a record and sample its latency
+ *
+ * Failed operations of the trace are replayed as lookups of a missing file.
+ * Extended attribute operations are not replayed, FALSE is returned for
+ * them.
+ */
+static int replay_execute( replay_t* replay, optrace_record_t* record, char** buffer, size_t* buffer_size )
+{
+    replay_file_t* file = &replay->files[record->path % replay->num_files];
+    char path[4096];
+    struct stat stbuf;
+    uint64_t start = replay_now();
+    int failed = FALSE;
+
+    if ( record->result < 0 && record->op != METRICS_OP_READ )
+    {
+        snprintf( path, sizeof( path ), "%s%s/missing-%016llx", replay_options.mountpoint, 
+            replay->directories[record->path % replay->num_directories], (unsigned long long)record->path );
+    }
+    else if ( record->op == METRICS_OP_READDIR )
+    {
+        snprintf( path, sizeof( path ), "%s%s", replay_options.mountpoint, replay->directories[record->path % replay->num_directories] );
+    }
+    else
+    {
+        snprintf( path, sizeof( path ), "%s%s", replay_options.mountpoint, file->path );
+    }
+
+    switch( record->op )
+    {
+        case METRICS_OP_GETATTR:
+            failed = ( lstat( path, &stbuf ) != 0 );
+        break;
+        case METRICS_OP_READDIR:
+        {
+            DIR* dir = opendir( path );
+            if ( ( failed = ( dir == NULL ) ) )
+            {
+                break;
+            }
+            while( readdir( dir ) != NULL );
+            closedir( dir );
+        }
+        break;
+        case METRICS_OP_OPEN:
+        {
+            int fd = open( path, O_RDONLY );
+            if ( ( failed = ( fd == -1 ) ) )
+            {
+                break;
+            }
+
+            // The descriptor is kept for the following reads, unless the
+            // file is already open
+            pthread_mutex_lock( &replay->lock );
+            if ( record->result >= 0 && file->fd == -1 )
+            {
+                file->fd = fd;
+                fd = -1;
+            }
+            pthread_mutex_unlock( &replay->lock );
+            ( fd != -1 ) ? close( fd ) : 0;
+        }
+        break;
+        case METRICS_OP_READ:
+        {
+            uint64_t offset = record->offset;
+
+            if ( *buffer_size < record->size )
+            {
+                *buffer = (char*)realloc( *buffer, ( *buffer_size = record->size ) );
+            }
+            if ( ( file = replay_file_acquire( replay, record->path ) ) == NULL )
+            {
+                failed = TRUE;
+                break;
+            }
+
+            // Offsets beyond the end of the mapped file wrap around
+            if ( file->size > 0 && offset >= file->size )
+            {
+                offset %= file->size;
+            }
+            start = replay_now();
+            failed = ( pread( file->fd, *buffer, record->size, (off_t)offset ) == -1 );
+            replay_file_release( replay, file );
+        }
+        break;
+        case METRICS_OP_RELEASE:
+        {
+            int fd = -1;
+
+            pthread_mutex_lock( &replay->lock );
+            if ( file->users == 0 )
+            {
+                fd = file->fd;
+                file->fd = -1;
+            }
+            pthread_mutex_unlock( &replay->lock );
+            ( fd != -1 ) ? close( fd ) : 0;
+        }
+        break;
+        default:
+            return FALSE;
+    }
+
+    replay_sample( replay, record, replay_now() - start, failed );
+    return TRUE;
+}
+
+/**
+ * Thread issuing the next operation of the trace once it is due
+ */
+static void* replay_worker( void* data )
+{
+    replay_t* replay = (replay_t*)data;
+    optrace_record_t record;
+    char* buffer = NULL;
+    size_t buffer_size = 0;
+
+    while( TRUE )
+    {
+        pthread_mutex_lock( &replay->lock );
+        if ( !optrace_read( replay->trace, &record ) )
+        {
+            pthread_mutex_unlock( &replay->lock );
+            break;
+        }
+        ++replay->operations;
+        pthread_mutex_unlock( &replay->lock );
+
+        if ( replay_options.speed > 0 )
+        {
+            uint64_t due = replay->start + (uint64_t)( record.time / replay_options.speed );
+            uint64_t now = replay_now();
+
+            if ( due > now )
+            {
+                usleep( (useconds_t)( due - now ) );
+            }
+            else if ( now - due > REPLAY_LATE )
+            {
+                __sync_fetch_and_add( &replay->late, 1 );
+            }
+        }
+
+        if ( record.op < METRICS_OPS )
+        {
+            replay_execute( replay, &record, &buffer, &buffer_size );
+        }
+    }
+
+    free( buffer );
+    return NULL;
+}
+
+/**
+ * Store the replayed and the recorded latency of an operation
+ */
+static void replay_sample( replay_t* replay, optrace_record_t* record, uint64_t latency, int failed )
+{
+    replay_op_t* op = &replay->ops[record->op];
+
+    pthread_mutex_lock( &replay->lock );
+    if ( op->num_samples == op->size_samples )
+    {
+        op->size_samples = ( op->size_samples == 0 ) ? 1024 : op->size_samples * 2;
+        op->replayed = (uint64_t*)realloc( op->replayed, sizeof( uint64_t ) * op->size_samples );
+        op->recorded = (uint64_t*)realloc( op->recorded, sizeof( uint64_t ) * op->size_samples );
+    }
+    op->replayed[op->num_samples] = latency;
+    op->recorded[op->num_samples] = record->latency;
+    ++op->num_samples;
+    op->errors += failed;
+    op->recorded_errors += ( record->result < 0 );
+    pthread_mutex_unlock( &replay->lock );
+}
+
+static int replay_compare_samples( const void* a, const void* b )
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return ( x > y ) - ( x < y );
+}
+
+/**
+ * Return the given percentile of a set of samples
+ *
+ * The samples are sorted on the first call.
+ */
+static uint64_t replay_percentile( uint64_t* samples, size_t num_samples, double percentile )
+{
+    if ( num_samples == 0 )
+    {
+        return 0;
+    }
+    qsort( samples, num_samples, sizeof( uint64_t ), replay_compare_samples );
+    return samples[(size_t)( percentile / 100.0 * ( num_samples - 1 ) + 0.5 )];
+}
+
+/**
+ * Print the latencies of the replay next to the recorded ones
+ */
+static void replay_report( replay_t* replay, double seconds )
+{
+    const double percentiles[] = { 50, 90, 99 };
+    int i = 0;
+    int j = 0;
+
+    printf( "Replayed %lu operations in %.1f s, %lu started late\n\n", replay->operations, seconds, replay->late );
+    printf( "%-10s %9s %15s %19s %19s %19s\n", "operation", "count", "errors", "p50 ms", "p90 ms", "p99 ms" );
+    printf( "%-10s %9s %15s %19s %19s %19s\n", "", "", "replay (trace)", "replay (trace)", "replay (trace)", "replay (trace)" );
+
+    for( i = 0; i < METRICS_OPS; ++i )
+    {
+        replay_op_t* op = &replay->ops[i];
+
+        if ( op->num_samples == 0 )
+        {
+            continue;
+        }
+
+        printf( "%-10s %9lu %6lu (%6lu) ", replay_op_names[i], (unsigned long)op->num_samples, op->errors, op->recorded_errors );
+        for( j = 0; j < 3; ++j )
+        {
+            printf( "%9.2f (%7.2f) ", 
+                replay_percentile( op->replayed, op->num_samples, percentiles[j] ) / 1000.0, 
+                replay_percentile( op->recorded, op->num_samples, percentiles[j] ) / 1000.0 );
+        }
+        printf( "\n" );
+        free( op->replayed );
+        free( op->recorded );
+    }
+}
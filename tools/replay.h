@@ -0,0 +1,98 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "optrace.h"
+#include "metrics.h"
+
+/**
+ * Latencies of one kind of filesystem operation
+ *
+ * Replayed holds the latencies measured during the replay, recorded those
+ * stored in the trace for the same operations. Both are given in
+ * microseconds. Failures are sampled as well and additionally counted.
+ */
+typedef struct
+{
+    uint64_t* replayed;
+    uint64_t* recorded;
+    size_t num_samples;
+    size_t size_samples;
+    unsigned long errors;
+    unsigned long recorded_errors;
+} replay_op_t;
+
+/**
+ * File of the replayed namespace
+ *
+ * Size is determined upon the first access. Fd is the descriptor shared by
+ * all operations on the file between an open and the matching release.
+ * Users counts the operations currently using it.
+ */
+typedef struct
+{
+    char* path;
+    uint64_t size;
+    int fd;
+    int opened;
+    int users;
+} replay_file_t;
+
+/**
+ * Options given on the commandline
+ */
+typedef struct
+{
+    char* trace;
+    char* mountpoint;
+    char* namespace;
+    double speed;
+    int threads;
+    unsigned long max_files;
+} replay_options_t;
+
+/**
+ * State shared by all replaying threads
+ *
+ * Records are read from the trace one at a time under the lock. Start is
+ * the time the replay started at. Late counts operations started more than
+ * REPLAY_LATE microseconds after they were due.
+ */
+typedef struct
+{
+    FILE* trace;
+    uint64_t start;
+    unsigned long operations;
+    unsigned long late;
+    replay_file_t* files;
+    size_t num_files;
+    char** directories;
+    size_t num_directories;
+    replay_op_t ops[METRICS_OPS];
+    pthread_mutex_t lock;
+} replay_t;
+
+#endif
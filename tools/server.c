@@ -0,0 +1,1841 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+/*
+ * Local stand-in for the Cloud Files service
+ *
+ * The server implements the subset of the API used by mossofs: auth, account
+ * and container listings with path and marker, HEAD, ranged GET, PUT and
+ * DELETE. All containers and objects are generated from a seed, therefore
+ * every run with the same parameters serves exactly the same data. Changes
+ * done using PUT and DELETE are kept in memory only.
+ *
+ * Only plain HTTP is supported. Every worker thread accepts and handles
+ * connections on its own.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <glib.h>
+
+#include "server.h"
+
+static void server_parse_options( int argc, char** argv );
+static void server_generate_namespace();
+static void server_generate_directory( server_container_t* container, char* prefix, int depth, int files_per_directory, uint64_t* seed );
+static server_entry_t* server_entry_new( char* name, int type, uint64_t size, uint64_t seed );
+static void server_entry_free( server_entry_t* entry );
+static void server_entry_release( server_entry_t* entry );
+static void server_container_insert( server_container_t* container, server_entry_t* entry );
+static void server_container_remove( server_container_t* container, server_entry_t* entry );
+static size_t server_lower_bound( server_container_t* container, const char* name );
+static void* server_worker( void* data );
+static void server_handle_connection( int fd );
+static int server_read_request( server_connection_t* connection, server_request_t* request );
+static void server_dispatch( server_connection_t* connection, server_request_t* request );
+static void server_route( server_connection_t* connection, server_request_t* request );
+static void server_handle_auth( server_connection_t* connection, server_request_t* request );
+static void server_handle_stats( server_connection_t* connection, server_request_t* request );
+static void server_handle_faults( server_connection_t* connection, server_request_t* request );
+static int server_inject_faults( server_connection_t* connection, server_request_t* request );
+static void server_handle_account( server_connection_t* connection, server_request_t* request );
+static void server_handle_container( server_connection_t* connection, server_request_t* request, char* name );
+static void server_handle_object( server_connection_t* connection, server_request_t* request, char* container_name, char* name );
+static void server_list_container( server_connection_t* connection, server_request_t* request, server_container_t* container );
+static void server_list_entry_json( GString* listing, server_entry_t* entry );
+static void server_send_object( server_connection_t* connection, server_request_t* request, server_entry_t* entry );
+static void server_send_status( server_connection_t* connection, server_request_t* request, int status, char* extra_headers );
+static void server_send_headers( server_connection_t* connection, server_request_t* request, int status, uint64_t content_length, char* format, ... );
+static int server_send_body( server_connection_t* connection, const char* data, size_t length );
+static char* server_query_parameter( server_request_t* request, char* key );
+static void server_url_decode( char* s );
+static void server_sleep( long milliseconds );
+static void server_reset( server_connection_t* connection );
+static double server_now();
+static void server_fill_content( uint64_t seed, uint64_t offset, char* buffer, size_t length );
+static uint64_t server_hash( const char* data, size_t length );
+static void server_etag( server_entry_t* entry, char* etag );
+
+/**
+ * Configuration and namespace of the running server
+ */
+static server_options_t server_options;
+static server_namespace_t server_namespace;
+static server_stats_t server_stats;
+
+/**
+ * Number of objects generated for the current container
+ */
+static uint64_t server_generated = 0;
+
+/**
+ * Faults currently injected. They are initialized from the commandline and
+ * may be replaced at runtime using the faults endpoint.
+ */
+static server_faults_t server_faults;
+static pthread_rwlock_t server_faults_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/**
+ * Start of the fault schedule as monotonic time in seconds. It is reset
+ * together with the statistics.
+ */
+static double server_epoch = 0;
+
+/**
+ * Number of storage requests currently processed. Requests above the
+ * configured maximum are rejected like by an overloaded proxy.
+ */
+static int server_inflight = 0;
+
+/**
+ * Seed of the pseudo random numbers used by the calling thread for fault
+ * injection
+ */
+static __thread uint64_t server_thread_seed = 0;
+
+int main( int argc, char** argv )
+{
+    int listen_fd = -1;
+    struct sockaddr_in address;
+    socklen_t address_length = sizeof( address );
+    pthread_t* workers = NULL;
+    int option = 1;
+    int i = 0;
+
+    server_parse_options( argc, argv );
+    signal( SIGPIPE, SIG_IGN );
+
+    server_generate_namespace();
+
+    for( i = 0; i < server_options.faults.num_faults; ++i )
+    {
+        server_faults_add( &server_faults, server_options.faults.faults[i].spec );
+    }
+    server_epoch = server_now();
+
+    if ( ( listen_fd = socket( AF_INET, SOCK_STREAM, 0 ) ) == -1 )
+    {
+        perror( "socket" );
+        return 1;
+    }
+    setsockopt( listen_fd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof( option ) );
+
+    memset( &address, 0, sizeof( address ) );
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons( server_options.port );
+    address.sin_addr.s_addr = inet_addr( server_options.address );
+
+    if ( bind( listen_fd, (struct sockaddr*)&address, sizeof( address ) ) == -1 || listen( listen_fd, 1024 ) == -1 )
+    {
+        perror( "bind" );
+        return 1;
+    }
+
+    // Determine the port actually used, as 0 selects a free one
+    getsockname( listen_fd, (struct sockaddr*)&address, &address_length );
+    server_options.port = ntohs( address.sin_port );
+
+    printf(
+        "Serving %d containers with %lu objects and %lu bytes on http://%s:%d/auth\n",
+        server_namespace.num_containers,
+        (unsigned long)server_stats.objects,
+        (unsigned long)server_stats.bytes,
+        server_options.address, server_options.port
+    );
+    fflush( stdout );
+
+    workers = (pthread_t*)calloc( server_options.threads, sizeof( pthread_t ) );
+    for( i = 0; i < server_options.threads; ++i )
+    {
+        pthread_create( &workers[i], NULL, server_worker, (void*)(intptr_t)listen_fd );
+    }
+    for( i = 0; i < server_options.threads; ++i )
+    {
+        pthread_join( workers[i], NULL );
+    }
+
+    return 0;
+}
+
+/**
+ * Print the usage information of the server
+ */
+static void server_usage( char* executable )
+{
+    printf( "Local Cloud Files stand-in server for mossofs tests and benchmarks\n\n" );
+    printf( "Usage: %s [options]\n\n", executable );
+    printf( "    --address=IP          address to listen on (127.0.0.1)\n" );
+    printf( "    --port=N              port to listen on, 0 selects a free one (8080)\n" );
+    printf( "    --threads=N           number of worker threads (32)\n" );
+    printf( "    --user=NAME           accepted username, any if not given\n" );
+    printf( "    --key=KEY             accepted api key, any if not given\n" );
+    printf( "    --seed=N              seed of the synthetic namespace (1)\n" );
+    printf( "    --containers=N        number of containers (1)\n" );
+    printf( "    --objects=N           number of small objects per container (1000)\n" );
+    printf( "    --fanout=N            subdirectories per directory (10)\n" );
+    printf( "    --depth=N             levels of subdirectories (2)\n" );
+    printf( "    --max-size=BYTES      maximum size of small objects (65536)\n" );
+    printf( "    --large-files=N       number of large objects per container (4)\n" );
+    printf( "    --large-size=BYTES    size of large objects (67108864)\n" );
+    printf( "    --latency=DIST        delay before every response in ms, either a number or\n" );
+    printf( "                          uniform:MIN:MAX, exponential:MEAN or pareto:SCALE:SHAPE (0)\n" );
+    printf( "    --jitter=MS           maximum random delay added to the latency (0)\n" );
+    printf( "    --bandwidth=BYTES     bandwidth limit per connection in bytes/s, 0 disables (0)\n" );
+    printf( "    --max-inflight=N      answer 503 while more requests are processed, 0 disables (0)\n" );
+    printf( "    --fault=SPEC          inject a fault, may be given multiple times, e.g.\n" );
+    printf( "                          stall,rate=0.01,delay=uniform:1000:4000\n" );
+    printf( "                          drip,rate=0.05,bandwidth=65536,method=GET\n" );
+    printf( "                          reset,rate=0.01,after=4096\n" );
+    printf( "                          error,rate=0.02,status=503,retry_after=1\n" );
+    printf( "                          error,status=429,every=60,duration=10\n" );
+}
+
+/**
+ * Read the commandline options into server_options
+ */
+static void server_parse_options( int argc, char** argv )
+{
+    static struct option long_options[] = {
+        { "address",     required_argument, NULL, 'a' },
+        { "port",        required_argument, NULL, 'p' },
+        { "threads",     required_argument, NULL, 't' },
+        { "user",        required_argument, NULL, 'u' },
+        { "key",         required_argument, NULL, 'k' },
+        { "seed",        required_argument, NULL, 's' },
+        { "containers",  required_argument, NULL, 'c' },
+        { "objects",     required_argument, NULL, 'o' },
+        { "fanout",      required_argument, NULL, 'f' },
+        { "depth",       required_argument, NULL, 'd' },
+        { "max-size",    required_argument, NULL, 'm' },
+        { "large-files", required_argument, NULL, 'L' },
+        { "large-size",  required_argument, NULL, 'S' },
+        { "latency",     required_argument, NULL, 'l' },
+        { "jitter",      required_argument, NULL, 'j' },
+        { "bandwidth",   required_argument, NULL, 'b' },
+        { "max-inflight", required_argument, NULL, 'I' },
+        { "fault",       required_argument, NULL, 'F' },
+        { "help",        no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    char spec[1024];
+    int ok = TRUE;
+    int c = 0;
+
+    server_options.address     = "127.0.0.1";
+    server_options.port        = 8080;
+    server_options.threads     = 32;
+    server_options.seed        = 1;
+    server_options.containers  = 1;
+    server_options.objects     = 1000;
+    server_options.fanout      = 10;
+    server_options.depth       = 2;
+    server_options.max_size    = 65536;
+    server_options.large_files = 4;
+    server_options.large_size  = 64 * 1024 * 1024;
+
+    while( ( c = getopt_long( argc, argv, "h", long_options, NULL ) ) != -1 )
+    {
+        switch( c )
+        {
+            case 'a': server_options.address     = optarg;                      break;
+            case 'p': server_options.port        = atoi( optarg );              break;
+            case 't': server_options.threads     = atoi( optarg );              break;
+            case 'u': server_options.user        = optarg;                      break;
+            case 'k': server_options.key         = optarg;                      break;
+            case 's': server_options.seed        = strtoull( optarg, NULL, 10 ); break;
+            case 'c': server_options.containers  = atoi( optarg );              break;
+            case 'o': server_options.objects     = strtoull( optarg, NULL, 10 ); break;
+            case 'f': server_options.fanout      = atoi( optarg );              break;
+            case 'd': server_options.depth       = atoi( optarg );              break;
+            case 'm': server_options.max_size    = strtoull( optarg, NULL, 10 ); break;
+            case 'L': server_options.large_files = atoi( optarg );              break;
+            case 'S': server_options.large_size  = strtoull( optarg, NULL, 10 ); break;
+            case 'b': server_options.bandwidth   = strtoull( optarg, NULL, 10 ); break;
+            case 'I': server_options.max_inflight = atoi( optarg );             break;
+            case 'l':
+                snprintf( spec, sizeof( spec ), "latency,delay=%s", optarg );
+                ok = server_faults_add( &server_options.faults, spec );
+            break;
+            case 'j':
+                snprintf( spec, sizeof( spec ), "latency,delay=uniform:0:%s", optarg );
+                ok = server_faults_add( &server_options.faults, spec );
+            break;
+            case 'F':
+                ok = server_faults_add( &server_options.faults, optarg );
+            break;
+            case 'h':
+                server_usage( argv[0] );
+                exit( 0 );
+            default:
+                server_usage( argv[0] );
+                exit( 1 );
+        }
+
+        if ( !ok )
+        {
+            exit( 1 );
+        }
+    }
+
+    if ( server_options.threads < 1 )
+    {
+        server_options.threads = 1;
+    }
+}
+
+/*
+ * Namespace handling
+ */
+
+/**
+ * Create a new namespace entry
+ *
+ * The content of synthetic objects is derived from the given seed.
+ */
+static server_entry_t* server_entry_new( char* name, int type, uint64_t size, uint64_t seed )
+{
+    server_entry_t* entry = (server_entry_t*)calloc( 1, sizeof( server_entry_t ) );
+    entry->name  = strdup( name );
+    entry->refcount = 1;
+    entry->type  = type;
+    entry->size  = size;
+    entry->seed  = seed;
+    entry->mtime = SERVER_MTIME_BASE + (time_t)( seed % ( 365 * 86400 ) );
+    entry->content_type = ( type == SERVER_ENTRY_DIRECTORY ) ? "application/directory" : "application/octet-stream";
+    return entry;
+}
+
+/**
+ * Free a namespace entry including uploaded data
+ */
+static void server_entry_free( server_entry_t* entry )
+{
+    free( entry->name );
+    ( entry->data != NULL ) ? free( entry->data ) : NULL;
+    ( entry->tags != NULL ) ? free( entry->tags ) : NULL;
+    ( entry->uploaded_content_type != NULL ) ? free( entry->uploaded_content_type ) : NULL;
+    free( entry );
+}
+
+/**
+ * Drop one reference to an entry and free it, if it was the last one
+ */
+static void server_entry_release( server_entry_t* entry )
+{
+    if ( __sync_sub_and_fetch( &entry->refcount, 1 ) == 0 )
+    {
+        server_entry_free( entry );
+    }
+}
+
+static int server_entry_compare( const void* a, const void* b )
+{
+    return strcmp( (*(server_entry_t**)a)->name, (*(server_entry_t**)b)->name );
+}
+
+static int server_container_compare( const void* a, const void* b )
+{
+    return strcmp( (*(server_container_t**)a)->name, (*(server_container_t**)b)->name );
+}
+
+/**
+ * Append an entry to a container during generation. The entries are sorted
+ * once the container is complete.
+ */
+static void server_container_append( server_container_t* container, server_entry_t* entry )
+{
+    if ( container->num_entries == container->size_entries )
+    {
+        container->size_entries = ( container->size_entries == 0 ) ? 1024 : container->size_entries * 2;
+        container->entries = (server_entry_t**)realloc( container->entries, sizeof( server_entry_t* ) * container->size_entries );
+    }
+    container->entries[container->num_entries++] = entry;
+    g_hash_table_insert( container->by_name, entry->name, entry );
+
+    if ( entry->type == SERVER_ENTRY_OBJECT )
+    {
+        container->bytes_used += entry->size;
+    }
+    ++container->object_count;
+}
+
+/**
+ * Generate the files and subdirectories of one directory
+ */
+static void server_generate_directory( server_container_t* container, char* prefix, int depth, int files_per_directory, uint64_t* seed )
+{
+    char name[1024];
+    int i = 0;
+
+    for( i = 0; i < files_per_directory && server_generated < server_options.objects; ++i, ++server_generated )
+    {
+        uint64_t object_seed = server_splitmix( seed );
+        uint64_t size = ( server_options.max_size == 0 ) ? 0 : ( object_seed % ( server_options.max_size + 1 ) );
+
+        // Every tenth name contains characters, which need to be encoded
+        snprintf( name, sizeof( name ), ( i % 10 == 9 ) ? "%sfile %06d.txt" : "%sfile%06d.dat", prefix, i );
+        server_container_append( container, server_entry_new( name, SERVER_ENTRY_OBJECT, size, object_seed ) );
+    }
+
+    if ( depth >= server_options.depth )
+    {
+        return;
+    }
+
+    for( i = 0; i < server_options.fanout; ++i )
+    {
+        snprintf( name, sizeof( name ), "%sdir%03d", prefix, i );
+        server_container_append( container, server_entry_new( name, SERVER_ENTRY_DIRECTORY, 0, server_splitmix( seed ) ) );
+
+        strncat( name, "/", sizeof( name ) - strlen( name ) - 1 );
+        server_generate_directory( container, name, depth + 1, files_per_directory, seed );
+    }
+}
+
+/**
+ * Generate all containers based on the given options
+ *
+ * The objects of a container are distributed evenly over a tree of fanout
+ * subdirectories per directory with the given depth. Large objects are placed
+ * in the root of every container.
+ */
+static void server_generate_namespace()
+{
+    uint64_t seed = server_options.seed;
+    uint64_t directories = 0;
+    uint64_t level = 1;
+    int files_per_directory = 0;
+    int i = 0;
+
+    pthread_rwlock_init( &server_namespace.lock, NULL );
+    server_namespace.by_name = g_hash_table_new( g_str_hash, g_str_equal );
+
+    for( i = 0; i <= server_options.depth; ++i )
+    {
+        directories += level;
+        level *= server_options.fanout;
+    }
+    files_per_directory = ( server_options.objects + directories - 1 ) / directories;
+
+    for( i = 0; i < server_options.containers; ++i )
+    {
+        server_container_t* container = (server_container_t*)calloc( 1, sizeof( server_container_t ) );
+        char name[64];
+        int j = 0;
+
+        snprintf( name, sizeof( name ), "container%03d", i );
+        container->name    = strdup( name );
+        container->by_name = g_hash_table_new( g_str_hash, g_str_equal );
+
+        server_generated = 0;
+        server_generate_directory( container, "", 0, files_per_directory, &seed );
+
+        for( j = 0; j < server_options.large_files; ++j )
+        {
+            snprintf( name, sizeof( name ), "large%03d.bin", j );
+            server_container_append( container, server_entry_new( name, SERVER_ENTRY_OBJECT, server_options.large_size, server_splitmix( &seed ) ) );
+        }
+
+        qsort( container->entries, container->num_entries, sizeof( server_entry_t* ), server_entry_compare );
+
+        server_stats.objects += container->object_count;
+        server_stats.bytes   += container->bytes_used;
+
+        server_namespace.containers = (server_container_t**)realloc(
+            server_namespace.containers, sizeof( server_container_t* ) * ( server_namespace.num_containers + 1 )
+        );
+        server_namespace.containers[server_namespace.num_containers++] = container;
+        g_hash_table_insert( server_namespace.by_name, container->name, container );
+    }
+}
+
+/**
+ * Return the index of the first entry in the container whose name is not
+ * smaller than the given one
+ */
+static size_t server_lower_bound( server_container_t* container, const char* name )
+{
+    size_t low  = 0;
+    size_t high = container->num_entries;
+
+    while( low < high )
+    {
+        size_t middle = low + ( high - low ) / 2;
+        if ( strcmp( container->entries[middle]->name, name ) < 0 )
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * Insert an entry into the sorted entries of a container
+ *
+ * The namespace lock needs to be held for writing.
+ */
+static void server_container_insert( server_container_t* container, server_entry_t* entry )
+{
+    size_t index = server_lower_bound( container, entry->name );
+
+    if ( container->num_entries == container->size_entries )
+    {
+        container->size_entries = ( container->size_entries == 0 ) ? 1024 : container->size_entries * 2;
+        container->entries = (server_entry_t**)realloc( container->entries, sizeof( server_entry_t* ) * container->size_entries );
+    }
+    memmove( container->entries + index + 1, container->entries + index, sizeof( server_entry_t* ) * ( container->num_entries - index ) );
+    container->entries[index] = entry;
+    ++container->num_entries;
+
+    g_hash_table_insert( container->by_name, entry->name, entry );
+    container->bytes_used += entry->size;
+    ++container->object_count;
+}
+
+/**
+ * Remove an entry from a container and release it
+ *
+ * The entry is freed once responses still sending it are finished. The
+ * namespace lock needs to be held for writing.
+ */
+static void server_container_remove( server_container_t* container, server_entry_t* entry )
+{
+    size_t index = server_lower_bound( container, entry->name );
+
+    memmove( container->entries + index, container->entries + index + 1, sizeof( server_entry_t* ) * ( container->num_entries - index - 1 ) );
+    --container->num_entries;
+
+    g_hash_table_remove( container->by_name, entry->name );
+    container->bytes_used -= entry->size;
+    --container->object_count;
+    server_entry_release( entry );
+}
+
+/*
+ * Content generation
+ */
+
+/**
+ * Fill the buffer with the synthetic content of an object starting at the
+ * given offset
+ *
+ * Every 8 byte word of the content is derived from the object seed and the
+ * word index, so any range can be generated without generating the data in
+ * front of it.
+ */
+static void server_fill_content( uint64_t seed, uint64_t offset, char* buffer, size_t length )
+{
+    while( length > 0 )
+    {
+        uint64_t state = seed ^ ( ( offset / 8 ) * 0xD6E8FEB86659FD93ULL );
+        uint64_t word  = server_splitmix( &state );
+        size_t skip  = offset % 8;
+        size_t count = ( 8 - skip < length ) ? ( 8 - skip ) : length;
+
+        memcpy( buffer, (char*)&word + skip, count );
+        buffer += count;
+        offset += count;
+        length -= count;
+    }
+}
+
+/**
+ * FNV-1a hash used for the etags of uploaded data
+ */
+static uint64_t server_hash( const char* data, size_t length )
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    size_t i = 0;
+    for( i = 0; i < length; ++i )
+    {
+        hash = ( hash ^ (unsigned char)data[i] ) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/**
+ * Write the 32 hex digit etag of an entry into the given buffer
+ *
+ * The etag is not a real md5 sum. It is a stable fingerprint of the content,
+ * which is all mossofs relies upon.
+ */
+static void server_etag( server_entry_t* entry, char* etag )
+{
+    uint64_t state = ( entry->data != NULL ) ? server_hash( entry->data, entry->size ) : entry->seed;
+    uint64_t high  = server_splitmix( &state );
+    uint64_t low   = server_splitmix( &state );
+    snprintf( etag, 33, "%016llx%016llx", (unsigned long long)high, (unsigned long long)low );
+}
+
+/*
+ * HTTP handling
+ */
+
+/**
+ * Worker thread accepting and handling connections
+ */
+static void* server_worker( void* data )
+{
+    int listen_fd = (int)(intptr_t)data;
+
+    server_thread_seed = server_options.seed ^ (uint64_t)(uintptr_t)pthread_self();
+
+    while( TRUE )
+    {
+        int fd = accept( listen_fd, NULL, NULL );
+        if ( fd == -1 )
+        {
+            if ( errno == EINTR || errno == ECONNABORTED )
+            {
+                continue;
+            }
+            perror( "accept" );
+            return NULL;
+        }
+        server_handle_connection( fd );
+        close( fd );
+    }
+    return NULL;
+}
+
+/**
+ * Handle all requests sent over one connection
+ */
+static void server_handle_connection( int fd )
+{
+    server_connection_t connection;
+    int option = 1;
+
+    memset( &connection, 0, sizeof( connection ) );
+    connection.fd = fd;
+    connection.reset_after = -1;
+    setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof( option ) );
+
+    __sync_fetch_and_add( &server_stats.connections, 1 );
+
+    while( TRUE )
+    {
+        server_request_t request;
+        memset( &request, 0, sizeof( request ) );
+
+        if ( !server_read_request( &connection, &request ) )
+        {
+            break;
+        }
+
+        server_dispatch( &connection, &request );
+        ( request.body != NULL ) ? free( request.body ) : NULL;
+
+        // Injected faults only affect a single response
+        connection.bandwidth   = 0;
+        connection.reset_after = -1;
+
+        if ( !request.keep_alive || connection.broken )
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * Read and parse the next request from the connection
+ *
+ * The request line and headers are parsed in place inside the connection
+ * buffer. Data following the headers is kept for the next request. FALSE is
+ * returned if the connection has been closed or the request is malformed.
+ */
+static int server_read_request( server_connection_t* connection, server_request_t* request )
+{
+    char* header_end = NULL;
+    char* line = NULL;
+    char* next = NULL;
+
+    // Remove the previous request from the buffer
+    if ( connection->consumed > 0 )
+    {
+        memmove( connection->buffer, connection->buffer + connection->consumed, connection->length - connection->consumed );
+        connection->length  -= connection->consumed;
+        connection->consumed = 0;
+    }
+
+    while( TRUE )
+    {
+        ssize_t received = 0;
+        connection->buffer[connection->length] = 0;
+
+        if ( ( header_end = strstr( connection->buffer, "\r\n\r\n" ) ) != NULL )
+        {
+            break;
+        }
+        if ( connection->length >= SERVER_BUFFER_SIZE - 1 )
+        {
+            return FALSE;
+        }
+        if ( ( received = recv( connection->fd, connection->buffer + connection->length, SERVER_BUFFER_SIZE - 1 - connection->length, 0 ) ) <= 0 )
+        {
+            return FALSE;
+        }
+        connection->length += received;
+    }
+
+    *header_end = 0;
+    connection->consumed = header_end + 4 - connection->buffer;
+
+    // Request line
+    line = connection->buffer;
+    if ( ( next = strstr( line, "\r\n" ) ) != NULL )
+    {
+        *next = 0;
+        next += 2;
+    }
+    request->method = strtok_r( line, " ", &request->version );
+    request->target = strtok_r( NULL, " ", &request->version );
+    if ( request->method == NULL || request->target == NULL )
+    {
+        return FALSE;
+    }
+    request->keep_alive = ( request->version != NULL && strcmp( request->version, "HTTP/1.1" ) == 0 );
+
+    // Header lines
+    for( line = next; line != NULL && *line != 0; line = next )
+    {
+        char* colon = NULL;
+        char* value = NULL;
+
+        if ( ( next = strstr( line, "\r\n" ) ) != NULL )
+        {
+            *next = 0;
+            next += 2;
+        }
+        if ( ( colon = strchr( line, ':' ) ) == NULL )
+        {
+            continue;
+        }
+        *colon = 0;
+        for( value = colon + 1; *value == ' ' || *value == '\t'; ++value );
+
+        if ( strcasecmp( line, "Content-Length" ) == 0 )    request->content_length = strtoull( value, NULL, 10 );
+        else if ( strcasecmp( line, "Content-Type" ) == 0 ) request->content_type   = value;
+        else if ( strcasecmp( line, "Range" ) == 0 )        request->range          = value;
+        else if ( strcasecmp( line, "X-Auth-User" ) == 0 )  request->auth_user      = value;
+        else if ( strcasecmp( line, "X-Auth-Key" ) == 0 )   request->auth_key       = value;
+        else if ( strcasecmp( line, "X-Auth-Token" ) == 0 ) request->auth_token     = value;
+        else if ( strcasecmp( line, "Host" ) == 0 )         request->host           = value;
+        else if ( strcasecmp( line, "Expect" ) == 0 )       request->expect_continue = ( strcasecmp( value, "100-continue" ) == 0 );
+        else if ( strcasecmp( line, "Connection" ) == 0 )
+        {
+            request->keep_alive = ( strcasecmp( value, "close" ) != 0 ) && ( request->keep_alive || strcasecmp( value, "keep-alive" ) == 0 );
+        }
+        else if ( strncasecmp( line, "X-Object-Meta-", 14 ) == 0 && request->num_tags < SERVER_MAX_TAGS )
+        {
+            request->tag_keys[request->num_tags]     = line;
+            request->tag_values[request->num_tags++] = value;
+        }
+    }
+
+    // Split the query string from the path
+    if ( ( request->query = strchr( request->target, '?' ) ) != NULL )
+    {
+        *(request->query++) = 0;
+    }
+    request->path = request->target;
+
+    // Read the request body if there is one
+    if ( request->content_length > 0 )
+    {
+        size_t available = connection->length - connection->consumed;
+        size_t offset    = 0;
+
+        if ( request->content_length > SERVER_MAX_UPLOAD )
+        {
+            return FALSE;
+        }
+
+        if ( request->expect_continue && available == 0 )
+        {
+            const char* response = "HTTP/1.1 100 Continue\r\n\r\n";
+            server_send_body( connection, response, strlen( response ) );
+        }
+
+        request->body = (char*)malloc( request->content_length + 1 );
+        offset = ( available > request->content_length ) ? request->content_length : available;
+        memcpy( request->body, connection->buffer + connection->consumed, offset );
+        connection->consumed += offset;
+
+        while( offset < request->content_length )
+        {
+            ssize_t received = recv( connection->fd, request->body + offset, request->content_length - offset, 0 );
+            if ( received <= 0 )
+            {
+                return FALSE;
+            }
+            offset += received;
+        }
+        request->body[request->content_length] = 0;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Count a request and route it to its handler
+ *
+ * If the maximal number of requests is processed already, the request is
+ * rejected instead.
+ */
+static void server_dispatch( server_connection_t* connection, server_request_t* request )
+{
+    char* path = request->path;
+
+    if ( strcmp( path, "/stats" ) == 0 )
+    {
+        // Stats requests are not counted, so they do not disturb measurements
+        server_handle_stats( connection, request );
+        return;
+    }
+
+    if ( strcmp( path, "/faults" ) == 0 )
+    {
+        server_handle_faults( connection, request );
+        return;
+    }
+
+    __sync_fetch_and_add( &server_stats.requests, 1 );
+    if ( strcmp( request->method, "GET" ) == 0 )         __sync_fetch_and_add( &server_stats.get, 1 );
+    else if ( strcmp( request->method, "HEAD" ) == 0 )   __sync_fetch_and_add( &server_stats.head, 1 );
+    else if ( strcmp( request->method, "PUT" ) == 0 )    __sync_fetch_and_add( &server_stats.put, 1 );
+    else if ( strcmp( request->method, "DELETE" ) == 0 ) __sync_fetch_and_add( &server_stats.delete, 1 );
+
+    if ( server_options.max_inflight <= 0 )
+    {
+        server_route( connection, request );
+        return;
+    }
+
+    if ( __sync_add_and_fetch( &server_inflight, 1 ) > server_options.max_inflight )
+    {
+        __sync_fetch_and_add( &server_stats.throttled, 1 );
+        server_send_status( connection, request, 503, NULL );
+    }
+    else
+    {
+        server_route( connection, request );
+    }
+    __sync_fetch_and_sub( &server_inflight, 1 );
+}
+
+/**
+ * Inject the configured faults into a counted request and pass it to the
+ * handler of the requested path
+ */
+static void server_route( server_connection_t* connection, server_request_t* request )
+{
+    char* path = request->path;
+
+    if ( !server_inject_faults( connection, request ) )
+    {
+        return;
+    }
+
+    if ( strcmp( path, "/auth" ) == 0 || strcmp( path, "/v1.0" ) == 0 )
+    {
+        __sync_fetch_and_add( &server_stats.auth, 1 );
+        server_handle_auth( connection, request );
+        return;
+    }
+
+    if ( strncmp( path, SERVER_STORAGE_PATH, strlen( SERVER_STORAGE_PATH ) ) != 0 )
+    {
+        server_send_status( connection, request, 404, NULL );
+        return;
+    }
+
+    if ( request->auth_token == NULL || strcmp( request->auth_token, SERVER_TOKEN ) != 0 )
+    {
+        server_send_status( connection, request, 401, NULL );
+        return;
+    }
+
+    path += strlen( SERVER_STORAGE_PATH );
+    if ( *path == 0 || strcmp( path, "/" ) == 0 )
+    {
+        server_handle_account( connection, request );
+        return;
+    }
+
+    // Split the container from the object name. Both are decoded afterwards,
+    // as the container may contain encoded slashes.
+    {
+        char* container = path + 1;
+        char* name      = strchr( container, '/' );
+
+        if ( name != NULL )
+        {
+            *(name++) = 0;
+            server_url_decode( name );
+        }
+        server_url_decode( container );
+
+        if ( name == NULL || *name == 0 )
+        {
+            server_handle_container( connection, request, container );
+        }
+        else
+        {
+            server_handle_object( connection, request, container, name );
+        }
+    }
+}
+
+/**
+ * Answer an authentication request with the storage url and the token
+ */
+static void server_handle_auth( server_connection_t* connection, server_request_t* request )
+{
+    char host[256];
+
+    if ( request->auth_user == NULL || request->auth_key == NULL
+      || ( server_options.user != NULL && strcmp( request->auth_user, server_options.user ) != 0 )
+      || ( server_options.key != NULL && strcmp( request->auth_key, server_options.key ) != 0 ) )
+    {
+        server_send_status( connection, request, 401, NULL );
+        return;
+    }
+
+    if ( request->host != NULL )
+    {
+        snprintf( host, sizeof( host ), "%s", request->host );
+    }
+    else
+    {
+        snprintf( host, sizeof( host ), "%s:%d", server_options.address, server_options.port );
+    }
+
+    server_send_headers(
+        connection, request, 204, 0,
+        "X-Storage-Url: http://%s" SERVER_STORAGE_PATH "\r\n"
+        "X-CDN-Management-Url: http://%s/cdn\r\n"
+        "X-Storage-Token: " SERVER_TOKEN "\r\n"
+        "X-Auth-Token: " SERVER_TOKEN "\r\n",
+        host, host
+    );
+}
+
+/**
+ * Report the request counters as JSON
+ *
+ * A POST or DELETE request resets the counters.
+ */
+static void server_handle_stats( server_connection_t* connection, server_request_t* request )
+{
+    char body[1024];
+    int length = 0;
+
+    if ( strcmp( request->method, "POST" ) == 0 || strcmp( request->method, "DELETE" ) == 0 )
+    {
+        server_stats.requests = server_stats.get = server_stats.head = server_stats.put = server_stats.delete = 0;
+        server_stats.auth = server_stats.bytes_sent = server_stats.connections = server_stats.throttled = 0;
+        memset( server_stats.faults, 0, sizeof( server_stats.faults ) );
+        server_epoch = server_now();
+        server_send_status( connection, request, 204, NULL );
+        return;
+    }
+
+    length = snprintf(
+        body, sizeof( body ),
+        "{\"requests\": %lu, \"get\": %lu, \"head\": %lu, \"put\": %lu, \"delete\": %lu, "
+        "\"auth\": %lu, \"bytes_sent\": %lu, \"connections\": %lu, \"throttled\": %lu, "
+        "\"faults\": {\"latency\": %lu, \"stall\": %lu, \"drip\": %lu, \"reset\": %lu, \"error\": %lu}}\n",
+        server_stats.requests, server_stats.get, server_stats.head, server_stats.put, server_stats.delete,
+        server_stats.auth, server_stats.bytes_sent, server_stats.connections, server_stats.throttled,
+        server_stats.faults[SERVER_FAULT_LATENCY], server_stats.faults[SERVER_FAULT_STALL],
+        server_stats.faults[SERVER_FAULT_DRIP], server_stats.faults[SERVER_FAULT_RESET],
+        server_stats.faults[SERVER_FAULT_ERROR]
+    );
+
+    server_send_headers( connection, request, 200, length, "Content-Type: application/json\r\n" );
+    server_send_body( connection, body, length );
+}
+
+/**
+ * Report or replace the injected faults
+ *
+ * GET lists the active fault specifications, one per line. PUT and POST
+ * replace them with the ones given in the request body, one per line. Empty
+ * lines and lines starting with # are ignored. DELETE restores the faults
+ * given on the commandline. Every change restarts the fault schedule.
+ */
+static void server_handle_faults( server_connection_t* connection, server_request_t* request )
+{
+    server_faults_t faults;
+    GString* body = NULL;
+    int i = 0;
+
+    memset( &faults, 0, sizeof( faults ) );
+
+    if ( strcmp( request->method, "GET" ) == 0 )
+    {
+        body = g_string_new( "" );
+
+        pthread_rwlock_rdlock( &server_faults_lock );
+        for( i = 0; i < server_faults.num_faults; ++i )
+        {
+            g_string_append_printf( body, "%s\n", server_faults.faults[i].spec );
+        }
+        pthread_rwlock_unlock( &server_faults_lock );
+
+        server_send_headers( connection, request, 200, body->len, "Content-Type: text/plain\r\n" );
+        server_send_body( connection, body->str, body->len );
+        g_string_free( body, TRUE );
+        return;
+    }
+
+    if ( strcmp( request->method, "DELETE" ) == 0 )
+    {
+        for( i = 0; i < server_options.faults.num_faults; ++i )
+        {
+            server_faults_add( &faults, server_options.faults.faults[i].spec );
+        }
+    }
+    else if ( strcmp( request->method, "PUT" ) == 0 || strcmp( request->method, "POST" ) == 0 )
+    {
+        char* saveptr = NULL;
+        char* line = NULL;
+
+        for( line = ( request->body != NULL ) ? strtok_r( request->body, "\r\n", &saveptr ) : NULL; line != NULL; line = strtok_r( NULL, "\r\n", &saveptr ) )
+        {
+            if ( *line == 0 || *line == '#' )
+            {
+                continue;
+            }
+            if ( !server_faults_add( &faults, line ) )
+            {
+                server_faults_clear( &faults );
+                server_send_status( connection, request, 400, NULL );
+                return;
+            }
+        }
+    }
+    else
+    {
+        server_send_status( connection, request, 405, NULL );
+        return;
+    }
+
+    pthread_rwlock_wrlock( &server_faults_lock );
+    server_faults_clear( &server_faults );
+    server_faults = faults;
+    server_epoch  = server_now();
+    pthread_rwlock_unlock( &server_faults_lock );
+
+    server_send_status( connection, request, 204, NULL );
+}
+
+/**
+ * Apply the faults chosen for a request
+ *
+ * The delay is applied directly. Errors and resets before the first byte
+ * end the request, in which case FALSE is returned. Dripping and resets
+ * during the response are carried out while sending it.
+ */
+static int server_inject_faults( server_connection_t* connection, server_request_t* request )
+{
+    server_fault_plan_t plan;
+    int i = 0;
+
+    pthread_rwlock_rdlock( &server_faults_lock );
+    server_faults_plan( &server_faults, request->method, request->path, server_now() - server_epoch, &server_thread_seed, &plan );
+    pthread_rwlock_unlock( &server_faults_lock );
+
+    for( i = 0; i < SERVER_FAULT_KINDS; ++i )
+    {
+        ( plan.injected[i] ) ? __sync_fetch_and_add( &server_stats.faults[i], 1 ) : 0;
+    }
+
+    connection->bandwidth   = plan.bandwidth;
+    connection->reset_after = plan.reset_after;
+
+    server_sleep( plan.delay );
+
+    if ( plan.reset_after == 0 )
+    {
+        server_reset( connection );
+        return FALSE;
+    }
+
+    if ( plan.status != 0 )
+    {
+        char extra[64];
+        snprintf( extra, sizeof( extra ), "Retry-After: %d\r\n", plan.retry_after );
+        server_send_status( connection, request, plan.status, ( plan.retry_after > 0 ) ? extra : NULL );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Write a listing body for the given names
+ *
+ * The listing is collected inside a growing buffer and sent as one response.
+ * If no names are listed a 204 is sent instead.
+ */
+static void server_send_listing( server_connection_t* connection, server_request_t* request, GString* listing, int json )
+{
+    if ( listing->len == 0 )
+    {
+        server_send_status( connection, request, 204, NULL );
+        return;
+    }
+    server_send_headers( 
+        connection, request, 200, listing->len, "Content-Type: %s; charset=UTF-8\r\n", 
+        ( json ) ? "application/json" : "text/plain"
+    );
+    if ( strcmp( request->method, "HEAD" ) != 0 )
+    {
+        server_send_body( connection, listing->str, listing->len );
+    }
+}
+
+/**
+ * List the containers of the account or report its usage
+ */
+static void server_handle_account( server_connection_t* connection, server_request_t* request )
+{
+    char* marker = server_query_parameter( request, "marker" );
+    char* limit  = server_query_parameter( request, "limit" );
+    int max = ( limit != NULL ) ? atoi( limit ) : SERVER_LIST_LIMIT;
+    int count = 0;
+    int i = 0;
+
+    if ( strcmp( request->method, "HEAD" ) == 0 )
+    {
+        server_send_headers(
+            connection, request, 204, 0,
+            "X-Account-Container-Count: %d\r\n", server_namespace.num_containers
+        );
+        return;
+    }
+    if ( strcmp( request->method, "GET" ) != 0 )
+    {
+        server_send_status( connection, request, 405, NULL );
+        return;
+    }
+
+    pthread_rwlock_rdlock( &server_namespace.lock );
+    {
+        GString* listing = g_string_new( NULL );
+        for( i = 0; i < server_namespace.num_containers && count < max; ++i )
+        {
+            server_container_t* container = server_namespace.containers[i];
+            if ( marker != NULL && strcmp( container->name, marker ) <= 0 )
+            {
+                continue;
+            }
+            g_string_append( listing, container->name );
+            g_string_append_c( listing, '\n' );
+            ++count;
+        }
+        pthread_rwlock_unlock( &server_namespace.lock );
+
+        server_send_listing( connection, request, listing, FALSE );
+        g_string_free( listing, TRUE );
+    }
+}
+
+/**
+ * Handle requests targeting a container
+ */
+static void server_handle_container( server_connection_t* connection, server_request_t* request, char* name )
+{
+    server_container_t* container = NULL;
+
+    if ( strcmp( request->method, "PUT" ) == 0 )
+    {
+        pthread_rwlock_wrlock( &server_namespace.lock );
+        if ( g_hash_table_lookup( server_namespace.by_name, name ) != NULL )
+        {
+            pthread_rwlock_unlock( &server_namespace.lock );
+            server_send_status( connection, request, 202, NULL );
+            return;
+        }
+
+        container = (server_container_t*)calloc( 1, sizeof( server_container_t ) );
+        container->name    = strdup( name );
+        container->by_name = g_hash_table_new( g_str_hash, g_str_equal );
+        server_namespace.containers = (server_container_t**)realloc(
+            server_namespace.containers, sizeof( server_container_t* ) * ( server_namespace.num_containers + 1 )
+        );
+        server_namespace.containers[server_namespace.num_containers++] = container;
+        qsort( server_namespace.containers, server_namespace.num_containers, sizeof( server_container_t* ), server_container_compare );
+        g_hash_table_insert( server_namespace.by_name, container->name, container );
+        pthread_rwlock_unlock( &server_namespace.lock );
+
+        server_send_status( connection, request, 201, NULL );
+        return;
+    }
+
+    pthread_rwlock_rdlock( &server_namespace.lock );
+    if ( ( container = g_hash_table_lookup( server_namespace.by_name, name ) ) == NULL )
+    {
+        pthread_rwlock_unlock( &server_namespace.lock );
+        server_send_status( connection, request, 404, NULL );
+        return;
+    }
+
+    if ( strcmp( request->method, "HEAD" ) == 0 )
+    {
+        uint64_t object_count = container->object_count;
+        uint64_t bytes_used   = container->bytes_used;
+        pthread_rwlock_unlock( &server_namespace.lock );
+
+        server_send_headers(
+            connection, request, 204, 0,
+            "X-Container-Object-Count: %llu\r\n"
+            "X-Container-Bytes-Used: %llu\r\n",
+            (unsigned long long)object_count, (unsigned long long)bytes_used
+        );
+        return;
+    }
+
+    if ( strcmp( request->method, "GET" ) == 0 )
+    {
+        // The lock is released by the listing function
+        server_list_container( connection, request, container );
+        return;
+    }
+
+    if ( strcmp( request->method, "DELETE" ) == 0 )
+    {
+        int status = ( container->num_entries > 0 ) ? 409 : 204;
+        pthread_rwlock_unlock( &server_namespace.lock );
+
+        if ( status == 204 )
+        {
+            int i = 0;
+            pthread_rwlock_wrlock( &server_namespace.lock );
+            if ( ( container = g_hash_table_lookup( server_namespace.by_name, name ) ) != NULL && container->num_entries == 0 )
+            {
+                g_hash_table_remove( server_namespace.by_name, name );
+                for( i = 0; i < server_namespace.num_containers; ++i )
+                {
+                    if ( server_namespace.containers[i] == container )
+                    {
+                        memmove( server_namespace.containers + i, server_namespace.containers + i + 1,
+                                 sizeof( server_container_t* ) * ( server_namespace.num_containers - i - 1 ) );
+                        --server_namespace.num_containers;
+                        break;
+                    }
+                }
+                g_hash_table_destroy( container->by_name );
+                free( container->entries );
+                free( container->name );
+                free( container );
+            }
+            pthread_rwlock_unlock( &server_namespace.lock );
+        }
+        server_send_status( connection, request, status, NULL );
+        return;
+    }
+
+    pthread_rwlock_unlock( &server_namespace.lock );
+    server_send_status( connection, request, 405, NULL );
+}
+
+/**
+ * List the objects of a container
+ *
+ * The path parameter selects a virtual directory. Only objects directly
+ * inside of it are listed. Entries nested deeper are skipped by searching
+ * for the first name behind their subdirectory, so listing a directory does
+ * not depend on the size of its subtree.
+ *
+ * The namespace lock needs to be held for reading and is released by this
+ * function.
+ */
+static void server_list_container( server_connection_t* connection, server_request_t* request, server_container_t* container )
+{
+    char* path   = server_query_parameter( request, "path" );
+    char* prefix = server_query_parameter( request, "prefix" );
+    char* marker = server_query_parameter( request, "marker" );
+    char* limit  = server_query_parameter( request, "limit" );
+    char* format = server_query_parameter( request, "format" );
+    int json  = ( format != NULL && strcmp( format, "json" ) == 0 );
+    int max   = ( limit != NULL ) ? atoi( limit ) : SERVER_LIST_LIMIT;
+    int count = 0;
+    GString* selector = g_string_new( NULL );
+    GString* listing  = g_string_new( NULL );
+    size_t index = 0;
+
+    if ( max > SERVER_LIST_LIMIT || max <= 0 )
+    {
+        max = SERVER_LIST_LIMIT;
+    }
+
+    // Everything listed needs to start with the selector
+    if ( path != NULL && *path != 0 )
+    {
+        g_string_append( selector, path );
+        g_string_append_c( selector, '/' );
+    }
+    else if ( prefix != NULL )
+    {
+        g_string_append( selector, prefix );
+    }
+
+    index = server_lower_bound( container, selector->str );
+    if ( marker != NULL && strcmp( marker, selector->str ) >= 0 )
+    {
+        // Continue right after the marker
+        index = server_lower_bound( container, marker );
+        if ( index < container->num_entries && strcmp( container->entries[index]->name, marker ) == 0 )
+        {
+            ++index;
+        }
+    }
+
+    while( index < container->num_entries && count < max )
+    {
+        server_entry_t* entry = container->entries[index];
+        char* slash = NULL;
+
+        if ( strncmp( entry->name, selector->str, selector->len ) != 0 )
+        {
+            break;
+        }
+
+        if ( path != NULL && ( slash = strchr( entry->name + selector->len, '/' ) ) != NULL )
+        {
+            // Jump behind all entries of this subdirectory. '0' directly
+            // follows '/' in the character table.
+            GString* skip = g_string_new_len( entry->name, slash - entry->name );
+            g_string_append_c( skip, '0' );
+            index = server_lower_bound( container, skip->str );
+            g_string_free( skip, TRUE );
+            continue;
+        }
+
+        if ( json )
+        {
+            g_string_append_c( listing, ( count == 0 ) ? '[' : ',' );
+            server_list_entry_json( listing, entry );
+        }
+        else
+        {
+            g_string_append( listing, entry->name );
+            g_string_append_c( listing, '\n' );
+        }
+        ++count;
+        ++index;
+    }
+    pthread_rwlock_unlock( &server_namespace.lock );
+
+    // Empty json listings are an empty array instead of a 204
+    if ( json )
+    {
+        g_string_append( listing, ( count == 0 ) ? "[]" : "]" );
+    }
+
+    server_send_listing( connection, request, listing, json );
+    g_string_free( listing, TRUE );
+    g_string_free( selector, TRUE );
+}
+
+/**
+ * Append one entry of a json listing
+ *
+ * Only the fields of the real service used by the client are written. Quotes,
+ * backslashes and control characters in the name are escaped.
+ */
+static void server_list_entry_json( GString* listing, server_entry_t* entry )
+{
+    const unsigned char* cur = (const unsigned char*)entry->name;
+
+    g_string_append( listing, "{\"name\": \"" );
+    for( ; *cur != 0; ++cur )
+    {
+        if ( *cur == '"' || *cur == '\\' )
+        {
+            g_string_append_c( listing, '\\' );
+            g_string_append_c( listing, *cur );
+        }
+        else if ( *cur < 0x20 )
+        {
+            g_string_append_printf( listing, "\\u%04x", *cur );
+        }
+        else
+        {
+            g_string_append_c( listing, *cur );
+        }
+    }
+    g_string_append_printf( 
+        listing, "\", \"bytes\": %llu, \"content_type\": \"%s\"}", 
+        (unsigned long long)entry->size, entry->content_type
+    );
+}
+
+/**
+ * Handle requests targeting an object
+ */
+static void server_handle_object( server_connection_t* connection, server_request_t* request, char* container_name, char* name )
+{
+    server_container_t* container = NULL;
+    server_entry_t* entry = NULL;
+
+    if ( strcmp( request->method, "PUT" ) == 0 )
+    {
+        server_entry_t* created = NULL;
+        int i = 0;
+
+        pthread_rwlock_wrlock( &server_namespace.lock );
+        if ( ( container = g_hash_table_lookup( server_namespace.by_name, container_name ) ) == NULL )
+        {
+            pthread_rwlock_unlock( &server_namespace.lock );
+            server_send_status( connection, request, 404, NULL );
+            return;
+        }
+
+        created = server_entry_new( name, SERVER_ENTRY_OBJECT, request->content_length, 0 );
+        created->mtime = time( NULL );
+        created->data  = request->body;
+        request->body  = NULL;
+
+        if ( request->content_type != NULL )
+        {
+            created->uploaded_content_type = strdup( request->content_type );
+            created->content_type = created->uploaded_content_type;
+            if ( strcmp( request->content_type, "application/directory" ) == 0 )
+            {
+                created->type = SERVER_ENTRY_DIRECTORY;
+            }
+        }
+
+        if ( request->num_tags > 0 )
+        {
+            GString* tags = g_string_new( NULL );
+            for( i = 0; i < request->num_tags; ++i )
+            {
+                g_string_append_printf( tags, "%s: %s\r\n", request->tag_keys[i], request->tag_values[i] );
+            }
+            created->tags = g_string_free( tags, FALSE );
+        }
+
+        if ( ( entry = g_hash_table_lookup( container->by_name, name ) ) != NULL )
+        {
+            server_container_remove( container, entry );
+        }
+        server_container_insert( container, created );
+        pthread_rwlock_unlock( &server_namespace.lock );
+
+        server_send_status( connection, request, 201, NULL );
+        return;
+    }
+
+    if ( strcmp( request->method, "DELETE" ) == 0 )
+    {
+        int status = 404;
+
+        pthread_rwlock_wrlock( &server_namespace.lock );
+        if ( ( container = g_hash_table_lookup( server_namespace.by_name, container_name ) ) != NULL
+          && ( entry = g_hash_table_lookup( container->by_name, name ) ) != NULL )
+        {
+            server_container_remove( container, entry );
+            status = 204;
+        }
+        pthread_rwlock_unlock( &server_namespace.lock );
+
+        server_send_status( connection, request, status, NULL );
+        return;
+    }
+
+    if ( strcmp( request->method, "GET" ) != 0 && strcmp( request->method, "HEAD" ) != 0 )
+    {
+        server_send_status( connection, request, 405, NULL );
+        return;
+    }
+
+    pthread_rwlock_rdlock( &server_namespace.lock );
+    if ( ( container = g_hash_table_lookup( server_namespace.by_name, container_name ) ) == NULL
+      || ( entry = g_hash_table_lookup( container->by_name, name ) ) == NULL )
+    {
+        pthread_rwlock_unlock( &server_namespace.lock );
+        server_send_status( connection, request, 404, NULL );
+        return;
+    }
+
+    // The entry is referenced instead of holding the lock while sending, as
+    // injected latency and bandwidth limits would block all writers.
+    __sync_add_and_fetch( &entry->refcount, 1 );
+    pthread_rwlock_unlock( &server_namespace.lock );
+
+    server_send_object( connection, request, entry );
+    server_entry_release( entry );
+}
+
+/**
+ * Send the headers and the requested range of an object
+ *
+ * HEAD requests are answered with 204 like the original service does.
+ */
+static void server_send_object( server_connection_t* connection, server_request_t* request, server_entry_t* entry )
+{
+    char etag[33];
+    char last_modified[64];
+    struct tm tm;
+    uint64_t start = 0;
+    uint64_t end   = ( entry->size > 0 ) ? entry->size - 1 : 0;
+    int status = 200;
+
+    server_etag( entry, etag );
+    gmtime_r( &entry->mtime, &tm );
+    strftime( last_modified, sizeof( last_modified ), "%a, %d %b %Y %H:%M:%S GMT", &tm );
+
+    if ( strcmp( request->method, "HEAD" ) == 0 )
+    {
+        server_send_headers(
+            connection, request, 204, entry->size,
+            "Content-Type: %s\r\n"
+            "Etag: %s\r\n"
+            "Last-Modified: %s\r\n"
+            "%s",
+            entry->content_type, etag, last_modified, ( entry->tags != NULL ) ? entry->tags : ""
+        );
+        return;
+    }
+
+    if ( request->range != NULL )
+    {
+        unsigned long long range_start = 0;
+        unsigned long long range_end   = 0;
+        int fields = sscanf( request->range, "bytes=%llu-%llu", &range_start, &range_end );
+
+        if ( fields < 1 || range_start >= entry->size || ( fields == 2 && range_end < range_start ) )
+        {
+            char extra[64];
+            snprintf( extra, sizeof( extra ), "Content-Range: bytes */%llu\r\n", (unsigned long long)entry->size );
+            server_send_status( connection, request, 416, extra );
+            return;
+        }
+
+        start  = range_start;
+        end    = ( fields == 2 && range_end < entry->size ) ? range_end : entry->size - 1;
+        status = 206;
+    }
+
+    if ( entry->size == 0 )
+    {
+        server_send_headers(
+            connection, request, 200, 0,
+            "Content-Type: %s\r\nEtag: %s\r\nLast-Modified: %s\r\n",
+            entry->content_type, etag, last_modified
+        );
+        return;
+    }
+
+    server_send_headers(
+        connection, request, status, end - start + 1,
+        "Content-Type: %s\r\n"
+        "Etag: %s\r\n"
+        "Last-Modified: %s\r\n"
+        "Content-Range: bytes %llu-%llu/%llu\r\n",
+        entry->content_type, etag, last_modified,
+        (unsigned long long)start, (unsigned long long)end, (unsigned long long)entry->size
+    );
+
+    if ( entry->data != NULL )
+    {
+        server_send_body( connection, entry->data + start, end - start + 1 );
+    }
+    else
+    {
+        char chunk[SERVER_CHUNK_SIZE];
+        uint64_t offset = start;
+        while( offset <= end && !connection->broken )
+        {
+            size_t length = ( end - offset + 1 < SERVER_CHUNK_SIZE ) ? ( end - offset + 1 ) : SERVER_CHUNK_SIZE;
+            server_fill_content( entry->seed, offset, chunk, length );
+            server_send_body( connection, chunk, length );
+            offset += length;
+        }
+    }
+}
+
+/**
+ * Send a response without a body
+ */
+static void server_send_status( server_connection_t* connection, server_request_t* request, int status, char* extra_headers )
+{
+    server_send_headers( connection, request, status, 0, "%s", ( extra_headers != NULL ) ? extra_headers : "" );
+}
+
+static const char* server_status_text( int status )
+{
+    switch( status )
+    {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 416: return "Requested Range Not Satisfiable";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+    }
+    return "Unknown";
+}
+
+/**
+ * Send the status line and headers of a response
+ *
+ * The format and its arguments specify additional header lines, each
+ * terminated by CRLF.
+ */
+static void server_send_headers( server_connection_t* connection, server_request_t* request, int status, uint64_t content_length, char* format, ... )
+{
+    char headers[SERVER_BUFFER_SIZE];
+    char date[64];
+    struct tm tm;
+    time_t now = time( NULL );
+    int length = 0;
+    va_list args;
+
+    gmtime_r( &now, &tm );
+    strftime( date, sizeof( date ), "%a, %d %b %Y %H:%M:%S GMT", &tm );
+
+    length = snprintf(
+        headers, sizeof( headers ),
+        "HTTP/1.1 %d %s\r\n"
+        "Date: %s\r\n"
+        "Content-Length: %llu\r\n"
+        "Connection: %s\r\n",
+        status, server_status_text( status ), date, (unsigned long long)content_length,
+        request->keep_alive ? "keep-alive" : "close"
+    );
+
+    va_start( args, format );
+    length += vsnprintf( headers + length, sizeof( headers ) - length - 2, format, args );
+    va_end( args );
+
+    if ( length > (int)sizeof( headers ) - 3 )
+    {
+        length = sizeof( headers ) - 3;
+    }
+    memcpy( headers + length, "\r\n", 2 );
+    length += 2;
+
+    server_send_body( connection, headers, length );
+}
+
+/**
+ * Send data over the connection respecting the configured bandwidth
+ *
+ * The bandwidth of a dripping response overrides the configured one. If a
+ * reset has been injected, the connection is reset as soon as the given
+ * number of bytes has been sent.
+ *
+ * FALSE is returned and the connection marked as broken if the data could not
+ * be sent.
+ */
+static int server_send_body( server_connection_t* connection, const char* data, size_t length )
+{
+    uint64_t bandwidth = ( connection->bandwidth > 0 ) ? connection->bandwidth : server_options.bandwidth;
+
+    while( length > 0 && !connection->broken )
+    {
+        size_t chunk = length;
+        ssize_t sent = 0;
+
+        if ( connection->reset_after == 0 )
+        {
+            server_reset( connection );
+            return FALSE;
+        }
+        if ( connection->reset_after > 0 && chunk > (uint64_t)connection->reset_after )
+        {
+            chunk = connection->reset_after;
+        }
+
+        if ( bandwidth > 0 )
+        {
+            // Send at most a tenth of a second worth of data at once and
+            // sleep for the time its transfer should have taken.
+            size_t slice = bandwidth / 10;
+            chunk = ( slice > 0 && chunk > slice ) ? slice : chunk;
+        }
+
+        if ( ( sent = send( connection->fd, data, chunk, MSG_NOSIGNAL ) ) <= 0 )
+        {
+            connection->broken = TRUE;
+            return FALSE;
+        }
+
+        __sync_fetch_and_add( &server_stats.bytes_sent, (unsigned long)sent );
+        if ( connection->reset_after > 0 )
+        {
+            connection->reset_after -= sent;
+        }
+
+        if ( bandwidth > 0 )
+        {
+            uint64_t nanoseconds = (uint64_t)sent * 1000000000ULL / bandwidth;
+            struct timespec delay = { nanoseconds / 1000000000ULL, nanoseconds % 1000000000ULL };
+            nanosleep( &delay, NULL );
+        }
+
+        data   += sent;
+        length -= sent;
+    }
+    return TRUE;
+}
+
+/**
+ * Sleep for the given number of milliseconds
+ */
+static void server_sleep( long milliseconds )
+{
+    struct timespec delay;
+
+    if ( milliseconds <= 0 )
+    {
+        return;
+    }
+
+    delay.tv_sec  = milliseconds / 1000;
+    delay.tv_nsec = ( milliseconds % 1000 ) * 1000000L;
+    nanosleep( &delay, NULL );
+}
+
+/**
+ * Abort the connection with a TCP reset
+ *
+ * A zero linger timeout lets the following close send a RST instead of a
+ * FIN.
+ */
+static void server_reset( server_connection_t* connection )
+{
+    struct linger linger = { 1, 0 };
+
+    setsockopt( connection->fd, SOL_SOCKET, SO_LINGER, &linger, sizeof( linger ) );
+    connection->broken = TRUE;
+}
+
+/**
+ * Current monotonic time in seconds
+ */
+static double server_now()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Find a parameter in the query string of the request and return its
+ * decoded value
+ *
+ * The query string is decoded in place. NULL is returned if the parameter is
+ * not given.
+ */
+static char* server_query_parameter( server_request_t* request, char* key )
+{
+    size_t key_length = strlen( key );
+    char* cur = request->query;
+    int i = 0;
+
+    // The query string is split and decoded on first use
+    if ( request->query != NULL && request->num_parameters == 0 )
+    {
+        while( cur != NULL && *cur != 0 && request->num_parameters < SERVER_MAX_PARAMETERS )
+        {
+            char* next = strchr( cur, '&' );
+            char* value = NULL;
+            if ( next != NULL )
+            {
+                *(next++) = 0;
+            }
+            if ( ( value = strchr( cur, '=' ) ) != NULL )
+            {
+                *(value++) = 0;
+                server_url_decode( value );
+            }
+            request->parameter_keys[request->num_parameters]     = cur;
+            request->parameter_values[request->num_parameters++] = ( value != NULL ) ? value : "";
+            cur = next;
+        }
+    }
+
+    for( i = 0; i < request->num_parameters; ++i )
+    {
+        if ( strncmp( request->parameter_keys[i], key, key_length + 1 ) == 0 )
+        {
+            return request->parameter_values[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Decode a urlencoded string in place
+ */
+static void server_url_decode( char* s )
+{
+    char* target = s;
+    while( *s != 0 )
+    {
+        if ( *s == '%' && g_ascii_isxdigit( s[1] ) && g_ascii_isxdigit( s[2] ) )
+        {
+            *(target++) = ( g_ascii_xdigit_value( s[1] ) << 4 ) | g_ascii_xdigit_value( s[2] );
+            s += 3;
+        }
+        else
+        {
+            *(target++) = *(s++);
+        }
+    }
+    *target = 0;
+}
@@ -0,0 +1,209 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <glib.h>
+
+#include "server_fault.h"
+
+/**
+ * Path of the storage url below the server address and the token handed out
+ * upon authentication
+ */
+#define SERVER_STORAGE_PATH "/v1/AUTH_bench"
+#define SERVER_TOKEN        "bench-token"
+
+/**
+ * Maximum number of entries returned by one listing request
+ */
+#define SERVER_LIST_LIMIT 10000
+
+#define SERVER_BUFFER_SIZE    65536
+#define SERVER_CHUNK_SIZE     65536
+#define SERVER_MAX_UPLOAD     ( 256 * 1024 * 1024 )
+#define SERVER_MAX_TAGS       32
+#define SERVER_MAX_PARAMETERS 16
+
+/**
+ * Base of the modification times of all synthetic objects
+ * (Thu, 01 Jan 2009 00:00:00 GMT)
+ */
+#define SERVER_MTIME_BASE 1230768000
+
+#define SERVER_ENTRY_OBJECT    0
+#define SERVER_ENTRY_DIRECTORY 1
+
+/**
+ * Options given on the commandline
+ */
+typedef struct 
+{
+    char* address;
+    int port;
+    int threads;
+    char* user;
+    char* key;
+    uint64_t seed;
+    int containers;
+    uint64_t objects;
+    int fanout;
+    int depth;
+    uint64_t max_size;
+    int large_files;
+    uint64_t large_size;
+    uint64_t bandwidth;
+    int max_inflight;
+    server_faults_t faults;
+} server_options_t;
+
+/**
+ * One object or virtual directory inside of a container
+ *
+ * Synthetic objects generate their content from the seed. Uploaded objects
+ * store their data.
+ *
+ * Entries are immutable once inserted. Refcount counts the namespace and
+ * every response currently sending the entry. The last one frees it.
+ */
+typedef struct 
+{
+    char* name;
+    int refcount;
+    int type;
+    uint64_t size;
+    uint64_t seed;
+    time_t mtime;
+    const char* content_type;
+    char* uploaded_content_type;
+    char* data;
+    char* tags;
+} server_entry_t;
+
+/**
+ * Container holding its entries sorted by name
+ */
+typedef struct 
+{
+    char* name;
+    server_entry_t** entries;
+    size_t num_entries;
+    size_t size_entries;
+    GHashTable* by_name;
+    uint64_t object_count;
+    uint64_t bytes_used;
+} server_container_t;
+
+/**
+ * All containers sorted by name
+ *
+ * The lock protects all containers and their entries.
+ */
+typedef struct 
+{
+    server_container_t** containers;
+    int num_containers;
+    GHashTable* by_name;
+    pthread_rwlock_t lock;
+} server_namespace_t;
+
+/**
+ * Counters reported by the stats endpoint
+ */
+typedef struct 
+{
+    unsigned long requests;
+    unsigned long get;
+    unsigned long head;
+    unsigned long put;
+    unsigned long delete;
+    unsigned long auth;
+    unsigned long bytes_sent;
+    unsigned long connections;
+    unsigned long faults[SERVER_FAULT_KINDS];
+    unsigned long throttled;
+    uint64_t objects;
+    uint64_t bytes;
+} server_stats_t;
+
+/**
+ * State of one client connection
+ *
+ * Bandwidth and reset_after are set by the faults injected into the current
+ * response. Reset_after counts down the bytes to send before the connection
+ * is reset, -1 disables the reset.
+ */
+typedef struct 
+{
+    int fd;
+    int broken;
+    uint64_t bandwidth;
+    int64_t reset_after;
+    char buffer[SERVER_BUFFER_SIZE];
+    size_t length;
+    size_t consumed;
+} server_connection_t;
+
+/**
+ * Parsed request. All strings point into the connection buffer.
+ */
+typedef struct 
+{
+    char* method;
+    char* target;
+    char* version;
+    char* path;
+    char* query;
+    char* host;
+    char* range;
+    char* content_type;
+    char* auth_user;
+    char* auth_key;
+    char* auth_token;
+    uint64_t content_length;
+    int expect_continue;
+    int keep_alive;
+    char* body;
+    char* tag_keys[SERVER_MAX_TAGS];
+    char* tag_values[SERVER_MAX_TAGS];
+    int num_tags;
+    char* parameter_keys[SERVER_MAX_PARAMETERS];
+    char* parameter_values[SERVER_MAX_PARAMETERS];
+    int num_parameters;
+} server_request_t;
+
+/**
+ * Pseudo random number generator used for content, etags and faults
+ */
+static inline uint64_t server_splitmix( uint64_t* state )
+{
+    uint64_t z = ( *state += 0x9E3779B97F4A7C15ULL );
+    z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+    return z ^ ( z >> 31 );
+}
+
+#endif
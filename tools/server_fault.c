@@ -0,0 +1,336 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "server.h"
+#include "server_fault.h"
+
+static int server_fault_parse( const char* spec, server_fault_t* fault );
+static int server_fault_active( server_fault_t* fault, const char* method, const char* path, double now );
+static inline double server_fault_random( uint64_t* seed );
+
+/**
+ * Names of the fault kinds as used inside of specifications
+ */
+const char* server_fault_kinds[SERVER_FAULT_KINDS] = {
+    "latency",
+    "stall",
+    "drip",
+    "reset",
+    "error"
+};
+
+/**
+ * Uniformly distributed random number in [0, 1)
+ */
+static inline double server_fault_random( uint64_t* seed )
+{
+    return ( server_splitmix( seed ) >> 11 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+/**
+ * Parse a distribution of the form "type:a[:b]"
+ *
+ * A plain number is accepted as fixed delay. FALSE is returned if the
+ * specification is invalid.
+ */
+int server_distribution_parse( const char* spec, server_distribution_t* distribution )
+{
+    char type[16];
+    int fields = 0;
+
+    memset( distribution, 0, sizeof( server_distribution_t ) );
+
+    if ( sscanf( spec, "%lf%n", &distribution->a, &fields ) == 1 && spec[fields] == 0 )
+    {
+        distribution->type = SERVER_DISTRIBUTION_FIXED;
+        return distribution->a >= 0;
+    }
+
+    fields = sscanf( spec, "%15[a-z]:%lf:%lf", type, &distribution->a, &distribution->b );
+
+    if ( fields == 2 && strcmp( type, "fixed" ) == 0 )
+    {
+        distribution->type = SERVER_DISTRIBUTION_FIXED;
+    }
+    else if ( fields == 3 && strcmp( type, "uniform" ) == 0 && distribution->b >= distribution->a )
+    {
+        distribution->type = SERVER_DISTRIBUTION_UNIFORM;
+    }
+    else if ( fields == 2 && strcmp( type, "exponential" ) == 0 )
+    {
+        distribution->type = SERVER_DISTRIBUTION_EXPONENTIAL;
+    }
+    else if ( fields == 3 && strcmp( type, "pareto" ) == 0 && distribution->b > 0 )
+    {
+        distribution->type = SERVER_DISTRIBUTION_PARETO;
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    return distribution->a >= 0;
+}
+
+/**
+ * Draw a delay in milliseconds from the given distribution
+ */
+double server_distribution_sample( server_distribution_t* distribution, uint64_t* seed )
+{
+    double value = 0;
+
+    switch( distribution->type )
+    {
+        case SERVER_DISTRIBUTION_FIXED:
+            value = distribution->a;
+        break;
+        case SERVER_DISTRIBUTION_UNIFORM:
+            value = distribution->a + server_fault_random( seed ) * ( distribution->b - distribution->a );
+        break;
+        case SERVER_DISTRIBUTION_EXPONENTIAL:
+            value = -distribution->a * log( 1.0 - server_fault_random( seed ) );
+        break;
+        case SERVER_DISTRIBUTION_PARETO:
+            value = distribution->a / pow( 1.0 - server_fault_random( seed ), 1.0 / distribution->b );
+        break;
+    }
+
+    if ( distribution->max > 0 && value > distribution->max )
+    {
+        value = distribution->max;
+    }
+    return value;
+}
+
+/**
+ * Parse a single fault specification
+ *
+ * FALSE is returned and the problem reported on stderr if the specification
+ * is invalid.
+ */
+static int server_fault_parse( const char* spec, server_fault_t* fault )
+{
+    char* copy = strdup( spec );
+    char* field = NULL;
+    char* saveptr = NULL;
+    int has_delay = FALSE;
+    int ok = TRUE;
+    int i = 0;
+
+    memset( fault, 0, sizeof( server_fault_t ) );
+    fault->kind      = -1;
+    fault->rate      = 1.0;
+    fault->bandwidth = 16384;
+    fault->status    = 503;
+
+    for( field = strtok_r( copy, ",", &saveptr ); field != NULL && ok; field = strtok_r( NULL, ",", &saveptr ) )
+    {
+        char* value = strchr( field, '=' );
+
+        if ( fault->kind == -1 )
+        {
+            for( i = 0; i < SERVER_FAULT_KINDS && strcmp( field, server_fault_kinds[i] ) != 0; ++i );
+            fault->kind = i;
+            ok = ( i < SERVER_FAULT_KINDS );
+            continue;
+        }
+
+        if ( value == NULL )
+        {
+            ok = FALSE;
+            break;
+        }
+        *(value++) = 0;
+
+        if ( strcmp( field, "rate" ) == 0 )             fault->rate        = atof( value );
+        else if ( strcmp( field, "bandwidth" ) == 0 )   fault->bandwidth   = strtoull( value, NULL, 10 );
+        else if ( strcmp( field, "after" ) == 0 )       fault->after       = strtoull( value, NULL, 10 );
+        else if ( strcmp( field, "status" ) == 0 )      fault->status      = atoi( value );
+        else if ( strcmp( field, "retry_after" ) == 0 ) fault->retry_after = atoi( value );
+        else if ( strcmp( field, "start" ) == 0 )       fault->start       = atof( value );
+        else if ( strcmp( field, "end" ) == 0 )         fault->end         = atof( value );
+        else if ( strcmp( field, "every" ) == 0 )       fault->every       = atof( value );
+        else if ( strcmp( field, "duration" ) == 0 )    fault->duration    = atof( value );
+        else if ( strcmp( field, "max" ) == 0 )         fault->delay.max   = atof( value );
+        else if ( strcmp( field, "method" ) == 0 )      fault->method      = strdup( value );
+        else if ( strcmp( field, "path" ) == 0 )        fault->path        = strdup( value );
+        else if ( strcmp( field, "delay" ) == 0 )
+        {
+            double max = fault->delay.max;
+            ok = server_distribution_parse( value, &fault->delay );
+            fault->delay.max = max;
+            has_delay = TRUE;
+        }
+        else
+        {
+            ok = FALSE;
+        }
+    }
+
+    if ( ok && ( fault->kind == SERVER_FAULT_LATENCY || fault->kind == SERVER_FAULT_STALL ) && !has_delay )
+    {
+        ok = FALSE;
+    }
+    if ( ok && ( fault->kind < 0 || fault->rate < 0 || fault->rate > 1 || fault->bandwidth == 0 ) )
+    {
+        ok = FALSE;
+    }
+    if ( ok && fault->kind == SERVER_FAULT_ERROR && ( fault->status < 400 || fault->status > 599 ) )
+    {
+        ok = FALSE;
+    }
+
+    free( copy );
+
+    if ( !ok )
+    {
+        fprintf( stderr, "Invalid fault specification: %s\n", spec );
+        ( fault->method != NULL ) ? free( fault->method ) : NULL;
+        ( fault->path != NULL ) ? free( fault->path ) : NULL;
+        return FALSE;
+    }
+
+    fault->spec = strdup( spec );
+    return TRUE;
+}
+
+/**
+ * Add a fault given by its specification to the set
+ *
+ * FALSE is returned if the specification is invalid.
+ */
+int server_faults_add( server_faults_t* faults, const char* spec )
+{
+    server_fault_t fault;
+
+    if ( !server_fault_parse( spec, &fault ) )
+    {
+        return FALSE;
+    }
+
+    faults->faults = (server_fault_t*)realloc( faults->faults, sizeof( server_fault_t ) * ( faults->num_faults + 1 ) );
+    faults->faults[faults->num_faults++] = fault;
+    return TRUE;
+}
+
+/**
+ * Remove all faults from the set
+ */
+void server_faults_clear( server_faults_t* faults )
+{
+    int i = 0;
+
+    for( i = 0; i < faults->num_faults; ++i )
+    {
+        free( faults->faults[i].spec );
+        ( faults->faults[i].method != NULL ) ? free( faults->faults[i].method ) : NULL;
+        ( faults->faults[i].path != NULL ) ? free( faults->faults[i].path ) : NULL;
+    }
+    ( faults->faults != NULL ) ? free( faults->faults ) : NULL;
+
+    faults->faults     = NULL;
+    faults->num_faults = 0;
+}
+
+/**
+ * Check whether a fault applies to a request at the given time
+ */
+static int server_fault_active( server_fault_t* fault, const char* method, const char* path, double now )
+{
+    if ( fault->method != NULL && strcasecmp( fault->method, method ) != 0 )
+    {
+        return FALSE;
+    }
+    if ( fault->path != NULL && strncmp( path, fault->path, strlen( fault->path ) ) != 0 )
+    {
+        return FALSE;
+    }
+    if ( now < fault->start || ( fault->end > 0 && now >= fault->end ) )
+    {
+        return FALSE;
+    }
+    if ( fault->every > 0 && fmod( now - fault->start, fault->every ) >= fault->duration )
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Decide which faults are injected into a request
+ *
+ * Every matching fault is drawn independently. Delays of all chosen latency
+ * and stall faults add up. Of all other kinds the first chosen one wins.
+ */
+void server_faults_plan( server_faults_t* faults, const char* method, const char* path, double now, uint64_t* seed, server_fault_plan_t* plan )
+{
+    double delay = 0;
+    int i = 0;
+
+    memset( plan, 0, sizeof( server_fault_plan_t ) );
+    plan->reset_after = -1;
+
+    for( i = 0; i < faults->num_faults; ++i )
+    {
+        server_fault_t* fault = &faults->faults[i];
+
+        if ( !server_fault_active( fault, method, path, now ) )
+        {
+            continue;
+        }
+        if ( fault->rate < 1.0 && server_fault_random( seed ) >= fault->rate )
+        {
+            continue;
+        }
+        if ( fault->kind != SERVER_FAULT_LATENCY && fault->kind != SERVER_FAULT_STALL && plan->injected[fault->kind] )
+        {
+            continue;
+        }
+
+        switch( fault->kind )
+        {
+            case SERVER_FAULT_LATENCY:
+            case SERVER_FAULT_STALL:
+                delay += server_distribution_sample( &fault->delay, seed );
+            break;
+            case SERVER_FAULT_DRIP:
+                plan->bandwidth = fault->bandwidth;
+            break;
+            case SERVER_FAULT_RESET:
+                plan->reset_after = (int64_t)fault->after;
+            break;
+            case SERVER_FAULT_ERROR:
+                plan->status      = fault->status;
+                plan->retry_after = fault->retry_after;
+            break;
+        }
+        plan->injected[fault->kind] = TRUE;
+    }
+
+    plan->delay = (long)( delay + 0.5 );
+}
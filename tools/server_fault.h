@@ -0,0 +1,136 @@
+#ifndef SERVER_FAULT_H
+#define SERVER_FAULT_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdint.h>
+
+/*
+ * Fault injection of the stand-in server
+ *
+ * A fault is described by a comma separated specification. The first field
+ * is its kind, all others are key=value pairs:
+ *
+ *   latency,delay=pareto:5:1.5,max=3000
+ *   stall,rate=0.01,delay=uniform:1000:4000
+ *   drip,rate=0.05,bandwidth=65536,method=GET
+ *   reset,rate=0.01,after=4096
+ *   error,rate=0.02,status=503,retry_after=1
+ *   error,status=503,every=60,duration=10,path=/container000
+ *
+ * Latency and stall add a delay sampled from the given distribution before
+ * the response is sent. Drip sends the response with the given bandwidth.
+ * Reset closes the connection with a TCP reset after the given number of
+ * bytes of the response have been sent. Error answers with the given status
+ * code instead of handling the request.
+ *
+ * Every fault is applied to the matching fraction rate of all requests. It
+ * may be restricted to a method or to paths starting with a prefix. Start and
+ * end limit it to a window in seconds, every and duration let it repeat
+ * periodically. Times are relative to the last reset of the server
+ * statistics.
+ */
+
+#define SERVER_FAULT_LATENCY 0
+#define SERVER_FAULT_STALL   1
+#define SERVER_FAULT_DRIP    2
+#define SERVER_FAULT_RESET   3
+#define SERVER_FAULT_ERROR   4
+#define SERVER_FAULT_KINDS   5
+
+#define SERVER_DISTRIBUTION_FIXED       0
+#define SERVER_DISTRIBUTION_UNIFORM     1
+#define SERVER_DISTRIBUTION_EXPONENTIAL 2
+#define SERVER_DISTRIBUTION_PARETO      3
+
+/**
+ * Distribution of a delay in milliseconds
+ *
+ * Fixed uses a as the constant delay, uniform draws from [a, b],
+ * exponential uses a as the mean and pareto a as the scale (the minimum) and
+ * b as the shape. Every sample is limited to max, if it is not 0.
+ */
+typedef struct 
+{
+    int type;
+    double a;
+    double b;
+    double max;
+} server_distribution_t;
+
+/**
+ * One configured fault
+ */
+typedef struct 
+{
+    char* spec;
+    int kind;
+    double rate;
+    server_distribution_t delay;
+    uint64_t bandwidth;
+    uint64_t after;
+    int status;
+    int retry_after;
+    double start;
+    double end;
+    double every;
+    double duration;
+    char* method;
+    char* path;
+} server_fault_t;
+
+/**
+ * Set of faults applied to all requests
+ */
+typedef struct 
+{
+    server_fault_t* faults;
+    int num_faults;
+} server_faults_t;
+
+/**
+ * Faults chosen for a single request
+ *
+ * Reset_after is -1 if the connection should not be reset. Status is 0 if
+ * the request should be handled normally.
+ */
+typedef struct 
+{
+    long delay;
+    uint64_t bandwidth;
+    int64_t reset_after;
+    int status;
+    int retry_after;
+    int injected[SERVER_FAULT_KINDS];
+} server_fault_plan_t;
+
+int server_distribution_parse( const char* spec, server_distribution_t* distribution );
+double server_distribution_sample( server_distribution_t* distribution, uint64_t* seed );
+
+int server_faults_add( server_faults_t* faults, const char* spec );
+void server_faults_clear( server_faults_t* faults );
+void server_faults_plan( server_faults_t* faults, const char* method, const char* path, double now, uint64_t* seed, server_fault_plan_t* plan );
+
+extern const char* server_fault_kinds[SERVER_FAULT_KINDS];
+
+#endif
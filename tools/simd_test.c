@@ -0,0 +1,338 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+/*
+ * Deterministic comparison of the SIMD kernels against their scalar versions
+ *
+ * Every variant supported by the running CPU is checked for all lengths up
+ * to a few vector widths at every alignment within a vector. Inputs are
+ * generated from a fixed seed, so every run checks exactly the same cases.
+ * The exit status is 0 if all kernels agree and 1 otherwise.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "simd.h"
+
+#define TRUE  1
+#define FALSE 0
+
+#define SIMD_TEST_MAX_LENGTH 160
+#define SIMD_TEST_ALIGNMENTS 32
+#define SIMD_TEST_MAX_ERRORS 10
+
+static const char* simd_test_names[] = { "auto", "scalar", "sse2", "avx2" };
+static const char* simd_test_lower = "0123456789abcdef";
+static const char* simd_test_upper = "0123456789ABCDEF";
+
+/**
+ * Bytes next to the boundaries of the ranges the kernels classify
+ */
+static const char simd_test_invalid[] = "/:@G`g \x7f\x80\xb0\xc6\xe6\xff";
+
+static uint64_t simd_test_state = 0x2545f4914f6cdd1dULL;
+static int simd_test_errors = 0;
+static long simd_test_cases = 0;
+
+static uint64_t simd_test_random();
+static int simd_test_find_byte( int variant );
+static int simd_test_urlencode( int variant );
+static int simd_test_hex_decode( int variant );
+static int simd_test_hex_case( int variant, const char* hex, size_t size, const char* description, size_t length, size_t alignment );
+static void simd_test_failure( int variant, const char* kernel, const char* description, size_t length, size_t alignment );
+
+int main()
+{
+    int variant = 0;
+
+    // The scalar versions are the reference, so check them against known
+    // results first.
+    {
+        unsigned char md5[16];
+        char encoded[64];
+        static const unsigned char empty_md5[16] = {
+            0xd4, 0x1d, 0x8c, 0xd9, 0x8f, 0x00, 0xb2, 0x04, 0xe9, 0x80, 0x09, 0x98, 0xec, 0xf8, 0x42, 0x7e
+        };
+
+        simd_set_variant( SIMD_VARIANT_SCALAR );
+        if ( !simd_hex_decode( md5, "d41D8cd98f00B204e9800998ecf8427E", 16 ) || memcmp( md5, empty_md5, 16 ) != 0 )
+        {
+            simd_test_failure( SIMD_VARIANT_SCALAR, "simd_hex_decode", "known md5", 32, 0 );
+        }
+        if ( simd_hex_decode( md5, "d41d8cd98f00b204e9800998ecf8427g", 16 ) )
+        {
+            simd_test_failure( SIMD_VARIANT_SCALAR, "simd_hex_decode", "invalid md5", 32, 0 );
+        }
+        if ( simd_urlencode( encoded, "a b/\xff", 5 ) != 11 || strncmp( encoded, "a%20b%2f%ff", 11 ) != 0 )
+        {
+            simd_test_failure( SIMD_VARIANT_SCALAR, "simd_urlencode", "known string", 5, 0 );
+        }
+    }
+
+    for( variant = SIMD_VARIANT_SSE2; variant <= SIMD_VARIANT_AVX2; ++variant )
+    {
+        if ( !simd_supported( variant ) )
+        {
+            printf( "%-8s not supported by this cpu, skipped\n", simd_test_names[variant] );
+            continue;
+        }
+
+        simd_test_find_byte( variant );
+        simd_test_urlencode( variant );
+        simd_test_hex_decode( variant );
+        printf( "%-8s checked\n", simd_test_names[variant] );
+    }
+
+    simd_set_variant( SIMD_VARIANT_AUTO );
+
+    printf( "%ld cases, %d failures\n", simd_test_cases, simd_test_errors );
+    return ( simd_test_errors == 0 ) ? 0 : 1;
+}
+
+/**
+ * Return the next value of a fixed xorshift sequence
+ */
+static uint64_t simd_test_random()
+{
+    simd_test_state ^= simd_test_state >> 12;
+    simd_test_state ^= simd_test_state << 25;
+    simd_test_state ^= simd_test_state >> 27;
+    return simd_test_state * 0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * Report a mismatch
+ *
+ * Only the first few mismatches are printed, but all of them are counted.
+ */
+static void simd_test_failure( int variant, const char* kernel, const char* description, size_t length, size_t alignment )
+{
+    if ( ++simd_test_errors <= SIMD_TEST_MAX_ERRORS )
+    {
+        fprintf(
+            stderr, "%s (%s) failed: %s, length %zu, alignment %zu\n",
+            kernel, simd_test_names[variant], description, length, alignment
+        );
+    }
+}
+
+/**
+ * Search for a byte at every position and for an absent byte
+ *
+ * Bytes with the high bit set are searched as well, as they are negative if
+ * char is signed.
+ */
+static int simd_test_find_byte( int variant )
+{
+    static const char needles[] = { '\n', '/', 0, (char)0x80, (char)0xff };
+    char buffer[SIMD_TEST_MAX_LENGTH + SIMD_TEST_ALIGNMENTS];
+    size_t length = 0;
+    size_t alignment = 0;
+    size_t position = 0;
+    size_t n = 0;
+    int ok = TRUE;
+
+    for( length = 0; length <= SIMD_TEST_MAX_LENGTH; ++length )
+    {
+        for( alignment = 0; alignment < SIMD_TEST_ALIGNMENTS; ++alignment )
+        {
+            char* input = buffer + alignment;
+
+            for( n = 0; n < sizeof( needles ); ++n )
+            {
+                // Fill the input without the needle, then place it at every
+                // position in turn. position == length leaves it absent, but
+                // directly behind the end.
+                for( position = 0; position <= length; ++position )
+                {
+                    const char* expected = NULL;
+                    const char* actual = NULL;
+                    size_t i = 0;
+
+                    for( i = 0; i < length; ++i )
+                    {
+                        do
+                        {
+                            input[i] = (char)simd_test_random();
+                        } while( input[i] == needles[n] );
+                    }
+                    input[position] = needles[n];
+
+                    simd_set_variant( SIMD_VARIANT_SCALAR );
+                    expected = simd_find_byte( input, length, needles[n] );
+                    simd_set_variant( variant );
+                    actual = simd_find_byte( input, length, needles[n] );
+
+                    ++simd_test_cases;
+                    if ( expected != actual )
+                    {
+                        simd_test_failure( variant, "simd_find_byte", "needle position", length, alignment );
+                        ok = FALSE;
+                    }
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+/**
+ * Encode random bytes, letters and digits and the bytes surrounding their
+ * ranges
+ */
+static int simd_test_urlencode( int variant )
+{
+    static const char boundaries[] = "09azAZ/:@[`{\x7f\x80\xff";
+    char buffer[SIMD_TEST_MAX_LENGTH + SIMD_TEST_ALIGNMENTS];
+    char expected[SIMD_TEST_MAX_LENGTH * 3];
+    char actual[SIMD_TEST_MAX_LENGTH * 3];
+    size_t length = 0;
+    size_t alignment = 0;
+    int round = 0;
+    int ok = TRUE;
+
+    for( length = 0; length <= SIMD_TEST_MAX_LENGTH; ++length )
+    {
+        for( alignment = 0; alignment < SIMD_TEST_ALIGNMENTS; ++alignment )
+        {
+            char* input = buffer + alignment;
+
+            for( round = 0; round < 4; ++round )
+            {
+                size_t expected_length = 0;
+                size_t actual_length = 0;
+                size_t i = 0;
+
+                for( i = 0; i < length; ++i )
+                {
+                    uint64_t r = simd_test_random();
+                    input[i] = ( r & 1 ) ? (char)( r >> 8 ) : boundaries[( r >> 8 ) % ( sizeof( boundaries ) - 1 )];
+                }
+
+                simd_set_variant( SIMD_VARIANT_SCALAR );
+                expected_length = simd_urlencode( expected, input, length );
+                simd_set_variant( variant );
+                actual_length = simd_urlencode( actual, input, length );
+
+                ++simd_test_cases;
+                if ( expected_length != actual_length || memcmp( expected, actual, expected_length ) != 0 )
+                {
+                    simd_test_failure( variant, "simd_urlencode", "random input", length, alignment );
+                    ok = FALSE;
+                }
+            }
+        }
+    }
+    return ok;
+}
+
+/**
+ * Decode one hex string using the scalar and the given variant and compare
+ * the results
+ *
+ * The decoded bytes are only compared if the input has been accepted, as
+ * they are undefined otherwise.
+ */
+static int simd_test_hex_case( int variant, const char* hex, size_t size, const char* description, size_t length, size_t alignment )
+{
+    unsigned char expected[SIMD_TEST_MAX_LENGTH];
+    unsigned char actual[SIMD_TEST_MAX_LENGTH];
+    int expected_valid = FALSE;
+    int actual_valid = FALSE;
+
+    simd_set_variant( SIMD_VARIANT_SCALAR );
+    expected_valid = simd_hex_decode( expected, hex, size );
+    simd_set_variant( variant );
+    actual_valid = simd_hex_decode( actual, hex, size );
+
+    ++simd_test_cases;
+    if ( expected_valid != actual_valid || ( expected_valid && memcmp( expected, actual, size ) != 0 ) )
+    {
+        simd_test_failure( variant, "simd_hex_decode", description, length, alignment );
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Decode valid hex strings in lower, upper and mixed case, as well as
+ * strings with an invalid digit at every position
+ *
+ * Sizes are given in decoded bytes. Size 16 is the 32 digit md5 checksum
+ * every meta request decodes.
+ */
+static int simd_test_hex_decode( int variant )
+{
+    char buffer[SIMD_TEST_MAX_LENGTH * 2 + SIMD_TEST_ALIGNMENTS];
+    size_t size = 0;
+    size_t alignment = 0;
+    size_t position = 0;
+    size_t n = 0;
+    int ok = TRUE;
+
+    for( size = 0; size <= SIMD_TEST_MAX_LENGTH / 2; ++size )
+    {
+        for( alignment = 0; alignment < SIMD_TEST_ALIGNMENTS; ++alignment )
+        {
+            char* hex = buffer + alignment;
+            int letter_case = 0;
+            size_t i = 0;
+
+            // 0: lower case, 1: upper case, 2: mixed case
+            for( letter_case = 0; letter_case < 3; ++letter_case )
+            {
+                for( i = 0; i < size * 2; ++i )
+                {
+                    uint64_t r = simd_test_random();
+                    const char* digits = ( letter_case == 0 || ( letter_case == 2 && ( r & 16 ) ) ) ? simd_test_lower : simd_test_upper;
+                    hex[i] = digits[r & 15];
+                }
+                ok &= simd_test_hex_case( variant, hex, size, ( letter_case == 2 ) ? "mixed case" : "single case", size * 2, alignment );
+            }
+
+            // Replace every digit of the last valid string by an invalid one
+            for( position = 0; position < size * 2; ++position )
+            {
+                char digit = hex[position];
+                n = simd_test_random() % ( sizeof( simd_test_invalid ) - 1 );
+                hex[position] = simd_test_invalid[n];
+                ok &= simd_test_hex_case( variant, hex, size, "invalid digit", size * 2, alignment );
+                hex[position] = digit;
+            }
+        }
+    }
+
+    // Every possible byte at every position of an md5 checksum
+    for( position = 0; position < 32; ++position )
+    {
+        for( n = 0; n < 256; ++n )
+        {
+            char md5[33] = "d41d8cd98f00b204e9800998ecf8427e";
+            md5[position] = (char)n;
+            ok &= simd_test_hex_case( variant, md5, 16, "md5 digit", 32, 0 );
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,474 @@
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+/*
+ * Trace driven simulation of the mossofs caches
+ *
+ * A trace recorded by mossofs using the record option is run against the
+ * metadata cache and the data cache of mossofs for every combination of
+ * the given cache sizes, block sizes, ttls and eviction policies. The
+ * caches are driven by the time stored in the trace instead of the wall
+ * clock. Like mossofs getattr and readdir are answered from the metadata
+ * cache, open always issues a request and reads are split into blocks of
+ * the data cache. Every missing block is fetched using a request of its own.
+ * Prefetching is not simulated. Neither is the bypass of streaming reads,
+ * as traces do not tell the handles of a file apart.
+ *
+ * For every configuration the hit ratios, the number of requests and the
+ * amount of data transferred are printed, next to those of mossofs without
+ * any data cache.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <getopt.h>
+#include <glib.h>
+
+#include "simulate.h"
+#include "salloc.h"
+#include "cache.h"
+#include "datacache.h"
+#include "metrics.h"
+
+#define TRUE  1
+#define FALSE 0
+
+/**
+ * Policy name used for the simulation without any data cache
+ */
+#define SIMULATE_NO_CACHE ( (uint64_t)-1 )
+
+static void simulate_parse_options( int argc, char** argv );
+static size_t simulate_parse_list( const char* list, uint64_t** values, int (*parse)( const char*, uint64_t* ) );
+static int simulate_parse_size( const char* value, uint64_t* size );
+static int simulate_parse_policy( const char* value, uint64_t* policy );
+static int simulate_load( simulate_trace_t* trace, const char* path );
+static time_t simulate_clock( time_t* now );
+static void simulate_meta( cache_t* cache, optrace_record_t* record, const char* prefix, simulate_result_t* result );
+static void simulate_read( datacache_t* data, simulate_trace_t* trace, optrace_record_t* record, uint64_t block_size, simulate_result_t* result );
+static void simulate_run( simulate_trace_t* trace, uint64_t policy, uint64_t size, uint64_t block_size, uint64_t ttl, simulate_result_t* result );
+static void simulate_print( uint64_t policy, uint64_t size, uint64_t block_size, uint64_t ttl, simulate_result_t* result );
+
+static simulate_options_t simulate_options;
+
+/**
+ * Current time of the simulation in seconds since the epoch
+ */
+static time_t simulate_now = 0;
+
+int main( int argc, char** argv )
+{
+    simulate_trace_t trace;
+    simulate_result_t result;
+    size_t policy = 0;
+    size_t size = 0;
+    size_t block_size = 0;
+    size_t ttl = 0;
+
+    simulate_parse_options( argc, argv );
+
+    if ( simulate_load( &trace, simulate_options.trace ) != 0 )
+    {
+        return 2;
+    }
+    fprintf( stderr, "Simulating %lu operations\n", (unsigned long)trace.num_records );
+
+    printf( "%-8s %9s %9s %7s %9s %9s %12s %14s\n", "policy", "size", "block", "ttl", "data hit", "meta hit", "requests", "transferred" );
+
+    // Without a data cache only the ttl matters
+    for( ttl = 0; ttl < simulate_options.num_ttls; ++ttl )
+    {
+        simulate_run( &trace, SIMULATE_NO_CACHE, 0, 0, simulate_options.ttls[ttl], &result );
+        simulate_print( SIMULATE_NO_CACHE, 0, 0, simulate_options.ttls[ttl], &result );
+    }
+
+    for( policy = 0; policy < simulate_options.num_policies; ++policy )
+    {
+        for( size = 0; size < simulate_options.num_sizes; ++size )
+        {
+            for( block_size = 0; block_size < simulate_options.num_block_sizes; ++block_size )
+            {
+                for( ttl = 0; ttl < simulate_options.num_ttls; ++ttl )
+                {
+                    simulate_run(
+                        &trace,
+                        simulate_options.policies[policy],
+                        simulate_options.sizes[size],
+                        simulate_options.block_sizes[block_size],
+                        simulate_options.ttls[ttl],
+                        &result
+                    );
+                    simulate_print(
+                        simulate_options.policies[policy],
+                        simulate_options.sizes[size],
+                        simulate_options.block_sizes[block_size],
+                        simulate_options.ttls[ttl],
+                        &result
+                    );
+                }
+            }
+        }
+    }
+
+    g_hash_table_destroy( trace.sizes );
+    free( trace.records );
+    return 0;
+}
+
+/**
+ * Print the usage information of the simulator
+ */
+static void simulate_usage( char* executable )
+{
+    printf( "Simulate the mossofs caches using a trace recorded by mossofs\n\n" );
+    printf( "Usage: %s --trace=FILE [options]\n\n", executable );
+    printf( "    --trace=FILE          trace recorded using -o record=FILE\n" );
+    printf( "    --sizes=LIST          data cache sizes (16M,64M,256M,1G)\n" );
+    printf( "    --block-sizes=LIST    block sizes of the data cache (64K,1M)\n" );
+    printf( "    --ttls=LIST           lifetimes of metadata cache entries in seconds (300)\n" );
+    printf( "    --policies=LIST       eviction policies: lru, clock, tinylfu, arc (all)\n\n" );
+    printf( "Lists are separated by commas. Sizes may use the suffixes K, M and G.\n" );
+}
+
+/**
+ * Read the commandline options into simulate_options
+ */
+static void simulate_parse_options( int argc, char** argv )
+{
+    static struct option long_options[] = {
+        { "trace",       required_argument, NULL, 't' },
+        { "sizes",       required_argument, NULL, 's' },
+        { "block-sizes", required_argument, NULL, 'b' },
+        { "ttls",        required_argument, NULL, 'T' },
+        { "policies",    required_argument, NULL, 'p' },
+        { "help",        no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    const char* sizes       = "16M,64M,256M,1G";
+    const char* block_sizes = "64K,1M";
+    const char* ttls        = "300";
+    const char* policies    = "lru,clock,tinylfu,arc";
+    int c = 0;
+
+    while( ( c = getopt_long( argc, argv, "h", long_options, NULL ) ) != -1 )
+    {
+        switch( c )
+        {
+            case 't': simulate_options.trace = optarg; break;
+            case 's': sizes                  = optarg; break;
+            case 'b': block_sizes            = optarg; break;
+            case 'T': ttls                   = optarg; break;
+            case 'p': policies               = optarg; break;
+            case 'h':
+                simulate_usage( argv[0] );
+                exit( 0 );
+            default:
+                simulate_usage( argv[0] );
+                exit( 2 );
+        }
+    }
+
+    simulate_options.num_sizes       = simulate_parse_list( sizes, &simulate_options.sizes, simulate_parse_size );
+    simulate_options.num_block_sizes = simulate_parse_list( block_sizes, &simulate_options.block_sizes, simulate_parse_size );
+    simulate_options.num_ttls        = simulate_parse_list( ttls, &simulate_options.ttls, simulate_parse_size );
+    simulate_options.num_policies    = simulate_parse_list( policies, &simulate_options.policies, simulate_parse_policy );
+
+    if ( simulate_options.trace == NULL
+      || simulate_options.num_sizes == 0
+      || simulate_options.num_block_sizes == 0
+      || simulate_options.num_ttls == 0
+      || simulate_options.num_policies == 0 )
+    {
+        simulate_usage( argv[0] );
+        exit( 2 );
+    }
+}
+
+/**
+ * Parse a comma separated list of values using the given function
+ *
+ * The number of values is returned. It is 0 if any of them is invalid.
+ */
+static size_t simulate_parse_list( const char* list, uint64_t** values, int (*parse)( const char*, uint64_t* ) )
+{
+    char** items = g_strsplit( list, ",", 0 );
+    size_t count = 0;
+
+    *values = (uint64_t*)smalloc( sizeof( uint64_t ) * ( g_strv_length( items ) + 1 ) );
+    for( count = 0; items[count] != NULL; ++count )
+    {
+        if ( parse( items[count], &( *values )[count] ) != 0 )
+        {
+            fprintf( stderr, "Invalid value: %s\n", items[count] );
+            count = 0;
+            break;
+        }
+    }
+
+    g_strfreev( items );
+    return count;
+}
+
+/**
+ * Parse a number optionally followed by one of the suffixes K, M or G
+ */
+static int simulate_parse_size( const char* value, uint64_t* size )
+{
+    char* end = NULL;
+
+    *size = strtoull( value, &end, 10 );
+    if ( end == value )
+    {
+        return -1;
+    }
+
+    switch( *end )
+    {
+        case 'k': case 'K': *size <<= 10; ++end; break;
+        case 'm': case 'M': *size <<= 20; ++end; break;
+        case 'g': case 'G': *size <<= 30; ++end; break;
+    }
+
+    return ( *end == 0 ) ? 0 : -1;
+}
+
+/**
+ * Parse the name of an eviction policy of the data cache
+ */
+static int simulate_parse_policy( const char* value, uint64_t* policy )
+{
+    int parsed = datacache_policy( value );
+
+    *policy = (uint64_t)parsed;
+    return ( parsed < 0 ) ? -1 : 0;
+}
+
+/**
+ * Read all records of the given trace into memory
+ *
+ * The size of every file read is estimated on the way.
+ */
+static int simulate_load( simulate_trace_t* trace, const char* path )
+{
+    optrace_header_t header;
+    size_t allocated = 1024;
+    FILE* file = NULL;
+    size_t i = 0;
+
+    if ( ( file = optrace_open( path, &header ) ) == NULL )
+    {
+        return -1;
+    }
+    if ( header.dropped > 0 )
+    {
+        fprintf( stderr, "The trace misses %llu operations dropped while recording\n", (unsigned long long)header.dropped );
+    }
+
+    memset( trace, 0, sizeof( simulate_trace_t ) );
+    trace->start   = header.start;
+    trace->records = (optrace_record_t*)smalloc( sizeof( optrace_record_t ) * allocated );
+    while( optrace_read( file, &trace->records[trace->num_records] ) )
+    {
+        if ( ++trace->num_records == allocated )
+        {
+            allocated *= 2;
+            trace->records = (optrace_record_t*)realloc( trace->records, sizeof( optrace_record_t ) * allocated );
+        }
+    }
+    fclose( file );
+
+    trace->sizes = g_hash_table_new_full( g_int64_hash, g_int64_equal, NULL, free );
+    for( i = 0; i < trace->num_records; ++i )
+    {
+        optrace_record_t* record = &trace->records[i];
+        uint64_t* size = NULL;
+
+        if ( record->op != METRICS_OP_READ || record->result <= 0 )
+        {
+            continue;
+        }
+
+        if ( ( size = g_hash_table_lookup( trace->sizes, &record->path ) ) == NULL )
+        {
+            size = snew( uint64_t );
+            g_hash_table_insert( trace->sizes, &record->path, size );
+        }
+        *size = ( record->offset + record->result > *size ) ? record->offset + record->result : *size;
+    }
+
+    return 0;
+}
+
+/**
+ * Clock of the metadata cache returning the time of the simulated operation
+ */
+static time_t simulate_clock( time_t* now )
+{
+    ( now != NULL ) ? ( *now = simulate_now ) : 0;
+    return simulate_now;
+}
+
+/**
+ * Simulate an operation answered using the metadata cache
+ *
+ * Every miss issues a request. Only successful results are cached, like
+ * mossofs does. The record itself serves as cached object.
+ */
+static void simulate_meta( cache_t* cache, optrace_record_t* record, const char* prefix, simulate_result_t* result )
+{
+    char identifier[17];
+    void* cached = NULL;
+
+    snprintf( identifier, sizeof( identifier ), "%016" PRIx64, record->path );
+
+    if ( ( cached = cache_get_object( cache, prefix, identifier ) ) != NULL )
+    {
+        ++result->meta_hits;
+        cache_release_object( cache, cached );
+        return;
+    }
+
+    ++result->meta_misses;
+    ++result->requests;
+    ( record->result >= 0 ) ? cache_add_object( cache, prefix, identifier, record ) : NULL;
+}
+
+/**
+ * Simulate a read using the data cache
+ *
+ * The blocks touched by a successful read are looked up one after another.
+ * Every missing block is fetched completely and added to the cache.
+ */
+static void simulate_read( datacache_t* data, simulate_trace_t* trace, optrace_record_t* record, uint64_t block_size, simulate_result_t* result )
+{
+    uint64_t size  = *(uint64_t*)g_hash_table_lookup( trace->sizes, &record->path );
+    uint64_t first = record->offset / block_size;
+    uint64_t last  = ( record->offset + record->result - 1 ) / block_size;
+    uint64_t index = 0;
+
+    for( index = first; index <= last; ++index )
+    {
+        uint64_t length = ( size - index * block_size < block_size ) ? size - index * block_size : block_size;
+
+        datacache_touch( data, record->path, index );
+        if ( datacache_read( data, record->path, index, NULL, 0, block_size ) >= 0 )
+        {
+            ++result->data_hits;
+            continue;
+        }
+
+        ++result->data_misses;
+        ++result->requests;
+        result->bytes += length;
+        datacache_add( data, record->path, index, NULL, length );
+    }
+}
+
+/**
+ * Simulate all operations of the trace using the given configuration
+ */
+static void simulate_run( simulate_trace_t* trace, uint64_t policy, uint64_t size, uint64_t block_size, uint64_t ttl, simulate_result_t* result )
+{
+    cache_t* meta = cache_new( ttl, NULL );
+    datacache_t* data = ( policy != SIMULATE_NO_CACHE ) ? datacache_new( policy, size, block_size ) : NULL;
+    size_t i = 0;
+
+    memset( result, 0, sizeof( simulate_result_t ) );
+    cache_set_clock( meta, simulate_clock );
+
+    for( i = 0; i < trace->num_records; ++i )
+    {
+        optrace_record_t* record = &trace->records[i];
+
+        simulate_now = ( trace->start + record->time ) / 1000000;
+
+        switch( record->op )
+        {
+            case METRICS_OP_GETATTR:
+                simulate_meta( meta, record, "meta", result );
+            break;
+            case METRICS_OP_READDIR:
+                simulate_meta( meta, record, "listing", result );
+            break;
+            case METRICS_OP_OPEN:
+                ++result->requests;
+            break;
+            case METRICS_OP_READ:
+                if ( data != NULL && record->result > 0 )
+                {
+                    simulate_read( data, trace, record, block_size, result );
+                }
+                else
+                {
+                    ++result->requests;
+                    result->bytes += ( record->result > 0 ) ? record->result : 0;
+                }
+            break;
+        }
+    }
+
+    cache_free( meta );
+    ( data != NULL ) ? datacache_free( data ) : NULL;
+}
+
+/**
+ * Format a size in bytes using the largest fitting binary unit
+ */
+static void simulate_format_size( char* buffer, size_t length, uint64_t size )
+{
+    const char* units = "BKMGT";
+
+    while( size >= 1024 && size % 1024 == 0 && units[1] != 0 )
+    {
+        size /= 1024;
+        ++units;
+    }
+    snprintf( buffer, length, "%llu%c", (unsigned long long)size, *units );
+}
+
+/**
+ * Print the result of one configuration
+ */
+static void simulate_print( uint64_t policy, uint64_t size, uint64_t block_size, uint64_t ttl, simulate_result_t* result )
+{
+    uint64_t data = result->data_hits + result->data_misses;
+    uint64_t meta = result->meta_hits + result->meta_misses;
+    char size_string[16];
+    char block_string[16];
+
+    simulate_format_size( size_string, sizeof( size_string ), size );
+    simulate_format_size( block_string, sizeof( block_string ), block_size );
+
+    printf( "%-8s %9s %9s %7llu %8.2f%% %8.2f%% %12llu %11.1f MB\n",
+        ( policy == SIMULATE_NO_CACHE ) ? "none" : datacache_policy_name( policy ),
+        ( policy == SIMULATE_NO_CACHE ) ? "-" : size_string,
+        ( policy == SIMULATE_NO_CACHE ) ? "-" : block_string,
+        (unsigned long long)ttl,
+        ( data > 0 ) ? 100.0 * result->data_hits / data : 0.0,
+        ( meta > 0 ) ? 100.0 * result->meta_hits / meta : 0.0,
+        (unsigned long long)result->requests,
+        result->bytes / 1048576.0
+    );
+}
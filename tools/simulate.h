@@ -0,0 +1,82 @@
+#ifndef SIMULATE_H
+#define SIMULATE_H
+
+/*
+ * This file is part of Mossofs.
+ *
+ * Mossofs is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; version 3 of the
+ * License.
+ *
+ * Mossofs is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mossofs; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301  USA
+ *
+ * Copyright (C) 2009 Jakob Westhoff <jakob@westhoffswelt.de>
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <glib.h>
+
+#include "optrace.h"
+
+/**
+ * Options given on the commandline
+ *
+ * Every combination of the given cache sizes, block sizes, ttls and
+ * policies is simulated. Sizes are given in bytes, ttls in seconds.
+ */
+typedef struct
+{
+    char* trace;
+    uint64_t* sizes;
+    size_t num_sizes;
+    uint64_t* block_sizes;
+    size_t num_block_sizes;
+    uint64_t* ttls;
+    size_t num_ttls;
+    uint64_t* policies;
+    size_t num_policies;
+} simulate_options_t;
+
+/**
+ * Recorded operations simulated against every configuration
+ *
+ * Start is the wall clock time the recording started at in microseconds
+ * since the epoch. The sizes map the path hashes of all files read to the
+ * largest end of a read seen, which is taken as their size.
+ */
+typedef struct
+{
+    optrace_record_t* records;
+    size_t num_records;
+    uint64_t start;
+    GHashTable* sizes;
+} simulate_trace_t;
+
+/**
+ * Outcome of the simulation of one configuration
+ *
+ * Requests and bytes are those which would have been sent to the backend.
+ * Bytes only include the transferred file data.
+ */
+typedef struct
+{
+    uint64_t requests;
+    uint64_t bytes;
+    uint64_t meta_hits;
+    uint64_t meta_misses;
+    uint64_t data_hits;
+    uint64_t data_misses;
+} simulate_result_t;
+
+#endif